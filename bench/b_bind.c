@@ -0,0 +1,184 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_bind.c
+ *
+ * Benchmarks for binding documents into structures.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_bind.h"
+#include "bench.h"
+
+/* what an application keeps for each record */
+struct b_bind_rec {
+	int32_t id;
+	char name[16];
+	double load;
+	bool up;
+	plist_bind_vector_t mac;
+};
+
+struct b_bind_doc {
+	plist_bind_vector_t recs;
+};
+
+static const plist_bind_desc_t b_bind_rec_fields[] = {
+	PLIST_BIND_FIELD("id", PLIST_BIND_INTEGER, struct b_bind_rec, id),
+	PLIST_BIND_FIELD("name", PLIST_BIND_STRBUF, struct b_bind_rec, name),
+	PLIST_BIND_FIELD("load", PLIST_BIND_REAL, struct b_bind_rec, load),
+	PLIST_BIND_FIELD("up", PLIST_BIND_BOOLEAN, struct b_bind_rec, up),
+	PLIST_BIND_FIELD("mac", PLIST_BIND_DATA, struct b_bind_rec, mac),
+	PLIST_BIND_END
+};
+
+static const plist_bind_desc_t b_bind_rec = {
+	NULL, PLIST_BIND_STRUCT, 0, sizeof(struct b_bind_rec),
+	b_bind_rec_fields, NULL, NULL
+};
+
+static const plist_bind_desc_t b_bind_doc_fields[] = {
+	PLIST_BIND_VECTOR("records", struct b_bind_doc, recs, &b_bind_rec),
+	PLIST_BIND_END
+};
+
+
+/**
+ * Generate a dictionary with an array of records, about mbytes in size.
+ */
+static char *
+_b_bind_doc(long mbytes, long *nrecsp, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t want;
+	size_t docsz;
+	size_t off;
+
+	want = (size_t) mbytes * 1024 * 1024;
+	docsz = want + 256;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, "{ \"version\" = 1; \"records\" = ( ");
+	for (i = 0; off < want; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"name\" = \"host%ld\"; "
+				"\"load\" = %ld.%02ld; \"up\" = true; "
+				"\"mac\" = <0011 2233 %04lx>; "
+				"\"tags\" = ( \"a\", \"b\" ) }, ",
+				i, i, i % 100, i % 97, i & 0xffff);
+	}
+	off += snprintf(&doc[off], docsz - off, ") }");
+	*nrecsp = i;
+	*docszp = off;
+	return doc;
+}
+
+
+int
+b_bind_records(int argc, char **argv)
+{
+	int err;
+	long mbytes;
+	long nrecs;
+	char *doc;
+	size_t docsz;
+	double start;
+	double parsed;
+	double bound;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	struct b_bind_doc bdoc;
+
+	mbytes = bench_arg(argc, argv, 1, 32);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	doc = _b_bind_doc(mbytes, &nrecs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+	printf("document %zu bytes, %ld records\n", docsz, nrecs);
+
+	/* the tree first and then converted */
+	memset(&bdoc, 0, sizeof(bdoc));
+	start = bench_now();
+	err = plist_txt_parse(txt, doc, docsz);
+	if (err == 0) {
+		err = plist_txt_result(txt, &ptmp);
+	}
+	parsed = bench_now();
+	if (err == 0) {
+		err = plist_bind(ptmp, b_bind_doc_fields, &bdoc);
+		plist_free(ptmp);
+	}
+	bound = bench_now();
+	if (err == 0 && bdoc.recs.pbv_nelems != (size_t) nrecs) {
+		err = EINVAL;
+	}
+	plist_bind_release(b_bind_doc_fields, &bdoc);
+	if (err == 0) {
+		bench_report("bind tree parse", docsz, 1, parsed - start);
+		bench_report("bind tree parse + bind + free", docsz, 1,
+			     bound - start);
+	}
+
+	/* straight from the parse events */
+	if (err == 0) {
+		memset(&bdoc, 0, sizeof(bdoc));
+		start = bench_now();
+		err = plist_bind_parse(txt, b_bind_doc_fields, &bdoc,
+				       doc, docsz);
+		bound = bench_now();
+		if (err == 0 && bdoc.recs.pbv_nelems != (size_t) nrecs) {
+			err = EINVAL;
+		}
+		plist_bind_release(b_bind_doc_fields, &bdoc);
+	}
+	if (err == 0) {
+		bench_report("bind events", docsz, 1, bound - start);
+	}
+
+	plist_txt_free(txt);
+	free(doc);
+	return err;
+}
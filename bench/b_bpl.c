@@ -0,0 +1,478 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_bpl.c
+ *
+ * Benchmarks for the binary plist reader
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_bpl.h"
+#include "bench.h"
+
+#define B_BPL_RECSZ   (128)	/* upper bound of bytes per record */
+#define B_BPL_SHARED  (8)	/* keys and values every record refers to */
+#define B_BPL_RECOBJS (5)	/* objects of each record */
+
+
+static void
+_b_bpl_put(uint8_t *buf, size_t *offp, uint64_t val, unsigned n)
+{
+	while (n-- > 0) {
+		buf[(*offp)++] = val >> (n * 8);
+	}
+}
+
+static void
+_b_bpl_ascii(uint8_t *buf, size_t *offp, const char *s)
+{
+	size_t len = strlen(s);
+
+	buf[(*offp)++] = 0x50 | len;
+	memcpy(&buf[*offp], s, len);
+	*offp += len;
+}
+
+/**
+ * Write a top level array of nrecs records the way another writer
+ * would, with the keys and the common values shared
+ */
+static uint8_t *
+_b_bpl_doc(long nrecs, size_t *docszp)
+{
+	long i;
+	long k;
+	double score;
+	uint64_t u64;
+	uint64_t nobjs;
+	uint64_t base;
+	uint8_t *buf;
+	size_t *offs;
+	size_t off;
+	size_t offtab;
+	char name[24];
+	static const char *shared[] = {
+		"id", "name", "score", "up", "tags", NULL, "alpha", "beta"
+	};
+
+	nobjs = B_BPL_SHARED + nrecs * B_BPL_RECOBJS + 1;
+	buf = malloc(nrecs * B_BPL_RECSZ + nobjs * 4 + 4096);
+	offs = malloc(nobjs * sizeof(*offs));
+	if (buf == NULL || offs == NULL) {
+		free(buf);
+		free(offs);
+		return NULL;
+	}
+	memcpy(buf, "bplist00", 8);
+	off = 8;
+	for (k = 0; k < B_BPL_SHARED; k++) {
+		offs[k] = off;
+		if (shared[k] == NULL) {
+			buf[off++] = 0x09;
+		} else {
+			_b_bpl_ascii(buf, &off, shared[k]);
+		}
+	}
+
+	for (i = 0; i < nrecs; i++) {
+		base = B_BPL_SHARED + i * B_BPL_RECOBJS;
+
+		offs[base] = off;
+		buf[off++] = 0xd5;
+		for (k = 0; k < 5; k++) {
+			_b_bpl_put(buf, &off, k, 4);
+		}
+		_b_bpl_put(buf, &off, base + 1, 4);
+		_b_bpl_put(buf, &off, base + 2, 4);
+		_b_bpl_put(buf, &off, base + 3, 4);
+		_b_bpl_put(buf, &off, 5, 4);
+		_b_bpl_put(buf, &off, base + 4, 4);
+
+		offs[base + 1] = off;
+		buf[off++] = 0x13;
+		_b_bpl_put(buf, &off, i, 8);
+
+		offs[base + 2] = off;
+		snprintf(name, sizeof(name), "rec%08ld", i);
+		_b_bpl_ascii(buf, &off, name);
+
+		offs[base + 3] = off;
+		score = i * 0.5;
+		memcpy(&u64, &score, sizeof(u64));
+		buf[off++] = 0x23;
+		_b_bpl_put(buf, &off, u64, 8);
+
+		offs[base + 4] = off;
+		buf[off++] = 0xa2;
+		_b_bpl_put(buf, &off, 6, 4);
+		_b_bpl_put(buf, &off, 7, 4);
+	}
+
+	/* the top array with a count that does not fit the marker */
+	offs[nobjs - 1] = off;
+	buf[off++] = 0xaf;
+	buf[off++] = 0x13;
+	_b_bpl_put(buf, &off, nrecs, 8);
+	for (i = 0; i < nrecs; i++) {
+		_b_bpl_put(buf, &off, B_BPL_SHARED + i * B_BPL_RECOBJS, 4);
+	}
+
+	offtab = off;
+	for (u64 = 0; u64 < nobjs; u64++) {
+		_b_bpl_put(buf, &off, offs[u64], 4);
+	}
+	memset(&buf[off], 0, 6);
+	off += 6;
+	buf[off++] = 4;
+	buf[off++] = 4;
+	_b_bpl_put(buf, &off, nobjs, 8);
+	_b_bpl_put(buf, &off, nobjs - 1, 8);
+	_b_bpl_put(buf, &off, offtab, 8);
+
+	free(offs);
+	*docszp = off;
+	return buf;
+}
+
+/**
+ * The same records as text for a reference point
+ */
+static char *
+_b_bpl_txt(long nrecs, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t off;
+	size_t docsz;
+
+	docsz = nrecs * B_BPL_RECSZ + 16;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, "(\n");
+	for (i = 0; i < nrecs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"name\" = \"rec%08ld\"; "
+				"\"score\" = %ld.%ld; \"up\" = true; "
+				"\"tags\" = ( \"alpha\", \"beta\" ) },\n",
+				i, i, i / 2, (i % 2) * 5);
+	}
+	off += snprintf(&doc[off], docsz - off, ")\n");
+	*docszp = off;
+	return doc;
+}
+
+static int
+_b_bpl_sum(plist_bpl_t *bpl, long long *sump)
+{
+	int err;
+	size_t i;
+	size_t count;
+	int64_t id;
+	plist_bpl_node_t root;
+	plist_bpl_node_t node;
+
+	err = plist_bpl_root(bpl, &root);
+	if (err == 0) {
+		err = plist_bpl_count(bpl, &root, &count);
+	}
+	for (i = 0; err == 0 && i < count; i++) {
+		err = plist_bpl_at(bpl, &root, i, &node);
+		if (err == 0) {
+			err = plist_bpl_lookup(bpl, &node, "id", &node);
+		}
+		if (err == 0) {
+			err = plist_bpl_integer(bpl, &node, &id);
+		}
+		*sump += id;
+	}
+	return err;
+}
+
+/**
+ * Build the whole tree from the binary document, or from the text of
+ * the same records when bpl is NULL
+ */
+static int
+_b_bpl_tree(plist_bpl_t *bpl, plist_txt_t *txt, const char *txtdoc,
+	    size_t txtsz, plist_t **plistpp)
+{
+	int err;
+	plist_bpl_node_t node;
+
+	if (bpl != NULL) {
+		err = plist_bpl_root(bpl, &node);
+		if (err == 0) {
+			err = plist_bpl_plist(bpl, &node, plistpp);
+		}
+		return err;
+	}
+	err = plist_txt_parse(txt, txtdoc, txtsz);
+	if (err == 0) {
+		err = plist_txt_result(txt, plistpp);
+	}
+	return err;
+}
+
+
+int
+b_bpl_read(int argc, char **argv)
+{
+	int fd;
+	int err;
+	int pass;
+	long mbytes;
+	long nrecs;
+	long long sum;
+	char *str;
+	char *txtdoc;
+	uint8_t *doc;
+	size_t docsz;
+	size_t txtsz;
+	double start;
+	double opened;
+	double found;
+	char path[] = "/tmp/plist_bench.XXXXXX";
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	plist_bpl_t *bpl;
+	plist_bpl_node_t node;
+
+	mbytes = bench_arg(argc, argv, 1, 64);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	nrecs = mbytes * 1024 * 1024 / 100;
+	doc = _b_bpl_doc(nrecs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	fd = mkstemp(path);
+	if (fd < 0) {
+		free(doc);
+		return errno;
+	}
+	err = (write(fd, doc, docsz) == (ssize_t) docsz) ? 0 : EIO;
+	close(fd);
+	free(doc);
+	txtdoc = _b_bpl_txt(nrecs, &txtsz);
+	if (err == 0 && txtdoc == NULL) {
+		err = ENOMEM;
+	}
+	if (err == 0) {
+		err = plist_txt_new(&txt);
+	}
+	if (err != 0) {
+		free(txtdoc);
+		unlink(path);
+		return err;
+	}
+	printf("document %zu bytes, %ld records\n", docsz, nrecs);
+
+	/* open and find one record */
+	start = bench_now();
+	err = plist_bpl_open(&bpl, path);
+	if (err != 0) {
+		plist_txt_free(txt);
+		free(txtdoc);
+		unlink(path);
+		return err;
+	}
+	opened = bench_now();
+	err = plist_bpl_root(bpl, &node);
+	if (err == 0) {
+		err = plist_bpl_at(bpl, &node, nrecs / 2, &node);
+	}
+	if (err == 0) {
+		err = plist_bpl_lookup(bpl, &node, "name", &node);
+	}
+	if (err == 0) {
+		err = plist_bpl_string(bpl, &node, &str);
+	}
+	found = bench_now();
+	if (err == 0) {
+		free(str);
+		bench_report("bpl open", docsz, 1, opened - start);
+		printf("%-32s %10.3f ms\n", "bpl lookup",
+		       (found - opened) * 1000.0);
+	}
+
+	/* one key of every record without building anything */
+	if (err == 0) {
+		sum = 0;
+		start = bench_now();
+		err = _b_bpl_sum(bpl, &sum);
+		if (err == 0 && sum != (long long) nrecs * (nrecs - 1) / 2) {
+			err = EINVAL;
+		}
+		if (err == 0) {
+			bench_report("bpl lazy walk", docsz, 1,
+				     bench_now() - start);
+		}
+	}
+
+	/* the whole tree against the text parser on the same records,
+	 * each built once first so that both get a warm heap */
+	for (pass = 0; err == 0 && pass < 4; pass++) {
+		start = bench_now();
+		err = _b_bpl_tree((pass < 2) ? bpl : NULL, txt, txtdoc,
+				  txtsz, &ptmp);
+		if (err != 0) {
+			break;
+		}
+		if (pass == 1) {
+			bench_report("bpl to plist", docsz, 1,
+				     bench_now() - start);
+		} else if (pass == 3) {
+			bench_report("txt to plist", txtsz, 1,
+				     bench_now() - start);
+		}
+		plist_free(ptmp);
+	}
+
+	plist_bpl_free(bpl);
+	plist_txt_free(txt);
+	free(txtdoc);
+	unlink(path);
+	return err;
+}
+
+
+int
+b_bpl_write(int argc, char **argv)
+{
+	int fd;
+	int err;
+	int pass;
+	long mbytes;
+	long nrecs;
+	char *txtdoc;
+	void *buf;
+	size_t sz;
+	size_t txtsz;
+	double start;
+	char path[] = "/tmp/plist_bench.XXXXXX";
+	plist_t *ptmp;
+	plist_t *ptmp2;
+	plist_txt_t *txt;
+	plist_bpl_t *bpl;
+	plist_bpl_node_t node;
+
+	mbytes = bench_arg(argc, argv, 1, 16);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	nrecs = mbytes * 1024 * 1024 / 100;
+	txtdoc = _b_bpl_txt(nrecs, &txtsz);
+	if (txtdoc == NULL) {
+		return ENOMEM;
+	}
+	buf = NULL;
+	err = plist_txt_new(&txt);
+	if (err == 0) {
+		err = plist_txt_parse(txt, txtdoc, txtsz);
+	}
+	if (err == 0) {
+		err = plist_txt_result(txt, &ptmp);
+	}
+	if (err != 0) {
+		free(txtdoc);
+		return err;
+	}
+
+	/* into a buffer and through a file */
+	start = bench_now();
+	err = plist_bpl_write_buf(ptmp, &buf, &sz);
+	if (err == 0) {
+		bench_report("bpl write buffer", sz, 1, bench_now() - start);
+		printf("%-32s %10zu bytes, text %zu bytes (%.1f%%)\n",
+		       "bpl size", sz, txtsz, sz * 100.0 / txtsz);
+		fd = mkstemp(path);
+		err = (fd < 0) ? errno : 0;
+	}
+	if (err == 0) {
+		start = bench_now();
+		err = plist_bpl_write(ptmp, fd);
+		if (err == 0) {
+			bench_report("bpl write file", sz, 1,
+				     bench_now() - start);
+		}
+		close(fd);
+		unlink(path);
+	}
+
+	/* reloading the cache, each built once first for a warm heap */
+	for (pass = 0; err == 0 && pass < 4; pass++) {
+		start = bench_now();
+		if (pass < 2) {
+			err = plist_bpl_new(&bpl, buf, sz);
+			if (err == 0) {
+				err = plist_bpl_root(bpl, &node);
+				if (err == 0) {
+					err = plist_bpl_plist(bpl, &node,
+							      &ptmp2);
+				}
+				plist_bpl_free(bpl);
+			}
+		} else {
+			err = plist_txt_parse(txt, txtdoc, txtsz);
+			if (err == 0) {
+				err = plist_txt_result(txt, &ptmp2);
+			}
+		}
+		if (err != 0) {
+			break;
+		}
+		if (pass == 1) {
+			bench_report("bpl reload", sz, 1, bench_now() - start);
+		} else if (pass == 3) {
+			bench_report("txt reload", txtsz, 1,
+				     bench_now() - start);
+		}
+		if (pass == 1 && !plist_isequal(ptmp, ptmp2)) {
+			err = EINVAL;
+		}
+		plist_free(ptmp2);
+	}
+
+	free(buf);
+	plist_free(ptmp);
+	plist_txt_free(txt);
+	free(txtdoc);
+	return err;
+}
@@ -0,0 +1,220 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_cbor.c
+ *
+ * Round trip latency of CBOR messages of about 4 KB, the size of a
+ * typical request between daemons, against the text and binary plist
+ * formats on the same tree. The encoder writes into one buffer that is
+ * reused for every message.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_io.h"
+#include "plist_cbor.h"
+#include "bench.h"
+
+#define B_CBOR_MSGSZ  (4096)	/* target size of the text message */
+
+
+/**
+ * A request with a header, a list of small records and an opaque blob,
+ * grown until the text form reaches about B_CBOR_MSGSZ
+ */
+static int
+_b_cbor_message(plist_t **plistpp)
+{
+	int err;
+	long i;
+	char *doc;
+	size_t off;
+	size_t docsz;
+
+	docsz = B_CBOR_MSGSZ * 2;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	off = snprintf(doc, docsz,
+		       "{ \"op\" = \"update\"; \"seq\" = 81723; "
+		       "\"sent\" = <*2013-03-21 20:04:00 +0000>; "
+		       "\"token\" = <00112233 44556677 8899aabb ccddeeff "
+		       "00112233 44556677 8899aabb ccddeeff>; \"items\" = ( ");
+	for (i = 0; off < B_CBOR_MSGSZ - 128; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"name\" = \"port%ld\"; "
+				"\"load\" = %ld.%02ld; \"up\" = %s; }, ",
+				i, i, i % 100, i % 97,
+				(i % 3) ? "true" : "false");
+	}
+	off += snprintf(&doc[off], docsz - off, "\"end\" ); }");
+	err = plist_read_buf(doc, off, 0, plistpp);
+	free(doc);
+	return err;
+}
+
+/**
+ * Time a round trip through one of the plist formats with the generic
+ * writer and reader
+ */
+static int
+_b_cbor_format(const char *name, const plist_t *plist,
+	       enum plist_format_e format, long iters)
+{
+	int err;
+	long i;
+	void *buf;
+	size_t sz;
+	double start;
+	plist_t *ptmp;
+
+	err = 0;
+	sz = 0;
+	start = bench_now();
+	for (i = 0; err == 0 && i < iters; i++) {
+		err = plist_write_buf(plist, format, &buf, &sz);
+		if (err != 0) {
+			break;
+		}
+		err = plist_read_buf(buf, sz, 0, &ptmp);
+		free(buf);
+		if (err == 0) {
+			plist_free(ptmp);
+		}
+	}
+	if (err == 0) {
+		bench_report(name, sz, iters, bench_now() - start);
+	}
+	return err;
+}
+
+
+int
+b_cbor_rtt(int argc, char **argv)
+{
+	int err;
+	long i;
+	long iters;
+	size_t len;
+	double start;
+	uint8_t *buf;
+	uint8_t *copy;
+	plist_t *plist;
+	plist_t *ptmp;
+
+	iters = bench_arg(argc, argv, 1, 100000);
+	if (iters <= 0) {
+		return EINVAL;
+	}
+	err = _b_cbor_message(&plist);
+	if (err != 0) {
+		return err;
+	}
+	err = plist_cbor_encode(plist, NULL, 0, &len);
+	buf = malloc(len);
+	copy = malloc(len);
+	if (err == 0 && (buf == NULL || copy == NULL)) {
+		err = ENOMEM;
+	}
+	if (err == 0) {
+		err = plist_cbor_encode(plist, buf, len, &len);
+	}
+	if (err != 0) {
+		goto out;
+	}
+	printf("message %zu bytes of CBOR\n", len);
+
+	start = bench_now();
+	for (i = 0; err == 0 && i < iters; i++) {
+		err = plist_cbor_encode(plist, buf, len, &len);
+	}
+	if (err != 0) {
+		goto out;
+	}
+	bench_report("cbor encode", len, iters, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; err == 0 && i < iters; i++) {
+		err = plist_cbor_decode(buf, len, &ptmp);
+		if (err == 0) {
+			plist_free(ptmp);
+		}
+	}
+	if (err != 0) {
+		goto out;
+	}
+	bench_report("cbor decode", len, iters, bench_now() - start);
+
+	/* the borrowed decode writes terminators, so it gets a fresh copy */
+	start = bench_now();
+	for (i = 0; err == 0 && i < iters; i++) {
+		memcpy(copy, buf, len);
+		err = plist_cbor_decode_borrowed(copy, len, &ptmp);
+		if (err == 0) {
+			plist_free(ptmp);
+		}
+	}
+	if (err != 0) {
+		goto out;
+	}
+	bench_report("cbor decode borrowed", len, iters, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; err == 0 && i < iters; i++) {
+		err = plist_cbor_encode(plist, buf, len, &len);
+		if (err == 0) {
+			err = plist_cbor_decode(buf, len, &ptmp);
+		}
+		if (err == 0) {
+			plist_free(ptmp);
+		}
+	}
+	if (err != 0) {
+		goto out;
+	}
+	bench_report("cbor round trip", len, iters, bench_now() - start);
+
+	err = _b_cbor_format("bpl round trip", plist, PLIST_FORMAT_BINARY,
+			     iters);
+	if (err == 0) {
+		err = _b_cbor_format("txt round trip", plist,
+				     PLIST_FORMAT_TEXT, iters);
+	}
+
+out:
+	free(copy);
+	free(buf);
+	plist_free(plist);
+	return err;
+}
@@ -0,0 +1,218 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_dump.c
+ *
+ * Throughput of plist_dump on one large data element and on a tree of
+ * small records, to a stream, into memory and through a function. The
+ * hex dump of the data is also done with a printf per byte the way it
+ * used to be, for a reference.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_io.h"
+#include "bench.h"
+
+#define B_DUMP_RECSZ  (160)	/* upper bound of bytes per record */
+
+
+static int
+_b_dump_discard(void *arg, const void *buf, size_t len)
+{
+	(void) buf;
+
+	*(size_t *) arg += len;
+	return 0;
+}
+
+/**
+ * The hex dump with a printf for every byte
+ */
+static void
+_b_dump_printf(FILE *fp, const uint8_t *buf, size_t bufsz)
+{
+	size_t i;
+	size_t j;
+	size_t cnt;
+
+	for (i = 0; i < bufsz; i += cnt) {
+		fprintf(fp, "%zu:\t", i);
+		cnt = (bufsz - i < 16) ? bufsz - i : 16;
+		for (j = 0; j < cnt; j++) {
+			fprintf(fp, "%02x ", buf[i + j]);
+		}
+		fprintf(fp, "%*s", (int) (1 + 16 - cnt) * 3, "");
+		for (j = 0; j < cnt; j++) {
+			fprintf(fp, "%c", (isprint(buf[i + j]) &&
+					   isascii(buf[i + j])) ?
+				buf[i + j] : '.');
+		}
+		fputs("\n", fp);
+	}
+	return;
+}
+
+/**
+ * Time the dump of one tree to /dev/null, into memory and through a
+ * function that only counts, passing back the size of the text
+ */
+static int
+_b_dump_tree(const char *name, const plist_t *plist, size_t *szp)
+{
+	int err;
+	FILE *fp;
+	void *buf;
+	size_t sz;
+	size_t len;
+	double start;
+	char label[48];
+
+	start = bench_now();
+	err = plist_dump_buf(plist, &buf, &sz);
+	if (err != 0) {
+		return err;
+	}
+	snprintf(label, sizeof(label), "%s to buffer", name);
+	bench_report(label, sz, 1, bench_now() - start);
+	free(buf);
+
+	len = 0;
+	start = bench_now();
+	err = plist_dump_cb(plist, _b_dump_discard, &len);
+	if (err != 0) {
+		return err;
+	}
+	snprintf(label, sizeof(label), "%s to function", name);
+	bench_report(label, len, 1, bench_now() - start);
+
+	fp = fopen("/dev/null", "w");
+	if (fp == NULL) {
+		return errno;
+	}
+	start = bench_now();
+	plist_dump(plist, fp);
+	fflush(fp);
+	snprintf(label, sizeof(label), "%s to stream", name);
+	bench_report(label, sz, 1, bench_now() - start);
+	fclose(fp);
+	*szp = sz;
+	return 0;
+}
+
+
+int
+b_dump(int argc, char **argv)
+{
+	int err;
+	long i;
+	long mbytes;
+	long nrecs;
+	char *doc;
+	size_t off;
+	size_t docsz;
+	size_t datasz;
+	uint8_t *data;
+	double start;
+	FILE *fp;
+	plist_t *ptmp;
+
+	mbytes = bench_arg(argc, argv, 1, 50);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+
+	/* one large data element, which is all hex lines */
+	datasz = mbytes * 1024 * 1024;
+	data = malloc(datasz);
+	if (data == NULL) {
+		return ENOMEM;
+	}
+	for (off = 0; off < datasz; off++) {
+		data[off] = off * 131 + (off >> 8);
+	}
+	err = plist_data_new(&ptmp, data, datasz);
+	if (err != 0) {
+		free(data);
+		return err;
+	}
+	printf("data %zu bytes\n", datasz);
+	err = _b_dump_tree("data", ptmp, &docsz);
+	plist_free(ptmp);
+
+	if (err == 0) {
+		fp = fopen("/dev/null", "w");
+		if (fp == NULL) {
+			err = errno;
+		}
+	}
+	if (err == 0) {
+		start = bench_now();
+		_b_dump_printf(fp, data, datasz);
+		fflush(fp);
+		bench_report("data with printf per byte", docsz, 1,
+			     bench_now() - start);
+		fclose(fp);
+	}
+	free(data);
+	if (err != 0) {
+		return err;
+	}
+
+	/* records, mostly indentation and short values */
+	nrecs = mbytes * 1024 * 1024 / (B_DUMP_RECSZ / 2);
+	docsz = nrecs * B_DUMP_RECSZ + 16;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	off = snprintf(doc, docsz, "( ");
+	for (i = 0; i < nrecs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"name\" = \"host%ld\"; "
+				"\"load\" = %ld.%02ld; \"up\" = true; "
+				"\"mac\" = <0011 2233 %04lx> }, ",
+				i, i, i % 100, i % 97, i & 0xffff);
+	}
+	off += snprintf(&doc[off], docsz - off, "\"end\" )");
+	err = plist_read_buf(doc, off, 0, &ptmp);
+	free(doc);
+	if (err != 0) {
+		return err;
+	}
+	printf("records %ld\n", nrecs);
+	err = _b_dump_tree("records", ptmp, &docsz);
+	plist_free(ptmp);
+	return err;
+}
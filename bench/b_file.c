@@ -0,0 +1,263 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_file.c
+ *
+ * Benchmarks for parsing text plists straight from files.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "bench.h"
+
+#define B_FILE_CHUNKSZ  (1024 * 1024)   /* generator write size */
+
+
+/**
+ * Write a top level array of records about mbytes in size.
+ */
+static int
+_b_file_write(const char *path, long mbytes, size_t *docszp)
+{
+	int fd;
+	int err;
+	long i;
+	char *chunk;
+	size_t want;
+	size_t docsz;
+	size_t off;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return errno;
+	}
+	chunk = malloc(B_FILE_CHUNKSZ);
+	if (chunk == NULL) {
+		close(fd);
+		return ENOMEM;
+	}
+
+	err = 0;
+	want = (size_t) mbytes * 1024 * 1024;
+	docsz = 0;
+	off = snprintf(chunk, B_FILE_CHUNKSZ, "( ");
+	for (i = 0; docsz + off < want; i++) {
+		off += snprintf(&chunk[off], B_FILE_CHUNKSZ - off,
+				"{ \"id\" = %ld; \"name\" = \"host%ld\"; "
+				"\"load\" = %ld.%02ld; \"up\" = true; "
+				"\"mac\" = <0011 2233 %04lx> }, ",
+				i, i, i % 100, i % 97, i & 0xffff);
+		if (off > B_FILE_CHUNKSZ - 256) {
+			if (write(fd, chunk, off) != (ssize_t) off) {
+				err = errno;
+				break;
+			}
+			docsz += off;
+			off = 0;
+		}
+	}
+	if (err == 0) {
+		off += snprintf(&chunk[off], B_FILE_CHUNKSZ - off, ")\n");
+		if (write(fd, chunk, off) != (ssize_t) off) {
+			err = errno;
+		}
+		docsz += off;
+	}
+	/* written back so the cache can be dropped */
+	if (err == 0 && fsync(fd) != 0) {
+		err = errno;
+	}
+	free(chunk);
+	close(fd);
+	*docszp = docsz;
+	return err;
+}
+
+
+/**
+ * Ask the kernel to drop the cached pages of a file.
+ */
+static void
+_b_file_drop(const char *path)
+{
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		(void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+
+/**
+ * Read the whole file into memory and parse it as one buffer.
+ */
+static int
+_b_file_slurp(plist_txt_t *txt, const char *path)
+{
+	int fd;
+	int err;
+	char *buf;
+	ssize_t len;
+	struct stat st;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	if (fstat(fd, &st) != 0) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+	buf = malloc(st.st_size);
+	if (buf == NULL) {
+		close(fd);
+		return ENOMEM;
+	}
+	err = 0;
+	for (len = 0; len < st.st_size; ) {
+		ssize_t n;
+
+		n = read(fd, &buf[len], st.st_size - len);
+		if (n <= 0) {
+			err = (n < 0) ? errno : EIO;
+			break;
+		}
+		len += n;
+	}
+	close(fd);
+	if (err == 0) {
+		err = plist_txt_parse(txt, buf, len);
+	}
+	free(buf);
+	return err;
+}
+
+
+/**
+ * Time one way of parsing the file and report it.
+ */
+static int
+_b_file_run(plist_txt_t *txt, const char *path, const char *label,
+	    int how, bool cold, size_t docsz)
+{
+	int err;
+	FILE *fp;
+	char cmd[256];
+	char name[64];
+	double start;
+	plist_t *ptmp;
+
+	if (cold) {
+		_b_file_drop(path);
+	}
+	start = bench_now();
+	switch (how) {
+	case 0:
+		err = plist_txt_parse_file(txt, path);
+		break;
+	case 1:
+		/* a pipe cannot be mapped so this takes the read path */
+		snprintf(cmd, sizeof(cmd), "cat '%s'", path);
+		fp = popen(cmd, "r");
+		if (fp == NULL) {
+			return errno;
+		}
+		err = plist_txt_parse_fd(txt, fileno(fp));
+		pclose(fp);
+		break;
+	default:
+		err = _b_file_slurp(txt, path);
+		break;
+	}
+	if (err == 0) {
+		err = plist_txt_result(txt, &ptmp);
+	}
+	if (err != 0) {
+		return err;
+	}
+	snprintf(name, sizeof(name), "%s %s", label, cold ? "cold" : "warm");
+	bench_report(name, docsz, 1, bench_now() - start);
+	plist_free(ptmp);
+	return 0;
+}
+
+
+int
+b_file_parse(int argc, char **argv)
+{
+	int i;
+	int err;
+	long mbytes;
+	char path[] = "/tmp/plist_bench.XXXXXX";
+	size_t docsz;
+	plist_txt_t *txt;
+
+	docsz = 0;
+	mbytes = bench_arg(argc, argv, 1, 64);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	i = mkstemp(path);
+	if (i < 0) {
+		return errno;
+	}
+	close(i);
+
+	err = _b_file_write(path, mbytes, &docsz);
+	if (err == 0) {
+		err = plist_txt_new(&txt);
+	}
+	if (err == 0) {
+		printf("document %zu bytes\n", docsz);
+		for (i = 0; err == 0 && i < 6; i++) {
+			static const char *labels[] = {
+				"file mmap", "file pipe", "file read+parse"
+			};
+
+			err = _b_file_run(txt, path, labels[i / 2], i / 2,
+					  (i % 2) == 0, docsz);
+		}
+		plist_txt_free(txt);
+	}
+	unlink(path);
+	return err;
+}
@@ -0,0 +1,289 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_flat.c
+ *
+ * Benchmarks for the flat plist reader
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_idx.h"
+#include "plist_flat.h"
+#include "bench.h"
+
+#define B_FLAT_RECSZ  (128)	/* upper bound of bytes per text record */
+
+
+static char *
+_b_flat_txt(long nrecs, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t off;
+	size_t docsz;
+
+	docsz = nrecs * B_FLAT_RECSZ + 16;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, "(\n");
+	for (i = 0; i < nrecs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"name\" = \"rec%08ld\"; "
+				"\"score\" = %ld.%ld; \"up\" = true; "
+				"\"tags\" = ( \"alpha\", \"beta\" ) },\n",
+				i, i, i / 2, (i % 2) * 5);
+	}
+	off += snprintf(&doc[off], docsz - off, ")\n");
+	*docszp = off;
+	return doc;
+}
+
+/**
+ * Open the flat file and read the name of one record
+ */
+static int
+_b_flat_first(const char *path, int flags, long rec, char *name, size_t sz)
+{
+	int err;
+	const char *str;
+	plist_flat_t *flat;
+	plist_flat_node_t node;
+
+	err = plist_flat_open(&flat, path, flags);
+	if (err != 0) {
+		return err;
+	}
+	err = plist_flat_root(flat, &node);
+	if (err == 0) {
+		err = plist_flat_at(flat, &node, rec, &node);
+	}
+	if (err == 0) {
+		err = plist_flat_lookup(flat, &node, "name", &node);
+	}
+	if (err == 0) {
+		err = plist_flat_string(flat, &node, &str, NULL);
+	}
+	if (err == 0) {
+		snprintf(name, sz, "%s", str);
+	}
+	plist_flat_free(flat);
+	return err;
+}
+
+/**
+ * The same through the structural index of the text
+ */
+static int
+_b_flat_idx(const char *doc, size_t docsz, long rec, char *name, size_t sz)
+{
+	int err;
+	plist_t *ptmp;
+	plist_idx_t *idx;
+	plist_idx_node_t node;
+
+	err = plist_idx_new(&idx, doc, docsz);
+	if (err != 0) {
+		return err;
+	}
+	err = plist_idx_root(idx, &node);
+	if (err == 0) {
+		err = plist_idx_at(idx, &node, rec, &node);
+	}
+	if (err == 0) {
+		err = plist_idx_lookup(idx, &node, "name", &node);
+	}
+	if (err == 0) {
+		err = plist_idx_plist(idx, &node, &ptmp);
+	}
+	if (err == 0) {
+		snprintf(name, sz, "%s", ptmp->p_string.ps_str);
+		plist_free(ptmp);
+	}
+	plist_idx_free(idx);
+	return err;
+}
+
+/**
+ * The same by parsing the whole text
+ */
+static int
+_b_flat_parse(plist_txt_t *txt, const char *doc, size_t docsz, long rec,
+	      char *name, size_t sz)
+{
+	int err;
+	plist_t *ptmp;
+	plist_t *pcur;
+
+	err = plist_txt_parse(txt, doc, docsz);
+	if (err == 0) {
+		err = plist_txt_result(txt, &ptmp);
+	}
+	if (err != 0) {
+		return err;
+	}
+	err = ENOENT;
+	TAILQ_FOREACH(pcur, &ptmp->p_array.pa_elems, p_entry) {
+		if (rec-- == 0) {
+			break;
+		}
+	}
+	if (pcur != NULL) {
+		TAILQ_FOREACH(pcur, &pcur->p_dict.pd_keys, p_entry) {
+			if (strcmp(pcur->p_key.pk_name, "name") == 0) {
+				snprintf(name, sz, "%s",
+					 pcur->p_key.pk_value->p_string.ps_str);
+				err = 0;
+				break;
+			}
+		}
+	}
+	plist_free(ptmp);
+	return err;
+}
+
+
+int
+b_flat_lookup(int argc, char **argv)
+{
+	int fd;
+	int err;
+	int pass;
+	long mbytes;
+	long nrecs;
+	char *txtdoc;
+	void *buf;
+	size_t sz;
+	size_t txtsz;
+	double start;
+	char name[32];
+	char want[32];
+	char path[] = "/tmp/plist_bench.XXXXXX";
+	plist_t *ptmp;
+	plist_txt_t *txt;
+
+	mbytes = bench_arg(argc, argv, 1, 64);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	nrecs = mbytes * 1024 * 1024 / 100;
+	txtdoc = _b_flat_txt(nrecs, &txtsz);
+	if (txtdoc == NULL) {
+		return ENOMEM;
+	}
+	buf = NULL;
+	err = plist_txt_new(&txt);
+	if (err == 0) {
+		err = plist_txt_parse(txt, txtdoc, txtsz);
+	}
+	if (err == 0) {
+		err = plist_txt_result(txt, &ptmp);
+	}
+	if (err != 0) {
+		free(txtdoc);
+		return err;
+	}
+
+	start = bench_now();
+	err = plist_flat_write_buf(ptmp, &buf, &sz);
+	if (err == 0) {
+		bench_report("flat write buffer", sz, 1, bench_now() - start);
+		printf("%-32s %10zu bytes, text %zu bytes (%.1f%%)\n",
+		       "flat size", sz, txtsz, sz * 100.0 / txtsz);
+		fd = mkstemp(path);
+		err = (fd < 0) ? errno : 0;
+	}
+	if (err == 0) {
+		err = plist_flat_write(ptmp, fd);
+		close(fd);
+	}
+	plist_free(ptmp);
+	if (err != 0) {
+		goto out;
+	}
+
+	start = bench_now();
+	err = plist_flat_verify(buf, sz);
+	if (err == 0) {
+		bench_report("flat verify", sz, 1, bench_now() - start);
+	}
+
+	/* time to the first answer from a cold start, each run once first
+	 * so that the file is in the page cache and the heap is warm */
+	snprintf(want, sizeof(want), "rec%08ld", nrecs / 2);
+	for (pass = 0; err == 0 && pass < 8; pass++) {
+		name[0] = '\0';
+		start = bench_now();
+		switch (pass / 2) {
+		case 0:
+			err = _b_flat_first(path, PLIST_FLAT_TRUSTED,
+					    nrecs / 2, name, sizeof(name));
+			break;
+		case 1:
+			err = _b_flat_first(path, 0, nrecs / 2, name,
+					    sizeof(name));
+			break;
+		case 2:
+			err = _b_flat_idx(txtdoc, txtsz, nrecs / 2, name,
+					  sizeof(name));
+			break;
+		default:
+			err = _b_flat_parse(txt, txtdoc, txtsz, nrecs / 2,
+					    name, sizeof(name));
+			break;
+		}
+		if (err == 0 && strcmp(name, want) != 0) {
+			err = EINVAL;
+		}
+		if (err != 0 || pass % 2 == 0) {
+			continue;
+		}
+		printf("%-32s %10.3f ms\n",
+		       (pass == 1) ? "first lookup flat trusted" :
+		       (pass == 3) ? "first lookup flat verified" :
+		       (pass == 5) ? "first lookup txt index" :
+		       "first lookup txt parse",
+		       (bench_now() - start) * 1000.0);
+	}
+	unlink(path);
+
+out:
+	free(buf);
+	plist_txt_free(txt);
+	free(txtdoc);
+	return err;
+}
@@ -0,0 +1,246 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_gen.c
+ *
+ * Benchmarks for decoders generated by plist-codegen.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_bind.h"
+#include "b_tlm.h"
+#include "bench.h"
+
+/* one telemetry record in the document */
+struct b_gen_rec {
+	size_t bgr_off;
+	size_t bgr_len;
+};
+
+static const plist_bind_desc_t b_gen_disk_fields[] = {
+	PLIST_BIND_FIELD("used", PLIST_BIND_INTEGER, struct b_tlm_disk_s, used),
+	PLIST_BIND_FIELD("free", PLIST_BIND_INTEGER, struct b_tlm_disk_s, free),
+	PLIST_BIND_END
+};
+
+static const plist_bind_desc_t b_gen_tlm_fields[] = {
+	PLIST_BIND_FIELD("id", PLIST_BIND_INTEGER, b_tlm_t, id),
+	PLIST_BIND_FIELD("host", PLIST_BIND_STRBUF, b_tlm_t, host),
+	PLIST_BIND_FIELD("ts", PLIST_BIND_INTEGER, b_tlm_t, ts),
+	PLIST_BIND_FIELD("cpu", PLIST_BIND_REAL, b_tlm_t, cpu),
+	PLIST_BIND_FIELD("mem", PLIST_BIND_INTEGER, b_tlm_t, mem),
+	PLIST_BIND_FIELD("up", PLIST_BIND_BOOLEAN, b_tlm_t, up),
+	PLIST_BIND_NESTED("disk", b_tlm_t, disk, b_gen_disk_fields),
+	PLIST_BIND_END
+};
+
+
+/**
+ * Generate the telemetry records one after another
+ */
+static char *
+_b_gen_doc(long nrecs, struct b_gen_rec *recs, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t docsz;
+	size_t off;
+
+	docsz = nrecs * 256;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = 0;
+	for (i = 0; i < nrecs; i++) {
+		recs[i].bgr_off = off;
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"host\" = \"node%04ld\"; "
+				"\"ts\" = %ld; \"cpu\" = %ld.%02ld; "
+				"\"mem\" = %ld; \"up\" = true; "
+				"\"disk\" = { \"used\" = %ld; \"free\" = %ld }; "
+				"\"note\" = ( \"x\", \"y\" ) }\n",
+				i, i % 10000, 1700000000 + i, i % 100, i % 97,
+				i * 4096, i * 7, i * 11);
+		recs[i].bgr_len = off - recs[i].bgr_off;
+	}
+	*docszp = off;
+	return doc;
+}
+
+static const plist_t *
+_b_gen_get(const plist_t *dict, const char *name)
+{
+	const plist_t *ptmp;
+
+	TAILQ_FOREACH(ptmp, &dict->p_dict.pd_keys, p_entry) {
+		if (strcmp(ptmp->p_key.pk_name, name) == 0) {
+			return ptmp->p_key.pk_value;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * What an application does by hand with a parsed record
+ */
+static int
+_b_gen_extract(const plist_t *ptmp, b_tlm_t *tlm)
+{
+	const plist_t *val;
+	const plist_t *disk;
+
+	if ((val = _b_gen_get(ptmp, "id")) != NULL) {
+		tlm->id = val->p_integer.pi_int;
+	}
+	if ((val = _b_gen_get(ptmp, "host")) != NULL) {
+		snprintf(tlm->host, sizeof(tlm->host), "%s",
+			 val->p_string.ps_str);
+	}
+	if ((val = _b_gen_get(ptmp, "ts")) != NULL) {
+		tlm->ts = val->p_integer.pi_int;
+	}
+	if ((val = _b_gen_get(ptmp, "cpu")) != NULL) {
+		tlm->cpu = val->p_real.pr_double;
+	}
+	if ((val = _b_gen_get(ptmp, "mem")) != NULL) {
+		tlm->mem = val->p_integer.pi_int;
+	}
+	if ((val = _b_gen_get(ptmp, "up")) != NULL) {
+		tlm->up = val->p_boolean.pb_bool;
+	}
+	if ((disk = _b_gen_get(ptmp, "disk")) != NULL) {
+		if ((val = _b_gen_get(disk, "used")) != NULL) {
+			tlm->disk.used = val->p_integer.pi_int;
+		}
+		if ((val = _b_gen_get(disk, "free")) != NULL) {
+			tlm->disk.free = val->p_integer.pi_int;
+		}
+	}
+	return 0;
+}
+
+
+int
+b_gen_tlm(int argc, char **argv)
+{
+	int err;
+	int way;
+	long i;
+	long nrecs;
+	long long sum;
+	char *doc;
+	char *copy;
+	size_t docsz;
+	double start;
+	double secs;
+	b_tlm_t tlm;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	struct b_gen_rec *recs;
+	static const char *names[] = {
+		"gen-tlm memcpy", "gen-tlm generated decoder",
+		"gen-tlm plist_bind_parse", "gen-tlm parse + extract"
+	};
+
+	nrecs = bench_arg(argc, argv, 1, 200000);
+	if (nrecs <= 0) {
+		return EINVAL;
+	}
+	recs = calloc(nrecs, sizeof(*recs));
+	if (recs == NULL) {
+		return ENOMEM;
+	}
+	doc = _b_gen_doc(nrecs, recs, &docsz);
+	copy = malloc(docsz);
+	err = plist_txt_new(&txt);
+	if (doc == NULL || copy == NULL || err != 0) {
+		free(recs);
+		free(doc);
+		free(copy);
+		return (err != 0) ? err : ENOMEM;
+	}
+	printf("document %zu bytes, %ld records\n", docsz, nrecs);
+
+	for (way = 0; err == 0 && way < 4; way++) {
+		sum = 0;
+		start = bench_now();
+		for (i = 0; err == 0 && i < nrecs; i++) {
+			const char *rec = &doc[recs[i].bgr_off];
+			size_t len = recs[i].bgr_len;
+
+			memset(&tlm, 0, sizeof(tlm));
+			switch (way) {
+			case 0:
+				memcpy(&copy[recs[i].bgr_off], rec, len);
+				tlm.id = copy[recs[i].bgr_off];
+				break;
+			case 1:
+				err = b_tlm_decode(&tlm, rec, len, NULL);
+				break;
+			case 2:
+				err = plist_bind_parse(txt, b_gen_tlm_fields,
+						       &tlm, rec, len);
+				break;
+			case 3:
+				err = plist_txt_parse(txt, rec, len);
+				if (err == 0) {
+					err = plist_txt_result(txt, &ptmp);
+				}
+				if (err == 0) {
+					err = _b_gen_extract(ptmp, &tlm);
+					plist_free(ptmp);
+				}
+				break;
+			}
+			sum += tlm.id + tlm.disk.free;
+		}
+		secs = bench_now() - start;
+		if (err == 0 && way > 0 &&
+		    sum != (nrecs - 1) * nrecs / 2 * 12) {
+			/* every way has to get the same values */
+			err = EINVAL;
+		}
+		if (err == 0) {
+			bench_report(names[way], docsz, 1, secs);
+		}
+	}
+
+	plist_txt_free(txt);
+	free(recs);
+	free(doc);
+	free(copy);
+	return err;
+}
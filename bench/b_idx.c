@@ -0,0 +1,177 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_idx.c
+ *
+ * Benchmarks for the structural index.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_idx.h"
+#include "bench.h"
+
+#define B_IDX_GROUPRECS  (1000) /* records in each top level array */
+#define B_IDX_TREEMAX    (64)   /* largest document to also parse whole */
+
+
+/**
+ * Generate a dictionary of groups that each hold an array of records,
+ * about mbytes in size.
+ */
+static char *
+_b_idx_doc(long mbytes, long *ngroupsp, size_t *docszp)
+{
+	long i;
+	long ngroups;
+	char *doc;
+	size_t want;
+	size_t docsz;
+	size_t off;
+
+	/* whole groups until the size is reached */
+	want = (size_t) mbytes * 1024 * 1024;
+	docsz = want + B_IDX_GROUPRECS * 160 + 64;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, "{ ");
+	for (ngroups = 0; off < want; ngroups++) {
+		off += snprintf(&doc[off], docsz - off, "\"g%ld\" = ( ",
+				ngroups);
+		for (i = 0; i < B_IDX_GROUPRECS; i++) {
+			off += snprintf(&doc[off], docsz - off,
+					"{ \"id\" = %ld; \"name\" = \"host%ld\"; "
+					"\"load\" = %ld.%02ld; \"up\" = true; "
+					"\"mac\" = <0011 2233 %04lx>; "
+					"\"tags\" = ( \"a\", \"b\" ) }, ",
+					i, i, i % 100, i % 97, i & 0xffff);
+		}
+		off += snprintf(&doc[off], docsz - off, "); ");
+	}
+	off += snprintf(&doc[off], docsz - off, "}");
+	*ngroupsp = ngroups;
+	*docszp = off;
+	return doc;
+}
+
+
+int
+b_idx_lookup(int argc, char **argv)
+{
+	int err;
+	long mbytes;
+	long ngroups;
+	char *doc;
+	char key[32];
+	size_t docsz;
+	double start;
+	double built;
+	double found;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	plist_idx_t *idx;
+	plist_idx_node_t node;
+
+	mbytes = bench_arg(argc, argv, 1, 256);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	doc = _b_idx_doc(mbytes, &ngroups, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	printf("document %zu bytes, %ld groups\n", docsz, ngroups);
+
+	/* the last group is the worst case for the top level walk */
+	snprintf(key, sizeof(key), "g%ld", ngroups - 1);
+
+	start = bench_now();
+	err = plist_idx_new(&idx, doc, docsz);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+	built = bench_now();
+	err = plist_idx_root(idx, &node);
+	if (err == 0) {
+		err = plist_idx_lookup(idx, &node, key, &node);
+	}
+	if (err == 0) {
+		err = plist_idx_at(idx, &node, B_IDX_GROUPRECS / 2, &node);
+	}
+	if (err == 0) {
+		err = plist_idx_lookup(idx, &node, "name", &node);
+	}
+	if (err == 0) {
+		err = plist_idx_plist(idx, &node, &ptmp);
+	}
+	found = bench_now();
+	if (err == 0) {
+		plist_free(ptmp);
+		bench_report("idx build", docsz, 1, built - start);
+		printf("%-32s %10.3f ms\n", "idx lookup",
+		       (found - built) * 1000.0);
+		printf("%-32s %10.3f ms\n", "idx time to first lookup",
+		       (found - start) * 1000.0);
+		printf("%-32s %10zu KB (%zu structurals)\n", "idx size",
+		       idx->pi_npos * 2 * sizeof(uint32_t) / 1024,
+		       idx->pi_npos);
+	}
+	plist_idx_free(idx);
+
+	if (err == 0 && mbytes <= B_IDX_TREEMAX) {
+		/* the tree has to be complete before anything is found */
+		err = plist_txt_new(&txt);
+		if (err == 0) {
+			start = bench_now();
+			err = plist_txt_parse(txt, doc, docsz);
+			if (err == 0) {
+				err = plist_txt_result(txt, &ptmp);
+			}
+			found = bench_now();
+			plist_txt_free(txt);
+		}
+		if (err == 0) {
+			printf("%-32s %10.3f ms\n",
+			       "tree time to first lookup",
+			       (found - start) * 1000.0);
+			plist_free(ptmp);
+		}
+	}
+
+	free(doc);
+	return err;
+}
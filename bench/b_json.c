@@ -0,0 +1,430 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_json.c
+ *
+ * Benchmarks for the JSON reader and writer, on records of short
+ * values and on long strings where the string scan dominates, with the
+ * text parser on the same records for a reference.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_json.h"
+#include "bench.h"
+
+#define B_JSON_RECSZ  (256)	/* upper bound of bytes per record */
+#define B_JSON_STRSZ  (1024)	/* length of each long string */
+
+/* events seen by the counting sink */
+static long _b_json_events;
+
+
+static char *
+_b_json_records(long nrecs, bool json, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t off;
+	size_t docsz;
+
+	docsz = nrecs * B_JSON_RECSZ + 16;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, json ? "[\n" : "(\n");
+	for (i = 0; i < nrecs; i++) {
+		off += snprintf(&doc[off], docsz - off, json ?
+				"{\"id\": %ld, \"name\": \"rec%08ld\", "
+				"\"score\": %ld.%ld, \"up\": true, "
+				"\"tags\": [\"alpha\", \"beta\"]}%s\n" :
+				"{ \"id\" = %ld; \"name\" = \"rec%08ld\"; "
+				"\"score\" = %ld.%ld; \"up\" = true; "
+				"\"tags\" = ( \"alpha\", \"beta\" ) }%s\n",
+				i, i, i / 2, (i % 2) * 5,
+				(json && i == nrecs - 1) ? "" : ",");
+	}
+	off += snprintf(&doc[off], docsz - off, json ? "]\n" : ")\n");
+	*docszp = off;
+	return doc;
+}
+
+/**
+ * An array of long strings with an escape now and then
+ */
+static char *
+_b_json_strings(size_t mbytes, size_t *docszp)
+{
+	long i;
+	long n;
+	char *doc;
+	char *cp;
+
+	n = mbytes * 1024 * 1024 / (B_JSON_STRSZ + 4);
+	doc = malloc(n * (B_JSON_STRSZ + 4) + 4);
+	if (doc == NULL) {
+		return NULL;
+	}
+	cp = doc;
+	*cp++ = '[';
+	for (i = 0; i < n; i++) {
+		*cp++ = '"';
+		memset(cp, 'a' + i % 26, B_JSON_STRSZ);
+		if (i % 4 == 0) {
+			memcpy(&cp[B_JSON_STRSZ / 2], "\\n", 2);
+		}
+		cp += B_JSON_STRSZ;
+		*cp++ = '"';
+		*cp++ = (i == n - 1) ? ']' : ',';
+		*cp++ = '\n';
+	}
+	*docszp = cp - doc;
+	return doc;
+}
+
+static int
+_b_json_count(void *arg)
+{
+	(void) arg;
+
+	_b_json_events++;
+	return 0;
+}
+
+static int
+_b_json_count_str(void *arg, const char *s, size_t len)
+{
+	(void) arg;
+	(void) s;
+	(void) len;
+
+	_b_json_events++;
+	return 0;
+}
+
+static int
+_b_json_count_int(void *arg, long long num)
+{
+	(void) arg;
+	(void) num;
+
+	_b_json_events++;
+	return 0;
+}
+
+static int
+_b_json_count_real(void *arg, double num)
+{
+	(void) arg;
+	(void) num;
+
+	_b_json_events++;
+	return 0;
+}
+
+static int
+_b_json_count_bool(void *arg, bool flag)
+{
+	(void) arg;
+	(void) flag;
+
+	_b_json_events++;
+	return 0;
+}
+
+static const plist_txt_sax_t _b_json_counter = {
+	.psx_begin_dict = _b_json_count,
+	.psx_end_dict = _b_json_count,
+	.psx_key = _b_json_count_str,
+	.psx_begin_array = _b_json_count,
+	.psx_end_array = _b_json_count,
+	.psx_string = _b_json_count_str,
+	.psx_integer = _b_json_count_int,
+	.psx_real = _b_json_count_real,
+	.psx_boolean = _b_json_count_bool,
+};
+
+/**
+ * Feed the document in fragments of fragsz, building the tree when
+ * sax is NULL
+ */
+static int
+_b_json_parse(plist_json_t *json, const plist_txt_sax_t *sax,
+	      const char *doc, size_t docsz, size_t fragsz, plist_t **plistpp)
+{
+	int err;
+	size_t n;
+	size_t off;
+
+	err = 0;
+	for (off = 0; err == 0 && off < docsz; off += n) {
+		n = (docsz - off < fragsz) ? docsz - off : fragsz;
+		if (sax == NULL) {
+			err = plist_json_parse(json, &doc[off], n);
+		} else {
+			err = plist_json_sax_parse(json, sax, NULL,
+						   &doc[off], n);
+		}
+	}
+	if (err == 0 && sax == NULL) {
+		return plist_json_result(json, plistpp);
+	}
+	if (err == 0 && json->pj_state != PLIST_JSON_STATE_DONE) {
+		err = ENOENT;
+	}
+	plist_json_reset(json);
+	return err;
+}
+
+/**
+ * Time the tree, built once first so that the heap is warm, and the
+ * events alone for the cost of the tokenizer
+ */
+static int
+_b_json_read(plist_json_t *json, const char *name, const char *doc,
+	     size_t docsz, size_t fragsz)
+{
+	int err;
+	int pass;
+	double start;
+	char label[48];
+	plist_t *ptmp;
+
+	ptmp = NULL;
+	for (err = 0, pass = 0; err == 0 && pass < 2; pass++) {
+		plist_free(ptmp);
+		ptmp = NULL;
+		start = bench_now();
+		err = _b_json_parse(json, NULL, doc, docsz, fragsz, &ptmp);
+		if (err == 0 && pass == 1) {
+			snprintf(label, sizeof(label), "%s to plist", name);
+			bench_report(label, docsz, 1, bench_now() - start);
+		}
+	}
+	plist_free(ptmp);
+	if (err == 0) {
+		_b_json_events = 0;
+		start = bench_now();
+		err = _b_json_parse(json, &_b_json_counter, doc, docsz,
+				    fragsz, NULL);
+		if (err == 0) {
+			snprintf(label, sizeof(label), "%s events", name);
+			bench_report(label, docsz, 1, bench_now() - start);
+		}
+	}
+	return err;
+}
+
+
+int
+b_json_read(int argc, char **argv)
+{
+	int err;
+	int pass;
+	long mbytes;
+	long nrecs;
+	size_t fragsz;
+	size_t docsz;
+	char *doc;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	plist_json_t *json;
+
+	mbytes = bench_arg(argc, argv, 1, 64);
+	fragsz = bench_arg(argc, argv, 2, 64) * 1024;
+	if (mbytes <= 0 || fragsz == 0) {
+		return EINVAL;
+	}
+	err = plist_json_new(&json);
+	if (err != 0) {
+		return err;
+	}
+
+	nrecs = mbytes * 1024 * 1024 / 100;
+	doc = _b_json_records(nrecs, true, &docsz);
+	if (doc == NULL) {
+		plist_json_free(json);
+		return ENOMEM;
+	}
+	printf("records %zu bytes, %ld records, %zu byte fragments\n",
+	       docsz, nrecs, fragsz);
+	err = _b_json_read(json, "json records", doc, docsz, fragsz);
+	free(doc);
+
+	/* the text parser on the same records */
+	if (err == 0) {
+		doc = _b_json_records(nrecs, false, &docsz);
+		err = (doc == NULL) ? ENOMEM : plist_txt_new(&txt);
+		for (pass = 0; err == 0 && pass < 2; pass++) {
+			start = bench_now();
+			err = plist_txt_parse(txt, doc, docsz);
+			if (err == 0) {
+				err = plist_txt_result(txt, &ptmp);
+			}
+			if (err == 0) {
+				if (pass == 1) {
+					bench_report("txt records to plist",
+						     docsz, 1,
+						     bench_now() - start);
+				}
+				plist_free(ptmp);
+			}
+		}
+		if (doc != NULL) {
+			plist_txt_free(txt);
+		}
+		free(doc);
+	}
+
+	if (err == 0) {
+		doc = _b_json_strings(mbytes, &docsz);
+		if (doc == NULL) {
+			plist_json_free(json);
+			return ENOMEM;
+		}
+		printf("strings %zu bytes, %d bytes each\n", docsz,
+		       B_JSON_STRSZ);
+		err = _b_json_read(json, "json strings", doc, docsz, fragsz);
+		free(doc);
+	}
+
+	plist_json_free(json);
+	return err;
+}
+
+
+/**
+ * Time writing a tree into a buffer and out through a descriptor
+ */
+static int
+_b_json_write(const char *name, const plist_t *plist)
+{
+	int fd;
+	int err;
+	void *buf;
+	size_t sz;
+	double start;
+	char label[48];
+
+	start = bench_now();
+	err = plist_json_write_buf(plist, &buf, &sz);
+	if (err != 0) {
+		return err;
+	}
+	snprintf(label, sizeof(label), "%s to buffer", name);
+	bench_report(label, sz, 1, bench_now() - start);
+	free(buf);
+
+	fd = open("/dev/null", O_WRONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	start = bench_now();
+	err = plist_json_write(plist, fd);
+	if (err == 0) {
+		snprintf(label, sizeof(label), "%s to fd", name);
+		bench_report(label, sz, 1, bench_now() - start);
+	}
+	close(fd);
+	return err;
+}
+
+
+int
+b_json_write(int argc, char **argv)
+{
+	int err;
+	long i;
+	long mbytes;
+	size_t docsz;
+	char *doc;
+	plist_t *ptmp;
+	plist_json_t *json;
+
+	mbytes = bench_arg(argc, argv, 1, 64);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	err = plist_json_new(&json);
+	if (err != 0) {
+		return err;
+	}
+
+	/* records, mostly punctuation and short values */
+	doc = _b_json_records(mbytes * 1024 * 1024 / 100, true, &docsz);
+	err = (doc == NULL) ? ENOMEM :
+	    _b_json_parse(json, NULL, doc, docsz, docsz, &ptmp);
+	free(doc);
+	if (err == 0) {
+		err = _b_json_write("records", ptmp);
+		plist_free(ptmp);
+	}
+
+	/* long strings, mostly the escape scan */
+	if (err == 0) {
+		doc = _b_json_strings(mbytes, &docsz);
+		err = (doc == NULL) ? ENOMEM :
+		    _b_json_parse(json, NULL, doc, docsz, docsz, &ptmp);
+		free(doc);
+	}
+	if (err == 0) {
+		err = _b_json_write("strings", ptmp);
+		plist_free(ptmp);
+	}
+
+	/* one large data element, which is all base64 */
+	if (err == 0) {
+		doc = malloc(mbytes * 1024 * 1024);
+		if (doc == NULL) {
+			plist_json_free(json);
+			return ENOMEM;
+		}
+		for (i = 0; i < mbytes * 1024 * 1024; i++) {
+			doc[i] = i * 31;
+		}
+		err = plist_data_ref_new(&ptmp, doc, mbytes * 1024 * 1024);
+		if (err == 0) {
+			err = _b_json_write("data", ptmp);
+			plist_free(ptmp);
+		}
+		free(doc);
+	}
+
+	plist_json_free(json);
+	return err;
+}
@@ -0,0 +1,1323 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_txt.c
+ *
+ * Benchmarks for the text plist parser.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "bench.h"
+
+
+/**
+ * Feed a document to the parser in fragments of fragsz bytes and
+ * collect the result.
+ */
+static int
+_b_txt_feed(plist_txt_t *txt, const char *doc, size_t docsz, size_t fragsz,
+	    plist_t **plistpp)
+{
+	int err;
+	size_t off;
+	size_t len;
+
+	for (off = 0; off < docsz; off += len) {
+		len = docsz - off;
+		if (len > fragsz) {
+			len = fragsz;
+		}
+		err = plist_txt_parse(txt, &doc[off], len);
+		if (err != 0) {
+			return err;
+		}
+	}
+	return plist_txt_result(txt, plistpp);
+}
+
+
+int
+b_txt_bigstr(int argc, char **argv)
+{
+	int i;
+	int err;
+	long mbytes;
+	long fragkb;
+	char *doc;
+	size_t off;
+	size_t docsz;
+	size_t strsz;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	char label[64];
+
+	mbytes = bench_arg(argc, argv, 1, 10);
+	fragkb = bench_arg(argc, argv, 2, 64);
+	if (mbytes <= 0 || fragkb <= 0) {
+		return EINVAL;
+	}
+
+	/* one quoted string of mbytes with a trailing terminator */
+	strsz = (size_t) mbytes * 1024 * 1024;
+	docsz = strsz + sizeof("\"\"");
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	doc[0] = '"';
+	for (off = 0; off < strsz; off++) {
+		doc[off + 1] = 'a' + (off % 26);
+	}
+	doc[strsz + 1] = '"';
+	doc[strsz + 2] = '\0';
+
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+
+	/* keep the scratch buffer between documents */
+	plist_txt_set_highwater(txt, strsz + 1);
+
+	snprintf(label, sizeof(label), "txt-bigstr %ldMB/%ldKB",
+		 mbytes, fragkb);
+	start = bench_now();
+	for (i = 0; i < 5; i++) {
+		err = _b_txt_feed(txt, doc, docsz, fragkb * 1024, &ptmp);
+		if (err != 0) {
+			break;
+		}
+		plist_free(ptmp);
+	}
+	if (err == 0) {
+		bench_report(label, docsz, i, bench_now() - start);
+	}
+
+	plist_txt_free(txt);
+	free(doc);
+	return err;
+}
+
+
+int
+b_txt_keys(int argc, char **argv)
+{
+#define _NKEYS  (16)
+
+	int i, j;
+	int err;
+	long ndicts;
+	char *doc;
+	size_t docsz;
+	size_t off;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	char label[64];
+
+	ndicts = bench_arg(argc, argv, 1, 10000);
+	if (ndicts <= 0) {
+		return EINVAL;
+	}
+
+	/* an array of small records made of short keys and values */
+	docsz = ndicts * (_NKEYS * sizeof("\"field00\" : \"value\"; ") +
+			  sizeof("{ }, ")) + 8;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	off = snprintf(doc, docsz, "( ");
+	for (i = 0; i < ndicts; i++) {
+		off += snprintf(&doc[off], docsz - off, "{ ");
+		for (j = 0; j < _NKEYS; j++) {
+			off += snprintf(&doc[off], docsz - off,
+					"\"field%02d\" : \"value\"; ", j);
+		}
+		off += snprintf(&doc[off], docsz - off,
+				(i + 1 < ndicts) ? "}, " : "}");
+	}
+	off += snprintf(&doc[off], docsz - off, " )");
+	docsz = off + 1;
+
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+
+	snprintf(label, sizeof(label), "txt-keys %ldx%d", ndicts, _NKEYS);
+	start = bench_now();
+	for (i = 0; i < 10; i++) {
+		err = _b_txt_feed(txt, doc, docsz, docsz, &ptmp);
+		if (err != 0) {
+			break;
+		}
+		plist_free(ptmp);
+	}
+	if (err == 0) {
+		bench_report(label, docsz, i, bench_now() - start);
+	}
+
+	plist_txt_free(txt);
+	free(doc);
+	return err;
+
+#undef _NKEYS
+}
+
+
+int
+b_txt_bigdict(int argc, char **argv)
+{
+	int i;
+	int err;
+	long nkeys;
+	long trusted;
+	char *doc;
+	size_t docsz;
+	size_t off;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	char label[64];
+
+	nkeys = bench_arg(argc, argv, 1, 200000);
+	trusted = bench_arg(argc, argv, 2, 0);
+	if (nkeys <= 0) {
+		return EINVAL;
+	}
+
+	/* one lookup table style dictionary */
+	docsz = nkeys * sizeof("\"key0000000000\" : 0000000000; ") + 8;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	off = snprintf(doc, docsz, "{ ");
+	for (i = 0; i < nkeys; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"\"key%d\" : %d; ", i, i);
+	}
+	off += snprintf(&doc[off], docsz - off, "}");
+	docsz = off + 1;
+
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+	if (trusted) {
+		plist_txt_setflags(txt, PLIST_TXT_NODUPCHECK);
+	}
+
+	snprintf(label, sizeof(label), "txt-bigdict %ld%s", nkeys,
+		 trusted ? " trusted" : "");
+	start = bench_now();
+	for (i = 0; i < 3; i++) {
+		err = _b_txt_feed(txt, doc, docsz, docsz, &ptmp);
+		if (err != 0) {
+			break;
+		}
+		plist_free(ptmp);
+	}
+	if (err == 0) {
+		bench_report(label, docsz, i, bench_now() - start);
+	}
+
+	plist_txt_free(txt);
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Generate an array of records with a mix of element types that
+ * resembles an inventory dump.
+ */
+static char *
+_b_txt_records(long nrecs, size_t *docszp)
+{
+	int i;
+	char *doc;
+	size_t docsz;
+	size_t off;
+
+	docsz = nrecs * 160 + 8;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, "( ");
+	for (i = 0; i < nrecs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" : %d; \"name\" : \"host%d\"; "
+				"\"load\" : %d.%02d; \"up\" : true; "
+				"\"mac\" : <0011 2233 %04x>; "
+				"\"tags\" : ( \"a\", \"b\" ) }%s",
+				i, i, i % 100, i % 97, i & 0xffff,
+				(i + 1 < nrecs) ? ", " : "");
+	}
+	off += snprintf(&doc[off], docsz - off, " )");
+	*docszp = off + 1;
+	return doc;
+}
+
+static int
+_b_sax_count(void *arg)
+{
+	(*(long *) arg)++;
+	return 0;
+}
+
+static int
+_b_sax_count_str(void *arg, const char *s, size_t len)
+{
+	(void) s;
+	(void) len;
+
+	(*(long *) arg)++;
+	return 0;
+}
+
+static int
+_b_sax_count_int(void *arg, long long num)
+{
+	(void) num;
+
+	(*(long *) arg)++;
+	return 0;
+}
+
+static int
+_b_sax_count_real(void *arg, double num)
+{
+	(void) num;
+
+	(*(long *) arg)++;
+	return 0;
+}
+
+static int
+_b_sax_count_bool(void *arg, bool flag)
+{
+	(void) flag;
+
+	(*(long *) arg)++;
+	return 0;
+}
+
+static int
+_b_sax_count_data(void *arg, const void *buf, size_t sz)
+{
+	(void) buf;
+	(void) sz;
+
+	(*(long *) arg)++;
+	return 0;
+}
+
+static const plist_txt_sax_t b_sax_count = {
+	.psx_begin_dict = _b_sax_count,
+	.psx_end_dict = _b_sax_count,
+	.psx_key = _b_sax_count_str,
+	.psx_begin_array = _b_sax_count,
+	.psx_end_array = _b_sax_count,
+	.psx_string = _b_sax_count_str,
+	.psx_integer = _b_sax_count_int,
+	.psx_real = _b_sax_count_real,
+	.psx_boolean = _b_sax_count_bool,
+	.psx_data = _b_sax_count_data,
+};
+
+/**
+ * Run one parse mode in a child process so the peak resident size
+ * belongs to that mode alone.
+ */
+static int
+_b_txt_sax_child(const char *label, int mode, const char *doc, size_t docsz)
+{
+	int i;
+	int err;
+	int status;
+	long nevents;
+	pid_t pid;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	struct rusage ru;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		return errno;
+	}
+	if (pid == 0) {
+		err = plist_txt_new(&txt);
+		if (err != 0) {
+			_exit(err);
+		}
+		start = bench_now();
+		for (i = 0; i < 3 && mode != 0; i++) {
+			if (mode == 1) {
+				nevents = 0;
+				err = plist_txt_sax_parse(txt, &b_sax_count,
+							  &nevents, doc, docsz);
+				plist_txt_reset(txt);
+			} else {
+				err = _b_txt_feed(txt, doc, docsz, docsz,
+						  &ptmp);
+				plist_free(ptmp);
+			}
+			if (err != 0) {
+				_exit(err);
+			}
+		}
+		if (mode != 0) {
+			bench_report(label, docsz, i, bench_now() - start);
+		}
+		fflush(stdout);
+		_exit(0);
+	}
+
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		return errno;
+	}
+	printf("%-32s peak rss %ld KB\n", label, ru.ru_maxrss);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EINTR;
+}
+
+
+int
+b_txt_sax(int argc, char **argv)
+{
+	int err;
+	long nrecs;
+	char *doc;
+	size_t docsz;
+
+	nrecs = bench_arg(argc, argv, 1, 200000);
+	if (nrecs <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_records(nrecs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	printf("document %zu bytes, %ld records\n", docsz, nrecs);
+
+	err = _b_txt_sax_child("input only", 0, doc, docsz);
+	if (err == 0) {
+		err = _b_txt_sax_child("txt-sax events", 1, doc, docsz);
+	}
+	if (err == 0) {
+		err = _b_txt_sax_child("txt-sax tree", 2, doc, docsz);
+	}
+
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Generate a dictionary of service settings that is mostly strings, the
+ * way a large read only configuration usually is.
+ */
+static char *
+_b_txt_config(long nsvcs, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t docsz;
+	size_t off;
+
+	docsz = nsvcs * 400 + 8;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, "{ ");
+	for (i = 0; i < nsvcs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"\"svc%ld\" = { \"path\" = "
+				"\"/usr/local/libexec/service/svc%ld/run\"; "
+				"\"user\" = \"daemon%ld\"; "
+				"\"description\" = \"background worker %ld for "
+				"the request queue\"; "
+				"\"socket\" = \"/var/run/service/svc%ld.sock\"; "
+				"\"args\" = ( \"--config\", "
+				"\"/etc/service/svc%ld.conf\" ); "
+				"\"key\" = <00112233 44556677>; }; ",
+				i, i, i, i, i, i);
+	}
+	off += snprintf(&doc[off], docsz - off, "}");
+	*docszp = off;
+	return doc;
+}
+
+/**
+ * Parse the configuration once in a child process, copying or borrowing
+ * the strings, and report the time and the peak resident size.
+ */
+static int
+_b_txt_borrow_child(const char *label, int mode, const char *doc,
+		    size_t docsz)
+{
+	int err;
+	int status;
+	pid_t pid;
+	char *buf;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	struct rusage ru;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		return errno;
+	}
+	if (pid == 0) {
+		/* the loader owns a copy of the input in every mode */
+		buf = malloc(docsz);
+		if (buf == NULL) {
+			_exit(ENOMEM);
+		}
+		memcpy(buf, doc, docsz);
+		err = plist_txt_new(&txt);
+		if (err != 0 || mode == 0) {
+			_exit(err);
+		}
+		start = bench_now();
+		if (mode == 1) {
+			err = plist_txt_parse(txt, buf, docsz);
+		} else {
+			err = plist_txt_parse_borrowed(txt, buf, docsz);
+		}
+		if (err == 0) {
+			err = plist_txt_result(txt, &ptmp);
+		}
+		if (err != 0) {
+			_exit(err);
+		}
+		bench_report(label, docsz, 1, bench_now() - start);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		return errno;
+	}
+	printf("%-32s peak rss %ld KB\n", label, ru.ru_maxrss);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EINTR;
+}
+
+
+int
+b_txt_borrow(int argc, char **argv)
+{
+	int err;
+	long nsvcs;
+	char *doc;
+	size_t docsz;
+
+	nsvcs = bench_arg(argc, argv, 1, 200000);
+	if (nsvcs <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_config(nsvcs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	printf("document %zu bytes, %ld services\n", docsz, nsvcs);
+
+	err = _b_txt_borrow_child("input only", 0, doc, docsz);
+	if (err == 0) {
+		err = _b_txt_borrow_child("txt-borrow copied", 1, doc, docsz);
+	}
+	if (err == 0) {
+		err = _b_txt_borrow_child("txt-borrow borrowed", 2, doc, docsz);
+	}
+
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Generate a stream of small log event documents, one after the other,
+ * and remember where each one ends for the framed comparison.
+ */
+static char *
+_b_txt_events(long ndocs, size_t **endsp, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t *ends;
+	size_t docsz;
+	size_t off;
+
+	docsz = ndocs * 128 + 1;
+	doc = malloc(docsz);
+	ends = malloc(ndocs * sizeof(*ends));
+	if (doc == NULL || ends == NULL) {
+		free(doc);
+		free(ends);
+		return NULL;
+	}
+	off = 0;
+	for (i = 0; i < ndocs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"ts\" = %ld; \"host\" = \"web%02ld\"; "
+				"\"level\" = \"info\"; \"ms\" = %ld.%ld; "
+				"\"msg\" = \"request served\"; }\n",
+				1700000000 + i, i % 64, i % 500, i % 10);
+		ends[i] = off;
+	}
+	*endsp = ends;
+	*docszp = off;
+	return doc;
+}
+
+
+int
+b_txt_stream(int argc, char **argv)
+{
+	int err;
+	long i;
+	long ndocs;
+	long fragsz;
+	long ndone;
+	char *doc;
+	char label[64];
+	size_t *ends;
+	size_t docsz;
+	size_t off;
+	size_t len;
+	size_t used;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+
+	ndocs = bench_arg(argc, argv, 1, 1000000);
+	fragsz = bench_arg(argc, argv, 2, 64) * 1024;
+	if (ndocs <= 0 || fragsz <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_events(ndocs, &ends, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(ends);
+		free(doc);
+		return err;
+	}
+	printf("stream %zu bytes, %ld documents\n", docsz, ndocs);
+
+	/* unframed, read in fragments the way a pipe hands them over */
+	ndone = 0;
+	start = bench_now();
+	for (off = 0; err == 0 && off < docsz; off += len) {
+		const char *cp;
+		size_t left;
+
+		len = docsz - off;
+		if (len > (size_t) fragsz) {
+			len = fragsz;
+		}
+		cp = &doc[off];
+		for (left = len; left > 0; left -= used, cp += used) {
+			err = plist_txt_parse_next(txt, cp, left, &used);
+			if (err == EAGAIN) {
+				err = 0;
+				break;
+			}
+			if (err == 0) {
+				err = plist_txt_result(txt, &ptmp);
+			}
+			if (err != 0) {
+				break;
+			}
+			plist_free(ptmp);
+			ndone++;
+		}
+	}
+	if (err == 0 && ndone != ndocs) {
+		err = EIO;
+	}
+	if (err == 0) {
+		snprintf(label, sizeof(label), "txt-stream next %ldk",
+			 fragsz / 1024);
+		bench_report(label, docsz, 1, bench_now() - start);
+		printf("%-32s %10.0f docs/s\n", label,
+		       ndocs / (bench_now() - start));
+	}
+
+	/* framed outside the parser, one parse and result per document */
+	start = bench_now();
+	for (i = 0, off = 0; err == 0 && i < ndocs; off = ends[i++]) {
+		err = plist_txt_parse(txt, &doc[off], ends[i] - off);
+		if (err == 0) {
+			err = plist_txt_result(txt, &ptmp);
+		}
+		if (err == 0) {
+			plist_free(ptmp);
+		}
+	}
+	if (err == 0) {
+		bench_report("txt-stream framed", docsz, 1,
+			     bench_now() - start);
+		printf("%-32s %10.0f docs/s\n", "txt-stream framed",
+		       ndocs / (bench_now() - start));
+	}
+
+	plist_txt_free(txt);
+	free(ends);
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Generate the stream that every connection carries: small events with
+ * an occasional large one, like a crash report in a log stream.
+ */
+static char *
+_b_txt_connstream(long ndocs, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t docsz;
+	size_t off;
+
+	docsz = ndocs * 128 + (ndocs / 16 + 1) * 2100;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = 0;
+	for (i = 0; i < ndocs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"ts\" = %ld; \"level\" = \"info\"; "
+				"\"ms\" = %ld.%ld; \"msg\" = \"",
+				1700000000 + i, i % 500, i % 10);
+		if ((i % 16) == 15) {
+			memset(&doc[off], 'x', 2048);
+			off += 2048;
+		} else {
+			off += snprintf(&doc[off], docsz - off,
+					"request served");
+		}
+		off += snprintf(&doc[off], docsz - off, "\"; }\n");
+	}
+	*docszp = off;
+	return doc;
+}
+
+/**
+ * Drive nconns contexts over the stream in round robin, each reading
+ * small fragments of a slightly different size so that they are all
+ * in the middle of a document at once.
+ */
+static int
+_b_txt_conns_child(const char *label, int mode, long nconns,
+		   const char *doc, size_t docsz)
+{
+	int err;
+	int status;
+	long i;
+	long live;
+	pid_t pid;
+	size_t used;
+	size_t len;
+	size_t *offs;
+	double start;
+	plist_t *ptmp;
+	plist_txt_t **txts;
+	plist_txt_pool_t *pool;
+	struct rusage ru;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		return errno;
+	}
+	if (pid == 0) {
+		txts = calloc(nconns, sizeof(*txts));
+		offs = calloc(nconns, sizeof(*offs));
+		if (txts == NULL || offs == NULL) {
+			_exit(ENOMEM);
+		}
+		pool = NULL;
+		if (mode == 2 && plist_txt_pool_new(&pool, 256, 1024) != 0) {
+			_exit(ENOMEM);
+		}
+		for (i = 0; mode != 0 && i < nconns; i++) {
+			if (plist_txt_new(&txts[i]) != 0) {
+				_exit(ENOMEM);
+			}
+			plist_txt_setpool(txts[i], pool);
+		}
+		if (mode == 0) {
+			_exit(0);
+		}
+
+		err = 0;
+		start = bench_now();
+		for (live = nconns; err == 0 && live > 0; ) {
+			live = 0;
+			for (i = 0; i < nconns && err == 0; i++) {
+				if (offs[i] == docsz) {
+					continue;
+				}
+				live++;
+				len = 61 + (i % 13);
+				if (len > docsz - offs[i]) {
+					len = docsz - offs[i];
+				}
+				while (len > 0) {
+					err = plist_txt_parse_next(txts[i],
+					    &doc[offs[i]], len, &used);
+					offs[i] += used;
+					len -= used;
+					if (err == EAGAIN) {
+						err = 0;
+						break;
+					}
+					if (err == 0) {
+						err = plist_txt_result(txts[i],
+								       &ptmp);
+					}
+					if (err != 0) {
+						break;
+					}
+					plist_free(ptmp);
+				}
+			}
+		}
+		if (err != 0) {
+			_exit(err);
+		}
+		bench_report(label, docsz * nconns, 1, bench_now() - start);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		return errno;
+	}
+	printf("%-32s peak rss %ld KB\n", label, ru.ru_maxrss);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EINTR;
+}
+
+
+int
+b_txt_conns(int argc, char **argv)
+{
+	int err;
+	long nconns;
+	long ndocs;
+	char *doc;
+	size_t docsz;
+
+	nconns = bench_arg(argc, argv, 1, 100000);
+	ndocs = bench_arg(argc, argv, 2, 32);
+	if (nconns <= 0 || ndocs <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_connstream(ndocs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	printf("%ld connections, each %zu bytes in %ld documents\n",
+	       nconns, docsz, ndocs);
+
+	err = _b_txt_conns_child("input only", 0, nconns, doc, docsz);
+	if (err == 0) {
+		err = _b_txt_conns_child("txt-conns private", 1, nconns,
+					 doc, docsz);
+	}
+	if (err == 0) {
+		err = _b_txt_conns_child("txt-conns pooled", 2, nconns,
+					 doc, docsz);
+	}
+
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Generate an array that is nothing but short tokens of every kind so
+ * that the parse time is all dispatch and classification.
+ */
+static char *
+_b_txt_dense(long mbytes, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t want;
+	size_t docsz;
+	size_t off;
+
+	want = (size_t) mbytes * 1024 * 1024;
+	docsz = want + 256;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz, "( ");
+	for (i = 0; off < want; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"%ld, \"s%ld\", true, { \"k\" = -%ld; "
+				"\"v\" = ( %ld.5, false ) }, <%02lx>, ",
+				i % 1000, i % 10, i % 7, i % 100, i & 0xff);
+	}
+	off += snprintf(&doc[off], docsz - off, "0 )");
+	*docszp = off;
+	return doc;
+}
+
+
+int
+b_txt_dense(int argc, char **argv)
+{
+	int i;
+	int err;
+	int cerr;
+	long mbytes;
+	long nevents;
+	char *doc;
+	size_t docsz;
+	double start;
+	double best;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	bench_counters_t bc;
+
+	mbytes = bench_arg(argc, argv, 1, 32);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_dense(mbytes, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+
+	/* the events alone, best of five */
+	best = 0;
+	nevents = 0;
+	for (i = 0; err == 0 && i < 5; i++) {
+		nevents = 0;
+		start = bench_now();
+		err = plist_txt_sax_parse(txt, &b_sax_count, &nevents,
+					  doc, docsz);
+		start = bench_now() - start;
+		plist_txt_reset(txt);
+		if (best == 0 || start < best) {
+			best = start;
+		}
+	}
+	if (err == 0) {
+		printf("document %zu bytes, %ld events\n", docsz, nevents);
+		bench_report("txt-dense events", docsz, 1, best);
+		printf("%-32s %10.1f Mevents/s\n", "txt-dense events",
+		       nevents / best / 1e6);
+
+		cerr = bench_counters_start(&bc);
+		err = plist_txt_sax_parse(txt, &b_sax_count, &nevents,
+					  doc, docsz);
+		plist_txt_reset(txt);
+		bench_counters_stop(&bc);
+		if (cerr == 0) {
+			printf("%-32s %10.2f instr/byte %10.4f misses/byte\n",
+			       "txt-dense events",
+			       (double) bc.bc_instr / docsz,
+			       (double) bc.bc_miss / docsz);
+		} else {
+			printf("%-32s counters unavailable: %s\n",
+			       "txt-dense events", strerror(cerr));
+		}
+	}
+
+	/* and with the tree */
+	if (err == 0) {
+		start = bench_now();
+		err = _b_txt_feed(txt, doc, docsz, docsz, &ptmp);
+		if (err == 0) {
+			bench_report("txt-dense tree", docsz, 1,
+				     bench_now() - start);
+			plist_free(ptmp);
+		}
+	}
+
+	plist_txt_free(txt);
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Generate a configuration style document with a few small sections
+ * around one large array of records, about kbytes in size.
+ */
+static char *
+_b_txt_sections(long kbytes, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t want;
+	size_t docsz;
+	size_t off;
+
+	want = (size_t) kbytes * 1024;
+	docsz = want + 1024;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz,
+		       "{ \"header\" = { \"version\" = 3; \"build\" = \"r1234\"; "
+		       "\"owner\" = \"ops\"; \"flags\" = ( \"a\", \"b\" ) }; "
+		       "\"records\" = ( ");
+	for (i = 0; off < want; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"name\" = \"host%ld\"; "
+				"\"load\" = %ld.%02ld; \"up\" = true; "
+				"\"mac\" = <0011 2233 %04lx>; "
+				"\"tags\" = ( \"a\", \"b\" ) }, ",
+				i, i, i % 100, i % 97, i & 0xffff);
+	}
+	off += snprintf(&doc[off], docsz - off,
+			"); \"stats\" = { \"count\" = %ld; \"mean\" = 0.5 }; "
+			"\"footer\" = { \"checksum\" = <deadbeef> } }", i);
+	*docszp = off;
+	return doc;
+}
+
+/**
+ * Follow a key path through the dictionaries of a tree
+ */
+static const plist_t *
+_b_txt_lookup(const plist_t *plist, const char *path)
+{
+	char key[64];
+	const char *ep;
+	const plist_t *ptmp;
+
+	while (plist != NULL && path[0] != '\0') {
+		ep = strchr(path, '/');
+		if (ep == NULL) {
+			ep = &path[strlen(path)];
+		}
+		snprintf(key, sizeof(key), "%.*s", (int) (ep - path), path);
+		path = (ep[0] == '/') ? &ep[1] : ep;
+
+		if (plist_iselem(plist, PLIST_DICT) == false) {
+			return NULL;
+		}
+		ptmp = NULL;
+		TAILQ_FOREACH(ptmp, &plist->p_dict.pd_keys, p_entry) {
+			if (strcmp(ptmp->p_key.pk_name, key) == 0) {
+				break;
+			}
+		}
+		plist = (ptmp != NULL) ? ptmp->p_key.pk_value : NULL;
+	}
+	return plist;
+}
+
+
+int
+b_txt_paths(int argc, char **argv)
+{
+	static const char *const paths[] = {
+		"header/version", "header/build", "stats/count",
+		"stats/mean", "footer/checksum"
+	};
+	int i;
+	int j;
+	int err;
+	int pass;
+	int found;
+	long kbytes;
+	long iters;
+	char *doc;
+	size_t docsz;
+	double start;
+	double secs;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	plist_txt_paths_t *pp;
+
+	kbytes = bench_arg(argc, argv, 1, 2048);
+	if (kbytes <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_sections(kbytes, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_txt_paths_new(&pp, (const char *const *) paths, 5);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		plist_txt_paths_free(pp);
+		free(doc);
+		return err;
+	}
+
+	/* about 256 MB of input for each way */
+	iters = (256L * 1024 * 1024) / docsz + 1;
+	printf("document %zu bytes, %d paths, %ld iterations\n",
+	       docsz, 5, iters);
+
+	for (pass = 0; err == 0 && pass < 2; pass++) {
+		plist_txt_setpaths(txt, (pass == 0) ? NULL : pp);
+		found = 0;
+		start = bench_now();
+		for (i = 0; err == 0 && i < iters; i++) {
+			err = plist_txt_parse(txt, doc, docsz);
+			if (err == 0) {
+				err = plist_txt_result(txt, &ptmp);
+			}
+			if (err != 0) {
+				break;
+			}
+			for (j = 0; j < 5; j++) {
+				found += (_b_txt_lookup(ptmp, paths[j]) != NULL);
+			}
+			plist_free(ptmp);
+		}
+		secs = bench_now() - start;
+		if (err == 0 && found != 5 * iters) {
+			err = ENOENT;
+		}
+		if (err == 0) {
+			bench_report((pass == 0) ?
+				     "txt-paths full + lookup" :
+				     "txt-paths projected + lookup",
+				     docsz, iters, secs);
+		}
+	}
+
+	plist_txt_free(txt);
+	plist_txt_paths_free(pp);
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Pull every token from the record document with the input fed in
+ * fragments of fragsz bytes and count them.
+ */
+static int
+_b_txt_pull(plist_txt_t *txt, const char *doc, size_t docsz, size_t fragsz,
+	    long *ntokensp)
+{
+	int err;
+	size_t off;
+	size_t len;
+	plist_txt_token_t tok;
+
+	err = ENOENT;
+	for (off = 0; off < docsz; off += len) {
+		len = (docsz - off < fragsz) ? docsz - off : fragsz;
+		err = plist_txt_feed(txt, &doc[off], len);
+		if (err != 0) {
+			break;
+		}
+		while ((err = plist_txt_next_token(txt, &tok)) == 0) {
+			(*ntokensp)++;
+		}
+		if (err != EAGAIN) {
+			break;
+		}
+	}
+	plist_txt_reset(txt);
+	return (err == ENOENT) ? 0 : err;
+}
+
+
+int
+b_txt_tokens(int argc, char **argv)
+{
+	int i;
+	int err;
+	int iters;
+	long nrecs;
+	long fragkb;
+	long ntokens;
+	char *doc;
+	size_t docsz;
+	double secs;
+	double start;
+	plist_txt_t *txt;
+
+	nrecs = bench_arg(argc, argv, 1, 100000);
+	fragkb = bench_arg(argc, argv, 2, 64);
+	if (nrecs <= 0 || fragkb <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_records(nrecs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+
+	iters = 5;
+	ntokens = 0;
+	start = bench_now();
+	for (i = 0; i < iters && err == 0; i++) {
+		err = _b_txt_pull(txt, doc, docsz, fragkb * 1024, &ntokens);
+	}
+	secs = bench_now() - start;
+	if (err == 0) {
+		bench_report("txt-tokens pull", docsz, iters, secs);
+		printf("%-32s %10.1f Mtokens/s\n", "txt-tokens pull",
+		       ntokens / secs / 1e6);
+	}
+
+	ntokens = 0;
+	start = bench_now();
+	for (i = 0; i < iters && err == 0; i++) {
+		err = plist_txt_sax_parse(txt, &b_sax_count, &ntokens,
+					  doc, docsz);
+		plist_txt_reset(txt);
+	}
+	secs = bench_now() - start;
+	if (err == 0) {
+		bench_report("txt-tokens events", docsz, iters, secs);
+		printf("%-32s %10.1f Mtokens/s\n", "txt-tokens events",
+		       ntokens / secs / 1e6);
+	}
+
+	plist_txt_free(txt);
+	free(doc);
+	return err;
+}
+
+
+int
+b_txt_parallel(int argc, char **argv)
+{
+	int i;
+	int err;
+	int nthreads;
+	long nrecs;
+	long maxthreads;
+	char *doc;
+	size_t docsz;
+	double secs;
+	double base;
+	double start;
+	char label[32];
+	plist_t *ptmp;
+	plist_txt_t *txt;
+
+	nrecs = bench_arg(argc, argv, 1, 200000);
+	maxthreads = bench_arg(argc, argv, 2, 64);
+	if (nrecs <= 0 || maxthreads <= 0) {
+		return EINVAL;
+	}
+	doc = _b_txt_records(nrecs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+	printf("document %zu bytes, %ld records, %ld processors\n", docsz,
+	       nrecs, sysconf(_SC_NPROCESSORS_ONLN));
+
+	base = 0;
+	for (nthreads = 1; nthreads <= maxthreads && err == 0;
+	     nthreads *= 2) {
+		/* best of a few runs so every thread has warm arenas */
+		secs = 0;
+		for (i = 0; i < 3 && err == 0; i++) {
+			start = bench_now();
+			err = plist_txt_parse_parallel(txt, doc, docsz,
+						       nthreads);
+			if (err == 0) {
+				err = plist_txt_result(txt, &ptmp);
+			}
+			if (secs == 0 || bench_now() - start < secs) {
+				secs = bench_now() - start;
+			}
+			if (err == 0) {
+				plist_free(ptmp);
+			}
+		}
+		if (err != 0) {
+			break;
+		}
+
+		if (base == 0) {
+			base = secs;
+		}
+		snprintf(label, sizeof(label), "txt-parallel %d threads",
+			 nthreads);
+		bench_report(label, docsz, 1, secs);
+		printf("%-32s %10.2fx\n", label, base / secs);
+	}
+
+	plist_txt_free(txt);
+	free(doc);
+	return err;
+}
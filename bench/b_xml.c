@@ -0,0 +1,634 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_xml.c
+ *
+ * Benchmarks for the XML plist reader and writer, the reader against
+ * libxml2 when configure found it. The libxml2 baseline is what a reader built on it does:
+ * the document into a DOM and the DOM into plist objects, and a SAX
+ * pass with empty callbacks for the cost of the tokenizer alone.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef BENCH_XML2
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#endif
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_xml.h"
+#include "bench.h"
+
+#define B_XML_RECSZ  (512)	/* upper bound of bytes per record */
+
+/* events seen by the counting sinks */
+static long _b_xml_events;
+
+
+static char *
+_b_xml_doc(long nrecs, size_t *docszp)
+{
+	long i;
+	char *doc;
+	size_t off;
+	size_t docsz;
+
+	docsz = nrecs * B_XML_RECSZ + 512;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return NULL;
+	}
+	off = snprintf(doc, docsz,
+		       "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		       "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\""
+		       " \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+		       "<plist version=\"1.0\">\n<array>\n");
+	for (i = 0; i < nrecs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"\t<dict>\n"
+				"\t\t<key>id</key>\n"
+				"\t\t<integer>%ld</integer>\n"
+				"\t\t<key>name</key>\n"
+				"\t\t<string>rec%08ld &amp; co</string>\n"
+				"\t\t<key>score</key>\n"
+				"\t\t<real>%ld.%ld</real>\n"
+				"\t\t<key>up</key>\n"
+				"\t\t<true/>\n"
+				"\t\t<key>blob</key>\n"
+				"\t\t<data>AAECAwQFBgcICQ==</data>\n"
+				"\t\t<key>tags</key>\n"
+				"\t\t<array>\n"
+				"\t\t\t<string>alpha</string>\n"
+				"\t\t\t<string>beta</string>\n"
+				"\t\t</array>\n"
+				"\t</dict>\n",
+				i, i, i / 2, (i % 2) * 5);
+	}
+	off += snprintf(&doc[off], docsz - off, "</array>\n</plist>\n");
+	*docszp = off;
+	return doc;
+}
+
+static int
+_b_xml_count(void *arg)
+{
+	(void) arg;
+
+	_b_xml_events++;
+	return 0;
+}
+
+static int
+_b_xml_count_str(void *arg, const char *s, size_t len)
+{
+	(void) arg;
+	(void) s;
+	(void) len;
+
+	_b_xml_events++;
+	return 0;
+}
+
+static int
+_b_xml_count_int(void *arg, long long num)
+{
+	(void) arg;
+	(void) num;
+
+	_b_xml_events++;
+	return 0;
+}
+
+static int
+_b_xml_count_real(void *arg, double num)
+{
+	(void) arg;
+	(void) num;
+
+	_b_xml_events++;
+	return 0;
+}
+
+static int
+_b_xml_count_bool(void *arg, bool flag)
+{
+	(void) arg;
+	(void) flag;
+
+	_b_xml_events++;
+	return 0;
+}
+
+static int
+_b_xml_count_data(void *arg, const void *buf, size_t sz)
+{
+	(void) arg;
+	(void) buf;
+	(void) sz;
+
+	_b_xml_events++;
+	return 0;
+}
+
+static const plist_txt_sax_t _b_xml_counter = {
+	.psx_begin_dict = _b_xml_count,
+	.psx_end_dict = _b_xml_count,
+	.psx_key = _b_xml_count_str,
+	.psx_begin_array = _b_xml_count,
+	.psx_end_array = _b_xml_count,
+	.psx_string = _b_xml_count_str,
+	.psx_integer = _b_xml_count_int,
+	.psx_real = _b_xml_count_real,
+	.psx_boolean = _b_xml_count_bool,
+	.psx_data = _b_xml_count_data,
+};
+
+/**
+ * Feed the document in fragments of fragsz, building the tree when
+ * sax is NULL
+ */
+static int
+_b_xml_parse(plist_xml_t *xml, const plist_txt_sax_t *sax, const char *doc,
+	     size_t docsz, size_t fragsz, plist_t **plistpp)
+{
+	int err;
+	size_t n;
+	size_t off;
+
+	err = 0;
+	for (off = 0; err == 0 && off < docsz; off += n) {
+		n = (docsz - off < fragsz) ? docsz - off : fragsz;
+		if (sax == NULL) {
+			err = plist_xml_parse(xml, &doc[off], n);
+		} else {
+			err = plist_xml_sax_parse(xml, sax, NULL,
+						  &doc[off], n);
+		}
+	}
+	if (err == 0 && sax == NULL) {
+		return plist_xml_result(xml, plistpp);
+	}
+	if (err == 0 && xml->px_state != PLIST_XML_STATE_DONE) {
+		err = ENOENT;
+	}
+	plist_xml_reset(xml);
+	return err;
+}
+
+
+#ifdef BENCH_XML2
+
+static const uint8_t _b_xml_b64[256] = {
+	['A'] = 1, ['B'] = 2, ['C'] = 3, ['D'] = 4, ['E'] = 5, ['F'] = 6,
+	['G'] = 7, ['H'] = 8, ['I'] = 9, ['J'] = 10, ['K'] = 11, ['L'] = 12,
+	['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16, ['Q'] = 17,
+	['R'] = 18, ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22,
+	['W'] = 23, ['X'] = 24, ['Y'] = 25, ['Z'] = 26,
+	['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30, ['e'] = 31,
+	['f'] = 32, ['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36,
+	['k'] = 37, ['l'] = 38, ['m'] = 39, ['n'] = 40, ['o'] = 41,
+	['p'] = 42, ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46,
+	['u'] = 47, ['v'] = 48, ['w'] = 49, ['x'] = 50, ['y'] = 51,
+	['z'] = 52, ['0'] = 53, ['1'] = 54, ['2'] = 55, ['3'] = 56,
+	['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60, ['8'] = 61,
+	['9'] = 62, ['+'] = 63, ['/'] = 64,
+};
+
+static int
+_b_xml2_data(const char *s, plist_t **plistpp)
+{
+	int err;
+	int bits;
+	uint32_t acc;
+	uint8_t *buf;
+	size_t n;
+
+	buf = malloc(strlen(s) + 1);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	n = 0;
+	acc = 0;
+	bits = 0;
+	for (; *s != '\0'; s++) {
+		if (_b_xml_b64[(unsigned char) *s] == 0) {
+			continue;
+		}
+		acc = (acc << 6) | (_b_xml_b64[(unsigned char) *s] - 1);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			buf[n++] = acc >> bits;
+		}
+	}
+	err = plist_data_new(plistpp, buf, n);
+	free(buf);
+	return err;
+}
+
+static xmlNodePtr
+_b_xml2_next(xmlNodePtr node)
+{
+	while (node != NULL && node->type != XML_ELEMENT_NODE) {
+		node = node->next;
+	}
+	return node;
+}
+
+/**
+ * Convert a DOM element into plist objects
+ */
+static int
+_b_xml2_node(xmlNodePtr node, plist_t **plistpp)
+{
+	int err;
+	char *text;
+	const char *name = (const char *) node->name;
+	xmlNodePtr child;
+	plist_t *ptmp;
+
+	if (strcmp(name, "dict") == 0 || strcmp(name, "array") == 0) {
+		bool isdict = (name[1] == 'i');
+
+		err = isdict ? plist_dict_new(plistpp) :
+		    plist_array_new(plistpp);
+		child = _b_xml2_next(node->children);
+		while (err == 0 && child != NULL) {
+			text = NULL;
+			if (isdict) {
+				text = (char *) xmlNodeGetContent(child);
+				child = _b_xml2_next(child->next);
+				if (child == NULL) {
+					err = EINVAL;
+				}
+			}
+			if (err == 0) {
+				err = _b_xml2_node(child, &ptmp);
+			}
+			if (err == 0) {
+				err = isdict ?
+				    plist_dict_set(*plistpp, text, ptmp) :
+				    plist_array_append(*plistpp, ptmp);
+			}
+			xmlFree(text);
+			if (child != NULL) {
+				child = _b_xml2_next(child->next);
+			}
+		}
+		if (err != 0) {
+			plist_free(*plistpp);
+		}
+		return err;
+	}
+	if (strcmp(name, "true") == 0 || strcmp(name, "false") == 0) {
+		return plist_boolean_new(plistpp, name[0] == 't');
+	}
+
+	text = (char *) xmlNodeGetContent(node);
+	if (text == NULL) {
+		return ENOMEM;
+	}
+	if (strcmp(name, "string") == 0) {
+		err = plist_string_new(plistpp, text);
+	} else if (strcmp(name, "integer") == 0) {
+		err = plist_integer_new(plistpp, strtoll(text, NULL, 10));
+	} else if (strcmp(name, "real") == 0) {
+		err = plist_real_new(plistpp, strtod(text, NULL));
+	} else if (strcmp(name, "data") == 0) {
+		err = _b_xml2_data(text, plistpp);
+	} else {
+		err = EINVAL;
+	}
+	xmlFree(text);
+	return err;
+}
+
+static int
+_b_xml2_tree(const char *doc, size_t docsz, plist_t **plistpp)
+{
+	int err;
+	xmlDocPtr xdoc;
+	xmlNodePtr node;
+
+	xdoc = xmlReadMemory(doc, docsz, NULL, NULL, XML_PARSE_NONET);
+	if (xdoc == NULL) {
+		return EINVAL;
+	}
+	node = xmlDocGetRootElement(xdoc);
+	node = (node != NULL) ? _b_xml2_next(node->children) : NULL;
+	err = (node != NULL) ? _b_xml2_node(node, plistpp) : EINVAL;
+	xmlFreeDoc(xdoc);
+	return err;
+}
+
+static void
+_b_xml2_start(void *ctx, const xmlChar *name, const xmlChar *prefix,
+	      const xmlChar *uri, int nns, const xmlChar **ns,
+	      int nattrs, int ndefaulted, const xmlChar **attrs)
+{
+	(void) ctx;
+	(void) name;
+	(void) prefix;
+	(void) uri;
+	(void) nns;
+	(void) ns;
+	(void) nattrs;
+	(void) ndefaulted;
+	(void) attrs;
+
+	_b_xml_events++;
+}
+
+static void
+_b_xml2_end(void *ctx, const xmlChar *name, const xmlChar *prefix,
+	    const xmlChar *uri)
+{
+	(void) ctx;
+	(void) name;
+	(void) prefix;
+	(void) uri;
+
+	_b_xml_events++;
+}
+
+static void
+_b_xml2_chars(void *ctx, const xmlChar *ch, int len)
+{
+	(void) ctx;
+	(void) ch;
+	(void) len;
+
+	_b_xml_events++;
+}
+
+static int
+_b_xml2_sax(const char *doc, size_t docsz, size_t fragsz)
+{
+	int err;
+	size_t n;
+	size_t off;
+	xmlSAXHandler sax;
+	xmlParserCtxtPtr ctxt;
+
+	memset(&sax, 0, sizeof(sax));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = _b_xml2_start;
+	sax.endElementNs = _b_xml2_end;
+	sax.characters = _b_xml2_chars;
+
+	ctxt = xmlCreatePushParserCtxt(&sax, NULL, NULL, 0, NULL);
+	if (ctxt == NULL) {
+		return ENOMEM;
+	}
+	err = 0;
+	for (off = 0; err == 0 && off < docsz; off += n) {
+		n = (docsz - off < fragsz) ? docsz - off : fragsz;
+		err = xmlParseChunk(ctxt, &doc[off], n, 0);
+	}
+	if (err == 0) {
+		err = xmlParseChunk(ctxt, NULL, 0, 1);
+	}
+	err = (err == 0 && ctxt->wellFormed) ? 0 : EINVAL;
+	xmlFreeParserCtxt(ctxt);
+	return err;
+}
+
+#endif /* BENCH_XML2 */
+
+
+int
+b_xml_read(int argc, char **argv)
+{
+	int err;
+	int pass;
+	long mbytes;
+	long nrecs;
+	size_t fragsz;
+	size_t docsz;
+	char *doc;
+	double start;
+	plist_t *ptmp;
+	plist_t *ptmp2;
+	plist_xml_t *xml;
+
+	mbytes = bench_arg(argc, argv, 1, 16);
+	fragsz = bench_arg(argc, argv, 2, 64) * 1024;
+	if (mbytes <= 0 || fragsz == 0) {
+		return EINVAL;
+	}
+	nrecs = mbytes * 1024 * 1024 / 330;
+	doc = _b_xml_doc(nrecs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_xml_new(&xml);
+	if (err != 0) {
+		free(doc);
+		return err;
+	}
+	printf("document %zu bytes, %ld records, %zu byte fragments\n",
+	       docsz, nrecs, fragsz);
+
+	/* the tree, built once first so that the heap is warm */
+	ptmp = NULL;
+	for (pass = 0; err == 0 && pass < 2; pass++) {
+		plist_free(ptmp);
+		start = bench_now();
+		err = _b_xml_parse(xml, NULL, doc, docsz, fragsz, &ptmp);
+		if (err == 0 && pass == 1) {
+			bench_report("xml to plist", docsz, 1,
+				     bench_now() - start);
+		}
+	}
+
+	/* events only, for the cost of the tokenizer */
+	if (err == 0) {
+		_b_xml_events = 0;
+		start = bench_now();
+		err = _b_xml_parse(xml, &_b_xml_counter, doc, docsz, fragsz,
+				   NULL);
+		if (err == 0) {
+			bench_report("xml events", docsz, 1,
+				     bench_now() - start);
+		}
+	}
+
+#ifdef BENCH_XML2
+	xmlInitParser();
+	for (pass = 0; err == 0 && pass < 2; pass++) {
+		start = bench_now();
+		err = _b_xml2_tree(doc, docsz, &ptmp2);
+		if (err == 0 && pass == 1) {
+			bench_report("libxml2 dom to plist", docsz, 1,
+				     bench_now() - start);
+			if (!plist_isequal(ptmp, ptmp2)) {
+				err = EINVAL;
+			}
+		}
+		if (err == 0) {
+			plist_free(ptmp2);
+		}
+	}
+	if (err == 0) {
+		start = bench_now();
+		err = _b_xml2_sax(doc, docsz, fragsz);
+		if (err == 0) {
+			bench_report("libxml2 sax events", docsz, 1,
+				     bench_now() - start);
+		}
+	}
+	xmlCleanupParser();
+#else
+	(void) ptmp2;
+	printf("libxml2 baseline not configured\n");
+#endif
+
+	plist_free(ptmp);
+	plist_xml_free(xml);
+	free(doc);
+	return err;
+}
+
+
+/**
+ * Time writing a tree into a buffer and out through a descriptor
+ */
+static int
+_b_xml_write(const char *name, const plist_t *plist)
+{
+	int fd;
+	int err;
+	void *buf;
+	size_t sz;
+	double start;
+	char label[48];
+
+	start = bench_now();
+	err = plist_xml_write_buf(plist, &buf, &sz);
+	if (err != 0) {
+		return err;
+	}
+	snprintf(label, sizeof(label), "%s to buffer", name);
+	bench_report(label, sz, 1, bench_now() - start);
+	free(buf);
+
+	fd = open("/dev/null", O_WRONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	start = bench_now();
+	err = plist_xml_write(plist, fd);
+	if (err == 0) {
+		snprintf(label, sizeof(label), "%s to fd", name);
+		bench_report(label, sz, 1, bench_now() - start);
+	}
+	close(fd);
+	return err;
+}
+
+
+int
+b_xml_write(int argc, char **argv)
+{
+	int err;
+	long i;
+	long mbytes;
+	long nrecs;
+	size_t docsz;
+	char *doc;
+	char str[64];
+	plist_t *ptmp;
+	plist_t *ptmp2;
+	plist_xml_t *xml;
+
+	mbytes = bench_arg(argc, argv, 1, 16);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+
+	/* records, mostly markup and short values */
+	nrecs = mbytes * 1024 * 1024 / 330;
+	doc = _b_xml_doc(nrecs, &docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	err = plist_xml_new(&xml);
+	if (err == 0) {
+		err = _b_xml_parse(xml, NULL, doc, docsz, docsz, &ptmp);
+		plist_xml_free(xml);
+	}
+	free(doc);
+	if (err != 0) {
+		return err;
+	}
+	err = _b_xml_write("records", ptmp);
+	plist_free(ptmp);
+
+	/* one large data element, which is all base64 */
+	if (err == 0) {
+		doc = malloc(mbytes * 1024 * 1024);
+		if (doc == NULL) {
+			return ENOMEM;
+		}
+		for (i = 0; i < mbytes * 1024 * 1024; i++) {
+			doc[i] = i * 31;
+		}
+		err = plist_data_ref_new(&ptmp, doc, mbytes * 1024 * 1024);
+		if (err == 0) {
+			err = _b_xml_write("data", ptmp);
+			plist_free(ptmp);
+		}
+		free(doc);
+	}
+
+	/* a huge array of strings with a reference in each */
+	if (err == 0) {
+		err = plist_array_new(&ptmp);
+	}
+	for (i = 0; err == 0 && i < mbytes * 1024 * 1024 / 80; i++) {
+		snprintf(str, sizeof(str), "string number %08ld with an "
+			 "ampersand & in it", i);
+		err = plist_string_new(&ptmp2, str);
+		if (err == 0) {
+			err = plist_array_append(ptmp, ptmp2);
+		}
+	}
+	if (err == 0) {
+		err = _b_xml_write("strings", ptmp);
+	}
+	plist_free(ptmp);
+	return err;
+}
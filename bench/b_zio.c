@@ -0,0 +1,172 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file b_zio.c
+ *
+ * Benchmarks for reading and writing compressed text documents, with
+ * the same document read uncompressed for a reference. Decoding runs on
+ * its own thread, so a compressed read should take about as long as
+ * the slower of decoding and parsing rather than both added together.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "plist.h"
+#include "plist_io.h"
+#include "bench.h"
+
+#define B_ZIO_RECSZ  (160)	/* upper bound of bytes per record */
+
+
+static int
+_b_zio_records(long mbytes, plist_t **plistpp)
+{
+	int err;
+	long i;
+	long nrecs;
+	char *doc;
+	size_t off;
+	size_t docsz;
+
+	nrecs = mbytes * 1024 * 1024 / (B_ZIO_RECSZ / 2);
+	docsz = nrecs * B_ZIO_RECSZ + 16;
+	doc = malloc(docsz);
+	if (doc == NULL) {
+		return ENOMEM;
+	}
+	off = snprintf(doc, docsz, "( ");
+	for (i = 0; i < nrecs; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %ld; \"name\" = \"host%ld\"; "
+				"\"load\" = %ld.%02ld; \"up\" = true; "
+				"\"mac\" = <0011 2233 %04lx> }, ",
+				i, i, i % 100, i % 97, i & 0xffff);
+	}
+	off += snprintf(&doc[off], docsz - off, "\"end\" )");
+	err = plist_read_buf(doc, off, 0, plistpp);
+	free(doc);
+	return err;
+}
+
+static int
+_b_zio_read(const char *label, const char *path, size_t docsz)
+{
+	int err;
+	double start;
+	plist_t *ptmp;
+
+	start = bench_now();
+	err = plist_read_file(path, 0, &ptmp);
+	if (err != 0) {
+		return err;
+	}
+	if (label != NULL) {
+		bench_report(label, docsz, 1, bench_now() - start);
+	}
+	plist_free(ptmp);
+	return 0;
+}
+
+
+int
+b_zio_read(int argc, char **argv)
+{
+	int fd;
+	int err;
+	long mbytes;
+	char path[] = "/tmp/plist_bench.XXXXXX";
+	char name[64];
+	double start;
+	size_t docsz;
+	struct stat st;
+	plist_t *plist;
+	enum plist_compress_e comp;
+	static const char *labels[] = { "plain", "gzip", "zstd" };
+
+	mbytes = bench_arg(argc, argv, 1, 64);
+	if (mbytes <= 0) {
+		return EINVAL;
+	}
+	err = _b_zio_records(mbytes, &plist);
+	if (err != 0) {
+		return err;
+	}
+	fd = mkstemp(path);
+	if (fd < 0) {
+		plist_free(plist);
+		return errno;
+	}
+	close(fd);
+
+	err = plist_write_file(plist, PLIST_FORMAT_TEXT, path);
+	if (err == 0 && stat(path, &st) != 0) {
+		err = errno;
+	}
+	docsz = st.st_size;
+	if (err == 0) {
+		printf("document %zu bytes\n", docsz);
+
+		/* the first tree in the process pays for growing the heap */
+		err = _b_zio_read(NULL, path, docsz);
+	}
+	if (err == 0) {
+		err = _b_zio_read("zio read plain", path, docsz);
+	}
+
+	for (comp = PLIST_COMPRESS_GZIP;
+	     err == 0 && comp <= PLIST_COMPRESS_ZSTD; comp++) {
+		if (!plist_compress_available(comp)) {
+			printf("%s not built in\n", labels[comp]);
+			continue;
+		}
+		start = bench_now();
+		err = plist_write_compressed_file(plist, PLIST_FORMAT_TEXT,
+						  comp, 0, path);
+		if (err == 0 && stat(path, &st) != 0) {
+			err = errno;
+		}
+		if (err != 0) {
+			break;
+		}
+		snprintf(name, sizeof(name), "zio write %s", labels[comp]);
+		bench_report(name, docsz, 1, bench_now() - start);
+		printf("%s %lld bytes\n", labels[comp], (long long) st.st_size);
+		snprintf(name, sizeof(name), "zio read %s", labels[comp]);
+		err = _b_zio_read(name, path, docsz);
+	}
+
+	unlink(path);
+	plist_free(plist);
+	return err;
+}
@@ -0,0 +1,156 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file bench.h
+ *
+ * Shared helpers for the benchmark driver. Each benchmark is a named
+ * entry point that takes its own optional arguments.
+ *
+ * @version $Id$
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <sys/cdefs.h>
+#include <stddef.h>
+
+/* forward declare */
+typedef struct bench_s bench_t;
+typedef struct bench_counters_s bench_counters_t;
+
+struct bench_s {
+	const char *b_name;
+	const char *b_descr;
+	int (*b_func)(int argc, char **argv);
+};
+
+/* hardware counters for the calling thread, where the kernel has them */
+struct bench_counters_s {
+	int bc_instrfd;
+	int bc_missfd;
+	long long bc_instr;
+	long long bc_miss;
+};
+
+__BEGIN_DECLS
+
+/**
+ * Monotonic wall clock in seconds for timing a benchmark loop.
+ *
+ * @return current time in seconds
+ */
+double bench_now(void);
+
+/**
+ * Print one result line with the throughput of the measured loop.
+ *
+ * @param  name   label for the measurement
+ * @param  bytes  input bytes processed per iteration
+ * @param  iters  number of iterations
+ * @param  secs   elapsed time for all of the iterations
+ */
+void bench_report(const char *name, size_t bytes, size_t iters, double secs);
+
+/**
+ * Start counting retired instructions and branch misses for the calling
+ * thread. Virtual machines often do not expose the counters.
+ *
+ * @param  bc  counters to start
+ * @return zero on success or an error value when there are no counters
+ */
+int bench_counters_start(bench_counters_t *bc);
+
+/**
+ * Stop the counters and read them into bc_instr and bc_miss.
+ *
+ * @param  bc  counters that were started with #bench_counters_start
+ */
+void bench_counters_stop(bench_counters_t *bc);
+
+/**
+ * Parse a numeric argument or return the default when it is absent.
+ *
+ * @param  argc  argument count passed to the benchmark
+ * @param  argv  arguments passed to the benchmark
+ * @param  idx   index of the argument to convert
+ * @param  def   default value
+ * @return the converted value
+ */
+long bench_arg(int argc, char **argv, int idx, long def);
+
+/* text parser benchmarks */
+int b_txt_bigstr(int argc, char **argv);
+int b_txt_keys(int argc, char **argv);
+int b_txt_bigdict(int argc, char **argv);
+int b_txt_sax(int argc, char **argv);
+int b_txt_tokens(int argc, char **argv);
+int b_txt_parallel(int argc, char **argv);
+int b_txt_borrow(int argc, char **argv);
+int b_txt_stream(int argc, char **argv);
+int b_txt_conns(int argc, char **argv);
+int b_txt_dense(int argc, char **argv);
+int b_txt_paths(int argc, char **argv);
+
+/* structural index benchmarks */
+int b_idx_lookup(int argc, char **argv);
+
+/* file parsing benchmarks */
+int b_file_parse(int argc, char **argv);
+
+/* structure binding benchmarks */
+int b_bind_records(int argc, char **argv);
+
+/* generated decoder benchmarks */
+int b_gen_tlm(int argc, char **argv);
+
+/* binary plist benchmarks */
+int b_bpl_read(int argc, char **argv);
+int b_bpl_write(int argc, char **argv);
+
+/* XML reader benchmarks */
+int b_xml_read(int argc, char **argv);
+int b_xml_write(int argc, char **argv);
+
+/* flat plist benchmarks */
+int b_flat_lookup(int argc, char **argv);
+
+/* JSON reader and writer benchmarks */
+int b_json_read(int argc, char **argv);
+int b_json_write(int argc, char **argv);
+
+/* compressed stream benchmarks */
+int b_zio_read(int argc, char **argv);
+
+/* CBOR message benchmarks */
+int b_cbor_rtt(int argc, char **argv);
+
+/* dump benchmarks */
+int b_dump(int argc, char **argv);
+
+__END_DECLS
+
+#endif /* !_BENCH_H_ */
@@ -0,0 +1,241 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_bench.c
+ *
+ * Benchmark driver for the Property List POSIX library. Run without
+ * arguments to list the benchmarks, or name one followed by its
+ * optional arguments.
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "bench.h"
+
+
+static bench_t bench_table[] = {
+	{ "txt-bigstr", "[mbytes] [fragkb]: large string documents",
+	  b_txt_bigstr },
+	{ "txt-keys", "[ndicts]: arrays of small key-heavy records",
+	  b_txt_keys },
+	{ "txt-bigdict", "[nkeys] [trusted]: one large dictionary",
+	  b_txt_bigdict },
+	{ "txt-sax", "[nrecords]: event callbacks against tree building",
+	  b_txt_sax },
+	{ "txt-tokens", "[nrecords] [fragkb]: pull tokenizer token rate",
+	  b_txt_tokens },
+	{ "txt-parallel", "[nrecords] [maxthreads]: thread scaling",
+	  b_txt_parallel },
+	{ "txt-borrow", "[nservices]: peak memory of borrowed strings",
+	  b_txt_borrow },
+	{ "txt-stream", "[ndocs] [fragkb]: back to back documents",
+	  b_txt_stream },
+	{ "txt-conns", "[nconns] [ndocs]: many concurrent contexts",
+	  b_txt_conns },
+	{ "txt-dense", "[mbytes]: short tokens only, dispatch cost",
+	  b_txt_dense },
+	{ "txt-paths", "[kbytes]: five key paths against a full parse",
+	  b_txt_paths },
+	{ "idx-lookup", "[mbytes]: structural index time to first lookup",
+	  b_idx_lookup },
+	{ "file-parse", "[mbytes]: mapped, piped and slurped files",
+	  b_file_parse },
+	{ "bind-records", "[mbytes]: records into structures, tree or events",
+	  b_bind_records },
+	{ "gen-tlm", "[nrecords]: generated decoder for telemetry records",
+	  b_gen_tlm },
+	{ "bpl-read", "[mbytes]: binary plist open, lookup, walk, and tree",
+	  b_bpl_read },
+	{ "bpl-write", "[mbytes]: binary plist write and reload against text",
+	  b_bpl_write },
+	{ "xml-read", "[mbytes] [fragkb]: XML reader against libxml2",
+	  b_xml_read },
+	{ "xml-write", "[mbytes]: XML writer to a buffer and a descriptor",
+	  b_xml_write },
+	{ "flat-lookup", "[mbytes]: flat open to first lookup against text",
+	  b_flat_lookup },
+	{ "json-read", "[mbytes] [fragkb]: JSON reader on records and strings",
+	  b_json_read },
+	{ "json-write", "[mbytes]: JSON writer to a buffer and a descriptor",
+	  b_json_write },
+	{ "zio-read", "[mbytes]: compressed text read and write",
+	  b_zio_read },
+	{ "cbor-rtt", "[iters]: 4 KB message round trips against bpl and text",
+	  b_cbor_rtt },
+	{ "dump", "[mbytes]: plist_dump of data and records",
+	  b_dump },
+
+	{ NULL, NULL, NULL }
+};
+
+
+double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+void
+bench_report(const char *name, size_t bytes, size_t iters, double secs)
+{
+	double mb;
+
+	mb = (double) bytes * iters / (1024.0 * 1024.0);
+	printf("%-32s %8zu iters %10.3f ms/iter %10.1f MB/s\n",
+	       name, iters, secs * 1000.0 / iters,
+	       (secs > 0) ? mb / secs : 0.0);
+	return;
+}
+
+
+#ifdef __linux__
+static int
+_bench_counter_open(unsigned long long config, int group)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = (group < 0);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+
+int
+bench_counters_start(bench_counters_t *bc)
+{
+	memset(bc, 0, sizeof(*bc));
+	bc->bc_instrfd = -1;
+	bc->bc_missfd = -1;
+#ifdef __linux__
+	bc->bc_instrfd = _bench_counter_open(PERF_COUNT_HW_INSTRUCTIONS, -1);
+	if (bc->bc_instrfd < 0) {
+		return errno;
+	}
+	bc->bc_missfd = _bench_counter_open(PERF_COUNT_HW_BRANCH_MISSES,
+					    bc->bc_instrfd);
+	if (bc->bc_missfd < 0) {
+		int err = errno;
+
+		close(bc->bc_instrfd);
+		bc->bc_instrfd = -1;
+		return err;
+	}
+	ioctl(bc->bc_instrfd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(bc->bc_instrfd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+
+void
+bench_counters_stop(bench_counters_t *bc)
+{
+#ifdef __linux__
+	if (bc->bc_instrfd < 0) {
+		return;
+	}
+	ioctl(bc->bc_instrfd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	if (read(bc->bc_instrfd, &bc->bc_instr, sizeof(bc->bc_instr)) < 0) {
+		bc->bc_instr = 0;
+	}
+	if (read(bc->bc_missfd, &bc->bc_miss, sizeof(bc->bc_miss)) < 0) {
+		bc->bc_miss = 0;
+	}
+	close(bc->bc_missfd);
+	close(bc->bc_instrfd);
+	bc->bc_instrfd = -1;
+	bc->bc_missfd = -1;
+#endif
+	return;
+}
+
+
+long
+bench_arg(int argc, char **argv, int idx, long def)
+{
+	if (idx >= argc) {
+		return def;
+	}
+	return strtol(argv[idx], NULL, 0);
+}
+
+
+static void
+usage(const char *prog)
+{
+	bench_t *b;
+
+	fprintf(stderr, "usage: %s <bench> [args...]\n", prog);
+	for (b = bench_table; b->b_name != NULL; b++) {
+		fprintf(stderr, "  %-16s %s\n", b->b_name, b->b_descr);
+	}
+	return;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	bench_t *b;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (b = bench_table; b->b_name != NULL; b++) {
+		if (strcmp(argv[1], b->b_name) == 0) {
+			return b->b_func(argc - 1, &argv[1]);
+		}
+	}
+	usage(argv[0]);
+	return 1;
+}
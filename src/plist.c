@@ -37,7 +37,6 @@
 #include <sys/syslog.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -524,6 +523,31 @@ plist_data_new(plist_t **datapp, const void *buf, size_t bufsz)
 }
 
 
+int
+plist_data_ref_new(plist_t **datapp, const void *buf, size_t bufsz)
+{
+	INITRET(datapp);
+
+	plist_t *data;
+
+	if (!datapp || !buf) {
+		return EINVAL;
+	}
+
+	data = malloc(sizeof(*data));
+	if (data == NULL) {
+		return ENOMEM;
+	}
+	memset(data, 0, sizeof(*data));
+
+	data->p_elem = PLIST_DATA;
+	data->p_data.pd_datasz = bufsz;
+	data->p_data.pd_data = (void *) buf;
+	*datapp = data;
+	return 0;
+}
+
+
 int
 plist_date_new(plist_t **datepp, const struct tm *tm)
 {
@@ -553,6 +577,18 @@ plist_string_new(plist_t **stringpp, const char *s)
 {
 	INITRET(stringpp);
 
+	if (!stringpp || !s) {
+		return EINVAL;
+	}
+	return plist_nstring_new(stringpp, s, strlen(s));
+}
+
+
+int
+plist_nstring_new(plist_t **stringpp, const char *s, size_t len)
+{
+	INITRET(stringpp);
+
 	plist_t *string;
 	size_t sz;
 
@@ -561,7 +597,7 @@ plist_string_new(plist_t **stringpp, const char *s)
 	}
 
 	sz = sizeof(*string);
-	sz += strlen(s) + 1;
+	sz += len + 1;
 	string = malloc(sz);
 	if (string == NULL) {
 		return ENOMEM;
@@ -570,7 +606,32 @@ plist_string_new(plist_t **stringpp, const char *s)
 
 	string->p_elem = PLIST_STRING;
 	string->p_string.ps_str = (char *) &string[1];
-	memcpy(string->p_string.ps_str, s, strlen(s) + 1);
+	memcpy(string->p_string.ps_str, s, len);
+	string->p_string.ps_str[len] = '\0';
+	*stringpp = string;
+	return 0;
+}
+
+
+int
+plist_string_ref_new(plist_t **stringpp, const char *s)
+{
+	INITRET(stringpp);
+
+	plist_t *string;
+
+	if (!stringpp || !s) {
+		return EINVAL;
+	}
+
+	string = malloc(sizeof(*string));
+	if (string == NULL) {
+		return ENOMEM;
+	}
+	memset(string, 0, sizeof(*string));
+
+	string->p_elem = PLIST_STRING;
+	string->p_string.ps_str = (char *) s;
 	*stringpp = string;
 	return 0;
 }
@@ -1019,6 +1080,151 @@ plist_free(plist_t *plist)
 }
 
 
+/**
+ * Helper to find the storage that a string, key or data element refers
+ * to. Storage that the element owns is allocated along with it and
+ * starts right after the element.
+ */
+static const void *
+_plist_storage(const plist_t *plist, size_t *szp)
+{
+	switch (plist->p_elem) {
+	case PLIST_KEY:
+		*szp = strlen(plist->p_key.pk_name) + 1;
+		return plist->p_key.pk_name;
+	case PLIST_STRING:
+		*szp = strlen(plist->p_string.ps_str) + 1;
+		return plist->p_string.ps_str;
+	case PLIST_DATA:
+		*szp = plist->p_data.pd_datasz;
+		return plist->p_data.pd_data;
+	default:
+		break;
+	}
+	return NULL;
+}
+
+
+/**
+ * Helper to move an element with borrowed storage into new memory with
+ * a copy of the storage, putting the new element in its place in the
+ * tree. Any other element is passed back as it is.
+ */
+static int
+_plist_detach(plist_t *plist, plist_t **plistpp)
+{
+	size_t sz;
+	plist_t *copy;
+	plist_t *parent;
+	const void *buf;
+
+	buf = _plist_storage(plist, &sz);
+	if (buf == NULL || buf == (const void *) &plist[1]) {
+		*plistpp = plist;
+		return 0;
+	}
+
+	copy = malloc(sizeof(*copy) + sz);
+	if (copy == NULL) {
+		return ENOMEM;
+	}
+	memcpy(copy, plist, sizeof(*copy));
+	memcpy(&copy[1], buf, sz);
+	switch (copy->p_elem) {
+	case PLIST_KEY:
+		copy->p_key.pk_name = (char *) &copy[1];
+		if (copy->p_key.pk_value != NULL) {
+			copy->p_key.pk_value->p_parent = copy;
+		}
+		break;
+	case PLIST_STRING:
+		copy->p_string.ps_str = (char *) &copy[1];
+		break;
+	default:
+		copy->p_data.pd_data = &copy[1];
+		break;
+	}
+
+	parent = plist->p_parent;
+	if (parent != NULL) {
+		switch (parent->p_elem) {
+		case PLIST_DICT:
+			TAILQ_INSERT_AFTER(&parent->p_dict.pd_keys,
+					   plist, copy, p_entry);
+			TAILQ_REMOVE(&parent->p_dict.pd_keys, plist, p_entry);
+			break;
+		case PLIST_ARRAY:
+			TAILQ_INSERT_AFTER(&parent->p_array.pa_elems,
+					   plist, copy, p_entry);
+			TAILQ_REMOVE(&parent->p_array.pa_elems, plist, p_entry);
+			break;
+		case PLIST_KEY:
+			parent->p_key.pk_value = copy;
+			break;
+		default:
+			break;
+		}
+	}
+	free(plist);
+	*plistpp = copy;
+	return 0;
+}
+
+
+int
+plist_detach_storage(plist_t **plistpp)
+{
+	int err;
+	plist_t *top;
+	plist_t *pcur;
+	plist_t *pnext;
+
+	if (!plistpp || !*plistpp) {
+		return EINVAL;
+	}
+
+	top = *plistpp;
+	for (pcur = top; pcur != NULL; pcur = pnext) {
+		err = _plist_detach(pcur, &pnext);
+		if (err != 0) {
+			return err;
+		}
+		if (pcur == top) {
+			top = pnext;
+			*plistpp = top;
+		}
+		pcur = pnext;
+
+		/* descend into the children first */
+		switch (pcur->p_elem) {
+		case PLIST_KEY:
+			pnext = pcur->p_key.pk_value;
+			break;
+		case PLIST_DICT:
+			pnext = TAILQ_FIRST(&pcur->p_dict.pd_keys);
+			break;
+		case PLIST_ARRAY:
+			pnext = TAILQ_FIRST(&pcur->p_array.pa_elems);
+			break;
+		default:
+			pnext = NULL;
+			break;
+		}
+
+		/* then ascend until there is a next sibling */
+		while (pnext == NULL && pcur != top) {
+			if (pcur->p_parent->p_elem == PLIST_KEY) {
+				pcur = pcur->p_parent;
+				continue;
+			}
+			pnext = TAILQ_NEXT(pcur, p_entry);
+			pcur = pcur->p_parent;
+		}
+	}
+	return 0;
+}
+
+
 bool
 plist_iselem(const plist_t *plist, enum plist_elem_e elem)
 {
@@ -1296,73 +1502,240 @@ plist_next(plist_iterator_t *pi)
 }
 
 
+#define DUMP_BUFSZ      (16 * 1024)	/* output gathered for each write */
+#define DUMP_NUMELEM    (16)		/* data bytes on a line */
+#define DUMP_INDENTLEN  (8)
+
+/* longest data line, the offset, hex pairs, padding and characters */
+#define DUMP_LINESZ     (24 + (DUMP_NUMELEM + 1) * 3 + DUMP_NUMELEM)
+
+/* two hex digits for every byte value */
+static const char _plist_dump_hex[] =
+	"000102030405060708090a0b0c0d0e0f"
+	"101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f"
+	"303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f"
+	"505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f"
+	"707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f"
+	"909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+	"b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+	"d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+	"f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* the character shown for every byte value, a dot when not printable */
+static const char _plist_dump_print[] =
+	"................"
+	"................"
+	" !\"#$%&'()*+,-./"
+	"0123456789:;<=>?"
+	"@ABCDEFGHIJKLMNO"
+	"PQRSTUVWXYZ[\\]^_"
+	"`abcdefghijklmno"
+	"pqrstuvwxyz{|}~."
+	"................"
+	"................"
+	"................"
+	"................"
+	"................"
+	"................"
+	"................"
+	"................";
+
 /**
- * Do a hex dump style of a buffer when a count, hex value, and then
- * printable characters at the end.
+ * Output of a dump, gathered in a local buffer and handed to the
+ * function once per flush
+ */
+struct plist_dumpbuf_s {
+	int (*db_func)(void *arg, const void *buf, size_t len);
+	void *db_arg;
+	int db_err;
+	size_t db_fill;
+	char db_buf[DUMP_BUFSZ];
+};
+
+static void
+_plist_dump_flush(struct plist_dumpbuf_s *db)
+{
+	if (db->db_fill > 0 && db->db_err == 0) {
+		db->db_err = db->db_func(db->db_arg, db->db_buf, db->db_fill);
+	}
+	db->db_fill = 0;
+	return;
+}
+
+/**
+ * Make room for n bytes, which is never more than the buffer
+ */
+static inline char *
+_plist_dump_room(struct plist_dumpbuf_s *db, size_t n)
+{
+	if (sizeof(db->db_buf) - db->db_fill < n) {
+		_plist_dump_flush(db);
+	}
+	return &db->db_buf[db->db_fill];
+}
+
+static void
+_plist_dump_bytes(struct plist_dumpbuf_s *db, const void *buf, size_t len)
+{
+	size_t n;
+	const char *cp = buf;
+
+	while (len > 0) {
+		if (db->db_fill == sizeof(db->db_buf)) {
+			_plist_dump_flush(db);
+		}
+		n = sizeof(db->db_buf) - db->db_fill;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(&db->db_buf[db->db_fill], cp, n);
+		db->db_fill += n;
+		cp += n;
+		len -= n;
+	}
+	return;
+}
+
+static void
+_plist_dump_indent(struct plist_dumpbuf_s *db, size_t len)
+{
+	size_t n;
+
+	while (len > 0) {
+		if (db->db_fill == sizeof(db->db_buf)) {
+			_plist_dump_flush(db);
+		}
+		n = sizeof(db->db_buf) - db->db_fill;
+		if (n > len) {
+			n = len;
+		}
+		memset(&db->db_buf[db->db_fill], ' ', n);
+		db->db_fill += n;
+		len -= n;
+	}
+	return;
+}
+
+/**
+ * Write a formatted value, which is tried in the room of a line and
+ * formatted again when it is longer, such as a large real
  */
 static void
-_datadump(FILE *fp, const void *buf, size_t bufsz)
+_plist_dump_fmt(struct plist_dumpbuf_s *db, const char *fmt, ...)
 {
-#define _NUMELEM 16
+	int n;
+	char *cp;
+	va_list ap;
+
+	cp = _plist_dump_room(db, DUMP_LINESZ);
+	va_start(ap, fmt);
+	n = vsnprintf(cp, DUMP_LINESZ, fmt, ap);
+	va_end(ap);
+	if (n < 0) {
+		return;
+	}
+	if (n >= DUMP_LINESZ && (size_t) n < sizeof(db->db_buf)) {
+		cp = _plist_dump_room(db, n + 1);
+		va_start(ap, fmt);
+		(void) vsnprintf(cp, n + 1, fmt, ap);
+		va_end(ap);
+	} else if (n >= DUMP_LINESZ) {
+		cp = malloc(n + 1);
+		if (cp == NULL) {
+			db->db_err = (db->db_err == 0) ? ENOMEM : db->db_err;
+			return;
+		}
+		va_start(ap, fmt);
+		(void) vsnprintf(cp, n + 1, fmt, ap);
+		va_end(ap);
+		_plist_dump_bytes(db, cp, n);
+		free(cp);
+		return;
+	}
+	db->db_fill += n;
+	return;
+}
 
-	int i, j;
-	int cnt;
-	int pad;
-	unsigned char ch;
+/**
+ * Do a hex dump style of a buffer when a count, hex value, and then
+ * printable characters at the end. Each line is put together in the
+ * output buffer from the tables.
+ */
+static void
+_plist_dump_data(struct plist_dumpbuf_s *db, const void *buf, size_t bufsz)
+{
+	size_t i;
+	size_t j;
+	size_t cnt;
+	size_t off;
+	char *cp;
+	char num[24];
 	const unsigned char *ptr;
 
 	ptr = buf;
-	for (i = 0; i < bufsz; i += cnt) {
-		fprintf(fp, "%u:\t", i);
+	for (i = 0; i < bufsz && db->db_err == 0; i += cnt) {
+		cp = _plist_dump_room(db, DUMP_LINESZ);
+
+		/* the offset in decimal */
+		off = sizeof(num);
+		j = i;
+		do {
+			num[--off] = '0' + j % 10;
+			j /= 10;
+		} while (j > 0);
+		memcpy(cp, &num[off], sizeof(num) - off);
+		cp += sizeof(num) - off;
+		*cp++ = ':';
+		*cp++ = '\t';
 
 		cnt = bufsz - i;
-		if (cnt > _NUMELEM) {
-			cnt = _NUMELEM;
+		if (cnt > DUMP_NUMELEM) {
+			cnt = DUMP_NUMELEM;
 		}
 		for (j = 0; j < cnt; j++) {
-			fprintf(fp, "%02x ", ptr[i + j]);
+			memcpy(cp, &_plist_dump_hex[ptr[i + j] * 2], 2);
+			cp[2] = ' ';
+			cp += 3;
 		}
-		pad = (1 + _NUMELEM - j) * 3;
-		fprintf(fp, "%*s", pad, "");
+		memset(cp, ' ', (1 + DUMP_NUMELEM - cnt) * 3);
+		cp += (1 + DUMP_NUMELEM - cnt) * 3;
 
-		/* now print the ASCII representation */
+		/* now the ASCII representation */
 		for (j = 0; j < cnt; j++) {
-			ch = ptr[i + j];
-			if (!isprint(ch) || !isascii(ch)) {
-				ch = '.';
-			}
-			fprintf(fp, "%c", ch);
+			*cp++ = _plist_dump_print[ptr[i + j]];
 		}
-		fputs("\n", fp);
+		*cp++ = '\n';
+		db->db_fill = cp - db->db_buf;
 	}
 	return;
-
-#undef _NUMELEM
 }
 
-void
-plist_dump(const plist_t *plist, FILE *fp)
+static void
+_plist_dump_walk(struct plist_dumpbuf_s *db, const plist_t *plist)
 {
-#define _INDENTLEN  (8)
-
-	int indent;
+	size_t indent;
+	const char *name;
 	const plist_t *pcur;
 	const plist_t *pnext;
 	char tmbuf[sizeof("YYYY-MM-DDThh:mm:ss.s+hh:mm")];
 
-	if (!plist || !fp) {
-		return;
-	}
-
 	indent = 0;
-	for (pcur = plist; pcur; pcur = pnext) {
+	for (pcur = plist; pcur && db->db_err == 0; pcur = pnext) {
 		pnext = NULL; /* default the next element */
 
-		fprintf(fp, "%*s%s", indent * _INDENTLEN, "",
-			plist_etos(pcur->p_elem));
+		_plist_dump_indent(db, indent * DUMP_INDENTLEN);
+		name = plist_etos(pcur->p_elem);
+		_plist_dump_bytes(db, name, strlen(name));
 		switch (pcur->p_elem) {
 		case PLIST_DICT:
-			fprintf(fp, "\n");
+			_plist_dump_bytes(db, "\n", 1);
 			pnext = TAILQ_FIRST(&pcur->p_dict.pd_keys);
 			if (pnext != NULL) {
 				indent++;
@@ -1370,14 +1743,17 @@ plist_dump(const plist_t *plist, FILE *fp)
 			}
 			break;
 		case PLIST_KEY:
-			fprintf(fp, "=%s\n", pcur->p_key.pk_name);
+			_plist_dump_bytes(db, "=", 1);
+			_plist_dump_bytes(db, pcur->p_key.pk_name,
+					  strlen(pcur->p_key.pk_name));
+			_plist_dump_bytes(db, "\n", 1);
 			pnext = pcur->p_key.pk_value;
 			if (pnext != NULL) {
 				continue;
 			}
 			break;
 		case PLIST_ARRAY:
-			fprintf(fp, "\n");
+			_plist_dump_bytes(db, "\n", 1);
 			pnext = TAILQ_FIRST(&pcur->p_array.pa_elems);
 			if (pnext != NULL) {
 				indent++;
@@ -1385,28 +1761,32 @@ plist_dump(const plist_t *plist, FILE *fp)
 			}
 			break;
 		case PLIST_DATA:
-			fprintf(fp, "\n");
-			_datadump(fp, pcur->p_data.pd_data,
-				  pcur->p_data.pd_datasz);
+			_plist_dump_bytes(db, "\n", 1);
+			_plist_dump_data(db, pcur->p_data.pd_data,
+					 pcur->p_data.pd_datasz);
 			break;
 		case PLIST_DATE:
 			strftime(tmbuf, sizeof(tmbuf),
 				 "%Y-%m-%dT%H:%M:%S%z",
 				 &pcur->p_date.pd_tm);
-			fprintf(fp, "=%s\n", tmbuf);
+			_plist_dump_fmt(db, "=%s\n", tmbuf);
 			break;
 		case PLIST_STRING:
-			fprintf(fp, "=%s\n", pcur->p_string.ps_str);
+			_plist_dump_bytes(db, "=", 1);
+			_plist_dump_bytes(db, pcur->p_string.ps_str,
+					  strlen(pcur->p_string.ps_str));
+			_plist_dump_bytes(db, "\n", 1);
 			break;
 		case PLIST_INTEGER:
-			fprintf(fp, "=%d\n", pcur->p_integer.pi_int);
+			_plist_dump_fmt(db, "=%d\n", pcur->p_integer.pi_int);
 			break;
 		case PLIST_REAL:
-			fprintf(fp, "=%f\n", pcur->p_real.pr_double);
+			_plist_dump_fmt(db, "=%f\n", pcur->p_real.pr_double);
 			break;
 		case PLIST_BOOLEAN:
-			fprintf(fp, "=%s\n",
-				pcur->p_boolean.pb_bool ? "true" : "false");
+			_plist_dump_fmt(db, "=%s\n",
+					pcur->p_boolean.pb_bool ?
+					"true" : "false");
 			break;
 		default:
 			break;
@@ -1448,8 +1828,120 @@ plist_dump(const plist_t *plist, FILE *fp)
 			break;
 		}
 	}
-
+	_plist_dump_flush(db);
 	return;
+}
+
+
+int
+plist_dump_cb(const plist_t *plist,
+	      int (*func)(void *arg, const void *buf, size_t len), void *arg)
+{
+	int err;
+	struct plist_dumpbuf_s *db;
+
+	if (!plist || !func) {
+		return EINVAL;
+	}
 
-#undef _INDENTLEN
+	/* the buffer is too large for the stack of a small thread */
+	db = malloc(sizeof(*db));
+	if (db == NULL) {
+		return ENOMEM;
+	}
+	db->db_func = func;
+	db->db_arg = arg;
+	db->db_err = 0;
+	db->db_fill = 0;
+	_plist_dump_walk(db, plist);
+	err = db->db_err;
+	free(db);
+	return err;
+}
+
+
+/**
+ * Memory that a dump is collected into, with room for a terminator
+ */
+struct plist_dumpmem_s {
+	char *dm_buf;
+	size_t dm_len;
+	size_t dm_sz;
+};
+
+static int
+_plist_dump_mem(void *arg, const void *buf, size_t len)
+{
+	size_t newsz;
+	char *ptr;
+	struct plist_dumpmem_s *dm = arg;
+
+	if (dm->dm_sz - dm->dm_len <= len) {
+		newsz = (dm->dm_sz == 0) ? DUMP_BUFSZ : dm->dm_sz;
+		while (newsz - dm->dm_len <= len) {
+			if (newsz > SIZE_MAX / 2) {
+				return ENOMEM;
+			}
+			newsz *= 2;
+		}
+		ptr = realloc(dm->dm_buf, newsz);
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		dm->dm_buf = ptr;
+		dm->dm_sz = newsz;
+	}
+	memcpy(&dm->dm_buf[dm->dm_len], buf, len);
+	dm->dm_len += len;
+	return 0;
+}
+
+int
+plist_dump_buf(const plist_t *plist, void **bufp, size_t *szp)
+{
+	int err;
+	struct plist_dumpmem_s dm;
+
+	if (!bufp || !szp) {
+		return EINVAL;
+	}
+	memset(&dm, 0, sizeof(dm));
+	err = plist_dump_cb(plist, _plist_dump_mem, &dm);
+	if (err == 0 && dm.dm_buf == NULL) {
+		dm.dm_buf = malloc(1);
+		if (dm.dm_buf == NULL) {
+			err = ENOMEM;
+		}
+	}
+	if (err != 0) {
+		free(dm.dm_buf);
+		return err;
+	}
+	dm.dm_buf[dm.dm_len] = '\0';
+	*bufp = dm.dm_buf;
+	*szp = dm.dm_len;
+	return 0;
+}
+
+
+static int
+_plist_dump_file(void *arg, const void *buf, size_t len)
+{
+	FILE *fp = arg;
+
+	errno = 0;
+	if (fwrite(buf, 1, len, fp) != len) {
+		return (errno != 0) ? errno : EIO;
+	}
+	return 0;
+}
+
+void
+plist_dump(const plist_t *plist, FILE *fp)
+{
+	if (!plist || !fp) {
+		return;
+	}
+	plist_dump_cb(plist, _plist_dump_file, fp);
+	return;
 }
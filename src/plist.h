@@ -313,6 +313,18 @@ int plist_array_del(plist_t *array, int loc);
  */
 int plist_data_new(plist_t **datapp, const void *buf, size_t bufsz);
 
+/**
+ * Initialize a plist data element that refers to the passed in buffer
+ * instead of a copy of it. The buffer has to outlive the element, or
+ * #plist_detach_storage has to be used before the buffer goes away.
+ *
+ * @param  datapp  result plist data element
+ * @param  buf     data buffer to refer to
+ * @param  bufsz   length of the data buffer
+ * @return zero on success or an error value
+ */
+int plist_data_ref_new(plist_t **datapp, const void *buf, size_t bufsz);
+
 /**
  * Initialize a plist date element. This will allocate the required
  * memory and copy the broken down date into the plist element.
@@ -333,6 +345,30 @@ int plist_date_new(plist_t **datepp, const struct tm *tm);
  */
 int plist_string_new(plist_t **stringpp, const char *s);
 
+/**
+ * Initialize a plist string element from a counted character array. This
+ * will allocate the required memory and copy len characters into the
+ * plist element followed by a terminating null. The array does not need
+ * to be null terminated.
+ *
+ * @param  stringpp  result plist string element
+ * @param  s         character array
+ * @param  len       number of characters to copy
+ * @return zero on success or an error value
+ */
+int plist_nstring_new(plist_t **stringpp, const char *s, size_t len);
+
+/**
+ * Initialize a plist string element that refers to a null terminated
+ * string instead of a copy of it. The string has to outlive the
+ * element, or #plist_detach_storage has to be used before it goes away.
+ *
+ * @param  stringpp  result plist string element
+ * @param  s         null terminated string to refer to
+ * @return zero on success or an error value
+ */
+int plist_string_ref_new(plist_t **stringpp, const char *s);
+
 /**
  * Initialize a plist string element with a format. This will allocate the
  * required memory and copy the formatted string into the plist element.
@@ -396,6 +432,19 @@ int plist_boolean_new(plist_t **booleanpp, bool flag);
  */
 int plist_copy(const plist_t *src, plist_t **dstpp);
 
+/**
+ * Give every string, key and data element in a tree its own copy of
+ * storage that was borrowed with the reference constructors or from
+ * #plist_txt_parse_borrowed. The elements that are copied are moved to
+ * new memory, so the passed in reference is updated when the top
+ * element itself moves. On failure the tree is intact but may still
+ * have some borrowed elements.
+ *
+ * @param  plistpp  pointer reference to the top of the tree
+ * @return zero on success or an error value
+ */
+int plist_detach_storage(plist_t **plistpp);
+
 /**
  * Deallocate a plist element and any children of the element. This is
  * a central routine to free any element type that has been allocated.
@@ -461,9 +510,36 @@ bool plist_isequal(const plist_t *plist1, const plist_t *plist2);
  * the property elements.
  *
  * @param  plist  reference to the element and children to print
+ * @param  fp     stream that the dump is written to
  */
 void plist_dump(const plist_t *plist, FILE *fp);
 
+/**
+ * Pretty print the elements as for #plist_dump into an allocated
+ * buffer. The buffer is null terminated past the size.
+ *
+ * @param  plist  reference to the element and children to print
+ * @param  bufp   result text that the caller frees
+ * @param  szp    result length of the text
+ * @return zero on success or an error value
+ */
+int plist_dump_buf(const plist_t *plist, void **bufp, size_t *szp);
+
+/**
+ * Pretty print the elements as for #plist_dump through a function.
+ * The text is gathered in a local buffer and the function is called
+ * once each time it fills, and once at the end.
+ *
+ * @param  plist  reference to the element and children to print
+ * @param  func   called with each piece of text, returning zero to
+ *                continue or an error value to stop the dump
+ * @param  arg    passed to the function
+ * @return zero on success or the error value from the function
+ */
+int plist_dump_cb(const plist_t *plist,
+		  int (*func)(void *arg, const void *buf, size_t len),
+		  void *arg);
+
 __END_DECLS
 
 #endif /* !_PLIST_H_ */
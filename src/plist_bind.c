@@ -0,0 +1,733 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_bind.c
+ *
+ * Bind dictionaries into C structures from a plist object or from the
+ * events of the text parser. Both walk the same conversions from a
+ * value to a member, the event sink just keeps the containers it is in
+ * on a stack of its own instead of recursing.
+ *
+ * @version $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist_bind.h"
+
+/* forward declare */
+static void _plist_bind_release(const plist_bind_desc_t *desc, void *ptr);
+
+
+static const plist_bind_desc_t *
+_plist_bind_find(const plist_bind_desc_t *fields, const char *key,
+		 size_t len)
+{
+	const plist_bind_desc_t *desc;
+
+	for (desc = fields; desc->pbd_key != NULL; desc++) {
+		if (strlen(desc->pbd_key) == len &&
+		    memcmp(desc->pbd_key, key, len) == 0) {
+			return desc;
+		}
+	}
+	return NULL;
+}
+
+
+/*
+ * Conversions of a value into the member that a descriptor points at
+ */
+
+static int
+_plist_bind_real(const plist_bind_desc_t *desc, void *ptr, double num)
+{
+	if (desc->pbd_type != PLIST_BIND_REAL) {
+		return EINVAL;
+	}
+	switch (desc->pbd_size) {
+	case sizeof(float):
+		*(float *) ptr = num;
+		return 0;
+	case sizeof(double):
+		*(double *) ptr = num;
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_bind_integer(const plist_bind_desc_t *desc, void *ptr, long long num)
+{
+	if (desc->pbd_type == PLIST_BIND_REAL) {
+		return _plist_bind_real(desc, ptr, num);
+	}
+	if (desc->pbd_type != PLIST_BIND_INTEGER) {
+		return EINVAL;
+	}
+
+	switch (desc->pbd_size) {
+	case sizeof(int8_t):
+		if (num < INT8_MIN || num > INT8_MAX) {
+			return ERANGE;
+		}
+		*(int8_t *) ptr = num;
+		return 0;
+	case sizeof(int16_t):
+		if (num < INT16_MIN || num > INT16_MAX) {
+			return ERANGE;
+		}
+		*(int16_t *) ptr = num;
+		return 0;
+	case sizeof(int32_t):
+		if (num < INT32_MIN || num > INT32_MAX) {
+			return ERANGE;
+		}
+		*(int32_t *) ptr = num;
+		return 0;
+	case sizeof(int64_t):
+		*(int64_t *) ptr = num;
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_bind_boolean(const plist_bind_desc_t *desc, void *ptr, bool flag)
+{
+	if (desc->pbd_type != PLIST_BIND_BOOLEAN ||
+	    desc->pbd_size != sizeof(bool)) {
+		return EINVAL;
+	}
+	*(bool *) ptr = flag;
+	return 0;
+}
+
+static int
+_plist_bind_string(const plist_bind_desc_t *desc, void *ptr,
+		   const char *s, size_t len)
+{
+	char *str;
+
+	switch (desc->pbd_type) {
+	case PLIST_BIND_STRING:
+		if (desc->pbd_size != sizeof(char *)) {
+			return EINVAL;
+		}
+		str = malloc(len + 1);
+		if (str == NULL) {
+			return ENOMEM;
+		}
+		memcpy(str, s, len);
+		str[len] = '\0';
+
+		/* a repeated key replaces the string from before */
+		free(*(char **) ptr);
+		*(char **) ptr = str;
+		return 0;
+	case PLIST_BIND_STRBUF:
+		if (len >= desc->pbd_size) {
+			return ERANGE;
+		}
+		memcpy(ptr, s, len);
+		((char *) ptr)[len] = '\0';
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_bind_data(const plist_bind_desc_t *desc, void *ptr,
+		 const void *buf, size_t sz)
+{
+	void *data;
+	plist_bind_vector_t *pbv = ptr;
+
+	if (desc->pbd_type != PLIST_BIND_DATA ||
+	    desc->pbd_size != sizeof(*pbv)) {
+		return EINVAL;
+	}
+	data = malloc((sz == 0) ? 1 : sz);
+	if (data == NULL) {
+		return ENOMEM;
+	}
+	memcpy(data, buf, sz);
+	free(pbv->pbv_elems);
+	pbv->pbv_elems = data;
+	pbv->pbv_nelems = sz;
+	pbv->pbv_maxelems = sz;
+	return 0;
+}
+
+static int
+_plist_bind_date(const plist_bind_desc_t *desc, void *ptr,
+		 const struct tm *tm)
+{
+	if (desc->pbd_type != PLIST_BIND_DATE ||
+	    desc->pbd_size != sizeof(struct tm)) {
+		return EINVAL;
+	}
+	*(struct tm *) ptr = *tm;
+	return 0;
+}
+
+/**
+ * Start binding an array into its member. A vector is emptied here
+ * rather than on the first element so that an empty array replaces
+ * what an earlier bind left in it.
+ */
+static void
+_plist_bind_clear(const plist_bind_desc_t *desc, void *member)
+{
+	if (desc->pbd_append == plist_bind_vector) {
+		_plist_bind_release(desc, member);
+	}
+	return;
+}
+
+/**
+ * Storage of the next element of an array member
+ */
+static int
+_plist_bind_append(const plist_bind_desc_t *desc, void *member, size_t idx,
+		   void **ptrp)
+{
+	int err;
+	void *elem;
+
+	if (desc->pbd_elem == NULL || desc->pbd_append == NULL) {
+		return EINVAL;
+	}
+	err = desc->pbd_append(desc, member, idx, &elem);
+	if (err != 0) {
+		return err;
+	}
+	*ptrp = (char *) elem + desc->pbd_elem->pbd_offset;
+	return 0;
+}
+
+
+/*
+ * Binding from a plist object
+ */
+
+static int _plist_bind_value(const plist_bind_desc_t *desc, void *ptr,
+			     const plist_t *value);
+
+static int
+_plist_bind_dict(const plist_t *dict, const plist_bind_desc_t *fields,
+		 void *obj)
+{
+	int err;
+	const plist_t *ptmp;
+	const plist_bind_desc_t *desc;
+
+	TAILQ_FOREACH(ptmp, &dict->p_dict.pd_keys, p_entry) {
+		desc = _plist_bind_find(fields, ptmp->p_key.pk_name,
+					strlen(ptmp->p_key.pk_name));
+		if (desc == NULL) {
+			continue;
+		}
+		err = _plist_bind_value(desc, (char *) obj + desc->pbd_offset,
+					ptmp->p_key.pk_value);
+		if (err != 0) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+static int
+_plist_bind_value(const plist_bind_desc_t *desc, void *ptr,
+		  const plist_t *value)
+{
+	int err;
+	size_t idx;
+	void *elem;
+	const plist_t *ptmp;
+
+	switch (value->p_elem) {
+	case PLIST_DICT:
+		if (desc->pbd_type != PLIST_BIND_STRUCT ||
+		    desc->pbd_fields == NULL) {
+			return EINVAL;
+		}
+		return _plist_bind_dict(value, desc->pbd_fields, ptr);
+
+	case PLIST_ARRAY:
+		if (desc->pbd_type != PLIST_BIND_ARRAY) {
+			return EINVAL;
+		}
+		_plist_bind_clear(desc, ptr);
+		idx = 0;
+		TAILQ_FOREACH(ptmp, &value->p_array.pa_elems, p_entry) {
+			err = _plist_bind_append(desc, ptr, idx++, &elem);
+			if (err == 0) {
+				err = _plist_bind_value(desc->pbd_elem, elem,
+							ptmp);
+			}
+			if (err != 0) {
+				return err;
+			}
+		}
+		return 0;
+
+	case PLIST_DATA:
+		return _plist_bind_data(desc, ptr, value->p_data.pd_data,
+					value->p_data.pd_datasz);
+	case PLIST_DATE:
+		return _plist_bind_date(desc, ptr, &value->p_date.pd_tm);
+	case PLIST_STRING:
+		return _plist_bind_string(desc, ptr, value->p_string.ps_str,
+					  strlen(value->p_string.ps_str));
+	case PLIST_INTEGER:
+		return _plist_bind_integer(desc, ptr,
+					   value->p_integer.pi_int);
+	case PLIST_REAL:
+		return _plist_bind_real(desc, ptr, value->p_real.pr_double);
+	case PLIST_BOOLEAN:
+		return _plist_bind_boolean(desc, ptr,
+					   value->p_boolean.pb_bool);
+	default:
+		return EINVAL;
+	}
+}
+
+
+int
+plist_bind(const plist_t *plist, const plist_bind_desc_t *fields, void *obj)
+{
+	if (!plist || !fields || !obj) {
+		return EINVAL;
+	}
+	if (plist->p_elem != PLIST_DICT) {
+		return EINVAL;
+	}
+	return _plist_bind_dict(plist, fields, obj);
+}
+
+
+/*
+ * Binding from parse events
+ */
+
+int
+plist_bind_new(plist_bind_t **bindpp, const plist_bind_desc_t *fields,
+	       void *obj)
+{
+	plist_bind_t *bind;
+
+	if (!bindpp || !fields || !obj) {
+		return EINVAL;
+	}
+
+	bind = malloc(sizeof(*bind));
+	if (bind == NULL) {
+		return ENOMEM;
+	}
+	memset(bind, 0, sizeof(*bind));
+	bind->pb_fields = fields;
+	bind->pb_obj = obj;
+	*bindpp = bind;
+	return 0;
+}
+
+
+void
+plist_bind_free(plist_bind_t *bind)
+{
+	if (!bind) {
+		return;
+	}
+	free(bind->pb_frames);
+	free(bind);
+	return;
+}
+
+static int
+_plist_bind_push(plist_bind_t *bind, const plist_bind_desc_t *fields,
+		 const plist_bind_desc_t *array, void *base)
+{
+	plist_bind_frame_t *pbf;
+
+	if (bind->pb_depth == bind->pb_maxdepth) {
+		int maxdepth;
+
+		maxdepth = (bind->pb_maxdepth == 0) ? 8 : 2 * bind->pb_maxdepth;
+		pbf = realloc(bind->pb_frames, maxdepth * sizeof(*pbf));
+		if (pbf == NULL) {
+			return ENOMEM;
+		}
+		bind->pb_frames = pbf;
+		bind->pb_maxdepth = maxdepth;
+	}
+	pbf = &bind->pb_frames[bind->pb_depth++];
+	pbf->pbf_fields = fields;
+	pbf->pbf_array = array;
+	pbf->pbf_base = base;
+	pbf->pbf_idx = 0;
+	return 0;
+}
+
+/**
+ * Find where the next value goes. The descriptor is NULL for a value
+ * that is not bound, which the caller ignores.
+ */
+static int
+_plist_bind_slot(plist_bind_t *bind, const plist_bind_desc_t **descp,
+		 void **ptrp)
+{
+	int err;
+	plist_bind_frame_t *pbf;
+	const plist_bind_desc_t *desc;
+
+	*descp = NULL;
+	if (bind->pb_depth == 0) {
+		/* the top level has to be the dictionary */
+		return EINVAL;
+	}
+	pbf = &bind->pb_frames[bind->pb_depth - 1];
+	if (pbf->pbf_array == NULL) {
+		desc = bind->pb_pending;
+		bind->pb_pending = NULL;
+		if (desc != NULL) {
+			*ptrp = (char *) pbf->pbf_base + desc->pbd_offset;
+			*descp = desc;
+		}
+		return 0;
+	}
+
+	err = _plist_bind_append(pbf->pbf_array, pbf->pbf_base,
+				 pbf->pbf_idx, ptrp);
+	if (err != 0) {
+		return err;
+	}
+	pbf->pbf_idx++;
+	*descp = pbf->pbf_array->pbd_elem;
+	return 0;
+}
+
+static int
+_plist_bind_begin(plist_bind_t *bind, enum plist_bind_type_e type)
+{
+	int err;
+	void *ptr;
+	const plist_bind_desc_t *desc;
+
+	if (bind->pb_skip > 0) {
+		bind->pb_skip++;
+		return 0;
+	}
+	if (bind->pb_depth == 0 && type == PLIST_BIND_STRUCT &&
+	    !bind->pb_done) {
+		return _plist_bind_push(bind, bind->pb_fields, NULL,
+					bind->pb_obj);
+	}
+
+	err = _plist_bind_slot(bind, &desc, &ptr);
+	if (err != 0) {
+		return err;
+	}
+	if (desc == NULL) {
+		/* not bound, ignore everything inside */
+		bind->pb_skip = 1;
+		return 0;
+	}
+	if (desc->pbd_type != type) {
+		return EINVAL;
+	}
+	if (type == PLIST_BIND_STRUCT) {
+		if (desc->pbd_fields == NULL) {
+			return EINVAL;
+		}
+		return _plist_bind_push(bind, desc->pbd_fields, NULL, ptr);
+	}
+	_plist_bind_clear(desc, ptr);
+	return _plist_bind_push(bind, NULL, desc, ptr);
+}
+
+static int
+_plist_bind_end(void *arg)
+{
+	plist_bind_t *bind = arg;
+
+	if (bind->pb_skip > 0) {
+		bind->pb_skip--;
+		return 0;
+	}
+	bind->pb_depth--;
+	if (bind->pb_depth == 0) {
+		bind->pb_done = true;
+	}
+	return 0;
+}
+
+static int
+_plist_bind_begin_dict(void *arg)
+{
+	return _plist_bind_begin(arg, PLIST_BIND_STRUCT);
+}
+
+static int
+_plist_bind_begin_array(void *arg)
+{
+	return _plist_bind_begin(arg, PLIST_BIND_ARRAY);
+}
+
+static int
+_plist_bind_key(void *arg, const char *name, size_t len)
+{
+	plist_bind_t *bind = arg;
+	plist_bind_frame_t *pbf;
+
+	if (bind->pb_skip > 0) {
+		return 0;
+	}
+	pbf = &bind->pb_frames[bind->pb_depth - 1];
+	bind->pb_pending = _plist_bind_find(pbf->pbf_fields, name, len);
+	return 0;
+}
+
+/* find the member of a scalar value or return for one that is ignored */
+#define BIND_SLOT(_bind, _desc, _ptr)					\
+	do {								\
+		int _err;						\
+									\
+		if ((_bind)->pb_skip > 0) {				\
+			return 0;					\
+		}							\
+		_err = _plist_bind_slot((_bind), &(_desc), &(_ptr));	\
+		if (_err != 0 || (_desc) == NULL) {			\
+			return _err;					\
+		}							\
+	} while (0)
+
+static int
+_plist_bind_sax_string(void *arg, const char *s, size_t len)
+{
+	void *ptr;
+	const plist_bind_desc_t *desc;
+
+	BIND_SLOT((plist_bind_t *) arg, desc, ptr);
+	return _plist_bind_string(desc, ptr, s, len);
+}
+
+static int
+_plist_bind_sax_integer(void *arg, long long num)
+{
+	void *ptr;
+	const plist_bind_desc_t *desc;
+
+	BIND_SLOT((plist_bind_t *) arg, desc, ptr);
+	return _plist_bind_integer(desc, ptr, num);
+}
+
+static int
+_plist_bind_sax_real(void *arg, double num)
+{
+	void *ptr;
+	const plist_bind_desc_t *desc;
+
+	BIND_SLOT((plist_bind_t *) arg, desc, ptr);
+	return _plist_bind_real(desc, ptr, num);
+}
+
+static int
+_plist_bind_sax_boolean(void *arg, bool flag)
+{
+	void *ptr;
+	const plist_bind_desc_t *desc;
+
+	BIND_SLOT((plist_bind_t *) arg, desc, ptr);
+	return _plist_bind_boolean(desc, ptr, flag);
+}
+
+static int
+_plist_bind_sax_data(void *arg, const void *buf, size_t sz)
+{
+	void *ptr;
+	const plist_bind_desc_t *desc;
+
+	BIND_SLOT((plist_bind_t *) arg, desc, ptr);
+	return _plist_bind_data(desc, ptr, buf, sz);
+}
+
+static int
+_plist_bind_sax_date(void *arg, const struct tm *tm)
+{
+	void *ptr;
+	const plist_bind_desc_t *desc;
+
+	BIND_SLOT((plist_bind_t *) arg, desc, ptr);
+	return _plist_bind_date(desc, ptr, tm);
+}
+
+#undef BIND_SLOT
+
+const plist_txt_sax_t plist_bind_sax = {
+	.psx_begin_dict = _plist_bind_begin_dict,
+	.psx_end_dict = _plist_bind_end,
+	.psx_key = _plist_bind_key,
+	.psx_begin_array = _plist_bind_begin_array,
+	.psx_end_array = _plist_bind_end,
+	.psx_string = _plist_bind_sax_string,
+	.psx_integer = _plist_bind_sax_integer,
+	.psx_real = _plist_bind_sax_real,
+	.psx_boolean = _plist_bind_sax_boolean,
+	.psx_data = _plist_bind_sax_data,
+	.psx_date = _plist_bind_sax_date,
+};
+
+
+int
+plist_bind_parse(plist_txt_t *txt, const plist_bind_desc_t *fields,
+		 void *obj, const void *buf, size_t sz)
+{
+	int err;
+	plist_bind_t *bind;
+
+	if (!txt || !fields || !obj || (!buf && sz > 0)) {
+		return EINVAL;
+	}
+
+	err = plist_bind_new(&bind, fields, obj);
+	if (err != 0) {
+		return err;
+	}
+	err = plist_txt_sax_parse(txt, &plist_bind_sax, bind, buf, sz);
+	if (err == 0 && !bind->pb_done) {
+		err = ENOENT;
+	}
+	plist_txt_reset(txt);
+	plist_bind_free(bind);
+	return err;
+}
+
+
+int
+plist_bind_vector(const plist_bind_desc_t *desc, void *member, size_t idx,
+		  void **elemp)
+{
+	size_t i;
+	void *elems;
+	size_t elemsz;
+	size_t maxelems;
+	plist_bind_vector_t *pbv = member;
+
+	if (!desc || !desc->pbd_elem || !member || !elemp) {
+		return EINVAL;
+	}
+	elemsz = desc->pbd_elem->pbd_size;
+	if (idx == 0) {
+		/* a new array replaces anything from before */
+		for (i = 0; i < pbv->pbv_nelems; i++) {
+			_plist_bind_release(desc->pbd_elem,
+					    (char *) pbv->pbv_elems +
+					    i * elemsz +
+					    desc->pbd_elem->pbd_offset);
+		}
+		pbv->pbv_nelems = 0;
+	}
+	if (pbv->pbv_nelems == pbv->pbv_maxelems) {
+		maxelems = (pbv->pbv_maxelems == 0) ?
+		    8 : 2 * pbv->pbv_maxelems;
+		elems = realloc(pbv->pbv_elems, maxelems * elemsz);
+		if (elems == NULL) {
+			return ENOMEM;
+		}
+		pbv->pbv_elems = elems;
+		pbv->pbv_maxelems = maxelems;
+	}
+	*elemp = (char *) pbv->pbv_elems + pbv->pbv_nelems * elemsz;
+	memset(*elemp, 0, elemsz);
+	pbv->pbv_nelems++;
+	return 0;
+}
+
+
+static void
+_plist_bind_release(const plist_bind_desc_t *desc, void *ptr)
+{
+	size_t i;
+	char **strp;
+	plist_bind_vector_t *pbv;
+
+	switch (desc->pbd_type) {
+	case PLIST_BIND_STRING:
+		strp = ptr;
+		free(*strp);
+		*strp = NULL;
+		break;
+	case PLIST_BIND_DATA:
+		pbv = ptr;
+		free(pbv->pbv_elems);
+		memset(pbv, 0, sizeof(*pbv));
+		break;
+	case PLIST_BIND_STRUCT:
+		if (desc->pbd_fields != NULL) {
+			plist_bind_release(desc->pbd_fields, ptr);
+		}
+		break;
+	case PLIST_BIND_ARRAY:
+		if (desc->pbd_append != plist_bind_vector) {
+			/* the storage belongs to the callback */
+			break;
+		}
+		pbv = ptr;
+		for (i = 0; i < pbv->pbv_nelems; i++) {
+			_plist_bind_release(desc->pbd_elem,
+					    (char *) pbv->pbv_elems +
+					    i * desc->pbd_elem->pbd_size +
+					    desc->pbd_elem->pbd_offset);
+		}
+		free(pbv->pbv_elems);
+		memset(pbv, 0, sizeof(*pbv));
+		break;
+	default:
+		break;
+	}
+	return;
+}
+
+
+void
+plist_bind_release(const plist_bind_desc_t *fields, void *obj)
+{
+	const plist_bind_desc_t *desc;
+
+	if (!fields || !obj) {
+		return;
+	}
+	for (desc = fields; desc->pbd_key != NULL; desc++) {
+		_plist_bind_release(desc, (char *) obj + desc->pbd_offset);
+	}
+	return;
+}
@@ -0,0 +1,234 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_bind.h
+ * Bind dictionaries straight into C structures. A descriptor table
+ * lists the keys of a dictionary along with the type and the offset of
+ * the member each one is stored in, so a document can fill in the
+ * structures of the application without a plist object tree in between.
+ * Keys that are not in a table are ignored and members for missing keys
+ * are left alone, so a structure should hold its defaults beforehand.
+ * Binding replaces and frees what a string, data, or vector member
+ * already holds, so those start out NULL or from an earlier bind.
+ *
+ * A table is bound from an existing tree with #plist_bind, or from the
+ * events of the text parser with the #plist_bind_sax sink, which never
+ * allocates a plist object.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_BIND_H_
+#define _PLIST_BIND_H_
+
+#include <stddef.h>
+#include <plist.h>
+#include <plist_txt.h>
+
+/* forward declare */
+typedef struct plist_bind_desc_s plist_bind_desc_t;
+typedef struct plist_bind_frame_s plist_bind_frame_t;
+typedef struct plist_bind_s plist_bind_t;
+typedef struct plist_bind_vector_s plist_bind_vector_t;
+
+/**
+ * Type of the member that a value is stored in
+ */
+enum plist_bind_type_e {
+	PLIST_BIND_BOOLEAN,	/* bool */
+	PLIST_BIND_INTEGER,	/* signed integer of 1, 2, 4, or 8 bytes */
+	PLIST_BIND_REAL,	/* float or double, integers are converted */
+	PLIST_BIND_STRING,	/* char * that is allocated with malloc */
+	PLIST_BIND_STRBUF,	/* char array of the member size */
+	PLIST_BIND_DATA,	/* plist_bind_vector_t of bytes */
+	PLIST_BIND_DATE,	/* struct tm */
+	PLIST_BIND_STRUCT,	/* dictionary bound with a nested table */
+	PLIST_BIND_ARRAY,	/* array bound one element at a time */
+};
+
+/**
+ * Binding of one dictionary key to a member of a structure. A table is
+ * an array of these that ends with an entry that has a NULL key.
+ *
+ * An array calls pbd_append for the storage of each element in turn,
+ * and the element is bound with pbd_elem at that address plus the
+ * offset in pbd_elem, which has no key of its own. The member passed
+ * to pbd_append is the one at pbd_offset, so it can hold whatever the
+ * callback keeps the elements in, such as a #plist_bind_vector_t with
+ * #plist_bind_vector.
+ */
+struct plist_bind_desc_s {
+	const char *pbd_key;
+	enum plist_bind_type_e pbd_type;
+	size_t pbd_offset;
+	size_t pbd_size;
+
+	/* table for a PLIST_BIND_STRUCT member */
+	const plist_bind_desc_t *pbd_fields;
+
+	/* element binding and storage for a PLIST_BIND_ARRAY member */
+	const plist_bind_desc_t *pbd_elem;
+	int (*pbd_append)(const plist_bind_desc_t *desc, void *member,
+			  size_t idx, void **elemp);
+};
+
+/* entry for a member of a structure type */
+#define PLIST_BIND_FIELD(_key, _type, _struct, _member)			\
+	{ (_key), (_type), offsetof(_struct, _member),			\
+	  sizeof(((_struct *) 0)->_member), NULL, NULL, NULL }
+
+/* entry for a nested structure */
+#define PLIST_BIND_NESTED(_key, _struct, _member, _fields)		\
+	{ (_key), PLIST_BIND_STRUCT, offsetof(_struct, _member),	\
+	  sizeof(((_struct *) 0)->_member), (_fields), NULL, NULL }
+
+/* entry for an array of elements that are kept in a vector member */
+#define PLIST_BIND_VECTOR(_key, _struct, _member, _elem)		\
+	{ (_key), PLIST_BIND_ARRAY, offsetof(_struct, _member),	\
+	  sizeof(((_struct *) 0)->_member), NULL, (_elem),		\
+	  plist_bind_vector }
+
+/* end of a table */
+#define PLIST_BIND_END  { NULL, 0, 0, 0, NULL, NULL, NULL }
+
+/**
+ * Growable array of elements that are allocated with realloc, for data
+ * members and for arrays with #plist_bind_vector
+ */
+struct plist_bind_vector_s {
+	void *pbv_elems;
+	size_t pbv_nelems;
+	size_t pbv_maxelems;
+};
+
+/**
+ * Container that is open while binding from parse events
+ */
+struct plist_bind_frame_s {
+	const plist_bind_desc_t *pbf_fields; /* table of a dictionary */
+	const plist_bind_desc_t *pbf_array;  /* entry of an array */
+	void *pbf_base; /* structure or array member */
+	size_t pbf_idx; /* next element of an array */
+};
+
+/**
+ * Binding context for the #plist_bind_sax event sink
+ */
+struct plist_bind_s {
+	const plist_bind_desc_t *pb_fields;
+	void *pb_obj;
+
+	/* containers that are open */
+	int pb_depth;
+	int pb_maxdepth;
+	plist_bind_frame_t *pb_frames;
+
+	/* binding of the value after a key or NULL to ignore it */
+	const plist_bind_desc_t *pb_pending;
+
+	/* nesting of a value that is ignored */
+	int pb_skip;
+
+	/* the top level dictionary is complete */
+	bool pb_done;
+};
+
+
+__BEGIN_DECLS
+
+/**
+ * Event sink that binds a document into a structure. The argument is
+ * a context from #plist_bind_new and the top level element has to be a
+ * dictionary.
+ */
+extern const plist_txt_sax_t plist_bind_sax;
+
+/**
+ * Bind a dictionary from a plist object into a structure
+ *
+ * @param  plist   dictionary to read from
+ * @param  fields  table of the structure
+ * @param  obj     structure to fill in
+ * @return zero on success, EINVAL when a value does not match the type or
+ *         size of its member, ERANGE when it does not fit, or an error
+ *         value
+ */
+int plist_bind(const plist_t *plist, const plist_bind_desc_t *fields,
+	       void *obj);
+
+/**
+ * Allocate a context to bind the events of one document
+ *
+ * @param  bindpp  result context
+ * @param  fields  table of the structure
+ * @param  obj     structure to fill in
+ * @return zero on success or an error value
+ */
+int plist_bind_new(plist_bind_t **bindpp, const plist_bind_desc_t *fields,
+		   void *obj);
+
+/**
+ * Free a context from #plist_bind_new. The structure keeps whatever was
+ * bound into it.
+ *
+ * @param  bind  context that was allocated with #plist_bind_new
+ */
+void plist_bind_free(plist_bind_t *bind);
+
+/**
+ * Parse a whole document from one buffer straight into a structure
+ *
+ * @param  txt     context that was allocated with #plist_txt_new
+ * @param  fields  table of the structure
+ * @param  obj     structure to fill in
+ * @param  buf     pointer to the document
+ * @param  sz      size of the document
+ * @return zero on success, ENOENT for an incomplete document, or an
+ *         error value as for #plist_bind and #plist_txt_parse
+ */
+int plist_bind_parse(plist_txt_t *txt, const plist_bind_desc_t *fields,
+		     void *obj, const void *buf, size_t sz);
+
+/**
+ * Element storage callback for an array member that is a
+ * #plist_bind_vector_t. Each element has the size of the element entry
+ * and starts out zeroed.
+ */
+int plist_bind_vector(const plist_bind_desc_t *desc, void *member,
+		      size_t idx, void **elemp);
+
+/**
+ * Free the strings, data, and vectors that binding allocated in a
+ * structure and everything nested in it, and clear the pointers.
+ *
+ * @param  fields  table of the structure
+ * @param  obj     structure that was bound
+ */
+void plist_bind_release(const plist_bind_desc_t *fields, void *obj);
+
+__END_DECLS
+
+#endif /* !_PLIST_BIND_H_ */
@@ -0,0 +1,1918 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_bpl.c
+ *
+ * Reader for binary property lists. Every offset in the offset table is
+ * checked when the document is opened, so visiting an object only has
+ * to check that its own length fits in front of the offset table.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for gmtime_r */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "plist_bpl.h"
+
+#define BPL_MAGIC      "bplist00"
+#define BPL_HEADERSZ   (8)
+#define BPL_TRAILERSZ  (32)
+#define BPL_EPOCH      (978307200.0) /* 2001-01-01 in the unix epoch */
+#define BPL_EXPAND     (8)	     /* plist objects per document object */
+#define BPL_READSZ     (64 * 1024)
+
+/* object markers, the high nibble of the first byte */
+#define BPL_SIMPLE     (0x0)
+#define BPL_INT        (0x1)
+#define BPL_REAL       (0x2)
+#define BPL_DATE       (0x3)
+#define BPL_DATA       (0x4)
+#define BPL_ASCII      (0x5)
+#define BPL_UTF16      (0x6)
+#define BPL_UID        (0x8)
+#define BPL_ARRAY      (0xa)
+#define BPL_SET        (0xc)
+#define BPL_DICT       (0xd)
+
+#define BPL_FALSE      (0x08)
+#define BPL_TRUE       (0x09)
+
+/**
+ * Layout of an object after its marker and count are read
+ */
+struct plist_bpl_obj_s {
+	unsigned bpo_kind;	/* high nibble of the marker */
+	unsigned bpo_info;	/* low nibble of the marker */
+	uint64_t bpo_count;	/* elements, bytes, or characters */
+	size_t bpo_start;	/* offset of the content */
+};
+
+
+static uint64_t
+_plist_bpl_uint(const uint8_t *cp, unsigned n)
+{
+	uint64_t val;
+
+	val = 0;
+	while (n-- > 0) {
+		val = (val << 8) | *cp++;
+	}
+	return val;
+}
+
+static int
+_plist_bpl_node(plist_bpl_t *bpl, uint64_t obj, plist_bpl_node_t *nodep)
+{
+	if (obj >= bpl->bp_nobjs) {
+		return EINVAL;
+	}
+	nodep->bpn_obj = obj;
+	nodep->bpn_off = _plist_bpl_uint(&bpl->bp_buf[bpl->bp_offtab +
+						      obj * bpl->bp_offsz],
+					 bpl->bp_offsz);
+	return 0;
+}
+
+/**
+ * Read the marker and the count of an object and check that the whole
+ * object is in front of the offset table
+ */
+static int
+_plist_bpl_obj(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+	       struct plist_bpl_obj_s *obj)
+{
+	size_t off;
+	size_t end;
+	size_t unit;
+	unsigned n;
+	const uint8_t *buf = bpl->bp_buf;
+
+	off = node->bpn_off;
+	end = bpl->bp_offtab;
+	if (off < BPL_HEADERSZ || off >= end) {
+		return EINVAL;
+	}
+	obj->bpo_kind = buf[off] >> 4;
+	obj->bpo_info = buf[off] & 0x0f;
+	obj->bpo_count = obj->bpo_info;
+	obj->bpo_start = off + 1;
+
+	switch (obj->bpo_kind) {
+	case BPL_DATA:
+	case BPL_ASCII:
+	case BPL_UTF16:
+	case BPL_ARRAY:
+	case BPL_SET:
+	case BPL_DICT:
+		if (obj->bpo_info != 0x0f) {
+			break;
+		}
+
+		/* the count follows as an integer object */
+		if (obj->bpo_start >= end ||
+		    (buf[obj->bpo_start] >> 4) != BPL_INT ||
+		    (buf[obj->bpo_start] & 0x0f) > 3) {
+			return EINVAL;
+		}
+		n = 1u << (buf[obj->bpo_start] & 0x0f);
+		if (end - obj->bpo_start - 1 < n) {
+			return EINVAL;
+		}
+		obj->bpo_count = _plist_bpl_uint(&buf[obj->bpo_start + 1], n);
+		obj->bpo_start += 1 + n;
+		break;
+	default:
+		break;
+	}
+
+	switch (obj->bpo_kind) {
+	case BPL_SIMPLE:
+		unit = 0;
+		break;
+	case BPL_INT:
+		if (obj->bpo_info > 4) {
+			return EINVAL;
+		}
+		unit = 1u << obj->bpo_info;
+		obj->bpo_count = 1;
+		break;
+	case BPL_REAL:
+		if (obj->bpo_info != 2 && obj->bpo_info != 3) {
+			return EINVAL;
+		}
+		unit = 1u << obj->bpo_info;
+		obj->bpo_count = 1;
+		break;
+	case BPL_DATE:
+		if (obj->bpo_info != 3) {
+			return EINVAL;
+		}
+		unit = 8;
+		obj->bpo_count = 1;
+		break;
+	case BPL_DATA:
+	case BPL_ASCII:
+		unit = 1;
+		break;
+	case BPL_UTF16:
+		unit = 2;
+		break;
+	case BPL_UID:
+		unit = obj->bpo_info + 1;
+		obj->bpo_count = 1;
+		break;
+	case BPL_ARRAY:
+	case BPL_SET:
+		unit = bpl->bp_refsz;
+		break;
+	case BPL_DICT:
+		unit = 2 * bpl->bp_refsz;
+		break;
+	default:
+		return EINVAL;
+	}
+	if (obj->bpo_start > end ||
+	    (unit != 0 && obj->bpo_count > (end - obj->bpo_start) / unit)) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+/**
+ * Follow the reference at position i of a container
+ */
+static int
+_plist_bpl_ref(plist_bpl_t *bpl, const struct plist_bpl_obj_s *obj,
+	       uint64_t i, plist_bpl_node_t *nodep)
+{
+	const uint8_t *cp;
+
+	cp = &bpl->bp_buf[obj->bpo_start + i * bpl->bp_refsz];
+	return _plist_bpl_node(bpl, _plist_bpl_uint(cp, bpl->bp_refsz),
+			       nodep);
+}
+
+/**
+ * Convert UTF-16 big endian to UTF-8. The output needs three bytes for
+ * each unit and one more for the terminator.
+ */
+static int
+_plist_bpl_utf8(const uint8_t *cp, uint64_t nunits, char *out,
+		size_t *lenp)
+{
+	uint32_t c;
+	uint32_t lo;
+	uint64_t i;
+	char *op = out;
+
+	for (i = 0; i < nunits; i++, cp += 2) {
+		c = ((uint32_t) cp[0] << 8) | cp[1];
+		if (c >= 0xd800 && c <= 0xdbff) {
+			/* the high half of a surrogate pair */
+			if (i + 1 == nunits) {
+				return EINVAL;
+			}
+			lo = ((uint32_t) cp[2] << 8) | cp[3];
+			if (lo < 0xdc00 || lo > 0xdfff) {
+				return EINVAL;
+			}
+			c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+			i++;
+			cp += 2;
+		} else if (c >= 0xdc00 && c <= 0xdfff) {
+			return EINVAL;
+		}
+
+		if (c < 0x80) {
+			*op++ = c;
+		} else if (c < 0x800) {
+			*op++ = 0xc0 | (c >> 6);
+			*op++ = 0x80 | (c & 0x3f);
+		} else if (c < 0x10000) {
+			*op++ = 0xe0 | (c >> 12);
+			*op++ = 0x80 | ((c >> 6) & 0x3f);
+			*op++ = 0x80 | (c & 0x3f);
+		} else {
+			*op++ = 0xf0 | (c >> 18);
+			*op++ = 0x80 | ((c >> 12) & 0x3f);
+			*op++ = 0x80 | ((c >> 6) & 0x3f);
+			*op++ = 0x80 | (c & 0x3f);
+		}
+	}
+	*op = '\0';
+	*lenp = op - out;
+	return 0;
+}
+
+/**
+ * Read a string object into an allocated UTF-8 buffer
+ */
+static int
+_plist_bpl_str(plist_bpl_t *bpl, const struct plist_bpl_obj_s *obj,
+	       char **strp, size_t *lenp)
+{
+	int err;
+	char *str;
+
+	if (obj->bpo_kind == BPL_ASCII) {
+		str = malloc(obj->bpo_count + 1);
+		if (str == NULL) {
+			return ENOMEM;
+		}
+		memcpy(str, &bpl->bp_buf[obj->bpo_start], obj->bpo_count);
+		str[obj->bpo_count] = '\0';
+		*lenp = obj->bpo_count;
+		*strp = str;
+		return 0;
+	}
+	if (obj->bpo_kind != BPL_UTF16) {
+		return EINVAL;
+	}
+
+	str = malloc(obj->bpo_count * 3 + 1);
+	if (str == NULL) {
+		return ENOMEM;
+	}
+	err = _plist_bpl_utf8(&bpl->bp_buf[obj->bpo_start], obj->bpo_count,
+			      str, lenp);
+	if (err != 0) {
+		free(str);
+		return err;
+	}
+	*strp = str;
+	return 0;
+}
+
+static int
+_plist_bpl_int(plist_bpl_t *bpl, const struct plist_bpl_obj_s *obj,
+	       int64_t *valp)
+{
+	uint64_t hi;
+	uint64_t lo;
+	const uint8_t *cp = &bpl->bp_buf[obj->bpo_start];
+
+	switch (obj->bpo_info) {
+	case 0:
+	case 1:
+	case 2:
+		/* the small sizes are unsigned */
+		*valp = _plist_bpl_uint(cp, 1u << obj->bpo_info);
+		return 0;
+	case 3:
+		*valp = (int64_t) _plist_bpl_uint(cp, 8);
+		return 0;
+	default:
+		hi = _plist_bpl_uint(cp, 8);
+		lo = _plist_bpl_uint(&cp[8], 8);
+		if ((hi == 0 && (lo >> 63) == 0) ||
+		    (hi == UINT64_MAX && (lo >> 63) == 1)) {
+			*valp = (int64_t) lo;
+			return 0;
+		}
+		return ERANGE;
+	}
+}
+
+static double
+_plist_bpl_double(plist_bpl_t *bpl, const struct plist_bpl_obj_s *obj)
+{
+	float f;
+	double d;
+	uint32_t u32;
+	uint64_t u64;
+	const uint8_t *cp = &bpl->bp_buf[obj->bpo_start];
+
+	if (obj->bpo_info == 2) {
+		u32 = _plist_bpl_uint(cp, 4);
+		memcpy(&f, &u32, sizeof(f));
+		return f;
+	}
+	u64 = _plist_bpl_uint(cp, 8);
+	memcpy(&d, &u64, sizeof(d));
+	return d;
+}
+
+static int
+_plist_bpl_tm(double secs, struct tm *tm)
+{
+	time_t t;
+
+	secs += BPL_EPOCH;
+	if (!isfinite(secs) || secs < -67768040609740800.0 ||
+	    secs > 67768036191676799.0) {
+		/* outside of what a struct tm year can hold */
+		return ERANGE;
+	}
+	t = (time_t) secs;
+	if ((double) t > secs) {
+		/* round toward the earlier second */
+		t--;
+	}
+	if (gmtime_r(&t, tm) == NULL) {
+		return ERANGE;
+	}
+	return 0;
+}
+
+static int
+_plist_bpl_check(plist_bpl_t *bpl)
+{
+	uint64_t i;
+	uint64_t off;
+	uint64_t offtab;
+	const uint8_t *trailer;
+
+	if (bpl->bp_sz < BPL_HEADERSZ + BPL_TRAILERSZ + 1 ||
+	    memcmp(bpl->bp_buf, BPL_MAGIC, BPL_HEADERSZ) != 0) {
+		return EINVAL;
+	}
+
+	/* 6 unused bytes, offset size, reference size, object count, top
+	 * object and offset table offset */
+	trailer = &bpl->bp_buf[bpl->bp_sz - BPL_TRAILERSZ];
+	bpl->bp_offsz = trailer[6];
+	bpl->bp_refsz = trailer[7];
+	bpl->bp_nobjs = _plist_bpl_uint(&trailer[8], 8);
+	bpl->bp_top = _plist_bpl_uint(&trailer[16], 8);
+	offtab = _plist_bpl_uint(&trailer[24], 8);
+	if (bpl->bp_offsz < 1 || bpl->bp_offsz > 8 ||
+	    bpl->bp_refsz < 1 || bpl->bp_refsz > 8 ||
+	    bpl->bp_nobjs == 0 || bpl->bp_top >= bpl->bp_nobjs) {
+		return EINVAL;
+	}
+	if (offtab <= BPL_HEADERSZ ||
+	    offtab > bpl->bp_sz - BPL_TRAILERSZ ||
+	    bpl->bp_nobjs > (bpl->bp_sz - BPL_TRAILERSZ - offtab) /
+			    bpl->bp_offsz) {
+		return EINVAL;
+	}
+	if (bpl->bp_refsz < 8 && (bpl->bp_nobjs - 1) >> (bpl->bp_refsz * 8)) {
+		/* some objects could not be referred to */
+		return EINVAL;
+	}
+	bpl->bp_offtab = offtab;
+
+	/* every object starts between the header and the offset table */
+	for (i = 0; i < bpl->bp_nobjs; i++) {
+		off = _plist_bpl_uint(&bpl->bp_buf[offtab + i * bpl->bp_offsz],
+				      bpl->bp_offsz);
+		if (off < BPL_HEADERSZ || off >= offtab) {
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
+int
+plist_bpl_new(plist_bpl_t **bplpp, const void *buf, size_t sz)
+{
+	int err;
+	plist_bpl_t *bpl;
+
+	if (!bplpp || (!buf && sz != 0)) {
+		return EINVAL;
+	}
+	bpl = malloc(sizeof(*bpl));
+	if (bpl == NULL) {
+		return ENOMEM;
+	}
+	memset(bpl, 0, sizeof(*bpl));
+	bpl->bp_buf = buf;
+	bpl->bp_sz = sz;
+
+	err = _plist_bpl_check(bpl);
+	if (err != 0) {
+		free(bpl);
+		return err;
+	}
+	*bplpp = bpl;
+	return 0;
+}
+
+/**
+ * Read a file that cannot be mapped into one buffer
+ */
+static int
+_plist_bpl_read(int fd, void **bufp, size_t *szp)
+{
+	int err;
+	void *ptr;
+	char *buf;
+	size_t sz;
+	size_t maxsz;
+	ssize_t n;
+
+	buf = NULL;
+	sz = 0;
+	maxsz = 0;
+	for (;;) {
+		if (maxsz - sz < BPL_READSZ) {
+			maxsz = (maxsz == 0) ? BPL_READSZ : maxsz * 2;
+			ptr = realloc(buf, maxsz);
+			if (ptr == NULL) {
+				err = ENOMEM;
+				break;
+			}
+			buf = ptr;
+		}
+		n = read(fd, &buf[sz], maxsz - sz);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err = errno;
+			break;
+		}
+		if (n == 0) {
+			*bufp = buf;
+			*szp = sz;
+			return 0;
+		}
+		sz += n;
+	}
+	free(buf);
+	return err;
+}
+
+int
+plist_bpl_open(plist_bpl_t **bplpp, const char *path)
+{
+	int fd;
+	int err;
+	void *buf;
+	size_t sz;
+	struct stat st;
+	plist_bpl_t *bpl;
+
+	if (!bplpp || !path) {
+		return EINVAL;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	if (fstat(fd, &st) != 0) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+
+	buf = MAP_FAILED;
+	sz = st.st_size;
+	if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    (off_t) sz == st.st_size) {
+		buf = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	if (buf == MAP_FAILED) {
+		err = _plist_bpl_read(fd, &buf, &sz);
+		close(fd);
+		if (err != 0) {
+			return err;
+		}
+		err = plist_bpl_new(&bpl, buf, sz);
+		if (err != 0) {
+			free(buf);
+			return err;
+		}
+		bpl->bp_mem = buf;
+		*bplpp = bpl;
+		return 0;
+	}
+	close(fd);
+
+	err = plist_bpl_new(&bpl, buf, sz);
+	if (err != 0) {
+		munmap(buf, sz);
+		return err;
+	}
+	bpl->bp_mapsz = sz;
+	*bplpp = bpl;
+	return 0;
+}
+
+void
+plist_bpl_free(plist_bpl_t *bpl)
+{
+	if (bpl == NULL) {
+		return;
+	}
+	if (bpl->bp_mapsz != 0) {
+		munmap((void *) bpl->bp_buf, bpl->bp_mapsz);
+	}
+	free(bpl->bp_mem);
+	free(bpl);
+}
+
+
+int
+plist_bpl_root(plist_bpl_t *bpl, plist_bpl_node_t *nodep)
+{
+	if (!bpl || !nodep) {
+		return EINVAL;
+	}
+	return _plist_bpl_node(bpl, bpl->bp_top, nodep);
+}
+
+enum plist_elem_e
+plist_bpl_type(plist_bpl_t *bpl, const plist_bpl_node_t *node)
+{
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !node || _plist_bpl_obj(bpl, node, &obj) != 0) {
+		return PLIST_UNKNOWN;
+	}
+	switch (obj.bpo_kind) {
+	case BPL_SIMPLE:
+		if (obj.bpo_info == (BPL_FALSE & 0x0f) ||
+		    obj.bpo_info == (BPL_TRUE & 0x0f)) {
+			return PLIST_BOOLEAN;
+		}
+		return PLIST_UNKNOWN;
+	case BPL_INT:
+		return PLIST_INTEGER;
+	case BPL_REAL:
+		return PLIST_REAL;
+	case BPL_DATE:
+		return PLIST_DATE;
+	case BPL_DATA:
+		return PLIST_DATA;
+	case BPL_ASCII:
+	case BPL_UTF16:
+		return PLIST_STRING;
+	case BPL_ARRAY:
+	case BPL_SET:
+		return PLIST_ARRAY;
+	case BPL_DICT:
+		return PLIST_DICT;
+	default:
+		return PLIST_UNKNOWN;
+	}
+}
+
+int
+plist_bpl_count(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		size_t *countp)
+{
+	int err;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !node || !countp) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_ARRAY && obj.bpo_kind != BPL_SET &&
+	    obj.bpo_kind != BPL_DICT) {
+		return EINVAL;
+	}
+	*countp = obj.bpo_count;
+	return 0;
+}
+
+int
+plist_bpl_at(plist_bpl_t *bpl, const plist_bpl_node_t *array,
+	     size_t n, plist_bpl_node_t *valp)
+{
+	int err;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !array || !valp) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, array, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_ARRAY && obj.bpo_kind != BPL_SET) {
+		return EINVAL;
+	}
+	if (n >= obj.bpo_count) {
+		return ENOENT;
+	}
+	return _plist_bpl_ref(bpl, &obj, n, valp);
+}
+
+int
+plist_bpl_entry(plist_bpl_t *bpl, const plist_bpl_node_t *dict,
+		size_t n, plist_bpl_node_t *keyp, plist_bpl_node_t *valp)
+{
+	int err;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !dict) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, dict, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_DICT) {
+		return EINVAL;
+	}
+	if (n >= obj.bpo_count) {
+		return ENOENT;
+	}
+	if (keyp != NULL) {
+		err = _plist_bpl_ref(bpl, &obj, n, keyp);
+		if (err != 0) {
+			return err;
+		}
+	}
+	if (valp != NULL) {
+		err = _plist_bpl_ref(bpl, &obj, obj.bpo_count + n, valp);
+	}
+	return err;
+}
+
+/**
+ * Compare a key object with a UTF-8 key
+ */
+static int
+_plist_bpl_keycmp(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		  const char *key, size_t keylen, bool *matchp)
+{
+	int err;
+	char *str;
+	size_t len;
+	struct plist_bpl_obj_s obj;
+
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	*matchp = false;
+	if (obj.bpo_kind == BPL_ASCII) {
+		*matchp = (obj.bpo_count == keylen &&
+			   memcmp(&bpl->bp_buf[obj.bpo_start], key,
+				  keylen) == 0);
+		return 0;
+	}
+	if (obj.bpo_kind != BPL_UTF16) {
+		return EINVAL;
+	}
+
+	/* each unit is one to three bytes of UTF-8 */
+	if (obj.bpo_count > keylen || obj.bpo_count * 3 < keylen) {
+		return 0;
+	}
+	err = _plist_bpl_str(bpl, &obj, &str, &len);
+	if (err != 0) {
+		return err;
+	}
+	*matchp = (len == keylen && memcmp(str, key, keylen) == 0);
+	free(str);
+	return 0;
+}
+
+int
+plist_bpl_lookup(plist_bpl_t *bpl, const plist_bpl_node_t *dict,
+		 const char *key, plist_bpl_node_t *valp)
+{
+	int err;
+	bool match;
+	size_t keylen;
+	uint64_t i;
+	plist_bpl_node_t knode;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !dict || !key || !valp) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, dict, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_DICT) {
+		return EINVAL;
+	}
+
+	keylen = strlen(key);
+	for (i = 0; i < obj.bpo_count; i++) {
+		err = _plist_bpl_ref(bpl, &obj, i, &knode);
+		if (err == 0) {
+			err = _plist_bpl_keycmp(bpl, &knode, key, keylen,
+						&match);
+		}
+		if (err != 0) {
+			return err;
+		}
+		if (match) {
+			return _plist_bpl_ref(bpl, &obj, obj.bpo_count + i,
+					      valp);
+		}
+	}
+	return ENOENT;
+}
+
+
+int
+plist_bpl_integer(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		  int64_t *valp)
+{
+	int err;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !node || !valp) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_INT) {
+		return EINVAL;
+	}
+	return _plist_bpl_int(bpl, &obj, valp);
+}
+
+int
+plist_bpl_real(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+	       double *valp)
+{
+	int err;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !node || !valp) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_REAL) {
+		return EINVAL;
+	}
+	*valp = _plist_bpl_double(bpl, &obj);
+	return 0;
+}
+
+int
+plist_bpl_boolean(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		  bool *valp)
+{
+	if (!bpl || !node || !valp) {
+		return EINVAL;
+	}
+	if (plist_bpl_type(bpl, node) != PLIST_BOOLEAN) {
+		return EINVAL;
+	}
+	*valp = (bpl->bp_buf[node->bpn_off] == BPL_TRUE);
+	return 0;
+}
+
+int
+plist_bpl_date(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+	       struct tm *tm)
+{
+	int err;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !node || !tm) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_DATE) {
+		return EINVAL;
+	}
+	return _plist_bpl_tm(_plist_bpl_double(bpl, &obj), tm);
+}
+
+int
+plist_bpl_data(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+	       const void **datap, size_t *szp)
+{
+	int err;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !node || !datap || !szp) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	if (obj.bpo_kind != BPL_DATA) {
+		return EINVAL;
+	}
+	*datap = &bpl->bp_buf[obj.bpo_start];
+	*szp = obj.bpo_count;
+	return 0;
+}
+
+int
+plist_bpl_string(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		 char **strp)
+{
+	int err;
+	size_t len;
+	struct plist_bpl_obj_s obj;
+
+	if (!bpl || !node || !strp) {
+		return EINVAL;
+	}
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	return _plist_bpl_str(bpl, &obj, strp, &len);
+}
+
+
+/**
+ * Decode state that is shared down the recursion
+ */
+struct plist_bpl_build_s {
+	plist_bpl_t *bb_bpl;
+	uint64_t bb_budget;	/* plist objects left to create */
+};
+
+static int _plist_bpl_build(struct plist_bpl_build_s *bb,
+			    const plist_bpl_node_t *node, int depth,
+			    plist_t **plistpp);
+
+/**
+ * Append a key to a dictionary without the duplicate scan of
+ * plist_dict_set, which would make large dictionaries quadratic
+ */
+static int
+_plist_bpl_dictadd(plist_t *dict, const char *name, size_t namelen,
+		   plist_t *value)
+{
+	plist_t *key;
+
+	key = malloc(sizeof(*key) + namelen + 1);
+	if (key == NULL) {
+		return ENOMEM;
+	}
+	memset(key, 0, sizeof(*key));
+
+	key->p_elem = PLIST_KEY;
+	key->p_key.pk_name = (char *) &key[1];
+	memcpy(key->p_key.pk_name, name, namelen);
+	key->p_key.pk_name[namelen] = '\0';
+	key->p_key.pk_value = value;
+	value->p_parent = key;
+
+	dict->p_dict.pd_numkeys++;
+	TAILQ_INSERT_TAIL(&dict->p_dict.pd_keys, key, p_entry);
+	key->p_parent = dict;
+	return 0;
+}
+
+static int
+_plist_bpl_container(struct plist_bpl_build_s *bb,
+		     const struct plist_bpl_obj_s *obj, int depth,
+		     plist_t *parent)
+{
+	int err;
+	char *name;
+	const char *key;
+	size_t len;
+	uint64_t i;
+	plist_t *value;
+	plist_bpl_node_t node;
+	struct plist_bpl_obj_s kobj;
+
+	for (i = 0; i < obj->bpo_count; i++) {
+		if (obj->bpo_kind != BPL_DICT) {
+			err = _plist_bpl_ref(bb->bb_bpl, obj, i, &node);
+			if (err == 0) {
+				err = _plist_bpl_build(bb, &node, depth + 1,
+						       &value);
+			}
+			if (err != 0) {
+				return err;
+			}
+			err = plist_array_append(parent, value);
+			if (err != 0) {
+				plist_free(value);
+				return err;
+			}
+			continue;
+		}
+
+		err = _plist_bpl_ref(bb->bb_bpl, obj, i, &node);
+		if (err == 0) {
+			err = _plist_bpl_obj(bb->bb_bpl, &node, &kobj);
+		}
+		if (err != 0) {
+			return err;
+		}
+		if (kobj.bpo_kind == BPL_ASCII) {
+			/* copied straight from the document into the key */
+			name = NULL;
+			key = (const char *) &bb->bb_bpl->bp_buf[kobj.bpo_start];
+			len = kobj.bpo_count;
+		} else {
+			err = _plist_bpl_str(bb->bb_bpl, &kobj, &name, &len);
+			if (err != 0) {
+				return err;
+			}
+			key = name;
+		}
+		err = _plist_bpl_ref(bb->bb_bpl, obj, obj->bpo_count + i,
+				     &node);
+		if (err == 0) {
+			err = _plist_bpl_build(bb, &node, depth + 1, &value);
+		}
+		if (err != 0) {
+			free(name);
+			return err;
+		}
+		err = _plist_bpl_dictadd(parent, key, len, value);
+		free(name);
+		if (err != 0) {
+			plist_free(value);
+			return err;
+		}
+	}
+	return 0;
+}
+
+static int
+_plist_bpl_build(struct plist_bpl_build_s *bb, const plist_bpl_node_t *node,
+		 int depth, plist_t **plistpp)
+{
+	int err;
+	char *str;
+	size_t len;
+	int64_t ll;
+	struct tm tm;
+	plist_t *ptmp;
+	plist_bpl_t *bpl = bb->bb_bpl;
+	struct plist_bpl_obj_s obj;
+
+	if (depth > PLIST_BPL_MAXDEPTH || bb->bb_budget == 0) {
+		return E2BIG;
+	}
+	bb->bb_budget--;
+
+	err = _plist_bpl_obj(bpl, node, &obj);
+	if (err != 0) {
+		return err;
+	}
+	switch (obj.bpo_kind) {
+	case BPL_SIMPLE:
+		if (obj.bpo_info != (BPL_FALSE & 0x0f) &&
+		    obj.bpo_info != (BPL_TRUE & 0x0f)) {
+			return ENOTSUP;
+		}
+		return plist_boolean_new(plistpp,
+					 obj.bpo_info == (BPL_TRUE & 0x0f));
+	case BPL_INT:
+		err = _plist_bpl_int(bpl, &obj, &ll);
+		if (err != 0) {
+			return err;
+		}
+		if (ll < INT_MIN || ll > INT_MAX) {
+			return ERANGE;
+		}
+		return plist_integer_new(plistpp, (int) ll);
+	case BPL_REAL:
+		return plist_real_new(plistpp, _plist_bpl_double(bpl, &obj));
+	case BPL_DATE:
+		err = _plist_bpl_tm(_plist_bpl_double(bpl, &obj), &tm);
+		if (err != 0) {
+			return err;
+		}
+		return plist_date_new(plistpp, &tm);
+	case BPL_DATA:
+		return plist_data_new(plistpp, &bpl->bp_buf[obj.bpo_start],
+				      obj.bpo_count);
+	case BPL_ASCII:
+		return plist_nstring_new(plistpp,
+					 (const char *)
+					 &bpl->bp_buf[obj.bpo_start],
+					 obj.bpo_count);
+	case BPL_UTF16:
+		err = _plist_bpl_str(bpl, &obj, &str, &len);
+		if (err != 0) {
+			return err;
+		}
+		err = plist_nstring_new(plistpp, str, len);
+		free(str);
+		return err;
+	case BPL_ARRAY:
+	case BPL_SET:
+		err = plist_array_new(&ptmp);
+		break;
+	case BPL_DICT:
+		err = plist_dict_new(&ptmp);
+		break;
+	default:
+		return ENOTSUP;
+	}
+	if (err != 0) {
+		return err;
+	}
+	err = _plist_bpl_container(bb, &obj, depth, ptmp);
+	if (err != 0) {
+		plist_free(ptmp);
+		return err;
+	}
+	*plistpp = ptmp;
+	return 0;
+}
+
+int
+plist_bpl_plist(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		plist_t **plistpp)
+{
+	struct plist_bpl_build_s bb;
+
+	if (!bpl || !node || !plistpp) {
+		return EINVAL;
+	}
+	bb.bb_bpl = bpl;
+	bb.bb_budget = bpl->bp_nobjs * BPL_EXPAND;
+	if (bb.bb_budget / BPL_EXPAND != bpl->bp_nobjs) {
+		bb.bb_budget = UINT64_MAX;
+	}
+	return _plist_bpl_build(&bb, node, 0, plistpp);
+}
+
+
+/*
+ * Writer
+ *
+ * The first pass flattens the tree into the object table, sharing one
+ * object between equal strings, numbers, dates and data, and records
+ * the references of each container. The sizes of the offsets and the
+ * references then follow from the object count and the total size, and
+ * the second pass streams the objects, the offset table and the
+ * trailer out in order.
+ */
+
+#define BPL_OUTSZ      (64 * 1024) /* staging buffer for a descriptor */
+#define BPL_HASHMIN    (256)
+
+/**
+ * Object of the document that is being written
+ */
+struct plist_bpl_wobj_s {
+	const plist_t *bwo_plist;	/* element, NULL for a key */
+	const char *bwo_str;		/* string or key */
+	size_t bwo_len;			/* bytes of a string or data */
+	uint64_t bwo_count;		/* UTF-16 units or container elements */
+	uint64_t bwo_val;		/* number bits or the first reference */
+	uint32_t bwo_hash;
+	uint8_t bwo_kind;
+	uint8_t bwo_info;
+};
+
+/**
+ * Entry of the table of shared objects, with the hash kept next to the
+ * object number so that a probe only reads the object on a likely match
+ */
+struct plist_bpl_wslot_s {
+	uint64_t bws_obj;
+	uint32_t bws_hash;
+};
+
+/**
+ * Open container while the tree is flattened
+ */
+struct plist_bpl_wframe_s {
+	const plist_t *bwf_next;	/* next element or key to visit */
+	uint64_t bwf_base;		/* first reference of the container */
+	uint64_t bwf_count;
+	uint64_t bwf_idx;
+	bool bwf_dict;
+};
+
+struct plist_bpl_writer_s {
+	struct plist_bpl_wobj_s *bw_objs;
+	uint64_t bw_nobjs;
+	uint64_t bw_maxobjs;
+
+	/* object numbers of the children of every container */
+	uint64_t *bw_refs;
+	uint64_t bw_nrefs;
+	uint64_t bw_maxrefs;
+
+	/* open addressed table of the shared objects */
+	struct plist_bpl_wslot_s *bw_hash;
+	uint64_t bw_hashsz;
+	uint64_t bw_nhashed;
+
+	struct plist_bpl_wframe_s *bw_stack;
+	size_t bw_depth;
+	size_t bw_maxdepth;
+
+	unsigned bw_offsz;
+	unsigned bw_refsz;
+
+	/* output, either the whole document or a staging buffer */
+	int bw_fd;
+	uint8_t *bw_out;
+	size_t bw_outsz;
+	size_t bw_fill;
+};
+
+static unsigned
+_plist_bpl_width(uint64_t val)
+{
+	unsigned n;
+
+	for (n = 1; n < 8 && (val >> (n * 8)) != 0; n++)
+		;
+	return n;
+}
+
+/**
+ * Low nibble of the integer marker for a count, which is the power of
+ * two of its size
+ */
+static unsigned
+_plist_bpl_intinfo(uint64_t val)
+{
+	unsigned n = _plist_bpl_width(val);
+
+	return (n > 4) ? 3 : (n > 2) ? 2 : n - 1;
+}
+
+/**
+ * Count the UTF-16 units of a UTF-8 string and store them when out is
+ * set. Any byte above 0x7f makes the whole string UTF-16.
+ */
+static int
+_plist_bpl_utf16(const char *s, size_t len, uint8_t *out, uint64_t *unitsp)
+{
+	size_t i;
+	size_t k;
+	size_t n;
+	uint32_t c;
+	uint32_t min;
+	uint64_t units;
+	const uint8_t *cp = (const uint8_t *) s;
+
+	units = 0;
+	for (i = 0; i < len; i += n) {
+		c = cp[i];
+		if (c < 0x80) {
+			n = 1;
+			min = 0;
+		} else if ((c & 0xe0) == 0xc0) {
+			n = 2;
+			min = 0x80;
+			c &= 0x1f;
+		} else if ((c & 0xf0) == 0xe0) {
+			n = 3;
+			min = 0x800;
+			c &= 0x0f;
+		} else if ((c & 0xf8) == 0xf0) {
+			n = 4;
+			min = 0x10000;
+			c &= 0x07;
+		} else {
+			return EINVAL;
+		}
+		if (len - i < n) {
+			return EINVAL;
+		}
+		for (k = 1; k < n; k++) {
+			if ((cp[i + k] & 0xc0) != 0x80) {
+				return EINVAL;
+			}
+			c = (c << 6) | (cp[i + k] & 0x3f);
+		}
+		if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+			return EINVAL;
+		}
+
+		if (c >= 0x10000) {
+			if (out != NULL) {
+				c -= 0x10000;
+				out[units * 2] = 0xd8 | (c >> 18);
+				out[units * 2 + 1] = (c >> 10) & 0xff;
+				out[units * 2 + 2] = 0xdc | ((c >> 8) & 0x03);
+				out[units * 2 + 3] = c & 0xff;
+			}
+			units += 2;
+		} else {
+			if (out != NULL) {
+				out[units * 2] = c >> 8;
+				out[units * 2 + 1] = c & 0xff;
+			}
+			units++;
+		}
+	}
+	*unitsp = units;
+	return 0;
+}
+
+static uint32_t
+_plist_bpl_hashbytes(uint32_t h, const void *buf, size_t len)
+{
+	const uint8_t *cp = buf;
+
+	while (len-- > 0) {
+		h = (h ^ *cp++) * 16777619u;
+	}
+	return h;
+}
+
+static bool
+_plist_bpl_wequal(const struct plist_bpl_wobj_s *a,
+		  const struct plist_bpl_wobj_s *b)
+{
+	if (a->bwo_hash != b->bwo_hash || a->bwo_kind != b->bwo_kind ||
+	    a->bwo_info != b->bwo_info || a->bwo_val != b->bwo_val ||
+	    a->bwo_len != b->bwo_len) {
+		return false;
+	}
+	switch (a->bwo_kind) {
+	case BPL_ASCII:
+	case BPL_UTF16:
+		return memcmp(a->bwo_str, b->bwo_str, a->bwo_len) == 0;
+	case BPL_DATA:
+		return memcmp(a->bwo_plist->p_data.pd_data,
+			      b->bwo_plist->p_data.pd_data, a->bwo_len) == 0;
+	default:
+		return true;
+	}
+}
+
+static int
+_plist_bpl_rehash(struct plist_bpl_writer_s *bw)
+{
+	uint64_t i;
+	uint64_t j;
+	uint64_t mask;
+	uint64_t hashsz;
+	struct plist_bpl_wslot_s *hash;
+
+	hashsz = (bw->bw_hashsz == 0) ? BPL_HASHMIN : bw->bw_hashsz * 2;
+	hash = malloc(hashsz * sizeof(*hash));
+	if (hash == NULL) {
+		return ENOMEM;
+	}
+	for (i = 0; i < hashsz; i++) {
+		hash[i].bws_obj = UINT64_MAX;
+	}
+	mask = hashsz - 1;
+	for (i = 0; i < bw->bw_hashsz; i++) {
+		if (bw->bw_hash[i].bws_obj == UINT64_MAX) {
+			continue;
+		}
+		j = bw->bw_hash[i].bws_hash & mask;
+		while (hash[j].bws_obj != UINT64_MAX) {
+			j = (j + 1) & mask;
+		}
+		hash[j] = bw->bw_hash[i];
+	}
+	free(bw->bw_hash);
+	bw->bw_hash = hash;
+	bw->bw_hashsz = hashsz;
+	return 0;
+}
+
+/**
+ * Add an object to the table, or find the number of an equal one for
+ * anything but a container
+ */
+static int
+_plist_bpl_add(struct plist_bpl_writer_s *bw, struct plist_bpl_wobj_s *wo,
+	       uint64_t *objp)
+{
+	int err;
+	void *ptr;
+	uint64_t j;
+	uint64_t maxobjs;
+	bool shared;
+
+	shared = (wo->bwo_kind != BPL_ARRAY && wo->bwo_kind != BPL_DICT);
+	if (shared) {
+		if (bw->bw_nhashed * 2 >= bw->bw_hashsz) {
+			err = _plist_bpl_rehash(bw);
+			if (err != 0) {
+				return err;
+			}
+		}
+		j = wo->bwo_hash & (bw->bw_hashsz - 1);
+		while (bw->bw_hash[j].bws_obj != UINT64_MAX) {
+			if (bw->bw_hash[j].bws_hash == wo->bwo_hash &&
+			    _plist_bpl_wequal(&bw->bw_objs[
+					      bw->bw_hash[j].bws_obj], wo)) {
+				*objp = bw->bw_hash[j].bws_obj;
+				return 0;
+			}
+			j = (j + 1) & (bw->bw_hashsz - 1);
+		}
+		bw->bw_hash[j].bws_obj = bw->bw_nobjs;
+		bw->bw_hash[j].bws_hash = wo->bwo_hash;
+		bw->bw_nhashed++;
+	}
+
+	if (bw->bw_nobjs == bw->bw_maxobjs) {
+		maxobjs = (bw->bw_maxobjs == 0) ? 64 : bw->bw_maxobjs * 2;
+		ptr = realloc(bw->bw_objs, maxobjs * sizeof(*bw->bw_objs));
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		bw->bw_objs = ptr;
+		bw->bw_maxobjs = maxobjs;
+	}
+	bw->bw_objs[bw->bw_nobjs] = *wo;
+	*objp = bw->bw_nobjs++;
+	return 0;
+}
+
+static int
+_plist_bpl_addstr(struct plist_bpl_writer_s *bw, const char *s,
+		  uint64_t *objp)
+{
+	int err;
+	size_t i;
+	struct plist_bpl_wobj_s wo;
+
+	memset(&wo, 0, sizeof(wo));
+	wo.bwo_str = s;
+	wo.bwo_len = strlen(s);
+	wo.bwo_kind = BPL_ASCII;
+	wo.bwo_count = wo.bwo_len;
+	for (i = 0; i < wo.bwo_len; i++) {
+		if ((unsigned char) s[i] >= 0x80) {
+			wo.bwo_kind = BPL_UTF16;
+			break;
+		}
+	}
+	if (wo.bwo_kind == BPL_UTF16) {
+		err = _plist_bpl_utf16(s, wo.bwo_len, NULL, &wo.bwo_count);
+		if (err != 0) {
+			return err;
+		}
+	}
+	wo.bwo_hash = _plist_bpl_hashbytes(2166136261u, s, wo.bwo_len);
+	return _plist_bpl_add(bw, &wo, objp);
+}
+
+static int
+_plist_bpl_push(struct plist_bpl_writer_s *bw, const plist_t *plist,
+		uint64_t obj)
+{
+	void *ptr;
+	size_t maxdepth;
+	uint64_t nrefs;
+	uint64_t maxrefs;
+	struct plist_bpl_wframe_s *bwf;
+
+	if (bw->bw_depth == bw->bw_maxdepth) {
+		maxdepth = (bw->bw_maxdepth == 0) ? 16 : bw->bw_maxdepth * 2;
+		ptr = realloc(bw->bw_stack, maxdepth * sizeof(*bw->bw_stack));
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		bw->bw_stack = ptr;
+		bw->bw_maxdepth = maxdepth;
+	}
+	bwf = &bw->bw_stack[bw->bw_depth];
+	bwf->bwf_idx = 0;
+	bwf->bwf_base = bw->bw_nrefs;
+	bwf->bwf_dict = (plist->p_elem == PLIST_DICT);
+	if (bwf->bwf_dict) {
+		bwf->bwf_next = TAILQ_FIRST(&plist->p_dict.pd_keys);
+		bwf->bwf_count = plist->p_dict.pd_numkeys;
+		nrefs = bwf->bwf_count * 2;
+	} else {
+		bwf->bwf_next = TAILQ_FIRST(&plist->p_array.pa_elems);
+		bwf->bwf_count = plist->p_array.pa_numelems;
+		nrefs = bwf->bwf_count;
+	}
+
+	if (bw->bw_maxrefs - bw->bw_nrefs < nrefs) {
+		maxrefs = (bw->bw_maxrefs == 0) ? 64 : bw->bw_maxrefs;
+		while (maxrefs - bw->bw_nrefs < nrefs) {
+			maxrefs *= 2;
+		}
+		ptr = realloc(bw->bw_refs, maxrefs * sizeof(*bw->bw_refs));
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		bw->bw_refs = ptr;
+		bw->bw_maxrefs = maxrefs;
+	}
+	bw->bw_nrefs += nrefs;
+	bw->bw_objs[obj].bwo_val = bwf->bwf_base;
+	bw->bw_depth++;
+	return 0;
+}
+
+/**
+ * Put one element in the object table
+ */
+static int
+_plist_bpl_visit(struct plist_bpl_writer_s *bw, const plist_t *plist,
+		 uint64_t *objp)
+{
+	int err;
+	time_t t;
+	double d;
+	struct tm tm;
+	struct plist_bpl_wobj_s wo;
+
+	memset(&wo, 0, sizeof(wo));
+	wo.bwo_plist = plist;
+	switch (plist->p_elem) {
+	case PLIST_DICT:
+	case PLIST_ARRAY:
+		wo.bwo_kind = (plist->p_elem == PLIST_DICT) ?
+			      BPL_DICT : BPL_ARRAY;
+		err = _plist_bpl_add(bw, &wo, objp);
+		if (err == 0) {
+			err = _plist_bpl_push(bw, plist, *objp);
+		}
+		return err;
+	case PLIST_STRING:
+		return _plist_bpl_addstr(bw, plist->p_string.ps_str, objp);
+	case PLIST_DATA:
+		wo.bwo_kind = BPL_DATA;
+		wo.bwo_len = plist->p_data.pd_datasz;
+		wo.bwo_count = wo.bwo_len;
+		wo.bwo_hash = _plist_bpl_hashbytes(2166136261u,
+						   plist->p_data.pd_data,
+						   wo.bwo_len);
+		break;
+	case PLIST_INTEGER:
+		wo.bwo_kind = BPL_INT;
+		wo.bwo_val = (uint64_t) (int64_t) plist->p_integer.pi_int;
+		if (plist->p_integer.pi_int < 0) {
+			wo.bwo_info = 3;
+		} else {
+			/* 1, 2 or 4 bytes */
+			wo.bwo_info = _plist_bpl_intinfo(wo.bwo_val);
+		}
+		break;
+	case PLIST_REAL:
+		wo.bwo_kind = BPL_REAL;
+		wo.bwo_info = 3;
+		memcpy(&wo.bwo_val, &plist->p_real.pr_double,
+		       sizeof(wo.bwo_val));
+		break;
+	case PLIST_BOOLEAN:
+		wo.bwo_kind = BPL_SIMPLE;
+		wo.bwo_info = plist->p_boolean.pb_bool ?
+			      (BPL_TRUE & 0x0f) : (BPL_FALSE & 0x0f);
+		break;
+	case PLIST_DATE:
+		wo.bwo_kind = BPL_DATE;
+		wo.bwo_info = 3;
+		/* the fields are local to the offset the date was read with */
+		tm = plist->p_date.pd_tm;
+		t = timegm(&tm) - plist->p_date.pd_tm.tm_gmtoff;
+		d = (double) t - BPL_EPOCH;
+		memcpy(&wo.bwo_val, &d, sizeof(wo.bwo_val));
+		break;
+	default:
+		return EINVAL;
+	}
+	wo.bwo_hash = _plist_bpl_hashbytes(wo.bwo_hash ^ wo.bwo_kind,
+					   &wo.bwo_val, sizeof(wo.bwo_val));
+	return _plist_bpl_add(bw, &wo, objp);
+}
+
+/**
+ * Flatten the tree without recursion so that the depth of a document
+ * is only limited by memory
+ */
+static int
+_plist_bpl_flatten(struct plist_bpl_writer_s *bw, const plist_t *plist)
+{
+	int err;
+	uint64_t obj;
+	uint64_t slot;
+	const plist_t *child;
+	struct plist_bpl_wframe_s *bwf;
+
+	err = _plist_bpl_visit(bw, plist, &obj);
+	while (err == 0 && bw->bw_depth > 0) {
+		bwf = &bw->bw_stack[bw->bw_depth - 1];
+		child = bwf->bwf_next;
+		if (child == NULL) {
+			if (bwf->bwf_idx != bwf->bwf_count) {
+				return EINVAL;
+			}
+			bw->bw_depth--;
+			continue;
+		}
+		if (bwf->bwf_idx == bwf->bwf_count) {
+			/* more elements than the count */
+			return EINVAL;
+		}
+		bwf->bwf_next = TAILQ_NEXT(child, p_entry);
+		slot = bwf->bwf_base + bwf->bwf_idx;
+		if (bwf->bwf_dict) {
+			err = _plist_bpl_addstr(bw, child->p_key.pk_name, &obj);
+			if (err != 0) {
+				break;
+			}
+			bw->bw_refs[slot] = obj;
+			slot += bwf->bwf_count;
+			child = child->p_key.pk_value;
+			if (child == NULL) {
+				return EINVAL;
+			}
+		}
+		bwf->bwf_idx++;
+
+		/* the frame can move when a container is pushed */
+		err = _plist_bpl_visit(bw, child, &obj);
+		if (err == 0) {
+			bw->bw_refs[slot] = obj;
+		}
+	}
+	return err;
+}
+
+/**
+ * Encoded size of an object
+ */
+static uint64_t
+_plist_bpl_wsize(struct plist_bpl_writer_s *bw,
+		 const struct plist_bpl_wobj_s *wo)
+{
+	uint64_t sz;
+
+	switch (wo->bwo_kind) {
+	case BPL_SIMPLE:
+		return 1;
+	case BPL_INT:
+	case BPL_REAL:
+	case BPL_DATE:
+		return 1 + (1u << wo->bwo_info);
+	case BPL_ASCII:
+	case BPL_DATA:
+		sz = wo->bwo_count;
+		break;
+	case BPL_UTF16:
+		sz = wo->bwo_count * 2;
+		break;
+	case BPL_ARRAY:
+		sz = wo->bwo_count * bw->bw_refsz;
+		break;
+	default:
+		sz = wo->bwo_count * 2 * bw->bw_refsz;
+		break;
+	}
+	if (wo->bwo_count >= 15) {
+		sz += 1 + (1u << _plist_bpl_intinfo(wo->bwo_count));
+	}
+	return 1 + sz;
+}
+
+static int
+_plist_bpl_flush(struct plist_bpl_writer_s *bw)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < bw->bw_fill; off += n) {
+		n = write(bw->bw_fd, &bw->bw_out[off], bw->bw_fill - off);
+		if (n < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			return errno;
+		}
+	}
+	bw->bw_fill = 0;
+	return 0;
+}
+
+/**
+ * Make room for n bytes of output, which is never more than a marker
+ * and a count, or one number
+ */
+static inline int
+_plist_bpl_room(struct plist_bpl_writer_s *bw, size_t n)
+{
+	if (bw->bw_outsz - bw->bw_fill >= n) {
+		return 0;
+	}
+	return (bw->bw_fd < 0) ? EINVAL : _plist_bpl_flush(bw);
+}
+
+static inline void
+_plist_bpl_wuint(struct plist_bpl_writer_s *bw, uint64_t val, unsigned n)
+{
+	while (n-- > 0) {
+		bw->bw_out[bw->bw_fill++] = val >> (n * 8);
+	}
+}
+
+static int
+_plist_bpl_wbytes(struct plist_bpl_writer_s *bw, const void *buf, size_t len)
+{
+	int err;
+	size_t n;
+	const uint8_t *cp = buf;
+
+	while (len > 0) {
+		err = _plist_bpl_room(bw, 1);
+		if (err != 0) {
+			return err;
+		}
+		n = bw->bw_outsz - bw->bw_fill;
+		n = (len < n) ? len : n;
+		memcpy(&bw->bw_out[bw->bw_fill], cp, n);
+		bw->bw_fill += n;
+		cp += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+_plist_bpl_wobj(struct plist_bpl_writer_s *bw,
+		const struct plist_bpl_wobj_s *wo)
+{
+	int err;
+	unsigned w;
+	uint64_t i;
+	uint64_t nrefs;
+	uint8_t units[4 * 64];
+	const char *cp;
+	const char *ep;
+
+	err = _plist_bpl_room(bw, 1 + 1 + 8);
+	if (err != 0) {
+		return err;
+	}
+	switch (wo->bwo_kind) {
+	case BPL_SIMPLE:
+		bw->bw_out[bw->bw_fill++] = wo->bwo_info;
+		return 0;
+	case BPL_INT:
+	case BPL_REAL:
+	case BPL_DATE:
+		bw->bw_out[bw->bw_fill++] = (wo->bwo_kind << 4) | wo->bwo_info;
+		_plist_bpl_wuint(bw, wo->bwo_val, 1u << wo->bwo_info);
+		return 0;
+	default:
+		break;
+	}
+
+	if (wo->bwo_count < 15) {
+		bw->bw_out[bw->bw_fill++] = (wo->bwo_kind << 4) |
+					    wo->bwo_count;
+	} else {
+		w = _plist_bpl_intinfo(wo->bwo_count);
+		bw->bw_out[bw->bw_fill++] = (wo->bwo_kind << 4) | 0x0f;
+		bw->bw_out[bw->bw_fill++] = (BPL_INT << 4) | w;
+		_plist_bpl_wuint(bw, wo->bwo_count, 1u << w);
+	}
+
+	switch (wo->bwo_kind) {
+	case BPL_ASCII:
+		return _plist_bpl_wbytes(bw, wo->bwo_str, wo->bwo_len);
+	case BPL_DATA:
+		return _plist_bpl_wbytes(bw, wo->bwo_plist->p_data.pd_data,
+					 wo->bwo_len);
+	case BPL_UTF16:
+		/* convert a piece at a time on character boundaries */
+		cp = wo->bwo_str;
+		ep = cp + wo->bwo_len;
+		while (cp < ep) {
+			const char *pp = cp;
+
+			for (i = 0; pp < ep && i < 64; i++) {
+				do {
+					pp++;
+				} while (pp < ep && (*pp & 0xc0) == 0x80);
+			}
+			err = _plist_bpl_utf16(cp, pp - cp, units, &i);
+			if (err == 0) {
+				err = _plist_bpl_wbytes(bw, units, i * 2);
+			}
+			if (err != 0) {
+				return err;
+			}
+			cp = pp;
+		}
+		return 0;
+	default:
+		nrefs = wo->bwo_count * ((wo->bwo_kind == BPL_DICT) ? 2 : 1);
+		for (i = 0; i < nrefs; i++) {
+			err = _plist_bpl_room(bw, 8);
+			if (err != 0) {
+				return err;
+			}
+			_plist_bpl_wuint(bw, bw->bw_refs[wo->bwo_val + i],
+					 bw->bw_refsz);
+		}
+		return 0;
+	}
+}
+
+/**
+ * Size the document, then write it. The buffer is allocated at the
+ * exact size when there is no descriptor.
+ */
+static int
+_plist_bpl_emit(struct plist_bpl_writer_s *bw, const plist_t *plist,
+		void **bufp, size_t *szp)
+{
+	int err;
+	uint64_t i;
+	uint64_t off;
+	uint64_t offtab;
+	uint64_t docsz;
+	struct plist_bpl_wobj_s *wo;
+
+	err = _plist_bpl_flatten(bw, plist);
+	if (err != 0) {
+		return err;
+	}
+
+	/* the containers know their counts now */
+	for (i = 0; i < bw->bw_nobjs; i++) {
+		wo = &bw->bw_objs[i];
+		if (wo->bwo_kind == BPL_ARRAY) {
+			wo->bwo_count = wo->bwo_plist->p_array.pa_numelems;
+		} else if (wo->bwo_kind == BPL_DICT) {
+			wo->bwo_count = wo->bwo_plist->p_dict.pd_numkeys;
+		}
+	}
+	bw->bw_refsz = _plist_bpl_width(bw->bw_nobjs - 1);
+	off = BPL_HEADERSZ;
+	for (i = 0; i + 1 < bw->bw_nobjs; i++) {
+		off += _plist_bpl_wsize(bw, &bw->bw_objs[i]);
+	}
+	bw->bw_offsz = _plist_bpl_width(off);
+	offtab = off + _plist_bpl_wsize(bw, &bw->bw_objs[i]);
+	docsz = offtab + bw->bw_nobjs * bw->bw_offsz + BPL_TRAILERSZ;
+	if (docsz != (size_t) docsz) {
+		return E2BIG;
+	}
+
+	if (bw->bw_fd < 0) {
+		/* room for the largest piece that is checked at once */
+		bw->bw_outsz = docsz + BPL_TRAILERSZ;
+	} else {
+		bw->bw_outsz = BPL_OUTSZ;
+	}
+	bw->bw_out = malloc(bw->bw_outsz);
+	if (bw->bw_out == NULL) {
+		return ENOMEM;
+	}
+
+	err = _plist_bpl_wbytes(bw, BPL_MAGIC, BPL_HEADERSZ);
+	for (i = 0; err == 0 && i < bw->bw_nobjs; i++) {
+		err = _plist_bpl_wobj(bw, &bw->bw_objs[i]);
+	}
+	off = BPL_HEADERSZ;
+	for (i = 0; err == 0 && i < bw->bw_nobjs; i++) {
+		err = _plist_bpl_room(bw, 8);
+		if (err == 0) {
+			_plist_bpl_wuint(bw, off, bw->bw_offsz);
+			off += _plist_bpl_wsize(bw, &bw->bw_objs[i]);
+		}
+	}
+	if (err == 0) {
+		err = _plist_bpl_room(bw, BPL_TRAILERSZ);
+	}
+	if (err != 0) {
+		return err;
+	}
+	memset(&bw->bw_out[bw->bw_fill], 0, 6);
+	bw->bw_fill += 6;
+	bw->bw_out[bw->bw_fill++] = bw->bw_offsz;
+	bw->bw_out[bw->bw_fill++] = bw->bw_refsz;
+	_plist_bpl_wuint(bw, bw->bw_nobjs, 8);
+	_plist_bpl_wuint(bw, 0, 8);
+	_plist_bpl_wuint(bw, offtab, 8);
+
+	if (bw->bw_fd >= 0) {
+		return _plist_bpl_flush(bw);
+	}
+	if (bw->bw_fill != docsz) {
+		return EINVAL;
+	}
+	*bufp = bw->bw_out;
+	*szp = bw->bw_fill;
+	bw->bw_out = NULL;
+	return 0;
+}
+
+static void
+_plist_bpl_wfree(struct plist_bpl_writer_s *bw)
+{
+	free(bw->bw_objs);
+	free(bw->bw_refs);
+	free(bw->bw_hash);
+	free(bw->bw_stack);
+	free(bw->bw_out);
+}
+
+int
+plist_bpl_write(const plist_t *plist, int fd)
+{
+	int err;
+	struct plist_bpl_writer_s bw;
+
+	if (!plist || fd < 0) {
+		return EINVAL;
+	}
+	memset(&bw, 0, sizeof(bw));
+	bw.bw_fd = fd;
+	err = _plist_bpl_emit(&bw, plist, NULL, NULL);
+	_plist_bpl_wfree(&bw);
+	return err;
+}
+
+int
+plist_bpl_write_buf(const plist_t *plist, void **bufp, size_t *szp)
+{
+	int err;
+	struct plist_bpl_writer_s bw;
+
+	if (!plist || !bufp || !szp) {
+		return EINVAL;
+	}
+	memset(&bw, 0, sizeof(bw));
+	bw.bw_fd = -1;
+	err = _plist_bpl_emit(&bw, plist, bufp, szp);
+	_plist_bpl_wfree(&bw);
+	return err;
+}
@@ -0,0 +1,299 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_bpl.h
+ *
+ * Reader and writer for binary property lists (bplist00).
+ *
+ * A binary plist is a table of objects that refer to each other by
+ * number, with a trailer at the end of the file that gives the size of
+ * the references and where the offset table is. Opening a document
+ * checks the trailer and every entry of the offset table once, which is
+ * linear in the number of objects but touches none of them. Objects are
+ * decoded when they are visited, and a subtree becomes plist objects only
+ * when #plist_bpl_plist is called on it.
+ *
+ * The document is not copied. A file is mapped read only and a buffer
+ * has to stay valid for the life of the reader.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_BPL_H_
+#define _PLIST_BPL_H_
+
+#include <stdint.h>
+#include <plist.h>
+
+#define PLIST_BPL_MAXDEPTH  (512) /* deepest nesting for #plist_bpl_plist */
+
+/* forward declare */
+typedef struct plist_bpl_s plist_bpl_t;
+typedef struct plist_bpl_node_s plist_bpl_node_t;
+
+/**
+ * Reader of one binary document
+ */
+struct plist_bpl_s {
+	const uint8_t *bp_buf;
+	size_t bp_sz;
+	size_t bp_mapsz;	/* length of the mapping, zero for a buffer */
+	void *bp_mem;		/* copy of a file that could not be mapped */
+
+	/* from the trailer */
+	unsigned bp_offsz;	/* bytes in an offset table entry */
+	unsigned bp_refsz;	/* bytes in an object reference */
+	uint64_t bp_nobjs;
+	uint64_t bp_top;
+	size_t bp_offtab;	/* offset of the offset table */
+};
+
+/**
+ * Reference to an object in the document. This is only a position so
+ * it can be copied freely and nothing is allocated until
+ * #plist_bpl_plist is called on it.
+ */
+struct plist_bpl_node_s {
+	uint64_t bpn_obj;	/* object number */
+	size_t bpn_off;		/* offset of the object marker */
+};
+
+
+__BEGIN_DECLS
+
+/**
+ * Open a binary document in a buffer. The header, the trailer and every
+ * entry of the offset table are checked.
+ *
+ * @param  bplpp  result reader
+ * @param  buf    pointer to the document, which is not copied
+ * @param  sz     size of the document
+ * @return zero on success, EINVAL for a document that is not a binary
+ *         plist or is damaged, or an error value
+ */
+int plist_bpl_new(plist_bpl_t **bplpp, const void *buf, size_t sz);
+
+/**
+ * Open a binary document in a file by mapping it. Anything that cannot
+ * be mapped, like a pipe, is read into memory instead.
+ *
+ * @param  bplpp  result reader
+ * @param  path   file to map
+ * @return zero on success or an error value as for #plist_bpl_new
+ */
+int plist_bpl_open(plist_bpl_t **bplpp, const char *path);
+
+/**
+ * Free the reader and unmap the file
+ *
+ * @param  bpl  reader from #plist_bpl_new or #plist_bpl_open
+ */
+void plist_bpl_free(plist_bpl_t *bpl);
+
+/**
+ * Retrieve the top object of the document
+ *
+ * @param  bpl    reader from #plist_bpl_new or #plist_bpl_open
+ * @param  nodep  result object
+ * @return zero on success or an error value
+ */
+int plist_bpl_root(plist_bpl_t *bpl, plist_bpl_node_t *nodep);
+
+/**
+ * Determine the type of an object. A set is reported as an array, and
+ * null, fill and UID objects, which have no plist element, as
+ * PLIST_UNKNOWN.
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node  object to check
+ * @return the element type or PLIST_UNKNOWN
+ */
+enum plist_elem_e plist_bpl_type(plist_bpl_t *bpl,
+				 const plist_bpl_node_t *node);
+
+/**
+ * Count the keys in a dictionary or the elements in an array
+ *
+ * @param  bpl     reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node    dictionary or array object
+ * @param  countp  result count
+ * @return zero on success or an error value
+ */
+int plist_bpl_count(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		    size_t *countp);
+
+/**
+ * Find an element of an array by position
+ *
+ * @param  bpl    reader from #plist_bpl_new or #plist_bpl_open
+ * @param  array  array object
+ * @param  n      zero based position in the array
+ * @param  valp   result object
+ * @return zero on success, ENOENT past the end, or an error value
+ */
+int plist_bpl_at(plist_bpl_t *bpl, const plist_bpl_node_t *array,
+		 size_t n, plist_bpl_node_t *valp);
+
+/**
+ * Retrieve the key and the value of a dictionary entry by position
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  dict  dictionary object
+ * @param  n     zero based position in the dictionary
+ * @param  keyp  result key object, which is a string, or NULL
+ * @param  valp  result value object or NULL
+ * @return zero on success, ENOENT past the end, or an error value
+ */
+int plist_bpl_entry(plist_bpl_t *bpl, const plist_bpl_node_t *dict,
+		    size_t n, plist_bpl_node_t *keyp, plist_bpl_node_t *valp);
+
+/**
+ * Find the value of a key in a dictionary
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  dict  dictionary object
+ * @param  key   null terminated UTF-8 key to find
+ * @param  valp  result object
+ * @return zero on success, ENOENT if the key is missing, or an error
+ */
+int plist_bpl_lookup(plist_bpl_t *bpl, const plist_bpl_node_t *dict,
+		     const char *key, plist_bpl_node_t *valp);
+
+/**
+ * Read the value of an integer object. Binary integers are 64 bits so
+ * this is the way to get values that do not fit a plist integer.
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node  integer object
+ * @param  valp  result value
+ * @return zero on success, ERANGE for a 128 bit value that does not fit,
+ *         or EINVAL for another type
+ */
+int plist_bpl_integer(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		      int64_t *valp);
+
+/**
+ * Read the value of a real object
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node  real object
+ * @param  valp  result value
+ * @return zero on success or EINVAL for another type
+ */
+int plist_bpl_real(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		   double *valp);
+
+/**
+ * Read the value of a boolean object
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node  boolean object
+ * @param  valp  result value
+ * @return zero on success or EINVAL for another type
+ */
+int plist_bpl_boolean(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		      bool *valp);
+
+/**
+ * Read the value of a date object
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node  date object
+ * @param  tm    result broken down UTC time
+ * @return zero on success, ERANGE for a date that cannot be broken
+ *         down, or EINVAL for another type
+ */
+int plist_bpl_date(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		   struct tm *tm);
+
+/**
+ * Point at the bytes of a data object without copying them
+ *
+ * @param  bpl    reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node   data object
+ * @param  datap  result pointer into the document
+ * @param  szp    result length
+ * @return zero on success or EINVAL for another type
+ */
+int plist_bpl_data(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		   const void **datap, size_t *szp);
+
+/**
+ * Read a string object as UTF-8
+ *
+ * @param  bpl   reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node  string object
+ * @param  strp  result null terminated string that the caller frees
+ * @return zero on success, EINVAL for another type or a bad UTF-16
+ *         sequence, or an error value
+ */
+int plist_bpl_string(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		     char **strp);
+
+/**
+ * Decode an object and everything below it into a plist object.
+ * Integers have to fit a plist integer, nesting is limited to
+ * #PLIST_BPL_MAXDEPTH, which also stops reference cycles, and a
+ * document that expands to more than eight objects for each one it
+ * holds through shared references is refused. Duplicate keys in a
+ * dictionary are kept as they are, like PLIST_TXT_NODUPCHECK.
+ *
+ * @param  bpl      reader from #plist_bpl_new or #plist_bpl_open
+ * @param  node     object to decode
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success, EINVAL for a damaged document, ERANGE for a
+ *         value that does not fit, ENOTSUP for an object that has no
+ *         plist element, E2BIG past the limits, or an error value
+ */
+int plist_bpl_plist(plist_bpl_t *bpl, const plist_bpl_node_t *node,
+		    plist_t **plistpp);
+
+/**
+ * Write a plist as a binary document. Equal strings, keys, numbers,
+ * dates and data are written once and shared, and the offsets and
+ * references use the fewest bytes that hold them. The document is
+ * sized before anything is written so the output is a single pass.
+ *
+ * @param  plist  element to write
+ * @param  fd     descriptor to write to
+ * @return zero on success, EINVAL for a string that is not UTF-8, or an
+ *         error value from write
+ */
+int plist_bpl_write(const plist_t *plist, int fd);
+
+/**
+ * Write a plist as a binary document into a buffer of the exact size
+ *
+ * @param  plist  element to write
+ * @param  bufp   result document that the caller frees
+ * @param  szp    result size of the document
+ * @return zero on success or an error value as for #plist_bpl_write
+ */
+int plist_bpl_write_buf(const plist_t *plist, void **bufp, size_t *szp);
+
+__END_DECLS
+
+#endif /* !_PLIST_BPL_H_ */
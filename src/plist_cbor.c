@@ -0,0 +1,834 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_cbor.c
+ *
+ * Encoder and decoder for CBOR items. The encoder walks the tree with
+ * the parent links and writes every head as soon as it is reached, since
+ * the counts of a container are known before its children. The decoder
+ * is recursive over the buffer and bounded by PLIST_CBOR_MAXDEPTH.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for gmtime_r and timegm */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "plist_cbor.h"
+
+/* major types, the top three bits of the initial byte */
+#define CBOR_UINT      (0)
+#define CBOR_NINT      (1)
+#define CBOR_BYTES     (2)
+#define CBOR_TEXT      (3)
+#define CBOR_ARRAY     (4)
+#define CBOR_MAP       (5)
+#define CBOR_TAG       (6)
+#define CBOR_SIMPLE    (7)
+
+/* additional information in the low five bits */
+#define CBOR_FALSE     (20)
+#define CBOR_TRUE      (21)
+#define CBOR_HALF      (25)
+#define CBOR_SINGLE    (26)
+#define CBOR_DOUBLE    (27)
+#define CBOR_INDEF     (31)
+
+#define CBOR_BREAK     (0xff)
+
+/* tags that are understood */
+#define CBOR_TAG_DATESTR  (0)
+#define CBOR_TAG_EPOCH    (1)
+
+#define ISDIGIT(_c)  ((_c) >= '0' && (_c) <= '9')
+
+
+/*
+ * Encoder
+ */
+
+struct plist_cbor_enc_s {
+	uint8_t *ce_buf;
+	size_t ce_sz;
+	size_t ce_len;		/* keeps counting past the end of the buffer */
+};
+
+static inline void
+_plist_cbor_put(struct plist_cbor_enc_s *ce, const void *p, size_t n)
+{
+	if (ce->ce_len <= ce->ce_sz && n <= ce->ce_sz - ce->ce_len) {
+		memcpy(&ce->ce_buf[ce->ce_len], p, n);
+	}
+	ce->ce_len += n;
+	return;
+}
+
+/**
+ * Write the initial byte of an item with the shortest argument that
+ * holds val, most significant byte first
+ */
+static void
+_plist_cbor_head(struct plist_cbor_enc_s *ce, uint8_t major, uint64_t val)
+{
+	size_t i;
+	size_t n;
+	uint8_t hd[9];
+
+	major <<= 5;
+	if (val < 24) {
+		hd[0] = major | val;
+		n = 1;
+	} else if (val <= UINT8_MAX) {
+		hd[0] = major | 24;
+		n = 2;
+	} else if (val <= UINT16_MAX) {
+		hd[0] = major | 25;
+		n = 3;
+	} else if (val <= UINT32_MAX) {
+		hd[0] = major | 26;
+		n = 5;
+	} else {
+		hd[0] = major | 27;
+		n = 9;
+	}
+	for (i = n - 1; i > 0; i--) {
+		hd[i] = val & 0xff;
+		val >>= 8;
+	}
+	_plist_cbor_put(ce, hd, n);
+	return;
+}
+
+static void
+_plist_cbor_int(struct plist_cbor_enc_s *ce, int64_t num)
+{
+	if (num >= 0) {
+		_plist_cbor_head(ce, CBOR_UINT, num);
+	} else {
+		_plist_cbor_head(ce, CBOR_NINT, (uint64_t) (-1 - num));
+	}
+	return;
+}
+
+static void
+_plist_cbor_real(struct plist_cbor_enc_s *ce, double num)
+{
+	int i;
+	float f;
+	uint32_t u32;
+	uint64_t u64;
+	uint8_t hd[9];
+
+	if (!isnan(num) && fabs(num) <= FLT_MAX && (double) (float) num == num) {
+		f = num;
+		memcpy(&u32, &f, sizeof(u32));
+		hd[0] = (CBOR_SIMPLE << 5) | CBOR_SINGLE;
+		for (i = 4; i > 0; i--) {
+			hd[i] = u32 & 0xff;
+			u32 >>= 8;
+		}
+		_plist_cbor_put(ce, hd, 5);
+		return;
+	}
+	memcpy(&u64, &num, sizeof(u64));
+	hd[0] = (CBOR_SIMPLE << 5) | CBOR_DOUBLE;
+	for (i = 8; i > 0; i--) {
+		hd[i] = u64 & 0xff;
+		u64 >>= 8;
+	}
+	_plist_cbor_put(ce, hd, 9);
+	return;
+}
+
+static int
+_plist_cbor_evalue(struct plist_cbor_enc_s *ce, const plist_t *pcur)
+{
+	size_t len;
+	struct tm tm;
+
+	switch (pcur->p_elem) {
+	case PLIST_DICT:
+		if (pcur->p_dict.pd_numkeys < 0) {
+			return EINVAL;
+		}
+		_plist_cbor_head(ce, CBOR_MAP, pcur->p_dict.pd_numkeys);
+		return 0;
+	case PLIST_ARRAY:
+		if (pcur->p_array.pa_numelems < 0) {
+			return EINVAL;
+		}
+		_plist_cbor_head(ce, CBOR_ARRAY, pcur->p_array.pa_numelems);
+		return 0;
+	case PLIST_KEY:
+		len = strlen(pcur->p_key.pk_name);
+		_plist_cbor_head(ce, CBOR_TEXT, len);
+		_plist_cbor_put(ce, pcur->p_key.pk_name, len);
+		return 0;
+	case PLIST_STRING:
+		len = strlen(pcur->p_string.ps_str);
+		_plist_cbor_head(ce, CBOR_TEXT, len);
+		_plist_cbor_put(ce, pcur->p_string.ps_str, len);
+		return 0;
+	case PLIST_DATA:
+		len = pcur->p_data.pd_datasz;
+		_plist_cbor_head(ce, CBOR_BYTES, len);
+		_plist_cbor_put(ce, pcur->p_data.pd_data, len);
+		return 0;
+	case PLIST_INTEGER:
+		_plist_cbor_int(ce, pcur->p_integer.pi_int);
+		return 0;
+	case PLIST_REAL:
+		_plist_cbor_real(ce, pcur->p_real.pr_double);
+		return 0;
+	case PLIST_BOOLEAN:
+		_plist_cbor_head(ce, CBOR_SIMPLE, pcur->p_boolean.pb_bool ?
+				 CBOR_TRUE : CBOR_FALSE);
+		return 0;
+	case PLIST_DATE:
+		/* the fields are local to the offset the date was read with */
+		tm = pcur->p_date.pd_tm;
+		_plist_cbor_head(ce, CBOR_TAG, CBOR_TAG_EPOCH);
+		_plist_cbor_int(ce, (int64_t) timegm(&tm) -
+				pcur->p_date.pd_tm.tm_gmtoff);
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_cbor_emit(struct plist_cbor_enc_s *ce, const plist_t *plist)
+{
+	int err;
+	const plist_t *pcur;
+	const plist_t *pnext;
+
+	if (plist->p_elem == PLIST_KEY) {
+		return EINVAL;
+	}
+	for (pcur = plist; pcur != NULL; pcur = pnext) {
+		err = _plist_cbor_evalue(ce, pcur);
+		if (err != 0) {
+			return err;
+		}
+
+		/* descend into a container, or from a key to its value */
+		switch (pcur->p_elem) {
+		case PLIST_DICT:
+			pnext = TAILQ_FIRST(&pcur->p_dict.pd_keys);
+			break;
+		case PLIST_ARRAY:
+			pnext = TAILQ_FIRST(&pcur->p_array.pa_elems);
+			break;
+		case PLIST_KEY:
+			pnext = pcur->p_key.pk_value;
+			if (pnext == NULL) {
+				return EINVAL;
+			}
+			continue;
+		default:
+			pnext = NULL;
+			break;
+		}
+
+		/* then ascend until there is a next sibling */
+		while (pnext == NULL && pcur != plist) {
+			if (pcur->p_parent == NULL) {
+				return EINVAL;
+			}
+			if (pcur->p_parent->p_elem == PLIST_KEY) {
+				pcur = pcur->p_parent;
+				continue;
+			}
+			pnext = TAILQ_NEXT(pcur, p_entry);
+			pcur = pcur->p_parent;
+		}
+	}
+	return 0;
+}
+
+
+int
+plist_cbor_encode(const plist_t *plist, void *buf, size_t bufsz,
+		  size_t *lenp)
+{
+	int err;
+	struct plist_cbor_enc_s ce;
+
+	if (!plist || !lenp) {
+		return EINVAL;
+	}
+	ce.ce_buf = buf;
+	ce.ce_sz = (buf != NULL) ? bufsz : 0;
+	ce.ce_len = 0;
+	err = _plist_cbor_emit(&ce, plist);
+	if (err != 0) {
+		return err;
+	}
+	*lenp = ce.ce_len;
+	if (buf != NULL && ce.ce_len > bufsz) {
+		return ENOSPC;
+	}
+	return 0;
+}
+
+
+int
+plist_cbor_write_buf(const plist_t *plist, void **bufp, size_t *szp)
+{
+	int err;
+	size_t len;
+	void *buf;
+
+	if (!bufp || !szp) {
+		return EINVAL;
+	}
+	err = plist_cbor_encode(plist, NULL, 0, &len);
+	if (err != 0) {
+		return err;
+	}
+	buf = malloc((len > 0) ? len : 1);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	err = plist_cbor_encode(plist, buf, len, &len);
+	if (err != 0) {
+		free(buf);
+		return err;
+	}
+	*bufp = buf;
+	*szp = len;
+	return 0;
+}
+
+
+/*
+ * Decoder
+ */
+
+struct plist_cbor_dec_s {
+	uint8_t *cd_buf;	/* only written when borrowing */
+	size_t cd_sz;
+	size_t cd_off;
+	bool cd_borrow;
+	bool cd_term;		/* a borrowed string ends at cd_off */
+};
+
+/**
+ * Read the head of the next item. A borrowed string that ends here is
+ * terminated over the initial byte once it has been read.
+ */
+static int
+_plist_cbor_rhead(struct plist_cbor_dec_s *cd, uint8_t *majorp,
+		  uint8_t *infop, uint64_t *valp)
+{
+	size_t i;
+	size_t n;
+	uint8_t ib;
+	uint64_t val;
+
+	if (cd->cd_off >= cd->cd_sz) {
+		return EINVAL;
+	}
+	ib = cd->cd_buf[cd->cd_off];
+	if (cd->cd_term) {
+		cd->cd_buf[cd->cd_off] = '\0';
+		cd->cd_term = false;
+	}
+	cd->cd_off++;
+
+	*majorp = ib >> 5;
+	*infop = ib & 0x1f;
+	if (*infop < 24) {
+		*valp = *infop;
+		return 0;
+	}
+	*valp = 0;
+	if (*infop > 27) {
+		return (*infop == CBOR_INDEF) ? 0 : EINVAL;
+	}
+	n = 1 << (*infop - 24);
+	if (n > cd->cd_sz - cd->cd_off) {
+		return EINVAL;
+	}
+	val = 0;
+	for (i = 0; i < n; i++) {
+		val = (val << 8) | cd->cd_buf[cd->cd_off + i];
+	}
+	cd->cd_off += n;
+	*valp = val;
+	return 0;
+}
+
+/**
+ * Consume the break that ends an indefinite length container
+ */
+static bool
+_plist_cbor_break(struct plist_cbor_dec_s *cd)
+{
+	if (cd->cd_off >= cd->cd_sz || cd->cd_buf[cd->cd_off] != CBOR_BREAK) {
+		return false;
+	}
+	if (cd->cd_term) {
+		cd->cd_buf[cd->cd_off] = '\0';
+		cd->cd_term = false;
+	}
+	cd->cd_off++;
+	return true;
+}
+
+/**
+ * Step over the bytes of a definite length string
+ */
+static int
+_plist_cbor_span(struct plist_cbor_dec_s *cd, uint8_t info, uint64_t len,
+		 uint8_t **pp)
+{
+	if (info == CBOR_INDEF) {
+		return ENOTSUP;
+	}
+	if (len > cd->cd_sz - cd->cd_off) {
+		return EINVAL;
+	}
+	*pp = &cd->cd_buf[cd->cd_off];
+	cd->cd_off += len;
+	return 0;
+}
+
+static int
+_plist_cbor_float(uint8_t info, uint64_t val, double *dp)
+{
+	int exp;
+	int mant;
+	float f;
+	uint32_t u32;
+
+	switch (info) {
+	case CBOR_HALF:
+		exp = (val >> 10) & 0x1f;
+		mant = val & 0x3ff;
+		if (exp == 0) {
+			*dp = ldexp(mant, -24);
+		} else if (exp == 31) {
+			*dp = (mant == 0) ? INFINITY : NAN;
+		} else {
+			*dp = ldexp(mant + 1024, exp - 25);
+		}
+		if (val & 0x8000) {
+			*dp = -*dp;
+		}
+		return 0;
+	case CBOR_SINGLE:
+		u32 = val;
+		memcpy(&f, &u32, sizeof(f));
+		*dp = f;
+		return 0;
+	case CBOR_DOUBLE:
+		memcpy(dp, &val, sizeof(*dp));
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_cbor_digits(const uint8_t *s, int n)
+{
+	int i;
+	int val;
+
+	val = 0;
+	for (i = 0; i < n; i++) {
+		val = val * 10 + (s[i] - '0');
+	}
+	return val;
+}
+
+/**
+ * Convert an RFC 3339 date and time to UTC, dropping any fraction of a
+ * second
+ */
+static int
+_plist_cbor_datestr(const uint8_t *s, size_t len, struct tm *tm)
+{
+	size_t i;
+	time_t t;
+	long off;
+	static const char layout[] = "dddd-dd-ddTdd:dd:dd";
+
+	if (len < sizeof(layout)) {
+		return EINVAL;
+	}
+	for (i = 0; i < sizeof(layout) - 1; i++) {
+		if (layout[i] == 'd' ? !ISDIGIT(s[i]) :
+		    (s[i] != layout[i] && !(i == 10 && s[i] == 't'))) {
+			return EINVAL;
+		}
+	}
+	memset(tm, 0, sizeof(*tm));
+	tm->tm_year = _plist_cbor_digits(&s[0], 4) - 1900;
+	tm->tm_mon = _plist_cbor_digits(&s[5], 2) - 1;
+	tm->tm_mday = _plist_cbor_digits(&s[8], 2);
+	tm->tm_hour = _plist_cbor_digits(&s[11], 2);
+	tm->tm_min = _plist_cbor_digits(&s[14], 2);
+	tm->tm_sec = _plist_cbor_digits(&s[17], 2);
+	if (tm->tm_mon > 11 || tm->tm_mday < 1 || tm->tm_mday > 31 ||
+	    tm->tm_hour > 23 || tm->tm_min > 59 || tm->tm_sec > 60) {
+		return EINVAL;
+	}
+
+	i = sizeof(layout) - 1;
+	if (s[i] == '.') {
+		for (i++; i < len && ISDIGIT(s[i]); i++);
+	}
+	if (i + 1 == len && (s[i] == 'Z' || s[i] == 'z')) {
+		off = 0;
+	} else if (i + 6 == len && (s[i] == '+' || s[i] == '-') &&
+		   ISDIGIT(s[i + 1]) && ISDIGIT(s[i + 2]) && s[i + 3] == ':' &&
+		   ISDIGIT(s[i + 4]) && ISDIGIT(s[i + 5])) {
+		off = _plist_cbor_digits(&s[i + 1], 2) * 3600L +
+		    _plist_cbor_digits(&s[i + 4], 2) * 60L;
+		if (s[i] == '-') {
+			off = -off;
+		}
+	} else {
+		return EINVAL;
+	}
+
+	t = timegm(tm) - off;
+	if (gmtime_r(&t, tm) == NULL) {
+		return ERANGE;
+	}
+	return 0;
+}
+
+/**
+ * Decode the item under a date tag
+ */
+static int
+_plist_cbor_date(struct plist_cbor_dec_s *cd, uint64_t tag,
+		 plist_t **plistpp)
+{
+	int err;
+	uint8_t major;
+	uint8_t info;
+	uint64_t val;
+	uint8_t *p;
+	double d;
+	time_t t;
+	struct tm tm;
+
+	err = _plist_cbor_rhead(cd, &major, &info, &val);
+	if (err != 0) {
+		return err;
+	}
+	if (tag == CBOR_TAG_DATESTR) {
+		if (major != CBOR_TEXT) {
+			return EINVAL;
+		}
+		err = _plist_cbor_span(cd, info, val, &p);
+		if (err == 0) {
+			err = _plist_cbor_datestr(p, val, &tm);
+		}
+		if (err != 0) {
+			return err;
+		}
+		return plist_date_new(plistpp, &tm);
+	}
+
+	if (info == CBOR_INDEF) {
+		return EINVAL;
+	}
+	switch (major) {
+	case CBOR_UINT:
+	case CBOR_NINT:
+		if (val > INT64_MAX) {
+			return ERANGE;
+		}
+		t = (major == CBOR_UINT) ? (time_t) val : -1 - (time_t) val;
+		break;
+	case CBOR_SIMPLE:
+		err = _plist_cbor_float(info, val, &d);
+		if (err != 0) {
+			return err;
+		}
+		if (!(d > -9.2e18 && d < 9.2e18)) {
+			return ERANGE;
+		}
+		t = (time_t) floor(d);
+		break;
+	default:
+		return EINVAL;
+	}
+	if (gmtime_r(&t, &tm) == NULL) {
+		return ERANGE;
+	}
+	return plist_date_new(plistpp, &tm);
+}
+
+/**
+ * Create a string element, borrowing the buffer when the string is
+ * followed by another item that can take its terminator
+ */
+static int
+_plist_cbor_string(struct plist_cbor_dec_s *cd, const uint8_t *p,
+		   size_t len, plist_t **plistpp)
+{
+	int err;
+
+	if (cd->cd_borrow && cd->cd_off < cd->cd_sz) {
+		err = plist_string_ref_new(plistpp, (const char *) p);
+		if (err == 0) {
+			cd->cd_term = true;
+		}
+		return err;
+	}
+	return plist_nstring_new(plistpp, (const char *) p, len);
+}
+
+/**
+ * Decode the key of a map entry into a key element that has no value
+ * yet, which a value always follows to terminate when it is borrowed
+ */
+static int
+_plist_cbor_key(struct plist_cbor_dec_s *cd, plist_t **keypp)
+{
+	int err;
+	uint8_t major;
+	uint8_t info;
+	uint64_t len;
+	uint8_t *p;
+	plist_t *key;
+
+	err = _plist_cbor_rhead(cd, &major, &info, &len);
+	if (err != 0) {
+		return err;
+	}
+	if (major != CBOR_TEXT) {
+		return EINVAL;
+	}
+	err = _plist_cbor_span(cd, info, len, &p);
+	if (err != 0) {
+		return err;
+	}
+
+	if (cd->cd_borrow && cd->cd_off < cd->cd_sz) {
+		key = malloc(sizeof(*key));
+		if (key == NULL) {
+			return ENOMEM;
+		}
+		memset(key, 0, sizeof(*key));
+		key->p_key.pk_name = (char *) p;
+		cd->cd_term = true;
+	} else {
+		key = malloc(sizeof(*key) + len + 1);
+		if (key == NULL) {
+			return ENOMEM;
+		}
+		memset(key, 0, sizeof(*key));
+		key->p_key.pk_name = (char *) &key[1];
+		memcpy(key->p_key.pk_name, p, len);
+		key->p_key.pk_name[len] = '\0';
+	}
+	key->p_elem = PLIST_KEY;
+	*keypp = key;
+	return 0;
+}
+
+static int
+_plist_cbor_item(struct plist_cbor_dec_s *cd, int depth, plist_t **plistpp)
+{
+	int err;
+	uint8_t major;
+	uint8_t info;
+	uint64_t val;
+	uint64_t i;
+	uint8_t *p;
+	double d;
+	plist_t *key;
+	plist_t *value;
+	plist_t *ptmp;
+
+	if (depth > PLIST_CBOR_MAXDEPTH) {
+		return E2BIG;
+	}
+	err = _plist_cbor_rhead(cd, &major, &info, &val);
+	if (err != 0) {
+		return err;
+	}
+	if (info == CBOR_INDEF && major != CBOR_ARRAY && major != CBOR_MAP &&
+	    major != CBOR_BYTES && major != CBOR_TEXT) {
+		return EINVAL;
+	}
+
+	switch (major) {
+	case CBOR_UINT:
+		if (val > INT_MAX) {
+			return ERANGE;
+		}
+		return plist_integer_new(plistpp, (int) val);
+	case CBOR_NINT:
+		if (val > INT_MAX) {
+			return ERANGE;
+		}
+		return plist_integer_new(plistpp, -1 - (int) val);
+	case CBOR_BYTES:
+		err = _plist_cbor_span(cd, info, val, &p);
+		if (err != 0) {
+			return err;
+		}
+		if (cd->cd_borrow) {
+			return plist_data_ref_new(plistpp, p, val);
+		}
+		return plist_data_new(plistpp, p, val);
+	case CBOR_TEXT:
+		err = _plist_cbor_span(cd, info, val, &p);
+		if (err != 0) {
+			return err;
+		}
+		return _plist_cbor_string(cd, p, val, plistpp);
+	case CBOR_TAG:
+		if (val == CBOR_TAG_DATESTR || val == CBOR_TAG_EPOCH) {
+			return _plist_cbor_date(cd, val, plistpp);
+		}
+		return _plist_cbor_item(cd, depth + 1, plistpp);
+	case CBOR_SIMPLE:
+		if (info == CBOR_FALSE || info == CBOR_TRUE) {
+			return plist_boolean_new(plistpp, info == CBOR_TRUE);
+		}
+		err = _plist_cbor_float(info, val, &d);
+		if (err != 0) {
+			return err;
+		}
+		return plist_real_new(plistpp, d);
+	case CBOR_ARRAY:
+		err = plist_array_new(&ptmp);
+		break;
+	default:
+		err = plist_dict_new(&ptmp);
+		break;
+	}
+	if (err != 0) {
+		return err;
+	}
+
+	/* each entry takes at least a byte, which bounds a bogus count */
+	for (i = 0; info == CBOR_INDEF || i < val; i++) {
+		if (info == CBOR_INDEF && _plist_cbor_break(cd)) {
+			break;
+		}
+		if (major == CBOR_ARRAY) {
+			err = _plist_cbor_item(cd, depth + 1, &value);
+			if (err != 0) {
+				break;
+			}
+			err = plist_array_append(ptmp, value);
+			if (err != 0) {
+				plist_free(value);
+				break;
+			}
+			continue;
+		}
+
+		err = _plist_cbor_key(cd, &key);
+		if (err != 0) {
+			break;
+		}
+		err = _plist_cbor_item(cd, depth + 1, &value);
+		if (err != 0) {
+			free(key);
+			break;
+		}
+		key->p_key.pk_value = value;
+		value->p_parent = key;
+		key->p_parent = ptmp;
+		TAILQ_INSERT_TAIL(&ptmp->p_dict.pd_keys, key, p_entry);
+		ptmp->p_dict.pd_numkeys++;
+	}
+	if (err != 0) {
+		plist_free(ptmp);
+		return err;
+	}
+	*plistpp = ptmp;
+	return 0;
+}
+
+static int
+_plist_cbor_decode(struct plist_cbor_dec_s *cd, plist_t **plistpp)
+{
+	int err;
+	plist_t *ptmp;
+
+	err = _plist_cbor_item(cd, 0, &ptmp);
+	if (err != 0) {
+		return err;
+	}
+	if (cd->cd_off != cd->cd_sz) {
+		plist_free(ptmp);
+		return EINVAL;
+	}
+	*plistpp = ptmp;
+	return 0;
+}
+
+
+int
+plist_cbor_decode(const void *buf, size_t sz, plist_t **plistpp)
+{
+	struct plist_cbor_dec_s cd;
+
+	if (!buf || !plistpp) {
+		return EINVAL;
+	}
+	memset(&cd, 0, sizeof(cd));
+	cd.cd_buf = (uint8_t *) buf;
+	cd.cd_sz = sz;
+	return _plist_cbor_decode(&cd, plistpp);
+}
+
+
+int
+plist_cbor_decode_borrowed(void *buf, size_t sz, plist_t **plistpp)
+{
+	struct plist_cbor_dec_s cd;
+
+	if (!buf || !plistpp) {
+		return EINVAL;
+	}
+	memset(&cd, 0, sizeof(cd));
+	cd.cd_buf = buf;
+	cd.cd_sz = sz;
+	cd.cd_borrow = true;
+	return _plist_cbor_decode(&cd, plistpp);
+}
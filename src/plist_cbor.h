@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_cbor.h
+ *
+ * CBOR (RFC 8949) encoding of plist objects for passing trees between
+ * processes. The encoder makes a single pass into a buffer the caller
+ * provides, using the element counts that containers already keep for
+ * definite lengths, and the decoder can leave strings, keys and data in
+ * the received buffer instead of copying them.
+ *
+ * Elements map to CBOR items as follows.
+ *
+ *   dict     map with text string keys
+ *   array    array
+ *   string   text string
+ *   data     byte string
+ *   integer  unsigned or negative integer
+ *   real     float, single precision when that is exact, else double
+ *   boolean  simple value true or false
+ *   date     tag 1 over the integer seconds since the epoch in UTC
+ *
+ * The decoder also takes indefinite length maps and arrays, half
+ * precision floats, tag 1 over a float, tag 0 over an RFC 3339 string,
+ * and the self-describe tag 55799. Other tags are skipped over and the
+ * item they wrap is decoded as it is. Indefinite length strings, null,
+ * undefined and other simple values are rejected, as are integers that
+ * do not fit an int, which is ERANGE. A map is trusted to have unique
+ * keys as the encoder writes them.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_CBOR_H_
+#define _PLIST_CBOR_H_
+
+#include <plist.h>
+
+#define PLIST_CBOR_MAXDEPTH  (512) /* deepest nesting that is accepted */
+
+
+__BEGIN_DECLS
+
+/**
+ * Encode a plist object into a buffer. The encoded length is passed back
+ * in lenp whether or not it fits, so a buffer that is too small can be
+ * grown to the exact size, and a NULL buffer only measures the object.
+ *
+ * @param  plist  object to encode
+ * @param  buf    output buffer or NULL
+ * @param  bufsz  size of the output buffer
+ * @param  lenp   result length of the encoding
+ * @return zero on success, ENOSPC when the buffer is too small, or an
+ *         error value
+ */
+int plist_cbor_encode(const plist_t *plist, void *buf, size_t bufsz,
+		      size_t *lenp);
+
+/**
+ * Encode a plist object into an allocated buffer
+ *
+ * @param  plist  object to encode
+ * @param  bufp   result buffer that the caller frees
+ * @param  szp    result length of the encoding
+ * @return zero on success or an error value
+ */
+int plist_cbor_write_buf(const plist_t *plist, void **bufp, size_t *szp);
+
+/**
+ * Decode one CBOR item that fills the whole buffer into a plist object.
+ * Strings, keys and data are copied.
+ *
+ * @param  buf      encoded item
+ * @param  sz       size of the encoded item
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success or an error value
+ */
+int plist_cbor_decode(const void *buf, size_t sz, plist_t **plistpp);
+
+/**
+ * Decode one CBOR item without copying strings, keys and data. The
+ * elements refer to the buffer instead, which is rewritten in place: a
+ * string is terminated with a null over the first byte of the item
+ * that follows it, once that byte has been read. Only a string that
+ * ends the buffer is copied. The buffer has to be writable and outlive
+ * the tree, or the tree has to be given its own copies with
+ * #plist_detach_storage.
+ *
+ * @param  buf      encoded item, which is modified
+ * @param  sz       size of the encoded item
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success or an error value
+ */
+int plist_cbor_decode_borrowed(void *buf, size_t sz, plist_t **plistpp);
+
+__END_DECLS
+
+#endif /* !_PLIST_CBOR_H_ */
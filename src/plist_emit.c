@@ -0,0 +1,398 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_emit.c
+ *
+ * Writer for the text format, the counterpart of the parser in
+ * plist_txt.c. The tree is walked through the parent links the same way
+ * as the XML and JSON writers, with one key or array element per line
+ * and a tab per level of nesting. Everything that is written reads back
+ * to the same elements, so dates use the <*...> extension with the
+ * offset they were read with and reals always carry a fraction or an
+ * exponent.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for gmtime_r and timegm */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+
+#include "plist_txt.h"
+#include "plist_wbuf.h"
+
+#define EMIT_HEXCHUNK (1024)		/* data bytes encoded per step */
+#define EMIT_MAXOFF   (99 * 3600 + 59 * 60) /* widest +HHMM offset */
+
+static const char _plist_emit_hex[] = "0123456789abcdef";
+
+static const char _plist_emit_tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+/* replacement after a backslash for the characters that are escaped */
+static const char _plist_emit_esc[256] = {
+	['"'] = '"',
+	['\\'] = '\\',
+	['\n'] = 'n',
+	['\r'] = 'r',
+	['\t'] = 't',
+	['\b'] = 'b',
+	['\f'] = 'f',
+};
+
+static int
+_plist_emit_indent(plist_wbuf_t *pw, int depth)
+{
+	int err;
+	int n;
+
+	for (err = 0; err == 0 && depth > 0; depth -= n) {
+		n = sizeof(_plist_emit_tabs) - 1;
+		n = (depth < n) ? depth : n;
+		err = _plist_wbuf_bytes(pw, _plist_emit_tabs, n);
+	}
+	return err;
+}
+
+/**
+ * Write a quoted string, copying the runs between the characters that
+ * need a backslash
+ */
+static int
+_plist_emit_string(plist_wbuf_t *pw, const char *s)
+{
+	int err;
+	const char *cp;
+	char esc[2];
+
+	err = WSTR(pw, "\"");
+	while (err == 0) {
+		for (cp = s; *cp != '\0'; cp++) {
+			if (_plist_emit_esc[(unsigned char) *cp] != 0) {
+				break;
+			}
+		}
+		err = _plist_wbuf_bytes(pw, s, cp - s);
+		if (err != 0 || *cp == '\0') {
+			break;
+		}
+		esc[0] = '\\';
+		esc[1] = _plist_emit_esc[(unsigned char) *cp];
+		err = _plist_wbuf_bytes(pw, esc, sizeof(esc));
+		s = cp + 1;
+	}
+	return (err != 0) ? err : WSTR(pw, "\"");
+}
+
+/**
+ * Write data as hex digits with a blank after every four bytes,
+ * encoding straight into the staging buffer a chunk at a time
+ */
+static int
+_plist_emit_data(plist_wbuf_t *pw, const uint8_t *buf, size_t sz)
+{
+	int err;
+	size_t n;
+	size_t i;
+	char *out;
+
+	err = WSTR(pw, "<");
+	while (err == 0 && sz > 0) {
+		n = (sz < EMIT_HEXCHUNK) ? sz : EMIT_HEXCHUNK;
+		err = _plist_wbuf_room(pw, EMIT_HEXCHUNK / 4 * 9);
+		if (err != 0) {
+			break;
+		}
+		out = &pw->pw_out[pw->pw_fill];
+		for (i = 0; i < n; i++) {
+			*out++ = _plist_emit_hex[buf[i] >> 4];
+			*out++ = _plist_emit_hex[buf[i] & 0xf];
+			if ((i & 3) == 3 && (i + 1 < n || n < sz)) {
+				*out++ = ' ';
+			}
+		}
+		pw->pw_fill = out - pw->pw_out;
+		buf += n;
+		sz -= n;
+	}
+	return (err != 0) ? err : WSTR(pw, ">");
+}
+
+/**
+ * Write the date fields with the offset they were read with, which
+ * names the same instant as the UTC of the XML and JSON writers. An
+ * offset that +HHMM cannot spell is moved to UTC first.
+ */
+static int
+_plist_emit_date(plist_wbuf_t *pw, const struct tm *date)
+{
+	int err;
+	int year;
+	long off = date->tm_gmtoff;
+	struct tm utc;
+	const struct tm *tm = date;
+	char buf[sizeof("<*YYYY-MM-DD HH:MM:SS +0000>")];
+	char *cp = buf;
+
+	if (off % 60 != 0 || off < -EMIT_MAXOFF || off > EMIT_MAXOFF) {
+		err = _plist_wbuf_utc(date, &utc);
+		if (err != 0) {
+			return err;
+		}
+		tm = &utc;
+		off = 0;
+	}
+	year = tm->tm_year + 1900;
+	if (year < 0 || year > 9999) {
+		return EINVAL;
+	}
+	*cp++ = '<';
+	*cp++ = '*';
+	cp = _plist_wbuf_2digits(cp, year / 100);
+	cp = _plist_wbuf_2digits(cp, year % 100);
+	*cp++ = '-';
+	cp = _plist_wbuf_2digits(cp, tm->tm_mon + 1);
+	*cp++ = '-';
+	cp = _plist_wbuf_2digits(cp, tm->tm_mday);
+	*cp++ = ' ';
+	cp = _plist_wbuf_2digits(cp, tm->tm_hour);
+	*cp++ = ':';
+	cp = _plist_wbuf_2digits(cp, tm->tm_min);
+	*cp++ = ':';
+	cp = _plist_wbuf_2digits(cp, tm->tm_sec);
+	*cp++ = ' ';
+	*cp++ = (off < 0) ? '-' : '+';
+	off = (off < 0) ? -off : off;
+	cp = _plist_wbuf_2digits(cp, off / 3600);
+	cp = _plist_wbuf_2digits(cp, off / 60 % 60);
+	*cp++ = '>';
+	return _plist_wbuf_bytes(pw, buf, cp - buf);
+}
+
+static int
+_plist_emit_int(plist_wbuf_t *pw, long long num)
+{
+	char buf[WBUF_INTSZ];
+	char *cp;
+
+	cp = _plist_wbuf_int(&buf[sizeof(buf)], num);
+	return _plist_wbuf_bytes(pw, cp, &buf[sizeof(buf)] - cp);
+}
+
+/**
+ * Write a real with a fraction so that the parser does not take it for
+ * an integer. The text format has no spelling for the values that are
+ * not numbers.
+ */
+static int
+_plist_emit_real(plist_wbuf_t *pw, double num)
+{
+	int n;
+	char buf[WBUF_REALSZ];
+
+	if (!isfinite(num)) {
+		return EINVAL;
+	}
+	n = _plist_wbuf_real(buf, num, true);
+	return _plist_wbuf_bytes(pw, buf, n);
+}
+
+/**
+ * Write one element after its indent, or only the open brace or
+ * parenthesis of a container that has children
+ */
+static int
+_plist_emit_value(plist_wbuf_t *pw, const plist_t *pcur)
+{
+	int err;
+
+	switch (pcur->p_elem) {
+	case PLIST_DICT:
+		return TAILQ_EMPTY(&pcur->p_dict.pd_keys) ?
+		    WSTR(pw, "{}") : WSTR(pw, "{\n");
+	case PLIST_ARRAY:
+		return TAILQ_EMPTY(&pcur->p_array.pa_elems) ?
+		    WSTR(pw, "()") : WSTR(pw, "(\n");
+	case PLIST_KEY:
+		err = _plist_emit_string(pw, pcur->p_key.pk_name);
+		return (err != 0) ? err : WSTR(pw, " = ");
+	case PLIST_STRING:
+		return _plist_emit_string(pw, pcur->p_string.ps_str);
+	case PLIST_INTEGER:
+		return _plist_emit_int(pw, pcur->p_integer.pi_int);
+	case PLIST_REAL:
+		return _plist_emit_real(pw, pcur->p_real.pr_double);
+	case PLIST_BOOLEAN:
+		return pcur->p_boolean.pb_bool ?
+		    WSTR(pw, "true") : WSTR(pw, "false");
+	case PLIST_DATE:
+		return _plist_emit_date(pw, &pcur->p_date.pd_tm);
+	case PLIST_DATA:
+		return _plist_emit_data(pw, pcur->p_data.pd_data,
+					pcur->p_data.pd_datasz);
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_emit(plist_wbuf_t *pw, const plist_t *plist)
+{
+	int err;
+	int depth;
+	const plist_t *pcur;
+	const plist_t *pnext;
+
+	if (plist->p_elem == PLIST_KEY) {
+		return EINVAL;
+	}
+	err = 0;
+	depth = 0;
+	for (pcur = plist; err == 0 && pcur != NULL; pcur = pnext) {
+		/* keys and array elements start their own line */
+		if (pcur != plist && pcur->p_parent->p_elem != PLIST_KEY) {
+			err = _plist_emit_indent(pw, depth);
+		}
+		if (err == 0) {
+			err = _plist_emit_value(pw, pcur);
+		}
+		if (err != 0) {
+			break;
+		}
+
+		/* descend into a container, or from a key to its value */
+		pnext = NULL;
+		if (pcur->p_elem == PLIST_DICT) {
+			pnext = TAILQ_FIRST(&pcur->p_dict.pd_keys);
+		} else if (pcur->p_elem == PLIST_ARRAY) {
+			pnext = TAILQ_FIRST(&pcur->p_array.pa_elems);
+		} else if (pcur->p_elem == PLIST_KEY) {
+			pnext = pcur->p_key.pk_value;
+			if (pnext == NULL) {
+				err = EINVAL;
+			}
+			continue;
+		}
+		if (pnext != NULL) {
+			depth++;
+			continue;
+		}
+
+		/* ascend, closing every container that is finished */
+		while (err == 0 && pcur != plist) {
+			pnext = pcur->p_parent;
+			if (pnext == NULL) {
+				err = EINVAL;
+				break;
+			}
+			if (pnext->p_elem == PLIST_KEY) {
+				pcur = pnext;
+				err = WSTR(pw, ";\n");
+				pnext = TAILQ_NEXT(pcur, p_entry);
+				if (err != 0 || pnext != NULL) {
+					break;
+				}
+				pcur = pcur->p_parent;
+				depth--;
+				err = _plist_emit_indent(pw, depth);
+				if (err == 0) {
+					err = WSTR(pw, "}");
+				}
+				continue;
+			}
+			pnext = TAILQ_NEXT(pcur, p_entry);
+			if (pnext != NULL) {
+				err = WSTR(pw, ",\n");
+				break;
+			}
+			pcur = pcur->p_parent;
+			depth--;
+			err = WSTR(pw, "\n");
+			if (err == 0) {
+				err = _plist_emit_indent(pw, depth);
+			}
+			if (err == 0) {
+				err = WSTR(pw, ")");
+			}
+		}
+		if (pcur == plist) {
+			pnext = NULL;
+		}
+	}
+	if (err == 0) {
+		err = WSTR(pw, "\n");
+	}
+	return err;
+}
+
+
+int
+plist_txt_write(const plist_t *plist, int fd)
+{
+	int err;
+	plist_wbuf_t pw;
+
+	if (!plist || fd < 0) {
+		return EINVAL;
+	}
+	err = _plist_wbuf_open(&pw, fd);
+	if (err != 0) {
+		return err;
+	}
+	err = _plist_emit(&pw, plist);
+	if (err == 0) {
+		err = _plist_wbuf_flush(&pw);
+	}
+	free(pw.pw_out);
+	return err;
+}
+
+
+int
+plist_txt_write_buf(const plist_t *plist, void **bufp, size_t *szp)
+{
+	int err;
+	plist_wbuf_t pw;
+
+	if (!plist || !bufp || !szp) {
+		return EINVAL;
+	}
+	(void) _plist_wbuf_open(&pw, -1);
+	err = _plist_emit(&pw, plist);
+	if (err != 0) {
+		free(pw.pw_out);
+		return err;
+	}
+	*bufp = pw.pw_out;
+	*szp = pw.pw_fill;
+	return 0;
+}
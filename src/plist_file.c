@@ -0,0 +1,197 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_file.c
+ *
+ * Parse a text plist straight from a file. A regular file is mapped and
+ * handed to the parser in windows, with the kernel told to read ahead
+ * and the pages behind the parser dropped so that a file much larger
+ * than memory can stream through. Anything that cannot be mapped, like
+ * a pipe, is read into one large buffer that is aligned for huge pages.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for madvise */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist_txt.h"
+
+#define FILE_WINDOWSZ  (8 * 1024 * 1024) /* mapped bytes per parse call */
+#define FILE_READSZ    (2 * 1024 * 1024) /* read buffer, one huge page */
+
+
+/**
+ * Finish the document at the end of the input. A top level number or
+ * boolean only ends at the next character, so one blank is added.
+ */
+static int
+_plist_file_eof(plist_txt_t *txt)
+{
+	return plist_txt_parse(txt, " ", 1);
+}
+
+/**
+ * Parse a mapped file from offset pos in windows. The kernel reads
+ * ahead of the parser and the windows behind it are dropped, since
+ * everything in them has been copied into the nodes.
+ */
+static int
+_plist_file_map(plist_txt_t *txt, char *addr, size_t len, size_t pos)
+{
+	int err;
+	size_t n;
+
+	madvise(addr, len, MADV_SEQUENTIAL);
+
+	err = 0;
+	for (; pos < len; pos += n) {
+		n = (len - pos < FILE_WINDOWSZ) ? len - pos : FILE_WINDOWSZ;
+		if (pos + n < len) {
+			/* start reading the next window */
+			madvise(&addr[pos + n],
+				(len - pos - n < FILE_WINDOWSZ) ?
+				len - pos - n : FILE_WINDOWSZ, MADV_WILLNEED);
+		}
+		err = plist_txt_parse(txt, &addr[pos], n);
+		if (err != 0) {
+			return err;
+		}
+		madvise(&addr[pos], n, MADV_DONTNEED);
+		if (txt->pt_state == PLIST_TXT_STATE_DONE) {
+			break;
+		}
+	}
+	return _plist_file_eof(txt);
+}
+
+static int
+_plist_file_read(plist_txt_t *txt, int fd)
+{
+	int err;
+	void *buf;
+	ssize_t n;
+
+	err = posix_memalign(&buf, FILE_READSZ, FILE_READSZ);
+	if (err != 0) {
+		return err;
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(buf, FILE_READSZ, MADV_HUGEPAGE);
+#endif
+
+	for (;;) {
+		n = read(fd, buf, FILE_READSZ);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err = errno;
+			break;
+		}
+		if (n == 0) {
+			err = _plist_file_eof(txt);
+			break;
+		}
+		err = plist_txt_parse(txt, buf, n);
+		if (err != 0 || txt->pt_state == PLIST_TXT_STATE_DONE) {
+			break;
+		}
+	}
+
+	free(buf);
+	return err;
+}
+
+
+int
+plist_txt_parse_fd(plist_txt_t *txt, int fd)
+{
+	int err;
+	char *addr;
+	size_t len;
+	off_t off;
+	off_t pgoff;
+	struct stat st;
+
+	if (!txt || fd < 0) {
+		return EINVAL;
+	}
+	if (fstat(fd, &st) != 0) {
+		return errno;
+	}
+
+	off = S_ISREG(st.st_mode) ? lseek(fd, 0, SEEK_CUR) : -1;
+	if (off < 0 || off >= st.st_size) {
+		return _plist_file_read(txt, fd);
+	}
+
+	/* the mapping has to start on a page */
+	pgoff = off & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+	len = st.st_size - pgoff;
+	addr = MAP_FAILED;
+	if ((off_t) len == st.st_size - pgoff) {
+		addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, pgoff);
+	}
+	if (addr == MAP_FAILED) {
+		/* too large for the address space or not mappable */
+		return _plist_file_read(txt, fd);
+	}
+
+	err = _plist_file_map(txt, addr, len, off - pgoff);
+	munmap(addr, len);
+	if (err == 0 && lseek(fd, st.st_size, SEEK_SET) < 0) {
+		err = errno;
+	}
+	return err;
+}
+
+
+int
+plist_txt_parse_file(plist_txt_t *txt, const char *path)
+{
+	int fd;
+	int err;
+
+	if (!txt || !path) {
+		return EINVAL;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	err = plist_txt_parse_fd(txt, fd);
+	close(fd);
+	return err;
+}
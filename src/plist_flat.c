@@ -0,0 +1,1104 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_flat.c
+ *
+ * Reader and writer for flat property lists. The reader only computes
+ * addresses within the document, so once it is verified every
+ * accessor is a few loads with no allocation.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for gmtime_r and timegm */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "plist_flat.h"
+
+#define FLAT_MAGIC     "plflat00"
+#define FLAT_MAGICSZ   (8)
+#define FLAT_HEADERSZ  (32)
+#define FLAT_ROOT      (16)	/* offset of the root slot */
+#define FLAT_SLOTSZ    (16)
+#define FLAT_KEYSZ     (8)
+#define FLAT_ALIGN     (8)
+#define FLAT_READSZ    (64 * 1024)
+
+/* slot types */
+#define FLAT_DICT      (1)
+#define FLAT_ARRAY     (2)
+#define FLAT_STRING    (3)
+#define FLAT_DATA      (4)
+#define FLAT_INTEGER   (5)
+#define FLAT_REAL      (6)
+#define FLAT_BOOLEAN   (7)
+#define FLAT_DATE      (8)
+
+
+static inline uint32_t
+_plist_flat_get32(const uint8_t *p)
+{
+	return (uint32_t) p[0] | (uint32_t) p[1] << 8 |
+	    (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline uint64_t
+_plist_flat_get64(const uint8_t *p)
+{
+	return (uint64_t) _plist_flat_get32(p) |
+	    (uint64_t) _plist_flat_get32(&p[4]) << 32;
+}
+
+static inline void
+_plist_flat_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline void
+_plist_flat_put64(uint8_t *p, uint64_t v)
+{
+	_plist_flat_put32(p, v);
+	_plist_flat_put32(&p[4], v >> 32);
+}
+
+/**
+ * Fields of a slot
+ */
+struct plist_flat_slot_s {
+	uint8_t pfs_type;
+	uint32_t pfs_len;	/* bytes of a string or data, or a count */
+	uint64_t pfs_val;	/* the value, or the offset it refers to */
+};
+
+static inline void
+_plist_flat_slot(const uint8_t *buf, uint32_t off,
+		 struct plist_flat_slot_s *slot)
+{
+	const uint8_t *p = &buf[off];
+
+	slot->pfs_type = p[0];
+	slot->pfs_len = _plist_flat_get32(&p[4]);
+	slot->pfs_val = _plist_flat_get64(&p[8]);
+}
+
+/**
+ * Compare a key in the document against one of a known length, in the
+ * order of the bytes with a shorter prefix first
+ */
+static inline int
+_plist_flat_keycmp(const uint8_t *buf, const uint8_t *key,
+		   const char *name, size_t len)
+{
+	int r;
+	uint32_t klen = _plist_flat_get32(&key[4]);
+
+	r = memcmp(&buf[_plist_flat_get32(key)], name,
+		   (klen < len) ? klen : len);
+	if (r != 0) {
+		return r;
+	}
+	return (klen < len) ? -1 : (klen > len);
+}
+
+
+/*
+ * Verifier
+ */
+
+struct plist_flat_check_s {
+	const uint8_t *fc_buf;
+	size_t fc_sz;
+	uint64_t fc_budget;	/* slots that may still be visited */
+};
+
+/**
+ * Check that off and len bytes past it are in the document and, for a
+ * string, that the null terminator is there too
+ */
+static int
+_plist_flat_span(struct plist_flat_check_s *fc, uint32_t from, uint64_t off,
+		 uint64_t len, bool str)
+{
+	if (off <= from || off > fc->fc_sz || len > fc->fc_sz - off ||
+	    (str && (len == fc->fc_sz - off || fc->fc_buf[off + len] != '\0'))) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+static int
+_plist_flat_check(struct plist_flat_check_s *fc, uint32_t off, int depth)
+{
+	int err;
+	uint32_t i;
+	uint32_t body;
+	uint32_t keys;
+	const uint8_t *key;
+	struct plist_flat_slot_s slot;
+
+	if (depth > PLIST_FLAT_MAXDEPTH) {
+		return E2BIG;
+	}
+	if (fc->fc_budget == 0) {
+		return EINVAL;
+	}
+	fc->fc_budget--;
+
+	_plist_flat_slot(fc->fc_buf, off, &slot);
+	switch (slot.pfs_type) {
+	case FLAT_INTEGER:
+	case FLAT_REAL:
+	case FLAT_DATE:
+		return 0;
+	case FLAT_BOOLEAN:
+		return (slot.pfs_val > 1) ? EINVAL : 0;
+	case FLAT_STRING:
+	case FLAT_DATA:
+		return _plist_flat_span(fc, off, slot.pfs_val, slot.pfs_len,
+					slot.pfs_type == FLAT_STRING);
+	case FLAT_ARRAY:
+	case FLAT_DICT:
+		break;
+	default:
+		return EINVAL;
+	}
+
+	/* the body of a container */
+	keys = (slot.pfs_type == FLAT_DICT) ? FLAT_KEYSZ : 0;
+	err = _plist_flat_span(fc, off, slot.pfs_val,
+			       (uint64_t) slot.pfs_len * (keys + FLAT_SLOTSZ),
+			       false);
+	if (err != 0 || slot.pfs_val % FLAT_ALIGN != 0) {
+		return EINVAL;
+	}
+	body = slot.pfs_val;
+	for (i = 0; keys != 0 && i < slot.pfs_len; i++) {
+		key = &fc->fc_buf[body + i * FLAT_KEYSZ];
+		err = _plist_flat_span(fc, off, _plist_flat_get32(key),
+				       _plist_flat_get32(&key[4]), true);
+		if (err == 0 && i > 0 &&
+		    _plist_flat_keycmp(fc->fc_buf, key - FLAT_KEYSZ,
+				       (const char *)
+				       &fc->fc_buf[_plist_flat_get32(key)],
+				       _plist_flat_get32(&key[4])) >= 0) {
+			/* out of order or a duplicate */
+			err = EINVAL;
+		}
+		if (err != 0) {
+			return err;
+		}
+	}
+	body += slot.pfs_len * keys;
+	for (i = 0; i < slot.pfs_len; i++) {
+		err = _plist_flat_check(fc, body + i * FLAT_SLOTSZ, depth + 1);
+		if (err != 0) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Check the header, which is all that a trusted document gets
+ */
+static int
+_plist_flat_header(const uint8_t *buf, size_t sz)
+{
+	if (sz < FLAT_HEADERSZ || sz > UINT32_MAX ||
+	    memcmp(buf, FLAT_MAGIC, FLAT_MAGICSZ) != 0 ||
+	    _plist_flat_get32(&buf[FLAT_MAGICSZ]) != sz) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+
+int
+plist_flat_verify(const void *buf, size_t sz)
+{
+	int err;
+	struct plist_flat_check_s fc;
+
+	if (!buf) {
+		return EINVAL;
+	}
+	err = _plist_flat_header(buf, sz);
+	if (err != 0) {
+		return err;
+	}
+
+	/* each slot is visited once unless bodies are shared, which the
+	 * writer never does, so this bounds a hostile document */
+	fc.fc_buf = buf;
+	fc.fc_sz = sz;
+	fc.fc_budget = sz / FLAT_SLOTSZ;
+	return _plist_flat_check(&fc, FLAT_ROOT, 0);
+}
+
+
+int
+plist_flat_new(plist_flat_t **flatpp, const void *buf, size_t sz, int flags)
+{
+	int err;
+	plist_flat_t *flat;
+
+	if (!flatpp || !buf) {
+		return EINVAL;
+	}
+	if (flags & PLIST_FLAT_TRUSTED) {
+		err = _plist_flat_header(buf, sz);
+	} else {
+		err = plist_flat_verify(buf, sz);
+	}
+	if (err != 0) {
+		return err;
+	}
+	flat = malloc(sizeof(*flat));
+	if (flat == NULL) {
+		return ENOMEM;
+	}
+	memset(flat, 0, sizeof(*flat));
+	flat->pf_buf = buf;
+	flat->pf_sz = sz;
+	*flatpp = flat;
+	return 0;
+}
+
+/**
+ * Read a file that cannot be mapped into one buffer
+ */
+static int
+_plist_flat_read(int fd, void **bufp, size_t *szp)
+{
+	int err;
+	void *ptr;
+	char *buf;
+	size_t sz;
+	size_t maxsz;
+	ssize_t n;
+
+	buf = NULL;
+	sz = 0;
+	maxsz = 0;
+	for (;;) {
+		if (maxsz - sz < FLAT_READSZ) {
+			maxsz = (maxsz == 0) ? FLAT_READSZ : maxsz * 2;
+			ptr = realloc(buf, maxsz);
+			if (ptr == NULL) {
+				err = ENOMEM;
+				break;
+			}
+			buf = ptr;
+		}
+		n = read(fd, &buf[sz], maxsz - sz);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err = errno;
+			break;
+		}
+		if (n == 0) {
+			*bufp = buf;
+			*szp = sz;
+			return 0;
+		}
+		sz += n;
+	}
+	free(buf);
+	return err;
+}
+
+int
+plist_flat_open(plist_flat_t **flatpp, const char *path, int flags)
+{
+	int fd;
+	int err;
+	void *buf;
+	size_t sz;
+	struct stat st;
+	plist_flat_t *flat;
+
+	if (!flatpp || !path) {
+		return EINVAL;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	if (fstat(fd, &st) != 0) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+
+	buf = MAP_FAILED;
+	sz = st.st_size;
+	if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    (off_t) sz == st.st_size) {
+		buf = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	if (buf == MAP_FAILED) {
+		err = _plist_flat_read(fd, &buf, &sz);
+		close(fd);
+		if (err != 0) {
+			return err;
+		}
+		err = plist_flat_new(&flat, buf, sz, flags);
+		if (err != 0) {
+			free(buf);
+			return err;
+		}
+		flat->pf_mem = buf;
+		*flatpp = flat;
+		return 0;
+	}
+	close(fd);
+
+	err = plist_flat_new(&flat, buf, sz, flags);
+	if (err != 0) {
+		munmap(buf, sz);
+		return err;
+	}
+	flat->pf_mapsz = sz;
+	*flatpp = flat;
+	return 0;
+}
+
+void
+plist_flat_free(plist_flat_t *flat)
+{
+	if (flat == NULL) {
+		return;
+	}
+	if (flat->pf_mapsz != 0) {
+		munmap((void *) flat->pf_buf, flat->pf_mapsz);
+	}
+	free(flat->pf_mem);
+	free(flat);
+}
+
+
+/*
+ * Accessors
+ */
+
+int
+plist_flat_root(plist_flat_t *flat, plist_flat_node_t *nodep)
+{
+	if (!flat || !nodep) {
+		return EINVAL;
+	}
+	nodep->pfn_off = FLAT_ROOT;
+	return 0;
+}
+
+enum plist_elem_e
+plist_flat_type(plist_flat_t *flat, const plist_flat_node_t *node)
+{
+	if (!flat || !node) {
+		return PLIST_UNKNOWN;
+	}
+	switch (flat->pf_buf[node->pfn_off]) {
+	case FLAT_DICT:
+		return PLIST_DICT;
+	case FLAT_ARRAY:
+		return PLIST_ARRAY;
+	case FLAT_STRING:
+		return PLIST_STRING;
+	case FLAT_DATA:
+		return PLIST_DATA;
+	case FLAT_INTEGER:
+		return PLIST_INTEGER;
+	case FLAT_REAL:
+		return PLIST_REAL;
+	case FLAT_BOOLEAN:
+		return PLIST_BOOLEAN;
+	case FLAT_DATE:
+		return PLIST_DATE;
+	default:
+		return PLIST_UNKNOWN;
+	}
+}
+
+/**
+ * Read the slot of a node that has to be of the given type
+ */
+static inline int
+_plist_flat_typed(plist_flat_t *flat, const plist_flat_node_t *node,
+		  uint8_t type, struct plist_flat_slot_s *slot)
+{
+	if (!flat || !node) {
+		return EINVAL;
+	}
+	_plist_flat_slot(flat->pf_buf, node->pfn_off, slot);
+	return (slot->pfs_type == type) ? 0 : EINVAL;
+}
+
+int
+plist_flat_count(plist_flat_t *flat, const plist_flat_node_t *node,
+		 size_t *countp)
+{
+	struct plist_flat_slot_s slot;
+
+	if (!flat || !node || !countp) {
+		return EINVAL;
+	}
+	_plist_flat_slot(flat->pf_buf, node->pfn_off, &slot);
+	if (slot.pfs_type != FLAT_DICT && slot.pfs_type != FLAT_ARRAY) {
+		return EINVAL;
+	}
+	*countp = slot.pfs_len;
+	return 0;
+}
+
+int
+plist_flat_at(plist_flat_t *flat, const plist_flat_node_t *array,
+	      size_t n, plist_flat_node_t *valp)
+{
+	int err;
+	struct plist_flat_slot_s slot;
+
+	if (!valp) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, array, FLAT_ARRAY, &slot);
+	if (err != 0) {
+		return err;
+	}
+	if (n >= slot.pfs_len) {
+		return ENOENT;
+	}
+	valp->pfn_off = slot.pfs_val + n * FLAT_SLOTSZ;
+	return 0;
+}
+
+int
+plist_flat_entry(plist_flat_t *flat, const plist_flat_node_t *dict,
+		 size_t n, const char **keyp, plist_flat_node_t *valp)
+{
+	int err;
+	struct plist_flat_slot_s slot;
+
+	err = _plist_flat_typed(flat, dict, FLAT_DICT, &slot);
+	if (err != 0) {
+		return err;
+	}
+	if (n >= slot.pfs_len) {
+		return ENOENT;
+	}
+	if (keyp != NULL) {
+		*keyp = (const char *) &flat->pf_buf[_plist_flat_get32(
+		    &flat->pf_buf[slot.pfs_val + n * FLAT_KEYSZ])];
+	}
+	if (valp != NULL) {
+		valp->pfn_off = slot.pfs_val + slot.pfs_len * FLAT_KEYSZ +
+		    n * FLAT_SLOTSZ;
+	}
+	return 0;
+}
+
+int
+plist_flat_lookup(plist_flat_t *flat, const plist_flat_node_t *dict,
+		  const char *key, plist_flat_node_t *valp)
+{
+	int r;
+	int err;
+	size_t len;
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t mid;
+	const uint8_t *keys;
+	struct plist_flat_slot_s slot;
+
+	if (!key || !valp) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, dict, FLAT_DICT, &slot);
+	if (err != 0) {
+		return err;
+	}
+	len = strlen(key);
+	keys = &flat->pf_buf[slot.pfs_val];
+	lo = 0;
+	hi = slot.pfs_len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		r = _plist_flat_keycmp(flat->pf_buf, &keys[mid * FLAT_KEYSZ],
+				       key, len);
+		if (r == 0) {
+			valp->pfn_off = slot.pfs_val +
+			    slot.pfs_len * FLAT_KEYSZ + mid * FLAT_SLOTSZ;
+			return 0;
+		}
+		if (r < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return ENOENT;
+}
+
+int
+plist_flat_integer(plist_flat_t *flat, const plist_flat_node_t *node,
+		   int64_t *valp)
+{
+	int err;
+	struct plist_flat_slot_s slot;
+
+	if (!valp) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, node, FLAT_INTEGER, &slot);
+	if (err == 0) {
+		*valp = (int64_t) slot.pfs_val;
+	}
+	return err;
+}
+
+int
+plist_flat_real(plist_flat_t *flat, const plist_flat_node_t *node,
+		double *valp)
+{
+	int err;
+	struct plist_flat_slot_s slot;
+
+	if (!valp) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, node, FLAT_REAL, &slot);
+	if (err == 0) {
+		memcpy(valp, &slot.pfs_val, sizeof(*valp));
+	}
+	return err;
+}
+
+int
+plist_flat_boolean(plist_flat_t *flat, const plist_flat_node_t *node,
+		   bool *valp)
+{
+	int err;
+	struct plist_flat_slot_s slot;
+
+	if (!valp) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, node, FLAT_BOOLEAN, &slot);
+	if (err == 0) {
+		*valp = (slot.pfs_val != 0);
+	}
+	return err;
+}
+
+int
+plist_flat_date(plist_flat_t *flat, const plist_flat_node_t *node,
+		struct tm *tm)
+{
+	int err;
+	time_t t;
+	struct plist_flat_slot_s slot;
+
+	if (!tm) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, node, FLAT_DATE, &slot);
+	if (err != 0) {
+		return err;
+	}
+	t = (time_t) (int64_t) slot.pfs_val;
+	if (gmtime_r(&t, tm) == NULL) {
+		return ERANGE;
+	}
+	return 0;
+}
+
+int
+plist_flat_data(plist_flat_t *flat, const plist_flat_node_t *node,
+		const void **datap, size_t *szp)
+{
+	int err;
+	struct plist_flat_slot_s slot;
+
+	if (!datap || !szp) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, node, FLAT_DATA, &slot);
+	if (err == 0) {
+		*datap = &flat->pf_buf[slot.pfs_val];
+		*szp = slot.pfs_len;
+	}
+	return err;
+}
+
+int
+plist_flat_string(plist_flat_t *flat, const plist_flat_node_t *node,
+		  const char **strp, size_t *lenp)
+{
+	int err;
+	struct plist_flat_slot_s slot;
+
+	if (!strp) {
+		return EINVAL;
+	}
+	err = _plist_flat_typed(flat, node, FLAT_STRING, &slot);
+	if (err == 0) {
+		*strp = (const char *) &flat->pf_buf[slot.pfs_val];
+		if (lenp != NULL) {
+			*lenp = slot.pfs_len;
+		}
+	}
+	return err;
+}
+
+static int
+_plist_flat_dictadd(plist_t *dict, const char *name, plist_t *value)
+{
+	size_t namesz;
+	plist_t *key;
+
+	namesz = strlen(name) + 1;
+	key = malloc(sizeof(*key) + namesz);
+	if (key == NULL) {
+		return ENOMEM;
+	}
+	memset(key, 0, sizeof(*key));
+
+	key->p_elem = PLIST_KEY;
+	key->p_key.pk_name = (char *) &key[1];
+	memcpy(key->p_key.pk_name, name, namesz);
+	key->p_key.pk_value = value;
+	value->p_parent = key;
+
+	dict->p_dict.pd_numkeys++;
+	TAILQ_INSERT_TAIL(&dict->p_dict.pd_keys, key, p_entry);
+	key->p_parent = dict;
+	return 0;
+}
+
+static int
+_plist_flat_build(plist_flat_t *flat, const plist_flat_node_t *node,
+		  int depth, plist_t **plistpp)
+{
+	int err;
+	size_t i;
+	int64_t ll;
+	double d;
+	bool b;
+	struct tm tm;
+	const char *str;
+	const void *data;
+	size_t sz;
+	plist_t *ptmp;
+	plist_t *value;
+	plist_flat_node_t child;
+
+	if (depth > PLIST_FLAT_MAXDEPTH) {
+		return E2BIG;
+	}
+	switch (plist_flat_type(flat, node)) {
+	case PLIST_INTEGER:
+		plist_flat_integer(flat, node, &ll);
+		if (ll < INT_MIN || ll > INT_MAX) {
+			return ERANGE;
+		}
+		return plist_integer_new(plistpp, (int) ll);
+	case PLIST_REAL:
+		plist_flat_real(flat, node, &d);
+		return plist_real_new(plistpp, d);
+	case PLIST_BOOLEAN:
+		plist_flat_boolean(flat, node, &b);
+		return plist_boolean_new(plistpp, b);
+	case PLIST_DATE:
+		err = plist_flat_date(flat, node, &tm);
+		if (err != 0) {
+			return err;
+		}
+		return plist_date_new(plistpp, &tm);
+	case PLIST_DATA:
+		err = plist_flat_data(flat, node, &data, &sz);
+		if (err != 0) {
+			return err;
+		}
+		return plist_data_new(plistpp, data, sz);
+	case PLIST_STRING:
+		err = plist_flat_string(flat, node, &str, &sz);
+		if (err != 0) {
+			return err;
+		}
+		return plist_nstring_new(plistpp, str, sz);
+	case PLIST_ARRAY:
+		err = plist_array_new(&ptmp);
+		break;
+	case PLIST_DICT:
+		err = plist_dict_new(&ptmp);
+		break;
+	default:
+		return EINVAL;
+	}
+	if (err != 0) {
+		return err;
+	}
+
+	err = plist_flat_count(flat, node, &sz);
+	for (i = 0; err == 0 && i < sz; i++) {
+		str = NULL;
+		if (ptmp->p_elem == PLIST_DICT) {
+			err = plist_flat_entry(flat, node, i, &str, &child);
+		} else {
+			err = plist_flat_at(flat, node, i, &child);
+		}
+		if (err == 0) {
+			err = _plist_flat_build(flat, &child, depth + 1, &value);
+		}
+		if (err != 0) {
+			break;
+		}
+		if (str != NULL) {
+			err = _plist_flat_dictadd(ptmp, str, value);
+		} else {
+			err = plist_array_append(ptmp, value);
+		}
+		if (err != 0) {
+			plist_free(value);
+		}
+	}
+	if (err != 0) {
+		plist_free(ptmp);
+		return err;
+	}
+	*plistpp = ptmp;
+	return 0;
+}
+
+int
+plist_flat_plist(plist_flat_t *flat, const plist_flat_node_t *node,
+		 plist_t **plistpp)
+{
+	if (!flat || !node || !plistpp) {
+		return EINVAL;
+	}
+	return _plist_flat_build(flat, node, 0, plistpp);
+}
+
+
+/*
+ * Writer
+ *
+ * The document is laid out front to back in one buffer. A container
+ * reserves its whole body first and its children are appended after
+ * it, filling in the body as they go, which is what keeps every offset
+ * pointing past the slot that refers to it.
+ */
+
+struct plist_flat_writer_s {
+	uint8_t *fw_buf;
+	size_t fw_sz;
+	size_t fw_maxsz;
+};
+
+/**
+ * Append len bytes at the given alignment, zeroed, and return their
+ * offset. The buffer can move so callers hold offsets, not pointers.
+ */
+static int
+_plist_flat_reserve(struct plist_flat_writer_s *fw, size_t len,
+		    size_t align, uint32_t *offp)
+{
+	void *ptr;
+	size_t off;
+	size_t newsz;
+
+	off = (fw->fw_sz + align - 1) & ~(align - 1);
+	if (off > UINT32_MAX || len > UINT32_MAX - off) {
+		return EFBIG;
+	}
+	if (off + len > fw->fw_maxsz) {
+		newsz = (fw->fw_maxsz == 0) ? 4096 : fw->fw_maxsz;
+		while (newsz < off + len) {
+			newsz *= 2;
+		}
+		ptr = realloc(fw->fw_buf, newsz);
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		fw->fw_buf = ptr;
+		fw->fw_maxsz = newsz;
+	}
+	memset(&fw->fw_buf[fw->fw_sz], 0, off + len - fw->fw_sz);
+	fw->fw_sz = off + len;
+	*offp = off;
+	return 0;
+}
+
+static int
+_plist_flat_bytes(struct plist_flat_writer_s *fw, const void *buf,
+		  size_t len, bool str, uint32_t *offp)
+{
+	int err;
+
+	err = _plist_flat_reserve(fw, len + str, 1, offp);
+	if (err == 0) {
+		memcpy(&fw->fw_buf[*offp], buf, len);
+	}
+	return err;
+}
+
+static void
+_plist_flat_wslot(struct plist_flat_writer_s *fw, uint32_t off, uint8_t type,
+		  uint32_t len, uint64_t val)
+{
+	uint8_t *p = &fw->fw_buf[off];
+
+	p[0] = type;
+	_plist_flat_put32(&p[4], len);
+	_plist_flat_put64(&p[8], val);
+}
+
+static int
+_plist_flat_keysort(const void *a, const void *b)
+{
+	const plist_t *ka = *(const plist_t * const *) a;
+	const plist_t *kb = *(const plist_t * const *) b;
+
+	return strcmp(ka->p_key.pk_name, kb->p_key.pk_name);
+}
+
+static int
+_plist_flat_emit(struct plist_flat_writer_s *fw, const plist_t *plist,
+		 uint32_t slot, int depth)
+{
+	int err;
+	size_t i;
+	size_t n;
+	size_t len;
+	uint32_t off;
+	uint32_t koff;
+	uint64_t u64;
+	struct tm tm;
+	const plist_t *pcur;
+	const plist_t **keys;
+
+	if (depth > PLIST_FLAT_MAXDEPTH) {
+		return E2BIG;
+	}
+	switch (plist->p_elem) {
+	case PLIST_INTEGER:
+		_plist_flat_wslot(fw, slot, FLAT_INTEGER, 0,
+				  (uint64_t) (int64_t) plist->p_integer.pi_int);
+		return 0;
+	case PLIST_REAL:
+		memcpy(&u64, &plist->p_real.pr_double, sizeof(u64));
+		_plist_flat_wslot(fw, slot, FLAT_REAL, 0, u64);
+		return 0;
+	case PLIST_BOOLEAN:
+		_plist_flat_wslot(fw, slot, FLAT_BOOLEAN, 0,
+				  plist->p_boolean.pb_bool);
+		return 0;
+	case PLIST_DATE:
+		/* the fields are local to the offset the date was read with */
+		tm = plist->p_date.pd_tm;
+		_plist_flat_wslot(fw, slot, FLAT_DATE, 0,
+				  (uint64_t) (int64_t) (timegm(&tm) -
+				  plist->p_date.pd_tm.tm_gmtoff));
+		return 0;
+	case PLIST_STRING:
+		len = strlen(plist->p_string.ps_str);
+		err = _plist_flat_bytes(fw, plist->p_string.ps_str, len, true,
+					&off);
+		if (err == 0) {
+			_plist_flat_wslot(fw, slot, FLAT_STRING, len, off);
+		}
+		return err;
+	case PLIST_DATA:
+		len = plist->p_data.pd_datasz;
+		if (len > UINT32_MAX) {
+			return EFBIG;
+		}
+		err = _plist_flat_bytes(fw, plist->p_data.pd_data, len, false,
+					&off);
+		if (err == 0) {
+			_plist_flat_wslot(fw, slot, FLAT_DATA, len, off);
+		}
+		return err;
+	case PLIST_ARRAY:
+		n = plist->p_array.pa_numelems;
+		if (n > UINT32_MAX / FLAT_SLOTSZ) {
+			return EFBIG;
+		}
+		err = _plist_flat_reserve(fw, n * FLAT_SLOTSZ, FLAT_ALIGN,
+					  &off);
+		if (err != 0) {
+			return err;
+		}
+		_plist_flat_wslot(fw, slot, FLAT_ARRAY, n, off);
+		i = 0;
+		TAILQ_FOREACH(pcur, &plist->p_array.pa_elems, p_entry) {
+			err = _plist_flat_emit(fw, pcur,
+					       off + i++ * FLAT_SLOTSZ,
+					       depth + 1);
+			if (err != 0) {
+				return err;
+			}
+		}
+		return 0;
+	case PLIST_DICT:
+		break;
+	default:
+		return EINVAL;
+	}
+
+	/* keys in the order of their bytes for the binary search */
+	n = plist->p_dict.pd_numkeys;
+	if (n > UINT32_MAX / (FLAT_KEYSZ + FLAT_SLOTSZ)) {
+		return EFBIG;
+	}
+	keys = malloc((n + 1) * sizeof(*keys));
+	if (keys == NULL) {
+		return ENOMEM;
+	}
+	i = 0;
+	TAILQ_FOREACH(pcur, &plist->p_dict.pd_keys, p_entry) {
+		keys[i++] = pcur;
+	}
+	qsort(keys, n, sizeof(*keys), _plist_flat_keysort);
+
+	err = _plist_flat_reserve(fw, n * (FLAT_KEYSZ + FLAT_SLOTSZ),
+				  FLAT_ALIGN, &off);
+	if (err == 0) {
+		_plist_flat_wslot(fw, slot, FLAT_DICT, n, off);
+	}
+	for (i = 0; err == 0 && i < n; i++) {
+		if (keys[i]->p_key.pk_value == NULL) {
+			err = EINVAL;
+			break;
+		}
+		len = strlen(keys[i]->p_key.pk_name);
+		err = _plist_flat_bytes(fw, keys[i]->p_key.pk_name, len, true,
+					&koff);
+		if (err != 0) {
+			break;
+		}
+		_plist_flat_put32(&fw->fw_buf[off + i * FLAT_KEYSZ], koff);
+		_plist_flat_put32(&fw->fw_buf[off + i * FLAT_KEYSZ + 4], len);
+		err = _plist_flat_emit(fw, keys[i]->p_key.pk_value,
+				       off + n * FLAT_KEYSZ + i * FLAT_SLOTSZ,
+				       depth + 1);
+	}
+	free(keys);
+	return err;
+}
+
+static int
+_plist_flat_layout(const plist_t *plist, struct plist_flat_writer_s *fw)
+{
+	int err;
+	uint32_t off;
+
+	memset(fw, 0, sizeof(*fw));
+	if (plist->p_elem == PLIST_KEY) {
+		return EINVAL;
+	}
+	err = _plist_flat_reserve(fw, FLAT_HEADERSZ, FLAT_ALIGN, &off);
+	if (err == 0) {
+		memcpy(fw->fw_buf, FLAT_MAGIC, FLAT_MAGICSZ);
+		err = _plist_flat_emit(fw, plist, FLAT_ROOT, 0);
+	}
+	if (err == 0) {
+		/* pad the end so documents can be laid end to end */
+		err = _plist_flat_reserve(fw, 0, FLAT_ALIGN, &off);
+	}
+	if (err == 0) {
+		_plist_flat_put32(&fw->fw_buf[FLAT_MAGICSZ], fw->fw_sz);
+		return 0;
+	}
+	free(fw->fw_buf);
+	return err;
+}
+
+
+int
+plist_flat_write(const plist_t *plist, int fd)
+{
+	int err;
+	size_t off;
+	ssize_t n;
+	struct plist_flat_writer_s fw;
+
+	if (!plist || fd < 0) {
+		return EINVAL;
+	}
+	err = _plist_flat_layout(plist, &fw);
+	if (err != 0) {
+		return err;
+	}
+	for (off = 0; off < fw.fw_sz; off += n) {
+		n = write(fd, &fw.fw_buf[off], fw.fw_sz - off);
+		if (n < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			err = errno;
+			break;
+		}
+	}
+	free(fw.fw_buf);
+	return err;
+}
+
+
+int
+plist_flat_write_buf(const plist_t *plist, void **bufp, size_t *szp)
+{
+	int err;
+	struct plist_flat_writer_s fw;
+
+	if (!plist || !bufp || !szp) {
+		return EINVAL;
+	}
+	err = _plist_flat_layout(plist, &fw);
+	if (err != 0) {
+		return err;
+	}
+	*bufp = fw.fw_buf;
+	*szp = fw.fw_sz;
+	return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_flat.h
+ *
+ * Flat property lists, a binary layout that is read in place. Every
+ * value is a 16 byte slot holding its type and either the value itself
+ * (integers, reals, booleans and dates) or the offset and length of
+ * what it refers to (strings, data, and the bodies of containers).
+ * A dictionary body is a table of keys sorted by their bytes followed
+ * by the value slots in the same order, so a lookup is a binary search
+ * over the mapped bytes with nothing decoded or allocated.
+ *
+ *   header  "plflat00", total size (u32), reserved (u32), root slot
+ *   slot    type (u8), pad (3), length or count (u32), value (u64)
+ *   array   count slots
+ *   dict    count keys of offset (u32) and length (u32), count slots
+ *
+ * Numbers are little endian, slots are 8 byte aligned, and strings and
+ * keys are null terminated in place. Every offset points past the slot
+ * that refers to it, which keeps the verifier from looping. Offsets
+ * are 32 bits so a document is limited to 4 GB.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_FLAT_H_
+#define _PLIST_FLAT_H_
+
+#include <stdint.h>
+#include <plist.h>
+
+#define PLIST_FLAT_MAXDEPTH  (512) /* deepest nesting that is accepted */
+
+/* skip the verifier for a document from a trusted writer */
+#define PLIST_FLAT_TRUSTED   (0x01)
+
+/* forward declare */
+typedef struct plist_flat_s plist_flat_t;
+typedef struct plist_flat_node_s plist_flat_node_t;
+
+/**
+ * Reader of one flat document
+ */
+struct plist_flat_s {
+	const uint8_t *pf_buf;
+	size_t pf_sz;
+	size_t pf_mapsz;	/* length of the mapping, zero for a buffer */
+	void *pf_mem;		/* copy of a file that could not be mapped */
+};
+
+/**
+ * Reference to a value in the document, which is the offset of its
+ * slot and can be copied freely
+ */
+struct plist_flat_node_s {
+	uint32_t pfn_off;
+};
+
+
+__BEGIN_DECLS
+
+/**
+ * Check that a flat document is well formed, so that every accessor
+ * stays inside of it: the header, every slot and offset, the null
+ * terminators, the key order, and the nesting depth.
+ *
+ * @param  buf  pointer to the document
+ * @param  sz   size of the document
+ * @return zero on success, EINVAL for a damaged document, or E2BIG for
+ *         nesting deeper than #PLIST_FLAT_MAXDEPTH
+ */
+int plist_flat_verify(const void *buf, size_t sz);
+
+/**
+ * Open a flat document in a buffer. The document is verified unless
+ * PLIST_FLAT_TRUSTED is given, in which case only the header is checked
+ * and a damaged document can make the accessors read out of bounds.
+ *
+ * @param  flatpp  result reader
+ * @param  buf     pointer to the document, which is not copied
+ * @param  sz      size of the document
+ * @param  flags   PLIST_FLAT_TRUSTED or zero
+ * @return zero on success or an error value as for #plist_flat_verify
+ */
+int plist_flat_new(plist_flat_t **flatpp, const void *buf, size_t sz,
+		   int flags);
+
+/**
+ * Open a flat document in a file by mapping it. Anything that cannot
+ * be mapped, like a pipe, is read into memory instead.
+ *
+ * @param  flatpp  result reader
+ * @param  path    file to map
+ * @param  flags   PLIST_FLAT_TRUSTED or zero
+ * @return zero on success or an error value as for #plist_flat_new
+ */
+int plist_flat_open(plist_flat_t **flatpp, const char *path, int flags);
+
+/**
+ * Free the reader and unmap the file
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ */
+void plist_flat_free(plist_flat_t *flat);
+
+/**
+ * Retrieve the top value of the document
+ *
+ * @param  flat   reader from #plist_flat_new or #plist_flat_open
+ * @param  nodep  result value
+ * @return zero on success or an error value
+ */
+int plist_flat_root(plist_flat_t *flat, plist_flat_node_t *nodep);
+
+/**
+ * Determine the type of a value
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  node  value to check
+ * @return the element type or PLIST_UNKNOWN
+ */
+enum plist_elem_e plist_flat_type(plist_flat_t *flat,
+				  const plist_flat_node_t *node);
+
+/**
+ * Count the keys of a dictionary or the elements of an array
+ *
+ * @param  flat    reader from #plist_flat_new or #plist_flat_open
+ * @param  node    dictionary or array
+ * @param  countp  result count
+ * @return zero on success or EINVAL for another type
+ */
+int plist_flat_count(plist_flat_t *flat, const plist_flat_node_t *node,
+		     size_t *countp);
+
+/**
+ * Find an element of an array by position
+ *
+ * @param  flat   reader from #plist_flat_new or #plist_flat_open
+ * @param  array  array value
+ * @param  n      zero based position in the array
+ * @param  valp   result value
+ * @return zero on success, ENOENT past the end, or an error value
+ */
+int plist_flat_at(plist_flat_t *flat, const plist_flat_node_t *array,
+		  size_t n, plist_flat_node_t *valp);
+
+/**
+ * Retrieve a key and its value from a dictionary by position, which is
+ * the order of the key bytes
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  dict  dictionary value
+ * @param  n     zero based position in the dictionary
+ * @param  keyp  result null terminated key in the document
+ * @param  valp  result value
+ * @return zero on success, ENOENT past the end, or an error value
+ */
+int plist_flat_entry(plist_flat_t *flat, const plist_flat_node_t *dict,
+		     size_t n, const char **keyp, plist_flat_node_t *valp);
+
+/**
+ * Find the value of a key in a dictionary with a binary search
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  dict  dictionary value
+ * @param  key   null terminated key to find
+ * @param  valp  result value
+ * @return zero on success, ENOENT if the key is missing, or an error
+ */
+int plist_flat_lookup(plist_flat_t *flat, const plist_flat_node_t *dict,
+		      const char *key, plist_flat_node_t *valp);
+
+/**
+ * Read an integer value
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  node  integer value
+ * @param  valp  result integer
+ * @return zero on success or EINVAL for another type
+ */
+int plist_flat_integer(plist_flat_t *flat, const plist_flat_node_t *node,
+		       int64_t *valp);
+
+/**
+ * Read a real value
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  node  real value
+ * @param  valp  result real
+ * @return zero on success or EINVAL for another type
+ */
+int plist_flat_real(plist_flat_t *flat, const plist_flat_node_t *node,
+		    double *valp);
+
+/**
+ * Read a boolean value
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  node  boolean value
+ * @param  valp  result boolean
+ * @return zero on success or EINVAL for another type
+ */
+int plist_flat_boolean(plist_flat_t *flat, const plist_flat_node_t *node,
+		       bool *valp);
+
+/**
+ * Read a date value, which is kept as seconds since the epoch
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  node  date value
+ * @param  tm    result broken down UTC time
+ * @return zero on success or EINVAL for another type
+ */
+int plist_flat_date(plist_flat_t *flat, const plist_flat_node_t *node,
+		    struct tm *tm);
+
+/**
+ * Retrieve the bytes of a data value in the document
+ *
+ * @param  flat   reader from #plist_flat_new or #plist_flat_open
+ * @param  node   data value
+ * @param  datap  result pointer into the document
+ * @param  szp    result size of the data
+ * @return zero on success or EINVAL for another type
+ */
+int plist_flat_data(plist_flat_t *flat, const plist_flat_node_t *node,
+		    const void **datap, size_t *szp);
+
+/**
+ * Retrieve a string value in the document, which is null terminated
+ *
+ * @param  flat  reader from #plist_flat_new or #plist_flat_open
+ * @param  node  string value
+ * @param  strp  result pointer into the document
+ * @param  lenp  result length of the string, or NULL
+ * @return zero on success or EINVAL for another type
+ */
+int plist_flat_string(plist_flat_t *flat, const plist_flat_node_t *node,
+		      const char **strp, size_t *lenp);
+
+/**
+ * Build plist objects for a value and everything below it
+ *
+ * @param  flat     reader from #plist_flat_new or #plist_flat_open
+ * @param  node     value to convert
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success, ERANGE for an integer that does not fit the
+ *         plist integer, or an error value
+ */
+int plist_flat_plist(plist_flat_t *flat, const plist_flat_node_t *node,
+		     plist_t **plistpp);
+
+/**
+ * Write a plist as a flat document. The document is laid out in memory
+ * and then written, since the offsets of a container have to be known
+ * before its children.
+ *
+ * @param  plist  element to write
+ * @param  fd     descriptor to write to
+ * @return zero on success, EINVAL for a key without a value, E2BIG for
+ *         nesting deeper than #PLIST_FLAT_MAXDEPTH, EFBIG for a document
+ *         past 4 GB, or an error value from write
+ */
+int plist_flat_write(const plist_t *plist, int fd);
+
+/**
+ * Write a plist as a flat document into an allocated buffer
+ *
+ * @param  plist  element to write
+ * @param  bufp   result document that the caller frees
+ * @param  szp    result size of the document
+ * @return zero on success or an error value as for #plist_flat_write
+ */
+int plist_flat_write_buf(const plist_t *plist, void **bufp, size_t *szp);
+
+__END_DECLS
+
+#endif /* !_PLIST_FLAT_H_ */
@@ -0,0 +1,967 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_gen.c
+ *
+ * Compiler of decoder schemas and the parts of the decoder runtime that
+ * are too large to inline: escape sequences, reals, data, dates, and
+ * skipping over values that the schema does not have.
+ *
+ * @version $Id$
+ */
+
+#define _XOPEN_SOURCE 700 /* for strptime */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "plist_gen.h"
+#include "plist_genrt.h"
+
+#define GEN_NUMBERMAX  (64)  /* longest number that is converted */
+#define GEN_SEEDS      (4096) /* perfect hash seeds tried for each size */
+
+/* forward declare */
+typedef struct plist_gen_type_s plist_gen_type_t;
+
+/* a schema type with its member declaration and its conversion */
+struct plist_gen_type_s {
+	const char *pgt_name;
+	const char *pgt_ctype;
+	const char *pgt_call;
+	bool pgt_alloc; /* released by the generated code */
+};
+
+static const plist_gen_type_t _plist_gen_types[] = {
+	{ "bool", "bool", "plist_gen_boolean", false },
+	{ "int8", "int8_t", "plist_gen_int8", false },
+	{ "int16", "int16_t", "plist_gen_int16", false },
+	{ "int32", "int32_t", "plist_gen_int32", false },
+	{ "int64", "int64_t", "plist_gen_int64", false },
+	{ "float", "float", "plist_gen_float", false },
+	{ "double", "double", "plist_gen_real", false },
+	{ "string", "char *", "plist_gen_string", true },
+	{ "data", "plist_bind_vector_t", "plist_gen_data", true },
+	{ "date", "struct tm", "plist_gen_date", false },
+	{ NULL, NULL, NULL, false }
+};
+
+
+/*
+ * Runtime
+ */
+
+int
+plist_gen_skip(plist_gen_t *pg)
+{
+	int depth;
+	const char *cp;
+	const char *ep = pg->pg_ep;
+
+	depth = 0;
+	cp = pg->pg_cp;
+	while (cp != ep) {
+		switch (cp[0]) {
+		case '"':
+			for (cp++; cp != ep && cp[0] != '"'; cp++) {
+				if (cp[0] == '\\' && &cp[1] != ep) {
+					cp++;
+				}
+			}
+			if (cp == ep) {
+				return ENOENT;
+			}
+			cp++;
+			break;
+		case '<':
+			cp = memchr(cp, '>', ep - cp);
+			if (cp == NULL) {
+				return ENOENT;
+			}
+			cp++;
+			break;
+		case '{':
+		case '(':
+			depth++;
+			cp++;
+			break;
+		case '}':
+		case ')':
+			if (depth == 0) {
+				goto done;
+			}
+			depth--;
+			cp++;
+			break;
+		case ';':
+		case ',':
+			if (depth == 0) {
+				goto done;
+			}
+			cp++;
+			break;
+		default:
+			cp++;
+			break;
+		}
+	}
+	return ENOENT;
+
+ done:
+	pg->pg_cp = cp;
+	return 0;
+}
+
+/**
+ * Copy a quoted string with its escape sequences processed, the same
+ * ones as the text parser
+ */
+static int
+_plist_gen_unescape(plist_gen_t *pg, char *buf, size_t bufsz, size_t *lenp)
+{
+	size_t len;
+	const char *cp;
+
+	if (pg->pg_cp[0] != '"') {
+		return EINVAL;
+	}
+	len = 0;
+	for (cp = &pg->pg_cp[1]; cp != pg->pg_ep && cp[0] != '"'; cp++) {
+		if (len == bufsz) {
+			return ERANGE;
+		}
+		if (cp[0] != '\\') {
+			buf[len++] = cp[0];
+			continue;
+		}
+		if (++cp == pg->pg_ep) {
+			break;
+		}
+		switch (cp[0]) {
+		case 'b':
+			buf[len++] = '\b';
+			break;
+		case 't':
+			buf[len++] = '\t';
+			break;
+		case 'f':
+			buf[len++] = '\f';
+			break;
+		case 'n':
+			buf[len++] = '\n';
+			break;
+		case 'r':
+			buf[len++] = '\r';
+			break;
+		default:
+			buf[len++] = cp[0];
+			break;
+		}
+	}
+	if (cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	pg->pg_cp = &cp[1];
+	*lenp = len;
+	return 0;
+}
+
+int
+plist_gen_keyslow(plist_gen_t *pg, const char **keyp, size_t *lenp)
+{
+	int err;
+
+	err = _plist_gen_unescape(pg, pg->pg_key, sizeof(pg->pg_key), lenp);
+	if (err != 0) {
+		return err;
+	}
+	*keyp = pg->pg_key;
+
+	plist_gen_space(pg);
+	if (pg->pg_cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	if (pg->pg_cp[0] != '=' && pg->pg_cp[0] != ':') {
+		return EINVAL;
+	}
+	pg->pg_cp++;
+	plist_gen_space(pg);
+	return (pg->pg_cp == pg->pg_ep) ? ENOENT : 0;
+}
+
+/**
+ * Copy the characters of a number so it can be converted
+ */
+static int
+_plist_gen_number(plist_gen_t *pg, char *buf, const char **endp)
+{
+	size_t len;
+	const char *cp;
+
+	if (pg->pg_cp[0] != '-' && (unsigned) (pg->pg_cp[0] - '0') > 9) {
+		return EINVAL;
+	}
+	for (cp = pg->pg_cp; cp != pg->pg_ep; cp++) {
+		if (strchr("0123456789.eE+-", cp[0]) == NULL || cp[0] == '\0') {
+			break;
+		}
+	}
+	if (cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	len = cp - pg->pg_cp;
+	if (len >= GEN_NUMBERMAX) {
+		return ERANGE;
+	}
+	memcpy(buf, pg->pg_cp, len);
+	buf[len] = '\0';
+	*endp = cp;
+	return 0;
+}
+
+int
+plist_gen_intslow(plist_gen_t *pg, long long *valp)
+{
+	int err;
+	char *ep;
+	char buf[GEN_NUMBERMAX];
+	const char *cp;
+	long long val;
+
+	err = _plist_gen_number(pg, buf, &cp);
+	if (err != 0) {
+		return err;
+	}
+	errno = 0;
+	val = strtoll(buf, &ep, 0);
+	if (errno == ERANGE) {
+		return ERANGE;
+	}
+	if (ep[0] != '\0') {
+		return EINVAL;
+	}
+	*valp = val;
+	pg->pg_cp = cp;
+	return 0;
+}
+
+int
+plist_gen_real(plist_gen_t *pg, double *valp)
+{
+	int err;
+	char *ep;
+	char buf[GEN_NUMBERMAX];
+	const char *cp;
+	double val;
+
+	err = _plist_gen_number(pg, buf, &cp);
+	if (err != 0) {
+		return err;
+	}
+	val = strtod(buf, &ep);
+	if (ep[0] != '\0') {
+		return EINVAL;
+	}
+	*valp = val;
+	pg->pg_cp = cp;
+	return 0;
+}
+
+int
+plist_gen_string(plist_gen_t *pg, char **strp)
+{
+	int err;
+	char *str;
+	size_t len;
+	const char *cp;
+
+	if (pg->pg_cp[0] != '"') {
+		return EINVAL;
+	}
+
+	/* the raw length is enough for the string with its escapes */
+	for (cp = &pg->pg_cp[1]; cp != pg->pg_ep && cp[0] != '"'; cp++) {
+		if (cp[0] == '\\' && &cp[1] != pg->pg_ep) {
+			cp++;
+		}
+	}
+	if (cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	len = cp - pg->pg_cp;
+	str = malloc(len);
+	if (str == NULL) {
+		return ENOMEM;
+	}
+	err = _plist_gen_unescape(pg, str, len, &len);
+	if (err != 0) {
+		free(str);
+		return err;
+	}
+	str[len] = '\0';
+	*strp = str;
+	return 0;
+}
+
+int
+plist_gen_strslow(plist_gen_t *pg, char *buf, size_t bufsz)
+{
+	int err;
+	size_t len;
+
+	if (bufsz == 0) {
+		return ERANGE;
+	}
+	err = _plist_gen_unescape(pg, buf, bufsz - 1, &len);
+	if (err != 0) {
+		return err;
+	}
+	buf[len] = '\0';
+	return 0;
+}
+
+static int
+_plist_gen_hex(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+int
+plist_gen_data(plist_gen_t *pg, plist_bind_vector_t *pbv)
+{
+	int hex;
+	size_t cnt;
+	uint8_t *bp;
+	const char *cp;
+	const char *close;
+
+	if (pg->pg_cp[0] != '<') {
+		return EINVAL;
+	}
+	close = memchr(pg->pg_cp, '>', pg->pg_ep - pg->pg_cp);
+	if (close == NULL) {
+		return ENOENT;
+	}
+	if (&pg->pg_cp[1] != close && pg->pg_cp[1] == '*') {
+		/* a date */
+		return EINVAL;
+	}
+
+	/* at most one byte for two characters */
+	bp = malloc((close - pg->pg_cp) / 2 + 1);
+	if (bp == NULL) {
+		return ENOMEM;
+	}
+	cnt = 0;
+	for (cp = &pg->pg_cp[1]; cp != close; cp++) {
+		if (isspace((unsigned char) cp[0])) {
+			continue;
+		}
+		hex = _plist_gen_hex(cp[0]);
+		if (hex < 0) {
+			free(bp);
+			return EINVAL;
+		}
+		if ((cnt % 2) == 0) {
+			bp[cnt / 2] = hex << 4;
+		} else {
+			bp[cnt / 2] |= hex;
+		}
+		cnt++;
+	}
+
+	pbv->pbv_elems = bp;
+	pbv->pbv_nelems = cnt/2 + cnt%2;
+	pbv->pbv_maxelems = (close - pg->pg_cp) / 2 + 1;
+	pg->pg_cp = &close[1];
+	return 0;
+}
+
+int
+plist_gen_date(plist_gen_t *pg, struct tm *tm)
+{
+	char buf[GEN_NUMBERMAX];
+	const char *cp;
+	const char *close;
+	struct tm tmp;
+
+	if (pg->pg_cp[0] != '<') {
+		return EINVAL;
+	}
+	close = memchr(pg->pg_cp, '>', pg->pg_ep - pg->pg_cp);
+	if (close == NULL) {
+		return ENOENT;
+	}
+	if (&pg->pg_cp[1] == close || pg->pg_cp[1] != '*') {
+		/* data */
+		return EINVAL;
+	}
+	if ((size_t) (close - &pg->pg_cp[2]) >= sizeof(buf)) {
+		return ERANGE;
+	}
+	memcpy(buf, &pg->pg_cp[2], close - &pg->pg_cp[2]);
+	buf[close - &pg->pg_cp[2]] = '\0';
+
+	memset(&tmp, 0, sizeof(tmp));
+	cp = strptime(buf, "%Y-%m-%d %H:%M:%S %z", &tmp);
+	if (cp == NULL) {
+		return EINVAL;
+	}
+	*tm = tmp;
+	pg->pg_cp = &close[1];
+	return 0;
+}
+
+
+/*
+ * Schema compiler
+ */
+
+static const plist_gen_type_t *
+_plist_gen_type(const char *name, unsigned *arraysz)
+{
+	int n;
+	const plist_gen_type_t *pgt;
+
+	*arraysz = 0;
+	if (sscanf(name, "char[%u]%n", arraysz, &n) == 1 &&
+	    name[n] == '\0') {
+		/* a fixed buffer has no entry */
+		return (*arraysz > 0) ? &_plist_gen_types[0] : NULL;
+	}
+	for (pgt = _plist_gen_types; pgt->pgt_name != NULL; pgt++) {
+		if (strcmp(pgt->pgt_name, name) == 0) {
+			return pgt;
+		}
+	}
+	return NULL;
+}
+
+static bool
+_plist_gen_isident(const char *s)
+{
+	if (!isalpha((unsigned char) s[0]) && s[0] != '_') {
+		return false;
+	}
+	for (s++; s[0] != '\0'; s++) {
+		if (!isalnum((unsigned char) s[0]) && s[0] != '_') {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Member name for a key, anything that is not allowed in an identifier
+ * becomes an underscore
+ */
+static void
+_plist_gen_member(const char *key, char *buf, size_t bufsz)
+{
+	size_t i;
+
+	i = 0;
+	if (isdigit((unsigned char) key[0])) {
+		buf[i++] = '_';
+	}
+	for (; key[0] != '\0' && i < bufsz - 1; key++) {
+		buf[i++] = (isalnum((unsigned char) key[0])) ? key[0] : '_';
+	}
+	buf[i] = '\0';
+	return;
+}
+
+/**
+ * Write a key as the body of a C string
+ */
+static void
+_plist_gen_literal(FILE *fp, const char *key)
+{
+	for (; key[0] != '\0'; key++) {
+		if (key[0] == '"' || key[0] == '\\') {
+			fprintf(fp, "\\%c", key[0]);
+		} else if (isprint((unsigned char) key[0])) {
+			fputc(key[0], fp);
+		} else {
+			fprintf(fp, "\\%03o", (unsigned char) key[0]);
+		}
+	}
+	return;
+}
+
+/**
+ * Check the fields of one structure and everything nested in it
+ */
+static int
+_plist_gen_check(const plist_t *fields, bool *allocp)
+{
+	int err;
+	unsigned arraysz;
+	char member[128];
+	char other[128];
+	const plist_t *key;
+	const plist_t *ptmp;
+	const plist_t *value;
+	const plist_gen_type_t *pgt;
+
+	if (fields->p_elem != PLIST_DICT || fields->p_dict.pd_numkeys == 0) {
+		return EINVAL;
+	}
+	TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+		value = key->p_key.pk_value;
+		if (key->p_key.pk_name[0] == '\0') {
+			return EINVAL;
+		}
+		if (value->p_elem == PLIST_DICT) {
+			err = _plist_gen_check(value, allocp);
+			if (err != 0) {
+				return err;
+			}
+		} else if (value->p_elem != PLIST_STRING) {
+			return EINVAL;
+		} else {
+			pgt = _plist_gen_type(value->p_string.ps_str, &arraysz);
+			if (pgt == NULL) {
+				return EINVAL;
+			}
+			if (arraysz == 0 && pgt->pgt_alloc) {
+				*allocp = true;
+			}
+		}
+
+		/* two keys cannot end up as the same member */
+		_plist_gen_member(key->p_key.pk_name, member, sizeof(member));
+		TAILQ_FOREACH(ptmp, &fields->p_dict.pd_keys, p_entry) {
+			if (ptmp == key) {
+				break;
+			}
+			_plist_gen_member(ptmp->p_key.pk_name, other,
+					  sizeof(other));
+			if (strcmp(member, other) == 0) {
+				return EINVAL;
+			}
+		}
+	}
+	return 0;
+}
+
+static void
+_plist_gen_structs(FILE *fp, const plist_t *fields, const char *tag)
+{
+	unsigned arraysz;
+	char member[128];
+	char nested[512];
+	const plist_t *key;
+	const plist_t *value;
+	const plist_gen_type_t *pgt;
+
+	/* nested structures are declared first */
+	TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+		value = key->p_key.pk_value;
+		if (value->p_elem == PLIST_DICT) {
+			_plist_gen_member(key->p_key.pk_name, member,
+					  sizeof(member));
+			snprintf(nested, sizeof(nested), "%s_%s", tag, member);
+			_plist_gen_structs(fp, value, nested);
+		}
+	}
+
+	fprintf(fp, "struct %s_s {\n", tag);
+	TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+		value = key->p_key.pk_value;
+		_plist_gen_member(key->p_key.pk_name, member, sizeof(member));
+		if (value->p_elem == PLIST_DICT) {
+			fprintf(fp, "\tstruct %s_%s_s %s;\n", tag, member, member);
+			continue;
+		}
+		pgt = _plist_gen_type(value->p_string.ps_str, &arraysz);
+		if (arraysz > 0) {
+			fprintf(fp, "\tchar %s[%u];\n", member, arraysz);
+		} else {
+			fprintf(fp, "\t%s%s%s;\n", pgt->pgt_ctype,
+				(strchr(pgt->pgt_ctype, '*') != NULL) ? "" : " ",
+				member);
+		}
+	}
+	fprintf(fp, "};\n\n");
+	return;
+}
+
+/**
+ * Find a seed and a table size where every key of a structure has a
+ * slot of its own
+ */
+static int
+_plist_gen_phash(const plist_t *fields, uint32_t *seedp, uint32_t *maskp)
+{
+	uint32_t n;
+	bool ok;
+	uint8_t *used;
+	uint32_t h;
+	uint32_t seed;
+	uint32_t size;
+	const plist_t *key;
+
+	n = fields->p_dict.pd_numkeys;
+	for (size = 1; size < n; size <<= 1) {
+		continue;
+	}
+	for (; size <= 16 * n; size <<= 1) {
+		used = malloc(size);
+		if (used == NULL) {
+			return ENOMEM;
+		}
+		for (seed = 0; seed < GEN_SEEDS; seed++) {
+			memset(used, 0, size);
+			ok = true;
+			TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+				h = plist_gen_hash(seed, key->p_key.pk_name,
+						   strlen(key->p_key.pk_name));
+				h &= size - 1;
+				if (used[h]) {
+					ok = false;
+					break;
+				}
+				used[h] = 1;
+			}
+			if (ok) {
+				free(used);
+				*seedp = seed;
+				*maskp = size - 1;
+				return 0;
+			}
+		}
+		free(used);
+	}
+	return EINVAL;
+}
+
+static int
+_plist_gen_decoder(FILE *fp, const plist_t *fields, const char *tag)
+{
+	int err;
+	uint32_t h;
+	uint32_t seed;
+	uint32_t mask;
+	unsigned arraysz;
+	char member[128];
+	char nested[512];
+	const plist_t *key;
+	const plist_t *value;
+	const plist_gen_type_t *pgt;
+
+	TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+		value = key->p_key.pk_value;
+		if (value->p_elem == PLIST_DICT) {
+			_plist_gen_member(key->p_key.pk_name, member,
+					  sizeof(member));
+			snprintf(nested, sizeof(nested), "%s_%s", tag, member);
+			err = _plist_gen_decoder(fp, value, nested);
+			if (err != 0) {
+				return err;
+			}
+		}
+	}
+
+	err = _plist_gen_phash(fields, &seed, &mask);
+	if (err != 0) {
+		return err;
+	}
+
+	fprintf(fp,
+		"static int\n"
+		"_%s_decode(struct %s_s *rec, plist_gen_t *pg)\n"
+		"{\n"
+		"\tint err;\n"
+		"\tsize_t len;\n"
+		"\tconst char *key;\n"
+		"\n"
+		"\terr = plist_gen_open(pg);\n"
+		"\twhile (err == 0) {\n"
+		"\t\terr = plist_gen_key(pg, &key, &len);\n"
+		"\t\tif (err != 0) {\n"
+		"\t\t\tbreak;\n"
+		"\t\t}\n"
+		"\t\tswitch (plist_gen_hash(%uu, key, len) & %uu) {\n",
+		tag, tag, seed, mask);
+
+	TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+		value = key->p_key.pk_value;
+		h = plist_gen_hash(seed, key->p_key.pk_name,
+				   strlen(key->p_key.pk_name)) & mask;
+		_plist_gen_member(key->p_key.pk_name, member, sizeof(member));
+
+		fprintf(fp, "\t\tcase %u:\n"
+			"\t\t\tif (len == %zu && memcmp(key, \"",
+			h, strlen(key->p_key.pk_name));
+		_plist_gen_literal(fp, key->p_key.pk_name);
+		fprintf(fp, "\", %zu) == 0) {\n",
+			strlen(key->p_key.pk_name));
+
+		if (value->p_elem == PLIST_DICT) {
+			fprintf(fp, "\t\t\t\terr = _%s_%s_decode("
+				"&rec->%s, pg);\n", tag, member, member);
+		} else {
+			pgt = _plist_gen_type(value->p_string.ps_str,
+					      &arraysz);
+			if (arraysz > 0) {
+				fprintf(fp, "\t\t\t\terr = plist_gen_strbuf("
+					"pg, rec->%s,\n"
+					"\t\t\t\t\t\t       "
+					"sizeof(rec->%s));\n",
+					member, member);
+			} else {
+				fprintf(fp, "\t\t\t\terr = %s(pg, &rec->%s);\n",
+					pgt->pgt_call, member);
+			}
+		}
+		fprintf(fp, "\t\t\t\tbreak;\n"
+			"\t\t\t}\n"
+			"\t\t\terr = plist_gen_skip(pg);\n"
+			"\t\t\tbreak;\n");
+	}
+
+	fprintf(fp,
+		"\t\tdefault:\n"
+		"\t\t\terr = plist_gen_skip(pg);\n"
+		"\t\t\tbreak;\n"
+		"\t\t}\n"
+		"\t\tif (err == 0) {\n"
+		"\t\t\terr = plist_gen_next(pg);\n"
+		"\t\t}\n"
+		"\t}\n"
+		"\treturn (err == PLIST_GEN_END) ? 0 : err;\n"
+		"}\n\n");
+	return 0;
+}
+
+/**
+ * Free what the decoder allocated, returns whether there was anything
+ * to free in the structure
+ */
+static bool
+_plist_gen_release(FILE *fp, const plist_t *fields, const char *tag)
+{
+	bool alloc;
+	bool any;
+	unsigned arraysz;
+	char member[128];
+	char nested[512];
+	const plist_t *key;
+	const plist_t *value;
+	const plist_gen_type_t *pgt;
+
+	any = false;
+	TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+		value = key->p_key.pk_value;
+		if (value->p_elem == PLIST_DICT) {
+			_plist_gen_member(key->p_key.pk_name, member,
+					  sizeof(member));
+			snprintf(nested, sizeof(nested), "%s_%s", tag, member);
+			alloc = false;
+			if (_plist_gen_check(value, &alloc) == 0 && alloc) {
+				_plist_gen_release(fp, value, nested);
+				any = true;
+			}
+			continue;
+		}
+		pgt = _plist_gen_type(value->p_string.ps_str, &arraysz);
+		if (arraysz == 0 && pgt->pgt_alloc) {
+			any = true;
+		}
+	}
+	if (!any) {
+		return false;
+	}
+
+	fprintf(fp, "static void\n"
+		"_%s_release(struct %s_s *rec)\n"
+		"{\n", tag, tag);
+	TAILQ_FOREACH(key, &fields->p_dict.pd_keys, p_entry) {
+		value = key->p_key.pk_value;
+		_plist_gen_member(key->p_key.pk_name, member, sizeof(member));
+		if (value->p_elem == PLIST_DICT) {
+			alloc = false;
+			if (_plist_gen_check(value, &alloc) == 0 && alloc) {
+				fprintf(fp, "\t_%s_%s_release(&rec->%s);\n",
+					tag, member, member);
+			}
+			continue;
+		}
+		pgt = _plist_gen_type(value->p_string.ps_str, &arraysz);
+		if (arraysz > 0 || !pgt->pgt_alloc) {
+			continue;
+		}
+		if (strcmp(pgt->pgt_name, "string") == 0) {
+			fprintf(fp, "\tfree(rec->%s);\n"
+				"\trec->%s = NULL;\n", member, member);
+		} else {
+			fprintf(fp, "\tfree(rec->%s.pbv_elems);\n"
+				"\tmemset(&rec->%s, 0, sizeof(rec->%s));\n",
+				member, member, member);
+		}
+	}
+	fprintf(fp, "\treturn;\n"
+		"}\n\n");
+	return true;
+}
+
+
+int
+plist_gen_compile(const plist_t *schema, const char *header,
+		  FILE *hfp, FILE *cfp)
+{
+	int err;
+	bool alloc;
+	char *cp;
+	char guard[256];
+	const char *name;
+	const plist_t *key;
+	const plist_t *fields;
+
+	if (!schema || !header || !hfp || !cfp) {
+		return EINVAL;
+	}
+	if (schema->p_elem != PLIST_DICT) {
+		return EINVAL;
+	}
+
+	name = NULL;
+	fields = NULL;
+	TAILQ_FOREACH(key, &schema->p_dict.pd_keys, p_entry) {
+		if (strcmp(key->p_key.pk_name, "name") == 0 &&
+		    key->p_key.pk_value->p_elem == PLIST_STRING) {
+			name = key->p_key.pk_value->p_string.ps_str;
+		}
+		if (strcmp(key->p_key.pk_name, "fields") == 0) {
+			fields = key->p_key.pk_value;
+		}
+	}
+	if (name == NULL || fields == NULL || !_plist_gen_isident(name) ||
+	    strlen(name) >= 128) {
+		return EINVAL;
+	}
+	alloc = false;
+	err = _plist_gen_check(fields, &alloc);
+	if (err != 0) {
+		return err;
+	}
+
+	/* the header with the structures */
+	snprintf(guard, sizeof(guard), "_%s_H_", name);
+	for (cp = guard; cp[0] != '\0'; cp++) {
+		*cp = toupper((unsigned char) *cp);
+	}
+	fprintf(hfp, "/* Generated by plist-codegen, do not edit. */\n\n"
+		"#ifndef %s\n"
+		"#define %s\n\n"
+		"#include <plist_genrt.h>\n\n", guard, guard);
+	_plist_gen_structs(hfp, fields, name);
+	fprintf(hfp,
+		"typedef struct %s_s %s_t;\n\n"
+		"__BEGIN_DECLS\n\n"
+		"/**\n"
+		" * Decode one document into a structure that holds the\n"
+		" * defaults for missing keys. Keys that are not in the\n"
+		" * schema are skipped.\n"
+		" *\n"
+		" * @param  rec    result structure\n"
+		" * @param  buf    pointer to the document\n"
+		" * @param  sz     size of the document\n"
+		" * @param  usedp  result count of bytes up to the end of\n"
+		" *               the document or NULL\n"
+		" * @return zero on success, ENOENT for an incomplete\n"
+		" *         document, EINVAL for a value of the wrong type,\n"
+		" *         ERANGE for a value that does not fit\n"
+		" */\n"
+		"int %s_decode(%s_t *rec, const void *buf, size_t sz,\n"
+		"\t\tsize_t *usedp);\n\n"
+		"/**\n"
+		" * Free the strings and data that decoding allocated\n"
+		" * @param  rec  structure that was decoded\n"
+		" */\n"
+		"void %s_release(%s_t *rec);\n\n"
+		"__END_DECLS\n\n"
+		"#endif /* !%s */\n",
+		name, name, name, name, name, name, guard);
+
+	/* and the source with the decoder */
+	fprintf(cfp, "/* Generated by plist-codegen, do not edit. */\n\n"
+		"#include <stdlib.h>\n"
+		"#include <string.h>\n"
+		"#include <errno.h>\n\n"
+		"#include \"%s\"\n\n\n", header);
+	err = _plist_gen_decoder(cfp, fields, name);
+	if (err != 0) {
+		return err;
+	}
+	alloc = _plist_gen_release(cfp, fields, name);
+	fprintf(cfp,
+		"\nint\n"
+		"%s_decode(%s_t *rec, const void *buf, size_t sz, "
+		"size_t *usedp)\n"
+		"{\n"
+		"\tint err;\n"
+		"\tplist_gen_t pg;\n"
+		"\n"
+		"\tif (!rec || (!buf && sz > 0)) {\n"
+		"\t\treturn EINVAL;\n"
+		"\t}\n"
+		"\tplist_gen_init(&pg, buf, sz);\n"
+		"\terr = _%s_decode(rec, &pg);\n"
+		"\tif (err == 0 && usedp != NULL) {\n"
+		"\t\t*usedp = pg.pg_cp - (const char *) buf;\n"
+		"\t}\n"
+		"\treturn err;\n"
+		"}\n\n\n"
+		"void\n"
+		"%s_release(%s_t *rec)\n"
+		"{\n"
+		"\tif (!rec) {\n"
+		"\t\treturn;\n"
+		"\t}\n",
+		name, name, name, name, name);
+	if (alloc) {
+		fprintf(cfp, "\t_%s_release(rec);\n", name);
+	}
+	fprintf(cfp, "\treturn;\n"
+		"}\n");
+
+	if (ferror(hfp) || ferror(cfp)) {
+		return EIO;
+	}
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_gen.h
+ * Specialized decoders for documents of a known shape. A schema, which
+ * is itself a plist text document, names the keys of a dictionary and
+ * the C type of each one:
+ *
+ *   {
+ *     "name" = "tlm";
+ *     "fields" = {
+ *       "id" = "int64";
+ *       "host" = "char[32]";
+ *       "load" = "double";
+ *       "disk" = { "used" = "int64"; "free" = "int64" };
+ *     };
+ *   }
+ *
+ * The types are bool, int8, int16, int32, int64, float, double, string
+ * (a char * from malloc), char[N], data (a plist_bind_vector_t of bytes),
+ * date (a struct tm), and a dictionary for a nested structure.
+ *
+ * #plist_gen_compile turns a schema into a header with the structure
+ * and a source file with tlm_decode and tlm_release, which is what the
+ * plist-codegen tool does at build time. The decoder finds each key with
+ * a perfect hash computed for the key set and stores the value with the
+ * conversion for its type, so there is no tree, no event dispatch, and
+ * no check of a type that cannot appear. Keys that are not in the
+ * schema are skipped over without being parsed.
+ *
+ * The small runtime that generated decoders are built from is in
+ * plist_genrt.h, which only generated code includes.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_GEN_H_
+#define _PLIST_GEN_H_
+
+#include <plist.h>
+
+
+__BEGIN_DECLS
+
+/**
+ * Write the decoder for a schema
+ *
+ * @param  schema  dictionary of the schema
+ * @param  header  name of the generated header for its include line
+ * @param  hfp     stream for the header
+ * @param  cfp     stream for the source
+ * @return zero on success, EINVAL for a schema that cannot be compiled,
+ *         or an error value
+ */
+int plist_gen_compile(const plist_t *schema, const char *header,
+		      FILE *hfp, FILE *cfp);
+
+__END_DECLS
+
+#endif /* !_PLIST_GEN_H_ */
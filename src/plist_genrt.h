@@ -0,0 +1,351 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_genrt.h
+ * Runtime of the decoders that #plist_gen_compile writes. It is
+ * installed because generated sources include it, but it is internal
+ * to them: the functions and the plist_gen_t position are not a stable
+ * interface for applications and may change along with the code that
+ * the generator writes.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_GENRT_H_
+#define _PLIST_GENRT_H_
+
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <plist.h>
+#include <plist_bind.h>
+
+#define PLIST_GEN_KEYMAX  (256) /* longest key with escape sequences */
+#define PLIST_GEN_END     (-1)  /* the dictionary has no more keys */
+
+/* forward declare */
+typedef struct plist_gen_s plist_gen_t;
+
+/**
+ * Position of a generated decoder in its document
+ */
+struct plist_gen_s {
+	const char *pg_cp;
+	const char *pg_ep;
+
+	/* a key that had to be unescaped */
+	char pg_key[PLIST_GEN_KEYMAX];
+};
+
+
+__BEGIN_DECLS
+
+/*
+ * Runtime of the generated decoders. Each conversion checks the first
+ * character of the value for its own type and returns EINVAL for any
+ * other, ENOENT when the document ends first, and ERANGE for a value
+ * that does not fit.
+ */
+int plist_gen_skip(plist_gen_t *pg);
+int plist_gen_keyslow(plist_gen_t *pg, const char **keyp, size_t *lenp);
+int plist_gen_intslow(plist_gen_t *pg, long long *valp);
+int plist_gen_real(plist_gen_t *pg, double *valp);
+int plist_gen_string(plist_gen_t *pg, char **strp);
+int plist_gen_strslow(plist_gen_t *pg, char *buf, size_t bufsz);
+int plist_gen_data(plist_gen_t *pg, plist_bind_vector_t *pbv);
+int plist_gen_date(plist_gen_t *pg, struct tm *tm);
+
+__END_DECLS
+
+
+
+static inline void
+plist_gen_init(plist_gen_t *pg, const void *buf, size_t sz)
+{
+	pg->pg_cp = buf;
+	pg->pg_ep = &pg->pg_cp[sz];
+	return;
+}
+
+static inline void
+plist_gen_space(plist_gen_t *pg)
+{
+	const char *cp = pg->pg_cp;
+
+	while (cp != pg->pg_ep &&
+	       (cp[0] == ' ' || (cp[0] >= '\t' && cp[0] <= '\r'))) {
+		cp++;
+	}
+	pg->pg_cp = cp;
+	return;
+}
+
+/**
+ * Key hash that the perfect hash of a schema is searched with
+ */
+static inline uint32_t
+plist_gen_hash(uint32_t seed, const char *s, size_t len)
+{
+	uint32_t h = seed ^ 2166136261u;
+
+	while (len-- > 0) {
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+/**
+ * Expect the start of a dictionary
+ */
+static inline int
+plist_gen_open(plist_gen_t *pg)
+{
+	plist_gen_space(pg);
+	if (pg->pg_cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	if (pg->pg_cp[0] != '{') {
+		return EINVAL;
+	}
+	pg->pg_cp++;
+	return 0;
+}
+
+/**
+ * Pick up the next key and its assignment, or PLIST_GEN_END after the
+ * close of the dictionary. The key points into the document unless it
+ * has escape sequences.
+ */
+static inline int
+plist_gen_key(plist_gen_t *pg, const char **keyp, size_t *lenp)
+{
+	const char *cp;
+
+	plist_gen_space(pg);
+	if (pg->pg_cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	if (pg->pg_cp[0] == '}') {
+		pg->pg_cp++;
+		return PLIST_GEN_END;
+	}
+	if (pg->pg_cp[0] != '"') {
+		return EINVAL;
+	}
+	for (cp = &pg->pg_cp[1]; cp != pg->pg_ep; cp++) {
+		if (cp[0] == '"' || cp[0] == '\\') {
+			break;
+		}
+	}
+	if (cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	if (cp[0] == '\\') {
+		return plist_gen_keyslow(pg, keyp, lenp);
+	}
+	*keyp = &pg->pg_cp[1];
+	*lenp = cp - *keyp;
+	pg->pg_cp = &cp[1];
+
+	plist_gen_space(pg);
+	if (pg->pg_cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	if (pg->pg_cp[0] != '=' && pg->pg_cp[0] != ':') {
+		return EINVAL;
+	}
+	pg->pg_cp++;
+	plist_gen_space(pg);
+	return (pg->pg_cp == pg->pg_ep) ? ENOENT : 0;
+}
+
+/**
+ * Step past the separator after a value. The close of the dictionary
+ * is left for #plist_gen_key.
+ */
+static inline int
+plist_gen_next(plist_gen_t *pg)
+{
+	plist_gen_space(pg);
+	if (pg->pg_cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	if (pg->pg_cp[0] == ';') {
+		pg->pg_cp++;
+		return 0;
+	}
+	return (pg->pg_cp[0] == '}') ? 0 : EINVAL;
+}
+
+static inline int
+plist_gen_integer(plist_gen_t *pg, long long *valp)
+{
+	bool neg;
+	const char *cp = pg->pg_cp;
+	unsigned long long val;
+
+	neg = (cp[0] == '-');
+	if (neg) {
+		cp++;
+	}
+	if (cp == pg->pg_ep || (unsigned) (cp[0] - '0') > 9) {
+		return (cp == pg->pg_ep) ? ENOENT : EINVAL;
+	}
+	if (cp[0] == '0' && &cp[1] != pg->pg_ep &&
+	    (unsigned) (cp[1] - '0') <= 9) {
+		/* octal like the text parser */
+		return plist_gen_intslow(pg, valp);
+	}
+
+	val = 0;
+	while (cp != pg->pg_ep && (unsigned) (cp[0] - '0') <= 9) {
+		if (val > (ULLONG_MAX - 9) / 10) {
+			return plist_gen_intslow(pg, valp);
+		}
+		val = val * 10 + (cp[0] - '0');
+		cp++;
+	}
+	if (cp == pg->pg_ep) {
+		/* a number has to be followed by something */
+		return ENOENT;
+	}
+	if (cp[0] == '.' || cp[0] == 'e' || cp[0] == 'E') {
+		return EINVAL;
+	}
+	if (val > (unsigned long long) LLONG_MAX + neg) {
+		return ERANGE;
+	}
+	*valp = neg ? -(long long) (val - 1) - 1 : (long long) val;
+	pg->pg_cp = cp;
+	return 0;
+}
+
+/* fixed size integers with a range check */
+#define PLIST_GEN_INTEGER(_name, _type, _min, _max)			\
+static inline int							\
+_name(plist_gen_t *pg, _type *valp)					\
+{									\
+	int err;							\
+	long long val;							\
+									\
+	err = plist_gen_integer(pg, &val);				\
+	if (err != 0) {							\
+		return err;						\
+	}								\
+	if (val < (_min) || val > (_max)) {				\
+		return ERANGE;						\
+	}								\
+	*valp = val;							\
+	return 0;							\
+}
+
+PLIST_GEN_INTEGER(plist_gen_int8, int8_t, INT8_MIN, INT8_MAX)
+PLIST_GEN_INTEGER(plist_gen_int16, int16_t, INT16_MIN, INT16_MAX)
+PLIST_GEN_INTEGER(plist_gen_int32, int32_t, INT32_MIN, INT32_MAX)
+PLIST_GEN_INTEGER(plist_gen_int64, int64_t, INT64_MIN, INT64_MAX)
+
+#undef PLIST_GEN_INTEGER
+
+static inline int
+plist_gen_float(plist_gen_t *pg, float *valp)
+{
+	int err;
+	double val;
+
+	err = plist_gen_real(pg, &val);
+	if (err == 0) {
+		*valp = val;
+	}
+	return err;
+}
+
+static inline int
+plist_gen_boolean(plist_gen_t *pg, bool *valp)
+{
+	const char *cp = pg->pg_cp;
+	size_t left = pg->pg_ep - cp;
+
+	if ((cp[0] | 0x20) == 't') {
+		if (left < sizeof("true")) {
+			return ENOENT;
+		}
+		if ((cp[1] | 0x20) != 'r' || (cp[2] | 0x20) != 'u' ||
+		    (cp[3] | 0x20) != 'e') {
+			return EINVAL;
+		}
+		*valp = true;
+		pg->pg_cp += 4;
+		return 0;
+	}
+	if ((cp[0] | 0x20) == 'f') {
+		if (left < sizeof("false")) {
+			return ENOENT;
+		}
+		if ((cp[1] | 0x20) != 'a' || (cp[2] | 0x20) != 'l' ||
+		    (cp[3] | 0x20) != 's' || (cp[4] | 0x20) != 'e') {
+			return EINVAL;
+		}
+		*valp = false;
+		pg->pg_cp += 5;
+		return 0;
+	}
+	return EINVAL;
+}
+
+/**
+ * A string into a fixed buffer that holds the terminating null
+ */
+static inline int
+plist_gen_strbuf(plist_gen_t *pg, char *buf, size_t bufsz)
+{
+	const char *cp;
+	size_t len;
+
+	if (pg->pg_cp[0] != '"') {
+		return EINVAL;
+	}
+	for (cp = &pg->pg_cp[1]; cp != pg->pg_ep; cp++) {
+		if (cp[0] == '"' || cp[0] == '\\') {
+			break;
+		}
+	}
+	if (cp == pg->pg_ep) {
+		return ENOENT;
+	}
+	if (cp[0] == '\\') {
+		return plist_gen_strslow(pg, buf, bufsz);
+	}
+	len = cp - &pg->pg_cp[1];
+	if (len >= bufsz) {
+		return ERANGE;
+	}
+	memcpy(buf, &pg->pg_cp[1], len);
+	buf[len] = '\0';
+	pg->pg_cp = &cp[1];
+	return 0;
+}
+
+#endif /* !_PLIST_GENRT_H_ */
@@ -0,0 +1,595 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_idx.c
+ *
+ * Structural index over a plist text document. The first stage runs the
+ * block scanner over the document and stores the offset of each
+ * structural it finds, so the cost per structural character is a store
+ * rather than a branch. The second stage is the lookup functions, which
+ * only read the index and the few bytes around the elements they visit.
+ *
+ * @version $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "plist_idx.h"
+#include "plist_txt.h"
+#include "plist_scan.h"
+
+#define IDX_MAXSZ    ((size_t) UINT32_MAX) /* offsets are 32 bits */
+
+
+static int
+_plist_idx_grow(plist_idx_t *idx, size_t newmax)
+{
+	void *ptr;
+
+	ptr = realloc(idx->pi_pos, newmax * sizeof(*idx->pi_pos));
+	if (ptr == NULL) {
+		return ENOMEM;
+	}
+	idx->pi_pos = ptr;
+	ptr = realloc(idx->pi_match, newmax * sizeof(*idx->pi_match));
+	if (ptr == NULL) {
+		return ENOMEM;
+	}
+	idx->pi_match = ptr;
+	idx->pi_maxpos = newmax;
+	return 0;
+}
+
+/**
+ * Pair up the containers of a block. The structural index of each
+ * bracket is the count of structurals before it.
+ */
+static int
+_plist_idx_nest(plist_idx_t *idx, const char *cp, uint64_t brk,
+		uint64_t structs, size_t first, uint32_t **stackp,
+		size_t *depthp, size_t *maxdepthp)
+{
+	char c;
+	size_t sidx;
+	uint32_t open;
+	unsigned int i;
+
+	while (brk != 0) {
+		i = __builtin_ctzll(brk);
+		brk &= brk - 1;
+		sidx = first + __builtin_popcountll(
+			structs & (((uint64_t) 1 << i) - 1));
+		c = cp[i];
+
+		if (c == '{' || c == '(') {
+			if (*depthp == *maxdepthp) {
+				void *ptr;
+				size_t newmax;
+
+				newmax = (*maxdepthp == 0) ?
+				    32 : *maxdepthp * 2;
+				ptr = realloc(*stackp,
+					      newmax * sizeof(**stackp));
+				if (ptr == NULL) {
+					return ENOMEM;
+				}
+				*stackp = ptr;
+				*maxdepthp = newmax;
+			}
+			(*stackp)[(*depthp)++] = sidx;
+			continue;
+		}
+
+		if (*depthp == 0) {
+			return EINVAL;
+		}
+		open = (*stackp)[--(*depthp)];
+		if (idx->pi_buf[idx->pi_pos[open]] != ((c == '}') ? '{' : '(')) {
+			/* mismatched container */
+			return EINVAL;
+		}
+		idx->pi_match[open] = sidx;
+	}
+	return 0;
+}
+
+/**
+ * Find the structural characters of the document. A string or data
+ * element always closes at the next structural, see _plist_scan_block,
+ * so only containers need a match.
+ */
+static int
+_plist_idx_build(plist_idx_t *idx)
+{
+	int err;
+	char tail[SCAN_BLOCKSZ];
+	const char *cp;
+	size_t base;
+	size_t first;
+	size_t depth;
+	size_t maxdepth;
+	uint32_t *stack;
+	uint64_t bits;
+	plist_scan_block_t blk;
+	plist_scan_carry_t carry;
+
+	/*
+	 * Size for a structural every four bytes, which is dense markup,
+	 * so that typical input never reallocates. Pages that are not
+	 * reached are never touched.
+	 */
+	err = _plist_idx_grow(idx, idx->pi_sz / 4 + SCAN_BLOCKSZ);
+	if (err != 0) {
+		return err;
+	}
+
+	depth = 0;
+	maxdepth = 0;
+	stack = NULL;
+	memset(&carry, 0, sizeof(carry));
+
+	for (base = 0; base < idx->pi_sz; base += SCAN_BLOCKSZ) {
+		cp = _plist_scan_block(idx->pi_buf, idx->pi_sz, base, tail,
+				       &carry, &blk);
+
+		if (idx->pi_maxpos - idx->pi_npos < SCAN_BLOCKSZ) {
+			/* by half again, the first guess is rarely far off */
+			err = _plist_idx_grow(idx, idx->pi_maxpos +
+					      idx->pi_maxpos / 2);
+			if (err != 0) {
+				goto out;
+			}
+		}
+		first = idx->pi_npos;
+		for (bits = blk.psb_structs; bits != 0; bits &= bits - 1) {
+			idx->pi_pos[idx->pi_npos++] =
+			    base + __builtin_ctzll(bits);
+		}
+
+		bits = blk.psb_brk & blk.psb_structs;
+		if (bits != 0) {
+			err = _plist_idx_nest(idx, cp, bits, blk.psb_structs,
+					      first, &stack, &depth, &maxdepth);
+			if (err != 0) {
+				goto out;
+			}
+		}
+	}
+
+	if (carry.psc_string != 0 || carry.psc_data != 0 || depth != 0) {
+		/* unterminated string, data, or container */
+		err = EINVAL;
+	}
+ out:
+	free(stack);
+	return err;
+}
+
+
+int
+plist_idx_new(plist_idx_t **idxpp, const void *buf, size_t sz)
+{
+	int err;
+	plist_idx_t *idx;
+
+	if (!idxpp || (!buf && sz != 0)) {
+		return EINVAL;
+	}
+	if (sz > IDX_MAXSZ) {
+		return EFBIG;
+	}
+
+	idx = malloc(sizeof(*idx));
+	if (idx == NULL) {
+		return ENOMEM;
+	}
+	memset(idx, 0, sizeof(*idx));
+	idx->pi_buf = buf;
+	idx->pi_sz = sz;
+
+	err = _plist_idx_build(idx);
+	if (err != 0) {
+		plist_idx_free(idx);
+		return err;
+	}
+	*idxpp = idx;
+	return 0;
+}
+
+
+void
+plist_idx_free(plist_idx_t *idx)
+{
+	if (!idx) {
+		return;
+	}
+	free(idx->pi_pos);
+	free(idx->pi_match);
+	free(idx);
+	return;
+}
+
+
+/* character at a structural index or nul past the last one */
+static char
+_plist_idx_char(plist_idx_t *idx, size_t sidx)
+{
+	if (sidx >= idx->pi_npos) {
+		return '\0';
+	}
+	return idx->pi_buf[idx->pi_pos[sidx]];
+}
+
+/* offset of a structural index or the end of the document */
+static size_t
+_plist_idx_off(plist_idx_t *idx, size_t sidx)
+{
+	if (sidx >= idx->pi_npos) {
+		return idx->pi_sz;
+	}
+	return idx->pi_pos[sidx];
+}
+
+static size_t
+_plist_idx_skipws(plist_idx_t *idx, size_t off)
+{
+	while (off < idx->pi_sz && isspace(idx->pi_buf[off])) {
+		off++;
+	}
+	return off;
+}
+
+/* whether the element starts with its own structural character */
+static bool
+_plist_idx_opens(plist_idx_t *idx, const plist_idx_node_t *node)
+{
+	char c;
+
+	if (node->pin_sidx >= idx->pi_npos ||
+	    idx->pi_pos[node->pin_sidx] != node->pin_off) {
+		return false;
+	}
+	c = idx->pi_buf[node->pin_off];
+	return (c == '{' || c == '(' || c == '"' || c == '<');
+}
+
+/* structural index of the close of an element that opens */
+static size_t
+_plist_idx_close(plist_idx_t *idx, size_t sidx)
+{
+	char c;
+
+	c = idx->pi_buf[idx->pi_pos[sidx]];
+	if (c == '{' || c == '(') {
+		return idx->pi_match[sidx];
+	}
+	/* nothing is indexed inside a string or data */
+	return sidx + 1;
+}
+
+/* structural index just past the element */
+static size_t
+_plist_idx_next(plist_idx_t *idx, const plist_idx_node_t *node)
+{
+	if (_plist_idx_opens(idx, node)) {
+		return _plist_idx_close(idx, node->pin_sidx) + 1;
+	}
+	/* a number or boolean runs up to the next structural */
+	return node->pin_sidx;
+}
+
+/**
+ * Compare a raw key from the document with a plain string, processing
+ * the escape sequences the same way as the text parser.
+ */
+static bool
+_plist_idx_keyeq(const char *raw, size_t rawlen, const char *key, size_t len)
+{
+	char c;
+	size_t i;
+	size_t j;
+
+	if (memchr(raw, '\\', rawlen) == NULL) {
+		return (rawlen == len && memcmp(raw, key, len) == 0);
+	}
+	for (i = 0, j = 0; i < rawlen; i++, j++) {
+		c = raw[i];
+		if (c == '\\' && ++i < rawlen) {
+			switch (raw[i]) {
+			case 'b':
+				c = '\b';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'f':
+				c = '\f';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			default:
+				c = raw[i];
+				break;
+			}
+		}
+		if (j >= len || key[j] != c) {
+			return false;
+		}
+	}
+	return (j == len);
+}
+
+
+int
+plist_idx_root(plist_idx_t *idx, plist_idx_node_t *nodep)
+{
+	if (!idx || !nodep) {
+		return EINVAL;
+	}
+	nodep->pin_off = _plist_idx_skipws(idx, 0);
+	nodep->pin_sidx = 0;
+	if (nodep->pin_off == idx->pi_sz) {
+		return ENOENT;
+	}
+	return 0;
+}
+
+
+enum plist_elem_e
+plist_idx_type(plist_idx_t *idx, const plist_idx_node_t *node)
+{
+	size_t off;
+	size_t end;
+
+	if (!idx || !node || node->pin_off >= idx->pi_sz) {
+		return PLIST_UNKNOWN;
+	}
+
+	off = node->pin_off;
+	switch (idx->pi_buf[off]) {
+	case '{':
+		return PLIST_DICT;
+	case '(':
+		return PLIST_ARRAY;
+	case '"':
+		return PLIST_STRING;
+	case '<':
+		if (off + 1 < idx->pi_sz && idx->pi_buf[off + 1] == '*') {
+			return PLIST_DATE;
+		}
+		return PLIST_DATA;
+	case 'T':
+	case 't':
+	case 'F':
+	case 'f':
+		return PLIST_BOOLEAN;
+	case '-':
+	case '0' ... '9':
+		end = _plist_idx_off(idx, node->pin_sidx);
+		for (; off < end; off++) {
+			if (idx->pi_buf[off] == '.' ||
+			    idx->pi_buf[off] == 'e' || idx->pi_buf[off] == 'E') {
+				return PLIST_REAL;
+			}
+		}
+		return PLIST_INTEGER;
+	default:
+		return PLIST_UNKNOWN;
+	}
+}
+
+
+/**
+ * Walk the entries of a dictionary. Stops at the entry matching key, or
+ * at the end when key is null or missing, and counts the entries passed.
+ */
+static int
+_plist_idx_dict(plist_idx_t *idx, const plist_idx_node_t *dict,
+		const char *key, plist_idx_node_t *valp, size_t *countp)
+{
+	char c;
+	size_t s;
+	size_t e;
+	size_t len;
+	size_t keylen;
+	plist_idx_node_t val;
+
+	if (plist_idx_type(idx, dict) != PLIST_DICT) {
+		return EINVAL;
+	}
+
+	keylen = (key != NULL) ? strlen(key) : 0;
+	*countp = 0;
+	for (s = dict->pin_sidx + 1;; (*countp)++) {
+		c = _plist_idx_char(idx, s);
+		if (c == '}') {
+			return ENOENT;
+		}
+		if (c != '"') {
+			return EINVAL;
+		}
+
+		e = s + 1;
+		len = idx->pi_pos[e] - idx->pi_pos[s] - 1;
+		c = _plist_idx_char(idx, e + 1);
+		if (c != ':' && c != '=') {
+			return EINVAL;
+		}
+		val.pin_off = _plist_idx_skipws(idx, idx->pi_pos[e + 1] + 1);
+		val.pin_sidx = e + 2;
+		if (key != NULL &&
+		    _plist_idx_keyeq(&idx->pi_buf[idx->pi_pos[s] + 1], len,
+				     key, keylen)) {
+			*valp = val;
+			return 0;
+		}
+
+		s = _plist_idx_next(idx, &val);
+		c = _plist_idx_char(idx, s);
+		if (c == ';') {
+			s++;
+		} else if (c != '}') {
+			return EINVAL;
+		}
+	}
+}
+
+/**
+ * Walk the elements of an array. Stops at element n or at the end and
+ * counts the elements passed.
+ */
+static int
+_plist_idx_array(plist_idx_t *idx, const plist_idx_node_t *array,
+		 size_t n, plist_idx_node_t *valp, size_t *countp)
+{
+	char c;
+	plist_idx_node_t val;
+
+	if (plist_idx_type(idx, array) != PLIST_ARRAY) {
+		return EINVAL;
+	}
+
+	val.pin_off = _plist_idx_skipws(idx, array->pin_off + 1);
+	val.pin_sidx = array->pin_sidx + 1;
+	for (*countp = 0;; (*countp)++) {
+		if (val.pin_off == _plist_idx_off(idx, val.pin_sidx) &&
+		    _plist_idx_char(idx, val.pin_sidx) == ')') {
+			/* end of the array or a trailing ',' */
+			return ENOENT;
+		}
+		if (*countp == n) {
+			*valp = val;
+			return 0;
+		}
+
+		val.pin_sidx = _plist_idx_next(idx, &val);
+		c = _plist_idx_char(idx, val.pin_sidx);
+		if (c == ')') {
+			(*countp)++;
+			return ENOENT;
+		}
+		if (c != ',') {
+			return EINVAL;
+		}
+		val.pin_off = _plist_idx_skipws(
+			idx, idx->pi_pos[val.pin_sidx] + 1);
+		val.pin_sidx++;
+	}
+}
+
+
+int
+plist_idx_lookup(plist_idx_t *idx, const plist_idx_node_t *dict,
+		 const char *key, plist_idx_node_t *valp)
+{
+	size_t count;
+
+	if (!idx || !dict || !key || !valp) {
+		return EINVAL;
+	}
+	return _plist_idx_dict(idx, dict, key, valp, &count);
+}
+
+
+int
+plist_idx_at(plist_idx_t *idx, const plist_idx_node_t *array,
+	     size_t n, plist_idx_node_t *valp)
+{
+	size_t count;
+
+	if (!idx || !array || !valp) {
+		return EINVAL;
+	}
+	return _plist_idx_array(idx, array, n, valp, &count);
+}
+
+
+int
+plist_idx_count(plist_idx_t *idx, const plist_idx_node_t *node,
+		size_t *countp)
+{
+	int err;
+	plist_idx_node_t val;
+
+	if (!idx || !node || !countp) {
+		return EINVAL;
+	}
+
+	switch (plist_idx_type(idx, node)) {
+	case PLIST_DICT:
+		err = _plist_idx_dict(idx, node, NULL, &val, countp);
+		break;
+	case PLIST_ARRAY:
+		err = _plist_idx_array(idx, node, SIZE_MAX, &val, countp);
+		break;
+	default:
+		return EINVAL;
+	}
+	return (err == ENOENT) ? 0 : err;
+}
+
+
+int
+plist_idx_plist(plist_idx_t *idx, const plist_idx_node_t *node,
+		plist_t **plistpp)
+{
+	int err;
+	size_t end;
+	plist_txt_t *txt;
+
+	if (!idx || !node || !plistpp || node->pin_off >= idx->pi_sz) {
+		return EINVAL;
+	}
+
+	if (_plist_idx_opens(idx, node)) {
+		end = idx->pi_pos[_plist_idx_close(idx, node->pin_sidx)] + 1;
+	} else {
+		end = _plist_idx_off(idx, node->pin_sidx);
+	}
+
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		return err;
+	}
+	err = plist_txt_parse(txt, &idx->pi_buf[node->pin_off],
+			      end - node->pin_off);
+	if (err == 0) {
+		/* terminate a trailing number or boolean */
+		err = plist_txt_parse(txt, " ", 1);
+	}
+	if (err == 0) {
+		err = plist_txt_result(txt, plistpp);
+	}
+	plist_txt_free(txt);
+	return err;
+}
@@ -0,0 +1,169 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_idx.h
+ *
+ * Structural index over a plist text document for reading a few
+ * elements of a large input without building the whole object tree.
+ *
+ * Indexing is a single pass that records the offset of every structural
+ * character ({ } ( ) < > " ; , : =) outside of strings and data, along
+ * with the matching close of each container. Lookups then jump over
+ * whole subtrees using the matches, and an element is only parsed into
+ * a plist object when it is asked for.
+ *
+ * The document is not copied and has to stay valid for the life of the
+ * index. Offsets are 32 bits so a document is limited to 4 GB.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_IDX_H_
+#define _PLIST_IDX_H_
+
+#include <plist.h>
+
+/* forward declare */
+typedef struct plist_idx_s plist_idx_t;
+typedef struct plist_idx_node_s plist_idx_node_t;
+
+/**
+ * Structural index of a document
+ */
+struct plist_idx_s {
+	const char *pi_buf;
+	size_t pi_sz;
+
+	/* offsets of the structural characters in document order */
+	size_t pi_npos;
+	size_t pi_maxpos;
+	uint32_t *pi_pos;
+
+	/* index of the matching close, only set for '{' and '(' */
+	uint32_t *pi_match;
+};
+
+/**
+ * Reference to an element in the document. This is only a position so
+ * it can be copied freely and nothing is allocated until #plist_idx_plist
+ * is called on it.
+ */
+struct plist_idx_node_s {
+	size_t pin_off;		/* offset of the element in the document */
+	size_t pin_sidx;	/* first structural at or after the element */
+};
+
+
+__BEGIN_DECLS
+
+/**
+ * Build the structural index of a document. This checks that strings,
+ * data, and containers are closed and nested correctly but the rest of
+ * the syntax is only checked as elements are visited.
+ *
+ * @param  idxpp  result index
+ * @param  buf    pointer to the document, which is not copied
+ * @param  sz     size of the document
+ * @return zero on success or an error value
+ */
+int plist_idx_new(plist_idx_t **idxpp, const void *buf, size_t sz);
+
+/**
+ * Free the structural index
+ *
+ * @param  idx  index that was allocated with #plist_idx_new
+ */
+void plist_idx_free(plist_idx_t *idx);
+
+/**
+ * Retrieve the top level element of the document
+ *
+ * @param  idx    index that was allocated with #plist_idx_new
+ * @param  nodep  result element
+ * @return zero on success, ENOENT for an empty document, or an error
+ */
+int plist_idx_root(plist_idx_t *idx, plist_idx_node_t *nodep);
+
+/**
+ * Determine the element type from the start of the element
+ *
+ * @param  idx   index that was allocated with #plist_idx_new
+ * @param  node  element to check
+ * @return the element type or PLIST_UNKNOWN
+ */
+enum plist_elem_e plist_idx_type(plist_idx_t *idx,
+				 const plist_idx_node_t *node);
+
+/**
+ * Find the value of a key in a dictionary element. Keys are compared
+ * after escape sequences are processed.
+ *
+ * @param  idx   index that was allocated with #plist_idx_new
+ * @param  dict  dictionary element
+ * @param  key   null terminated key to find
+ * @param  valp  result element
+ * @return zero on success, ENOENT if the key is missing, or an error
+ */
+int plist_idx_lookup(plist_idx_t *idx, const plist_idx_node_t *dict,
+		     const char *key, plist_idx_node_t *valp);
+
+/**
+ * Find an element of an array by position
+ *
+ * @param  idx    index that was allocated with #plist_idx_new
+ * @param  array  array element
+ * @param  n      zero based position in the array
+ * @param  valp   result element
+ * @return zero on success, ENOENT past the end, or an error
+ */
+int plist_idx_at(plist_idx_t *idx, const plist_idx_node_t *array,
+		 size_t n, plist_idx_node_t *valp);
+
+/**
+ * Count the keys in a dictionary or the elements in an array
+ *
+ * @param  idx     index that was allocated with #plist_idx_new
+ * @param  node    dictionary or array element
+ * @param  countp  result count
+ * @return zero on success or an error value
+ */
+int plist_idx_count(plist_idx_t *idx, const plist_idx_node_t *node,
+		    size_t *countp);
+
+/**
+ * Parse an element and everything below it into a plist object
+ *
+ * @param  idx      index that was allocated with #plist_idx_new
+ * @param  node     element to parse
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success or an error value
+ */
+int plist_idx_plist(plist_idx_t *idx, const plist_idx_node_t *node,
+		    plist_t **plistpp);
+
+__END_DECLS
+
+#endif /* !_PLIST_IDX_H_ */
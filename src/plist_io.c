@@ -0,0 +1,727 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_io.c
+ *
+ * Format detection and the dispatch to each reader and writer. The XML,
+ * JSON, and text readers are fed as the input arrives, while the binary
+ * and flat readers need the whole document and read it in place from a
+ * mapping when there is one.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for madvise */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plist_io.h"
+#include "plist_txt.h"
+#include "plist_xml.h"
+#include "plist_json.h"
+#include "plist_bpl.h"
+#include "plist_flat.h"
+#include "plist_zio.h"
+
+#define IO_SNIFFSZ  (64 * 1024)		/* most input looked at to decide */
+#define IO_READSZ   (1024 * 1024)	/* read size for a pipe */
+#define IO_MAGICSZ  (4)			/* longest compression magic */
+
+/* the input came out of a decoder, so is not decoded again */
+#define IO_DECODED  (0x100)
+
+#define ISSPACE(_c)  ((_c) == ' ' || (_c) == '\n' || \
+		      (_c) == '\t' || (_c) == '\r')
+
+/**
+ * Reader that is fed the input in fragments
+ */
+struct plist_io_s {
+	enum plist_format_e pio_format;
+	plist_txt_t *pio_txt;
+	plist_xml_t *pio_xml;
+	plist_json_t *pio_json;
+};
+
+
+/**
+ * Compare the input with a literal that may be cut short by the end of
+ * the input.
+ *
+ * @return 1 on a match, 0 on a mismatch, -1 when the input is a prefix
+ */
+static int
+_plist_io_prefix(const char *cp, const char *ep, const char *lit)
+{
+	size_t n = strlen(lit);
+
+	if ((size_t) (ep - cp) < n) {
+		return (memcmp(cp, lit, ep - cp) == 0) ? -1 : 0;
+	}
+	return memcmp(cp, lit, n) == 0;
+}
+
+/**
+ * Scan a document that starts with a { or a string for the first
+ * character that only text or only JSON has
+ */
+static int
+_plist_io_sniff_open(const char *cp, const char *ep,
+		     enum plist_format_e *fmtp)
+{
+	bool instr = false;
+
+	for (; cp < ep; cp++) {
+		if (instr) {
+			if (cp[0] == '"') {
+				instr = false;
+			} else if (cp[0] == '\\') {
+				if (cp + 1 == ep) {
+					break;
+				}
+				if (cp[1] == 'u') {
+					*fmtp = PLIST_FORMAT_JSON;
+					return 0;
+				}
+				cp++;
+			}
+			continue;
+		}
+		switch (cp[0]) {
+		case '"':
+			instr = true;
+			break;
+		case ':':
+			*fmtp = PLIST_FORMAT_JSON;
+			break;
+		case '=':
+		case ';':
+		case '(':
+		case ')':
+		case '<':
+			*fmtp = PLIST_FORMAT_TEXT;
+			return 0;
+		case '[':
+		case ']':
+		case ',':
+		case 'n':
+			*fmtp = PLIST_FORMAT_JSON;
+			return 0;
+		default:
+			break;
+		}
+	}
+	return EAGAIN;
+}
+
+/**
+ * Decide the format of the input. When the input is not enough to be
+ * sure, EAGAIN is returned with the best guess set.
+ *
+ * @return zero, EAGAIN for more input, or EINVAL for no known format
+ */
+static int
+_plist_io_sniff(const void *buf, size_t sz, enum plist_format_e *fmtp)
+{
+	int m;
+	const char *cp = buf;
+	const char *ep = cp + sz;
+
+	*fmtp = PLIST_FORMAT_UNKNOWN;
+	if (plist_compress_detect(buf, sz) != PLIST_COMPRESS_NONE) {
+		/* a compressed stream, which has to be decoded first */
+		return EINVAL;
+	}
+
+	*fmtp = PLIST_FORMAT_TEXT;
+	m = _plist_io_prefix(cp, ep, "bplist00");
+	if (m != 0) {
+		*fmtp = PLIST_FORMAT_BINARY;
+		return (m > 0) ? 0 : EAGAIN;
+	}
+	m = _plist_io_prefix(cp, ep, "plflat00");
+	if (m != 0) {
+		*fmtp = PLIST_FORMAT_FLAT;
+		return (m > 0) ? 0 : EAGAIN;
+	}
+
+	/* byte order mark and white space */
+	m = _plist_io_prefix(cp, ep, "\xef\xbb\xbf");
+	if (m < 0) {
+		return EAGAIN;
+	}
+	if (m > 0) {
+		cp += 3;
+	}
+	while (cp < ep && ISSPACE(cp[0])) {
+		cp++;
+	}
+	if (cp == ep) {
+		return EAGAIN;
+	}
+
+	switch (cp[0]) {
+	case '<':
+		if ((m = _plist_io_prefix(cp, ep, "<?xml")) == 0 &&
+		    (m = _plist_io_prefix(cp, ep, "<!")) == 0) {
+			m = _plist_io_prefix(cp, ep, "<plist");
+		}
+		if (m != 0) {
+			*fmtp = PLIST_FORMAT_XML;
+			return (m > 0) ? 0 : EAGAIN;
+		}
+		/* text data or date */
+		return 0;
+	case '(':
+	case '-':
+	case '0' ... '9':
+	case 't':
+	case 'T':
+	case 'f':
+	case 'F':
+		return 0;
+	case '[':
+	case 'n':
+		*fmtp = PLIST_FORMAT_JSON;
+		return 0;
+	case '{':
+	case '"':
+		return _plist_io_sniff_open(cp, ep, fmtp);
+	default:
+		*fmtp = PLIST_FORMAT_UNKNOWN;
+		return EINVAL;
+	}
+}
+
+
+enum plist_format_e
+plist_format_detect(const void *buf, size_t sz)
+{
+	enum plist_format_e fmt;
+
+	if (!buf || _plist_io_sniff(buf, sz, &fmt) != 0) {
+		return PLIST_FORMAT_UNKNOWN;
+	}
+	return fmt;
+}
+
+
+static int
+_plist_io_open(struct plist_io_s *io, enum plist_format_e fmt, int flags)
+{
+	int err;
+
+	memset(io, 0, sizeof(*io));
+	io->pio_format = fmt;
+	switch (fmt) {
+	case PLIST_FORMAT_TEXT:
+		return plist_txt_new(&io->pio_txt);
+	case PLIST_FORMAT_XML:
+		return plist_xml_new(&io->pio_xml);
+	case PLIST_FORMAT_JSON:
+		err = plist_json_new(&io->pio_json);
+		if (err != 0) {
+			return err;
+		}
+		if (flags & PLIST_READ_DATES) {
+			plist_json_setflags(io->pio_json, PLIST_JSON_DATES);
+		}
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static void
+_plist_io_close(struct plist_io_s *io)
+{
+	if (io->pio_txt != NULL) {
+		plist_txt_free(io->pio_txt);
+	}
+	if (io->pio_xml != NULL) {
+		plist_xml_free(io->pio_xml);
+	}
+	if (io->pio_json != NULL) {
+		plist_json_free(io->pio_json);
+	}
+	memset(io, 0, sizeof(*io));
+}
+
+static int
+_plist_io_parse(struct plist_io_s *io, const void *buf, size_t sz)
+{
+	switch (io->pio_format) {
+	case PLIST_FORMAT_TEXT:
+		return plist_txt_parse(io->pio_txt, buf, sz);
+	case PLIST_FORMAT_XML:
+		return plist_xml_parse(io->pio_xml, buf, sz);
+	case PLIST_FORMAT_JSON:
+		return plist_json_parse(io->pio_json, buf, sz);
+	default:
+		return EINVAL;
+	}
+}
+
+/**
+ * Finish the document at the end of the input. A top level number only
+ * ends at the next character, so one blank is added first.
+ */
+static int
+_plist_io_finish(struct plist_io_s *io, plist_t **plistpp)
+{
+	int err;
+
+	err = _plist_io_parse(io, " ", 1);
+	if (err != 0) {
+		return err;
+	}
+	switch (io->pio_format) {
+	case PLIST_FORMAT_TEXT:
+		return plist_txt_result(io->pio_txt, plistpp);
+	case PLIST_FORMAT_XML:
+		return plist_xml_result(io->pio_xml, plistpp);
+	case PLIST_FORMAT_JSON:
+		return plist_json_result(io->pio_json, plistpp);
+	default:
+		return EINVAL;
+	}
+}
+
+/**
+ * Read a whole document in one buffer with the reader for its format
+ */
+static int
+_plist_io_whole(const void *buf, size_t sz, enum plist_format_e fmt,
+		int flags, plist_t **plistpp)
+{
+	int err;
+	plist_bpl_t *bpl;
+	plist_bpl_node_t bnode;
+	plist_flat_t *flat;
+	plist_flat_node_t fnode;
+	struct plist_io_s io;
+
+	switch (fmt) {
+	case PLIST_FORMAT_BINARY:
+		err = plist_bpl_new(&bpl, buf, sz);
+		if (err != 0) {
+			return err;
+		}
+		err = plist_bpl_root(bpl, &bnode);
+		if (err == 0) {
+			err = plist_bpl_plist(bpl, &bnode, plistpp);
+		}
+		plist_bpl_free(bpl);
+		return err;
+	case PLIST_FORMAT_FLAT:
+		err = plist_flat_new(&flat, buf, sz,
+				     (flags & PLIST_READ_TRUSTED) ?
+				     PLIST_FLAT_TRUSTED : 0);
+		if (err != 0) {
+			return err;
+		}
+		err = plist_flat_root(flat, &fnode);
+		if (err == 0) {
+			err = plist_flat_plist(flat, &fnode, plistpp);
+		}
+		plist_flat_free(flat);
+		return err;
+	default:
+		break;
+	}
+
+	err = _plist_io_open(&io, fmt, flags);
+	if (err == 0) {
+		if (fmt == PLIST_FORMAT_TEXT && (flags & PLIST_READ_PARALLEL)) {
+			err = plist_txt_parse_parallel(io.pio_txt, buf, sz, 0);
+		} else {
+			err = _plist_io_parse(&io, buf, sz);
+		}
+	}
+	if (err == 0) {
+		err = _plist_io_finish(&io, plistpp);
+	}
+	_plist_io_close(&io);
+	return err;
+}
+
+
+static ssize_t
+_plist_io_read(int fd, void *buf, size_t sz)
+{
+	ssize_t n;
+
+	do {
+		n = read(fd, buf, sz);
+	} while (n < 0 && errno == EINTR);
+	return n;
+}
+
+/**
+ * Read from a descriptor that cannot be mapped. Blocks are collected
+ * until the format is known, and from then on they are either fed to
+ * the reader as they arrive or collected to the end of the input. A
+ * compressed stream is handed to a decoder, collected blocks first,
+ * and the reading starts over on the decoded bytes.
+ */
+static int
+_plist_io_pipe(int fd, int flags, plist_t **plistpp)
+{
+	int err;
+	char *buf;
+	char *ptr;
+	char *zbuf;
+	size_t bufsz;
+	size_t fill;
+	ssize_t n;
+	bool whole;
+	enum plist_format_e fmt;
+	enum plist_compress_e comp;
+	plist_zio_t *z;
+	struct plist_io_s io;
+
+	z = NULL;
+	zbuf = NULL;
+	bufsz = IO_READSZ;
+	buf = malloc(bufsz);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+again:
+	/* collect the input until the format is known */
+	fill = 0;
+	fmt = PLIST_FORMAT_UNKNOWN;
+	comp = PLIST_COMPRESS_NONE;
+	err = EAGAIN;
+	do {
+		n = _plist_io_read(fd, &buf[fill], bufsz - fill);
+		if (n < 0) {
+			err = errno;
+			goto out;
+		}
+		fill += n;
+		if (!(flags & IO_DECODED)) {
+			comp = plist_compress_detect(buf, fill);
+			if (comp != PLIST_COMPRESS_NONE) {
+				break;
+			}
+		}
+		err = _plist_io_sniff(buf, fill, &fmt);
+	} while (n > 0 && (fill < IO_MAGICSZ ||
+			   (err == EAGAIN && fill < IO_SNIFFSZ)));
+
+	if (comp != PLIST_COMPRESS_NONE) {
+		/* the decoder owns the collected blocks until it is done */
+		err = plist_zio_reader(&z, comp, buf, fill, fd, &fd);
+		if (err != 0) {
+			goto out;
+		}
+		zbuf = buf;
+		buf = malloc(bufsz);
+		if (buf == NULL) {
+			err = ENOMEM;
+			goto out;
+		}
+		flags |= IO_DECODED;
+		goto again;
+	}
+	if (err == EINVAL) {
+		goto out;
+	}
+
+	whole = (fmt == PLIST_FORMAT_BINARY || fmt == PLIST_FORMAT_FLAT ||
+		 (fmt == PLIST_FORMAT_TEXT && (flags & PLIST_READ_PARALLEL)));
+	if (whole) {
+		while (n > 0) {
+			if (fill == bufsz) {
+				ptr = (bufsz > SIZE_MAX / 2) ?
+				    NULL : realloc(buf, bufsz * 2);
+				if (ptr == NULL) {
+					err = ENOMEM;
+					goto out;
+				}
+				buf = ptr;
+				bufsz *= 2;
+			}
+			n = _plist_io_read(fd, &buf[fill], bufsz - fill);
+			if (n < 0) {
+				err = errno;
+				goto out;
+			}
+			fill += n;
+		}
+		err = _plist_io_whole(buf, fill, fmt, flags, plistpp);
+		goto out;
+	}
+
+	/* feed the collected input and then every block as it is read */
+	err = _plist_io_open(&io, fmt, flags);
+	while (err == 0 && n > 0) {
+		err = _plist_io_parse(&io, buf, fill);
+		if (err != 0) {
+			break;
+		}
+		n = _plist_io_read(fd, buf, bufsz);
+		if (n < 0) {
+			err = errno;
+		}
+		fill = (n > 0) ? n : 0;
+	}
+	if (err == 0) {
+		if (fill > 0) {
+			err = _plist_io_parse(&io, buf, fill);
+		}
+		if (err == 0) {
+			err = _plist_io_finish(&io, plistpp);
+		}
+	}
+	_plist_io_close(&io);
+
+out:
+	if (z != NULL) {
+		err = plist_zio_finish(z, err);
+	}
+	free(zbuf);
+	free(buf);
+	return err;
+}
+
+
+/**
+ * Read a compressed document that is whole in memory through a decoder
+ */
+static int
+_plist_io_decode(enum plist_compress_e comp, const void *buf, size_t sz,
+		 int flags, plist_t **plistpp)
+{
+	int err;
+	int rfd;
+	plist_zio_t *z;
+
+	err = plist_zio_reader(&z, comp, buf, sz, -1, &rfd);
+	if (err != 0) {
+		return err;
+	}
+	err = _plist_io_pipe(rfd, flags | IO_DECODED, plistpp);
+	return plist_zio_finish(z, err);
+}
+
+
+int
+plist_read_buf(const void *buf, size_t sz, int flags, plist_t **plistpp)
+{
+	int err;
+	enum plist_format_e fmt;
+	enum plist_compress_e comp;
+
+	if (!buf || !plistpp) {
+		return EINVAL;
+	}
+	comp = plist_compress_detect(buf, sz);
+	if (comp != PLIST_COMPRESS_NONE) {
+		return _plist_io_decode(comp, buf, sz, flags, plistpp);
+	}
+	err = _plist_io_sniff(buf, sz, &fmt);
+	if (err == EINVAL) {
+		return err;
+	}
+	return _plist_io_whole(buf, sz, fmt, flags, plistpp);
+}
+
+int
+plist_read_fd(int fd, int flags, plist_t **plistpp)
+{
+	int err;
+	char *addr;
+	size_t len;
+	size_t pos;
+	off_t off;
+	off_t pgoff;
+	struct stat st;
+	enum plist_format_e fmt;
+	enum plist_compress_e comp;
+	plist_txt_t *txt;
+
+	if (fd < 0 || !plistpp) {
+		return EINVAL;
+	}
+	if (fstat(fd, &st) != 0) {
+		return errno;
+	}
+
+	off = S_ISREG(st.st_mode) ? lseek(fd, 0, SEEK_CUR) : -1;
+	if (off < 0 || off >= st.st_size) {
+		return _plist_io_pipe(fd, flags, plistpp);
+	}
+
+	/* the mapping has to start on a page */
+	pgoff = off & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+	len = st.st_size - pgoff;
+	pos = off - pgoff;
+	addr = MAP_FAILED;
+	if ((off_t) len == st.st_size - pgoff) {
+		addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, pgoff);
+	}
+	if (addr == MAP_FAILED) {
+		/* too large for the address space or not mappable */
+		return _plist_io_pipe(fd, flags, plistpp);
+	}
+
+	comp = plist_compress_detect(&addr[pos], len - pos);
+	if (comp != PLIST_COMPRESS_NONE) {
+		madvise(addr, len, MADV_SEQUENTIAL);
+		err = _plist_io_decode(comp, &addr[pos], len - pos, flags,
+				       plistpp);
+		munmap(addr, len);
+		if (err == 0 && lseek(fd, st.st_size, SEEK_SET) < 0) {
+			err = errno;
+		}
+		return err;
+	}
+
+	err = _plist_io_sniff(&addr[pos],
+			      (len - pos < IO_SNIFFSZ) ? len - pos : IO_SNIFFSZ,
+			      &fmt);
+	if (err == EINVAL) {
+		munmap(addr, len);
+		return err;
+	}
+
+	if (fmt == PLIST_FORMAT_TEXT && !(flags & PLIST_READ_PARALLEL)) {
+		/* the text reader drops the windows behind it */
+		munmap(addr, len);
+		err = plist_txt_new(&txt);
+		if (err != 0) {
+			return err;
+		}
+		err = plist_txt_parse_fd(txt, fd);
+		if (err == 0) {
+			err = plist_txt_result(txt, plistpp);
+		}
+		plist_txt_free(txt);
+		return err;
+	}
+
+	madvise(addr, len, (fmt == PLIST_FORMAT_BINARY ||
+			    fmt == PLIST_FORMAT_FLAT) ?
+		MADV_WILLNEED : MADV_SEQUENTIAL);
+	err = _plist_io_whole(&addr[pos], len - pos, fmt, flags, plistpp);
+	munmap(addr, len);
+	if (err == 0 && lseek(fd, st.st_size, SEEK_SET) < 0) {
+		err = errno;
+	}
+	return err;
+}
+
+
+int
+plist_read_file(const char *path, int flags, plist_t **plistpp)
+{
+	int fd;
+	int err;
+
+	if (!path || !plistpp) {
+		return EINVAL;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return errno;
+	}
+	err = plist_read_fd(fd, flags, plistpp);
+	close(fd);
+	return err;
+}
+
+
+int
+plist_write_fd(const plist_t *plist, enum plist_format_e format, int fd)
+{
+	switch (format) {
+	case PLIST_FORMAT_TEXT:
+		return plist_txt_write(plist, fd);
+	case PLIST_FORMAT_XML:
+		return plist_xml_write(plist, fd);
+	case PLIST_FORMAT_BINARY:
+		return plist_bpl_write(plist, fd);
+	case PLIST_FORMAT_FLAT:
+		return plist_flat_write(plist, fd);
+	case PLIST_FORMAT_JSON:
+		return plist_json_write(plist, fd);
+	default:
+		return EINVAL;
+	}
+}
+
+
+int
+plist_write_buf(const plist_t *plist, enum plist_format_e format,
+		void **bufp, size_t *szp)
+{
+	switch (format) {
+	case PLIST_FORMAT_TEXT:
+		return plist_txt_write_buf(plist, bufp, szp);
+	case PLIST_FORMAT_XML:
+		return plist_xml_write_buf(plist, bufp, szp);
+	case PLIST_FORMAT_BINARY:
+		return plist_bpl_write_buf(plist, bufp, szp);
+	case PLIST_FORMAT_FLAT:
+		return plist_flat_write_buf(plist, bufp, szp);
+	case PLIST_FORMAT_JSON:
+		return plist_json_write_buf(plist, bufp, szp);
+	default:
+		return EINVAL;
+	}
+}
+
+
+int
+plist_write_file(const plist_t *plist, enum plist_format_e format,
+		 const char *path)
+{
+	int fd;
+	int err;
+
+	if (!plist || !path) {
+		return EINVAL;
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		return errno;
+	}
+	err = plist_write_fd(plist, format, fd);
+	if (close(fd) != 0 && err == 0) {
+		err = errno;
+	}
+	return err;
+}
@@ -0,0 +1,231 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_io.h
+ *
+ * Single entry points for reading and writing a plist in any of the
+ * formats the library has. The reader looks at the start of the input
+ * and hands it to the reader for that format, and the writer takes the
+ * format as an argument.
+ *
+ * The input is recognized as follows, after a UTF-8 byte order mark
+ * and white space.
+ *
+ *   bplist00        binary (no leading space is allowed)
+ *   plflat00        flat (no leading space is allowed)
+ *   <?xml <! <plist XML
+ *   [ or null       JSON
+ *   ( < digits      text
+ *
+ * A document that starts with a { or a string could be either text or
+ * JSON, since the text parser also takes a : after a key. It is read up
+ * to the first character that only one of the two has: = ; ( ) < pick
+ * text, and [ ] , a \u escape or a null pick JSON. When the first 64 KB
+ * have none of those, JSON is picked if a : was seen and text otherwise.
+ *
+ * Input that is compressed with gzip or zstd is decoded on a thread of
+ * its own while it is parsed, when the library is built with zlib or
+ * libzstd. The writers can compress their output the same way.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_IO_H_
+#define _PLIST_IO_H_
+
+#include <plist.h>
+
+/* parse large text documents with #plist_txt_parse_parallel */
+#define PLIST_READ_PARALLEL  (0x01)
+
+/* skip the flat verifier, see PLIST_FLAT_TRUSTED */
+#define PLIST_READ_TRUSTED   (0x02)
+
+/* read ISO 8601 strings in JSON as dates, see PLIST_JSON_DATES */
+#define PLIST_READ_DATES     (0x04)
+
+/**
+ * Serialized forms of a plist
+ */
+enum plist_format_e {
+	PLIST_FORMAT_UNKNOWN = 0,
+	PLIST_FORMAT_TEXT,
+	PLIST_FORMAT_XML,
+	PLIST_FORMAT_BINARY,
+	PLIST_FORMAT_FLAT,
+	PLIST_FORMAT_JSON,
+};
+
+/**
+ * Compression of the input or output stream
+ */
+enum plist_compress_e {
+	PLIST_COMPRESS_NONE = 0,
+	PLIST_COMPRESS_GZIP,
+	PLIST_COMPRESS_ZSTD,
+};
+
+
+__BEGIN_DECLS
+
+/**
+ * Recognize the format of a document from its first bytes
+ *
+ * @param  buf  pointer to the start of the document
+ * @param  sz   number of bytes available
+ * @return the format, or PLIST_FORMAT_UNKNOWN when the bytes are not
+ *         the start of any format, are compressed, or are too few to
+ *         tell
+ */
+enum plist_format_e plist_format_detect(const void *buf, size_t sz);
+
+/**
+ * Recognize a compressed stream from its first bytes
+ *
+ * @param  buf  pointer to the start of the stream
+ * @param  sz   number of bytes available
+ * @return the compression or PLIST_COMPRESS_NONE
+ */
+enum plist_compress_e plist_compress_detect(const void *buf, size_t sz);
+
+/**
+ * Check whether a compression was built into the library
+ *
+ * @param  comp  compression to check
+ * @return true when it can be read and written
+ */
+bool plist_compress_available(enum plist_compress_e comp);
+
+/**
+ * Read a whole document of any format from a buffer
+ *
+ * @param  buf      pointer to the document, which is not kept
+ * @param  sz       size of the document
+ * @param  flags    PLIST_READ_* flags or zero
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success, EINVAL for input in no known format or a
+ *         damaged compressed stream, ENOTSUP for a compression that was
+ *         not built in, or an error value from the reader of the format
+ */
+int plist_read_buf(const void *buf, size_t sz, int flags, plist_t **plistpp);
+
+/**
+ * Read a document of any format from the current offset of a
+ * descriptor to the end of the input. A regular file is mapped, and a
+ * text file is parsed in windows the same way as #plist_txt_parse_fd.
+ * A pipe is read in blocks, which go to the XML, JSON and text readers
+ * as they arrive and are collected for the binary and flat readers.
+ * Compressed input is decoded on another thread into a pipe that is
+ * read the same way.
+ *
+ * @param  fd       open file descriptor, which is left open
+ * @param  flags    PLIST_READ_* flags or zero
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success or an error value as for #plist_read_buf
+ */
+int plist_read_fd(int fd, int flags, plist_t **plistpp);
+
+/**
+ * Read a document of any format from a file. See #plist_read_fd.
+ *
+ * @param  path     name of the file
+ * @param  flags    PLIST_READ_* flags or zero
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success or an error value as for #plist_read_buf
+ */
+int plist_read_file(const char *path, int flags, plist_t **plistpp);
+
+/**
+ * Write a plist in the given format to a descriptor
+ *
+ * @param  plist   element to write
+ * @param  format  format of the output
+ * @param  fd      descriptor to write to
+ * @return zero on success, EINVAL for an unknown format, or an error
+ *         value from the writer of the format
+ */
+int plist_write_fd(const plist_t *plist, enum plist_format_e format, int fd);
+
+/**
+ * Write a plist in the given format to an allocated buffer
+ *
+ * @param  plist   element to write
+ * @param  format  format of the output
+ * @param  bufp    result buffer that the caller frees
+ * @param  szp     result size of the buffer
+ * @return zero on success or an error value as for #plist_write_fd
+ */
+int plist_write_buf(const plist_t *plist, enum plist_format_e format,
+		    void **bufp, size_t *szp);
+
+/**
+ * Write a plist in the given format to a file, which is created or
+ * truncated
+ *
+ * @param  plist   element to write
+ * @param  format  format of the output
+ * @param  path    name of the file
+ * @return zero on success or an error value as for #plist_write_fd
+ */
+int plist_write_file(const plist_t *plist, enum plist_format_e format,
+		     const char *path);
+
+/**
+ * Write a plist in the given format through a compressor to a
+ * descriptor. The compressor runs on a thread of its own that is fed
+ * by the writer through a pipe.
+ *
+ * @param  plist   element to write
+ * @param  format  format of the output
+ * @param  comp    compression of the output
+ * @param  level   compression level, or zero for the default
+ * @param  fd      descriptor to write to
+ * @return zero on success, ENOTSUP for a compression that was not built
+ *         in, or an error value as for #plist_write_fd
+ */
+int plist_write_compressed(const plist_t *plist, enum plist_format_e format,
+			   enum plist_compress_e comp, int level, int fd);
+
+/**
+ * Write a plist in the given format through a compressor to a file,
+ * which is created or truncated. See #plist_write_compressed.
+ *
+ * @param  plist   element to write
+ * @param  format  format of the output
+ * @param  comp    compression of the output
+ * @param  level   compression level, or zero for the default
+ * @param  path    name of the file
+ * @return zero on success or an error value as for
+ *         #plist_write_compressed
+ */
+int plist_write_compressed_file(const plist_t *plist,
+				enum plist_format_e format,
+				enum plist_compress_e comp, int level,
+				const char *path);
+
+__END_DECLS
+
+#endif /* !_PLIST_IO_H_ */
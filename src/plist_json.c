@@ -0,0 +1,1171 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_json.c
+ *
+ * Reader and writer for JSON documents. The reader is a state machine
+ * over the fed fragments in the same shape as the XML reader. Strings
+ * are scanned 16 bytes at a time with SSE2 for the quote, a backslash,
+ * or a control character, and a string or number that is whole inside
+ * the fragment is handed on in place, so the scratch buffer is only
+ * touched for values that span fragments or have escapes.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for gmtime_r and timegm */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "plist_json.h"
+#include "plist_wbuf.h"
+
+#define JSON_STACKSZ   (16)	/* initial nesting stack */
+#define JSON_BUFSZ     (256)	/* initial scratch buffer */
+
+#define ISSPACE(_c)  ((_c) == ' ' || (_c) == '\n' || \
+		      (_c) == '\t' || (_c) == '\r')
+#define ISDIGIT(_c)  ((_c) >= '0' && (_c) <= '9')
+#define ISNUMBER(_c) (ISDIGIT(_c) || (_c) == '-' || (_c) == '+' || \
+		      (_c) == '.' || (_c) == 'e' || (_c) == 'E')
+
+/* what the grammar takes next at the current level */
+#define JSON_VALUE     (0)	/* any value */
+#define JSON_FIRST     (1)	/* a value or the end of an empty array */
+#define JSON_KEY       (2)	/* a key */
+#define JSON_FIRSTKEY  (3)	/* a key or the end of an empty object */
+#define JSON_COLON     (4)	/* the colon after a key */
+#define JSON_NEXT      (5)	/* a comma or the end of the container */
+
+
+/**
+ * Length of the leading run of string characters that are taken as
+ * they are, up to a quote, a backslash, or a control character. The
+ * writer escapes the same set.
+ */
+static inline size_t
+_plist_json_plain(const char *s, size_t len)
+{
+	size_t i = 0;
+	unsigned char c;
+#ifdef __SSE2__
+	__m128i v;
+	__m128i m;
+	unsigned bits;
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i ctl = _mm_set1_epi8(0x1f);
+
+	for (; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) &s[i]);
+		m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+				 _mm_cmpeq_epi8(v, bslash));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+		bits = _mm_movemask_epi8(m);
+		if (bits != 0) {
+			return i + __builtin_ctz(bits);
+		}
+	}
+#endif
+	for (; i < len; i++) {
+		c = s[i];
+		if (c == '"' || c == '\\' || c < 0x20) {
+			return i;
+		}
+	}
+	return len;
+}
+
+/**
+ * Append to the current string or number, always leaving room for a
+ * terminating null.
+ */
+static int
+_plist_json_append(plist_json_t *json, const char *s, size_t len)
+{
+	char *ptr;
+	size_t newsz;
+
+	if (json->pj_textlen + len >= json->pj_bufsz) {
+		newsz = (json->pj_bufsz == 0) ? JSON_BUFSZ : json->pj_bufsz;
+		while (json->pj_textlen + len >= newsz) {
+			if (newsz > SIZE_MAX / 2) {
+				return ENOMEM;
+			}
+			newsz *= 2;
+		}
+		ptr = realloc(json->pj_buf, newsz);
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		json->pj_buf = ptr;
+		json->pj_bufsz = newsz;
+	}
+	memcpy(&json->pj_buf[json->pj_textlen], s, len);
+	json->pj_textlen += len;
+	return 0;
+}
+
+static int
+_plist_json_push(plist_json_t *json, uint8_t c)
+{
+	int newmax;
+	uint8_t *ptr;
+
+	if (json->pj_depth == json->pj_stackmax) {
+		newmax = (json->pj_stackmax == 0) ?
+		    JSON_STACKSZ : json->pj_stackmax * 2;
+		ptr = realloc(json->pj_stack, newmax);
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		json->pj_stack = ptr;
+		json->pj_stackmax = newmax;
+	}
+	json->pj_stack[json->pj_depth++] = c;
+	return 0;
+}
+
+/**
+ * A value is complete, which finishes the document at the top level
+ */
+static void
+_plist_json_complete(plist_json_t *json)
+{
+	if (json->pj_depth == 0) {
+		json->pj_state = PLIST_JSON_STATE_DONE;
+	} else {
+		json->pj_state = PLIST_JSON_STATE_SCAN;
+		json->pj_expect = JSON_NEXT;
+	}
+}
+
+/**
+ * Decode the escape sequence after a backslash, which is complete
+ */
+static int
+_plist_json_escape(plist_json_t *json)
+{
+	int i;
+	int c;
+	char buf[4];
+	uint32_t cp;
+
+	if (json->pj_surrogate != 0 && json->pj_esc[0] != 'u') {
+		return EINVAL;
+	}
+	switch (json->pj_esc[0]) {
+	case '"':
+	case '\\':
+	case '/':
+		return _plist_json_append(json, json->pj_esc, 1);
+	case 'b':
+		return _plist_json_append(json, "\b", 1);
+	case 'f':
+		return _plist_json_append(json, "\f", 1);
+	case 'n':
+		return _plist_json_append(json, "\n", 1);
+	case 'r':
+		return _plist_json_append(json, "\r", 1);
+	case 't':
+		return _plist_json_append(json, "\t", 1);
+	case 'u':
+		break;
+	default:
+		return EINVAL;
+	}
+
+	for (cp = 0, i = 1; i < 5; i++) {
+		c = (unsigned char) json->pj_esc[i];
+		if (ISDIGIT(c)) {
+			c -= '0';
+		} else if (c >= 'a' && c <= 'f') {
+			c -= 'a' - 10;
+		} else if (c >= 'A' && c <= 'F') {
+			c -= 'A' - 10;
+		} else {
+			return EINVAL;
+		}
+		cp = (cp << 4) | c;
+	}
+
+	/* characters past the basic plane come as a surrogate pair */
+	if (json->pj_surrogate != 0) {
+		if (cp < 0xdc00 || cp > 0xdfff) {
+			return EINVAL;
+		}
+		cp = 0x10000 + ((json->pj_surrogate - 0xd800) << 10) +
+		    (cp - 0xdc00);
+		json->pj_surrogate = 0;
+	} else if (cp >= 0xd800 && cp <= 0xdbff) {
+		json->pj_surrogate = cp;
+		return 0;
+	} else if (cp >= 0xdc00 && cp <= 0xdfff) {
+		return EINVAL;
+	}
+
+	if (cp < 0x80) {
+		buf[0] = cp;
+		return _plist_json_append(json, buf, 1);
+	} else if (cp < 0x800) {
+		buf[0] = 0xc0 | (cp >> 6);
+		buf[1] = 0x80 | (cp & 0x3f);
+		return _plist_json_append(json, buf, 2);
+	} else if (cp < 0x10000) {
+		buf[0] = 0xe0 | (cp >> 12);
+		buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+		buf[2] = 0x80 | (cp & 0x3f);
+		return _plist_json_append(json, buf, 3);
+	}
+	buf[0] = 0xf0 | (cp >> 18);
+	buf[1] = 0x80 | ((cp >> 12) & 0x3f);
+	buf[2] = 0x80 | ((cp >> 6) & 0x3f);
+	buf[3] = 0x80 | (cp & 0x3f);
+	return _plist_json_append(json, buf, 4);
+}
+
+static int
+_plist_json_digits(const char *s, int n, int *valp)
+{
+	int v;
+
+	for (v = 0; n > 0; n--, s++) {
+		if (!ISDIGIT(*s)) {
+			return EINVAL;
+		}
+		v = v * 10 + (*s - '0');
+	}
+	*valp = v;
+	return 0;
+}
+
+/**
+ * Read a string that is exactly a date in the form the writer uses,
+ * YYYY-MM-DDTHH:MM:SSZ
+ */
+static bool
+_plist_json_date(const char *s, size_t len, struct tm *tm)
+{
+	int year;
+
+	if (len != 20 || s[4] != '-' || s[7] != '-' || s[10] != 'T' ||
+	    s[13] != ':' || s[16] != ':' || s[19] != 'Z') {
+		return false;
+	}
+	memset(tm, 0, sizeof(*tm));
+	if (_plist_json_digits(s, 4, &year) != 0 ||
+	    _plist_json_digits(&s[5], 2, &tm->tm_mon) != 0 ||
+	    _plist_json_digits(&s[8], 2, &tm->tm_mday) != 0 ||
+	    _plist_json_digits(&s[11], 2, &tm->tm_hour) != 0 ||
+	    _plist_json_digits(&s[14], 2, &tm->tm_min) != 0 ||
+	    _plist_json_digits(&s[17], 2, &tm->tm_sec) != 0) {
+		return false;
+	}
+	if (tm->tm_mon < 1 || tm->tm_mon > 12 || tm->tm_mday < 1 ||
+	    tm->tm_mday > 31 || tm->tm_hour > 23 || tm->tm_min > 59 ||
+	    tm->tm_sec > 60) {
+		return false;
+	}
+	tm->tm_year = year - 1900;
+	tm->tm_mon -= 1;
+	return true;
+}
+
+/**
+ * Deliver a key or a string that is complete
+ */
+static int
+_plist_json_string(plist_json_t *json, const plist_txt_sax_t *sax,
+		   void *arg, const char *s, size_t len)
+{
+	int err;
+	struct tm tm;
+
+	if (json->pj_key) {
+		json->pj_state = PLIST_JSON_STATE_SCAN;
+		json->pj_expect = JSON_COLON;
+		if (sax->psx_key == NULL) {
+			return 0;
+		}
+		return sax->psx_key(arg, s, len);
+	}
+
+	err = 0;
+	if ((json->pj_flags & PLIST_JSON_DATES) &&
+	    _plist_json_date(s, len, &tm)) {
+		if (sax->psx_date != NULL) {
+			err = sax->psx_date(arg, &tm);
+		}
+	} else if (sax->psx_string != NULL) {
+		err = sax->psx_string(arg, s, len);
+	}
+	_plist_json_complete(json);
+	return err;
+}
+
+/**
+ * Deliver a number that is complete. The character after it has to be
+ * readable, which is either the rest of the fragment or a null.
+ */
+static int
+_plist_json_number(plist_json_t *json, const plist_txt_sax_t *sax,
+		   void *arg, const char *s, size_t len)
+{
+	int err;
+	bool neg;
+	bool integral;
+	bool overflow;
+	size_t i;
+	double real;
+	char *end;
+	unsigned long long num;
+	unsigned long long limit;
+
+	i = 0;
+	neg = (s[0] == '-');
+	if (neg) {
+		i++;
+	}
+	if (i == len || !ISDIGIT(s[i])) {
+		return EINVAL;
+	}
+
+	/* the integer part, without leading zeros */
+	limit = neg ? (unsigned long long) LLONG_MAX + 1 : LLONG_MAX;
+	overflow = false;
+	num = 0;
+	if (s[i] == '0') {
+		i++;
+	} else {
+		for (; i < len && ISDIGIT(s[i]); i++) {
+			if (num > (limit - (s[i] - '0')) / 10) {
+				overflow = true;
+			}
+			num = num * 10 + (s[i] - '0');
+		}
+	}
+
+	integral = true;
+	if (i < len && s[i] == '.') {
+		integral = false;
+		if (++i == len || !ISDIGIT(s[i])) {
+			return EINVAL;
+		}
+		while (i < len && ISDIGIT(s[i])) {
+			i++;
+		}
+	}
+	if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+		integral = false;
+		if (++i < len && (s[i] == '+' || s[i] == '-')) {
+			i++;
+		}
+		if (i == len || !ISDIGIT(s[i])) {
+			return EINVAL;
+		}
+		while (i < len && ISDIGIT(s[i])) {
+			i++;
+		}
+	}
+	if (i != len) {
+		return EINVAL;
+	}
+
+	err = 0;
+	if (integral && !overflow) {
+		if (sax->psx_integer != NULL) {
+			err = sax->psx_integer(arg, neg ?
+					       (long long) (0 - num) :
+					       (long long) num);
+		}
+	} else {
+		real = strtod(s, &end);
+		if (end != &s[len]) {
+			return EINVAL;
+		}
+		if (sax->psx_real != NULL) {
+			err = sax->psx_real(arg, real);
+		}
+	}
+	_plist_json_complete(json);
+	return err;
+}
+
+/**
+ * Close the container at the current level
+ */
+static int
+_plist_json_close(plist_json_t *json, const plist_txt_sax_t *sax, void *arg)
+{
+	int err = 0;
+
+	if (json->pj_stack[--json->pj_depth] == '{') {
+		if (sax->psx_end_dict != NULL) {
+			err = sax->psx_end_dict(arg);
+		}
+	} else if (sax->psx_end_array != NULL) {
+		err = sax->psx_end_array(arg);
+	}
+	_plist_json_complete(json);
+	return err;
+}
+
+/**
+ * Start the value whose first character is at *cpp and move *cpp past
+ * what was consumed
+ */
+static int
+_plist_json_value(plist_json_t *json, const plist_txt_sax_t *sax,
+		  void *arg, const char **cpp, const char *ep)
+{
+	int err;
+	size_t n;
+	const char *p;
+	const char *cp = *cpp;
+
+	switch (*cp) {
+	case '{':
+	case '[':
+		err = _plist_json_push(json, *cp);
+		if (err != 0) {
+			return err;
+		}
+		if (*cp == '{') {
+			json->pj_expect = JSON_FIRSTKEY;
+			err = (sax->psx_begin_dict == NULL) ? 0 :
+			    sax->psx_begin_dict(arg);
+		} else {
+			json->pj_expect = JSON_FIRST;
+			err = (sax->psx_begin_array == NULL) ? 0 :
+			    sax->psx_begin_array(arg);
+		}
+		*cpp = cp + 1;
+		return err;
+
+	case '"':
+		cp++;
+		n = _plist_json_plain(cp, ep - cp);
+		if (cp + n != ep && cp[n] == '"') {
+			/* the usual case of a string in one piece */
+			*cpp = cp + n + 1;
+			return _plist_json_string(json, sax, arg, cp, n);
+		}
+		json->pj_textlen = 0;
+		json->pj_state = PLIST_JSON_STATE_STRING;
+		*cpp = cp + n;
+		return _plist_json_append(json, cp, n);
+
+	case 't':
+		json->pj_lit = "true";
+		break;
+	case 'f':
+		json->pj_lit = "false";
+		break;
+	case 'n':
+		json->pj_lit = "null";
+		break;
+
+	default:
+		if (*cp != '-' && !ISDIGIT(*cp)) {
+			return EINVAL;
+		}
+		for (p = cp; p != ep && ISNUMBER(*p); p++)
+			;
+		*cpp = p;
+		if (p != ep) {
+			return _plist_json_number(json, sax, arg, cp, p - cp);
+		}
+		json->pj_textlen = 0;
+		json->pj_state = PLIST_JSON_STATE_NUMBER;
+		return _plist_json_append(json, cp, p - cp);
+	}
+
+	json->pj_litlen = 0;
+	json->pj_state = PLIST_JSON_STATE_LITERAL;
+	return 0;
+}
+
+/**
+ * Take the next structural character between values
+ */
+static int
+_plist_json_scan(plist_json_t *json, const plist_txt_sax_t *sax, void *arg,
+		 const char **cpp, const char *ep)
+{
+	char c = **cpp;
+	char top;
+
+	switch (json->pj_expect) {
+	case JSON_COLON:
+		if (c != ':') {
+			return EINVAL;
+		}
+		json->pj_expect = JSON_VALUE;
+		(*cpp)++;
+		return 0;
+
+	case JSON_NEXT:
+		top = json->pj_stack[json->pj_depth - 1];
+		(*cpp)++;
+		if (c == ',') {
+			json->pj_expect = (top == '{') ? JSON_KEY : JSON_VALUE;
+			return 0;
+		}
+		if ((c == '}' && top == '{') || (c == ']' && top == '[')) {
+			return _plist_json_close(json, sax, arg);
+		}
+		return EINVAL;
+
+	case JSON_FIRSTKEY:
+		if (c == '}') {
+			(*cpp)++;
+			return _plist_json_close(json, sax, arg);
+		}
+		/* FALLTHROUGH */
+	case JSON_KEY:
+		if (c != '"') {
+			return EINVAL;
+		}
+		json->pj_key = true;
+		return _plist_json_value(json, sax, arg, cpp, ep);
+
+	case JSON_FIRST:
+		if (c == ']') {
+			(*cpp)++;
+			return _plist_json_close(json, sax, arg);
+		}
+		/* FALLTHROUGH */
+	default:
+		json->pj_key = false;
+		return _plist_json_value(json, sax, arg, cpp, ep);
+	}
+}
+
+static int
+_plist_json_run(plist_json_t *json, const plist_txt_sax_t *sax, void *arg,
+		const void *buf, size_t sz)
+{
+	int err;
+	char c;
+	size_t n;
+	const char *p;
+	const char *cp = buf;
+	const char *ep = cp + sz;
+
+	if (json->pj_state == PLIST_JSON_STATE_ERROR) {
+		return EINVAL;
+	}
+
+	err = 0;
+	while (err == 0) {
+		if (json->pj_state == PLIST_JSON_STATE_DONE) {
+			json->pj_tail = cp;
+			return 0;
+		}
+		if (cp == ep) {
+			return 0;
+		}
+
+		switch (json->pj_state) {
+		case PLIST_JSON_STATE_SCAN:
+			while (cp != ep && ISSPACE(*cp)) {
+				cp++;
+			}
+			if (cp != ep) {
+				err = _plist_json_scan(json, sax, arg, &cp, ep);
+			}
+			break;
+
+		case PLIST_JSON_STATE_STRING:
+			if (json->pj_surrogate != 0) {
+				/* only the low half of the pair can follow */
+				if (*cp++ != '\\') {
+					err = EINVAL;
+					break;
+				}
+				json->pj_esclen = 0;
+				json->pj_state = PLIST_JSON_STATE_ESCAPE;
+				break;
+			}
+			n = _plist_json_plain(cp, ep - cp);
+			err = _plist_json_append(json, cp, n);
+			cp += n;
+			if (err != 0 || cp == ep) {
+				break;
+			}
+			c = *cp++;
+			if (c == '"') {
+				err = _plist_json_string(json, sax, arg,
+							 json->pj_buf,
+							 json->pj_textlen);
+			} else if (c == '\\') {
+				json->pj_esclen = 0;
+				json->pj_state = PLIST_JSON_STATE_ESCAPE;
+			} else {
+				err = EINVAL;
+			}
+			break;
+
+		case PLIST_JSON_STATE_ESCAPE:
+			while (cp != ep) {
+				json->pj_esc[json->pj_esclen++] = *cp++;
+				if (json->pj_esc[0] != 'u' ||
+				    json->pj_esclen == 5) {
+					err = _plist_json_escape(json);
+					json->pj_state =
+					    PLIST_JSON_STATE_STRING;
+					break;
+				}
+			}
+			break;
+
+		case PLIST_JSON_STATE_NUMBER:
+			for (p = cp; p != ep && ISNUMBER(*p); p++)
+				;
+			err = _plist_json_append(json, cp, p - cp);
+			cp = p;
+			if (err != 0 || cp == ep) {
+				break;
+			}
+			json->pj_buf[json->pj_textlen] = '\0';
+			err = _plist_json_number(json, sax, arg, json->pj_buf,
+						 json->pj_textlen);
+			break;
+
+		case PLIST_JSON_STATE_LITERAL:
+			while (cp != ep && json->pj_lit[json->pj_litlen] != '\0') {
+				if (*cp++ != json->pj_lit[json->pj_litlen++]) {
+					err = EINVAL;
+					break;
+				}
+			}
+			if (err != 0 || json->pj_lit[json->pj_litlen] != '\0') {
+				break;
+			}
+			if (json->pj_lit[0] == 'n') {
+				/* null has no plist counterpart */
+				err = EINVAL;
+				break;
+			}
+			if (sax->psx_boolean != NULL) {
+				err = sax->psx_boolean(arg,
+						       json->pj_lit[0] == 't');
+			}
+			_plist_json_complete(json);
+			break;
+
+		default:
+			err = EINVAL;
+			break;
+		}
+	}
+
+	json->pj_state = PLIST_JSON_STATE_ERROR;
+	return err;
+}
+
+
+int
+plist_json_new(plist_json_t **jsonpp)
+{
+	int err;
+	plist_json_t *json;
+
+	if (!jsonpp) {
+		return EINVAL;
+	}
+	json = malloc(sizeof(*json));
+	if (json == NULL) {
+		return ENOMEM;
+	}
+	memset(json, 0, sizeof(*json));
+	err = plist_txt_new(&json->pj_tree);
+	if (err != 0) {
+		free(json);
+		return err;
+	}
+	json->pj_state = PLIST_JSON_STATE_SCAN;
+	json->pj_expect = JSON_VALUE;
+	*jsonpp = json;
+	return 0;
+}
+
+
+void
+plist_json_free(plist_json_t *json)
+{
+	if (json == NULL) {
+		return;
+	}
+	plist_txt_free(json->pj_tree);
+	free(json->pj_stack);
+	free(json->pj_buf);
+	free(json);
+}
+
+
+void
+plist_json_setflags(plist_json_t *json, int flags)
+{
+	if (!json) {
+		return;
+	}
+	json->pj_flags = flags;
+}
+
+
+int
+plist_json_parse(plist_json_t *json, const void *buf, size_t sz)
+{
+	if (!json || (!buf && sz != 0)) {
+		return EINVAL;
+	}
+	return _plist_json_run(json, &plist_txt_tree_sax, json->pj_tree,
+			       buf, sz);
+}
+
+
+int
+plist_json_sax_parse(plist_json_t *json, const plist_txt_sax_t *sax,
+		     void *arg, const void *buf, size_t sz)
+{
+	if (!json || !sax || (!buf && sz != 0)) {
+		return EINVAL;
+	}
+	return _plist_json_run(json, sax, arg, buf, sz);
+}
+
+
+void
+plist_json_reset(plist_json_t *json)
+{
+	if (!json) {
+		return;
+	}
+	plist_txt_reset(json->pj_tree);
+	json->pj_state = PLIST_JSON_STATE_SCAN;
+	json->pj_depth = 0;
+	json->pj_expect = JSON_VALUE;
+	json->pj_key = false;
+	json->pj_textlen = 0;
+	json->pj_esclen = 0;
+	json->pj_surrogate = 0;
+	json->pj_lit = NULL;
+	json->pj_litlen = 0;
+	json->pj_tail = NULL;
+}
+
+
+int
+plist_json_result(plist_json_t *json, plist_t **plistpp)
+{
+	plist_t *ptmp;
+
+	if (!json || !plistpp) {
+		return EINVAL;
+	}
+	if (json->pj_state != PLIST_JSON_STATE_DONE) {
+		plist_json_reset(json);
+		return ENOENT;
+	}
+
+	/* detach the tree before the builder is reset */
+	ptmp = json->pj_tree->pt_top;
+	json->pj_tree->pt_top = NULL;
+	plist_json_reset(json);
+	*plistpp = ptmp;
+	return 0;
+}
+
+
+/*
+ * Writer
+ *
+ * The tree is walked through the parent links the same way as the XML
+ * writer, with a comma written whenever the walk moves on to a sibling.
+ * Strings are copied in runs between the characters that need an
+ * escape, found with the same scan as the reader.
+ */
+
+#define JSON_B64CHUNK  (3 * 1024)	/* data bytes encoded per step */
+
+static const char _plist_json_hex[] = "0123456789abcdef";
+
+/**
+ * Write a quoted string with the characters that need it escaped
+ */
+static int
+_plist_json_wstring(plist_wbuf_t *pw, const char *s, size_t len)
+{
+	int err;
+	size_t n;
+	unsigned char c;
+	char esc[6];
+
+	err = WSTR(pw, "\"");
+	while (err == 0) {
+		n = _plist_json_plain(s, len);
+		err = _plist_wbuf_bytes(pw, s, n);
+		if (err != 0 || n == len) {
+			break;
+		}
+		c = s[n];
+		esc[0] = '\\';
+		esc[1] = c;
+		switch (c) {
+		case '"':
+		case '\\':
+			break;
+		case '\n':
+			esc[1] = 'n';
+			break;
+		case '\r':
+			esc[1] = 'r';
+			break;
+		case '\t':
+			esc[1] = 't';
+			break;
+		case '\b':
+			esc[1] = 'b';
+			break;
+		case '\f':
+			esc[1] = 'f';
+			break;
+		default:
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = _plist_json_hex[c >> 4];
+			esc[5] = _plist_json_hex[c & 0xf];
+			break;
+		}
+		err = _plist_wbuf_bytes(pw, esc, (esc[1] == 'u') ? 6 : 2);
+		s += n + 1;
+		len -= n + 1;
+	}
+	return (err != 0) ? err : WSTR(pw, "\"");
+}
+
+/**
+ * Write data as a base64 string, encoding straight into the staging
+ * buffer a chunk at a time
+ */
+static int
+_plist_json_wdata(plist_wbuf_t *pw, const uint8_t *buf, size_t sz)
+{
+	int err;
+	size_t n;
+
+	err = WSTR(pw, "\"");
+	while (err == 0 && sz > 0) {
+		n = (sz < JSON_B64CHUNK) ? sz : JSON_B64CHUNK;
+		err = _plist_wbuf_room(pw, JSON_B64CHUNK / 3 * 4);
+		if (err != 0) {
+			break;
+		}
+		pw->pw_fill = _plist_wbuf_b64(&pw->pw_out[pw->pw_fill],
+					      buf, n) - pw->pw_out;
+		buf += n;
+		sz -= n;
+	}
+	return (err != 0) ? err : WSTR(pw, "\"");
+}
+
+/**
+ * Format the date as a UTC string with the offset it was read with
+ * taken off, the same instant as the XML writer
+ */
+static int
+_plist_json_wdate(plist_wbuf_t *pw, const struct tm *date)
+{
+	int err;
+	int year;
+	struct tm utc;
+	const struct tm *tm = &utc;
+	char buf[sizeof("\"YYYY-MM-DDTHH:MM:SSZ\"")];
+	char *cp = buf;
+
+	err = _plist_wbuf_utc(date, &utc);
+	if (err != 0) {
+		return err;
+	}
+	year = tm->tm_year + 1900;
+	if (year < 0 || year > 9999) {
+		return EINVAL;
+	}
+	*cp++ = '"';
+	cp = _plist_wbuf_2digits(cp, year / 100);
+	cp = _plist_wbuf_2digits(cp, year % 100);
+	*cp++ = '-';
+	cp = _plist_wbuf_2digits(cp, tm->tm_mon + 1);
+	*cp++ = '-';
+	cp = _plist_wbuf_2digits(cp, tm->tm_mday);
+	*cp++ = 'T';
+	cp = _plist_wbuf_2digits(cp, tm->tm_hour);
+	*cp++ = ':';
+	cp = _plist_wbuf_2digits(cp, tm->tm_min);
+	*cp++ = ':';
+	cp = _plist_wbuf_2digits(cp, tm->tm_sec);
+	*cp++ = 'Z';
+	*cp++ = '"';
+	return _plist_wbuf_bytes(pw, buf, cp - buf);
+}
+
+static int
+_plist_json_wint(plist_wbuf_t *pw, long long num)
+{
+	char buf[WBUF_INTSZ];
+	char *cp;
+
+	cp = _plist_wbuf_int(&buf[sizeof(buf)], num);
+	return _plist_wbuf_bytes(pw, cp, &buf[sizeof(buf)] - cp);
+}
+
+/**
+ * Format a real that is exactly an integer of up to 53 bits over 10,
+ * 100, or 1000, which covers most reals in practice. Reading the digits
+ * back divides by the same power of ten and rounds to the same value,
+ * so there is no need for the printf and strtod round trip.
+ */
+static char *
+_plist_json_fixed(double num, char *ep)
+{
+	int k;
+	double v;
+	double scale;
+	unsigned long long u;
+
+	for (k = 1, scale = 10.0; k <= 3; k++, scale *= 10.0) {
+		v = num * scale;
+		if (fabs(v) < 9007199254740992.0 && v == trunc(v) &&
+		    v / scale == num) {
+			break;
+		}
+	}
+	if (k > 3) {
+		return NULL;
+	}
+	u = fabs(v);
+	while (k-- > 0) {
+		*--ep = '0' + u % 10;
+		u /= 10;
+	}
+	*--ep = '.';
+	do {
+		*--ep = '0' + u % 10;
+		u /= 10;
+	} while (u != 0);
+	if (signbit(num)) {
+		*--ep = '-';
+	}
+	return ep;
+}
+
+/**
+ * Write a real, taking the exact short form when there is one. JSON
+ * has no spelling for the values that are not numbers.
+ */
+static int
+_plist_json_wreal(plist_wbuf_t *pw, double num)
+{
+	int n;
+	char buf[WBUF_REALSZ];
+	char *cp;
+
+	if (!isfinite(num)) {
+		return EINVAL;
+	}
+	cp = _plist_json_fixed(num, &buf[sizeof(buf)]);
+	if (cp != NULL) {
+		return _plist_wbuf_bytes(pw, cp, &buf[sizeof(buf)] - cp);
+	}
+	n = _plist_wbuf_real(buf, num, true);
+	return _plist_wbuf_bytes(pw, buf, n);
+}
+
+/**
+ * Write one value, or only the opening bracket of a container that has
+ * children, which the walk closes when it ascends
+ */
+static int
+_plist_json_wvalue(plist_wbuf_t *pw, const plist_t *pcur)
+{
+	int err;
+
+	switch (pcur->p_elem) {
+	case PLIST_DICT:
+		return TAILQ_EMPTY(&pcur->p_dict.pd_keys) ?
+		    WSTR(pw, "{}") : WSTR(pw, "{");
+	case PLIST_ARRAY:
+		return TAILQ_EMPTY(&pcur->p_array.pa_elems) ?
+		    WSTR(pw, "[]") : WSTR(pw, "[");
+	case PLIST_KEY:
+		err = _plist_json_wstring(pw, pcur->p_key.pk_name,
+					  strlen(pcur->p_key.pk_name));
+		return (err != 0) ? err : WSTR(pw, ":");
+	case PLIST_STRING:
+		return _plist_json_wstring(pw, pcur->p_string.ps_str,
+					   strlen(pcur->p_string.ps_str));
+	case PLIST_INTEGER:
+		return _plist_json_wint(pw, pcur->p_integer.pi_int);
+	case PLIST_REAL:
+		return _plist_json_wreal(pw, pcur->p_real.pr_double);
+	case PLIST_BOOLEAN:
+		return pcur->p_boolean.pb_bool ?
+		    WSTR(pw, "true") : WSTR(pw, "false");
+	case PLIST_DATE:
+		return _plist_json_wdate(pw, &pcur->p_date.pd_tm);
+	case PLIST_DATA:
+		return _plist_json_wdata(pw, pcur->p_data.pd_data,
+					 pcur->p_data.pd_datasz);
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_json_emit(plist_wbuf_t *pw, const plist_t *plist)
+{
+	int err;
+	const plist_t *pcur;
+	const plist_t *pnext;
+
+	if (plist->p_elem == PLIST_KEY) {
+		return EINVAL;
+	}
+	err = 0;
+	for (pcur = plist; err == 0 && pcur != NULL; pcur = pnext) {
+		err = _plist_json_wvalue(pw, pcur);
+		if (err != 0) {
+			break;
+		}
+
+		/* descend into a container, or from a key to its value */
+		pnext = NULL;
+		if (pcur->p_elem == PLIST_DICT) {
+			pnext = TAILQ_FIRST(&pcur->p_dict.pd_keys);
+		} else if (pcur->p_elem == PLIST_ARRAY) {
+			pnext = TAILQ_FIRST(&pcur->p_array.pa_elems);
+		} else if (pcur->p_elem == PLIST_KEY) {
+			pnext = pcur->p_key.pk_value;
+			if (pnext == NULL) {
+				err = EINVAL;
+			}
+			continue;
+		}
+		if (pnext != NULL) {
+			continue;
+		}
+
+		/* ascend, closing every container that is finished */
+		while (err == 0 && pcur != plist) {
+			pnext = pcur->p_parent;
+			if (pnext == NULL) {
+				err = EINVAL;
+				break;
+			}
+			if (pnext->p_elem == PLIST_KEY) {
+				pcur = pnext;
+				pnext = TAILQ_NEXT(pcur, p_entry);
+				if (pnext != NULL) {
+					err = WSTR(pw, ",");
+					break;
+				}
+				pcur = pcur->p_parent;
+				err = WSTR(pw, "}");
+				continue;
+			}
+			pnext = TAILQ_NEXT(pcur, p_entry);
+			if (pnext != NULL) {
+				err = WSTR(pw, ",");
+				break;
+			}
+			pcur = pcur->p_parent;
+			err = WSTR(pw, "]");
+		}
+		if (pcur == plist) {
+			pnext = NULL;
+		}
+	}
+	if (err == 0) {
+		err = WSTR(pw, "\n");
+	}
+	return err;
+}
+
+
+int
+plist_json_write(const plist_t *plist, int fd)
+{
+	int err;
+	plist_wbuf_t pw;
+
+	if (!plist || fd < 0) {
+		return EINVAL;
+	}
+	err = _plist_wbuf_open(&pw, fd);
+	if (err != 0) {
+		return err;
+	}
+	err = _plist_json_emit(&pw, plist);
+	if (err == 0) {
+		err = _plist_wbuf_flush(&pw);
+	}
+	free(pw.pw_out);
+	return err;
+}
+
+
+int
+plist_json_write_buf(const plist_t *plist, void **bufp, size_t *szp)
+{
+	int err;
+	plist_wbuf_t pw;
+
+	if (!plist || !bufp || !szp) {
+		return EINVAL;
+	}
+	(void) _plist_wbuf_open(&pw, -1);
+	err = _plist_json_emit(&pw, plist);
+	if (err != 0) {
+		free(pw.pw_out);
+		return err;
+	}
+	*bufp = pw.pw_out;
+	*szp = pw.pw_fill;
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_json.h
+ *
+ * Incremental reader and streaming writer for JSON documents. The
+ * reader is fed fragments of any size the same way as #plist_txt_parse
+ * and reports the values to the same #plist_txt_sax_t sink, so a
+ * document can be built into a plist object or bound with a sink like
+ * #plist_bind_sax without a second library.
+ *
+ * JSON has fewer types than a property list, so values map as follows.
+ *
+ *   object   dict, with duplicate keys rejected
+ *   array    array
+ *   string   string, or a date with PLIST_JSON_DATES
+ *   number   integer when it has no fraction or exponent and fits a
+ *            long long, otherwise real
+ *   true     boolean
+ *   false    boolean
+ *   null     rejected with EINVAL, there is nothing to map it to
+ *
+ * The writer turns data into a base64 string and a date into an ISO
+ * 8601 string in UTC (YYYY-MM-DDTHH:MM:SSZ), which PLIST_JSON_DATES
+ * reads back as a date. Data reads back as a string.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_JSON_H_
+#define _PLIST_JSON_H_
+
+#include <plist.h>
+#include <plist_txt.h>
+
+/* forward declare */
+typedef struct plist_json_s plist_json_t;
+
+enum plist_json_state_e {
+	PLIST_JSON_STATE_ERROR = 0,
+	PLIST_JSON_STATE_DONE,
+
+	PLIST_JSON_STATE_SCAN,
+	PLIST_JSON_STATE_STRING,
+	PLIST_JSON_STATE_ESCAPE,
+	PLIST_JSON_STATE_NUMBER,
+	PLIST_JSON_STATE_LITERAL,
+};
+
+/* parser option flags */
+#define PLIST_JSON_DATES  0x0001 /* strings shaped like a date are dates */
+
+/**
+ * JSON parser context
+ */
+struct plist_json_s {
+	enum plist_json_state_e pj_state;
+
+	/* open containers, '{' or '[' per level */
+	int pj_depth;
+	int pj_stackmax;
+	uint8_t *pj_stack;
+
+	/* what the grammar takes next at the current level */
+	int pj_expect;
+
+	/* the string being read is a key */
+	bool pj_key;
+
+	/* string or number that spanned fragments or was unescaped */
+	size_t pj_textlen;
+	size_t pj_bufsz;
+	char *pj_buf;
+
+	/* escape sequence after the backslash */
+	int pj_esclen;
+	char pj_esc[6];
+
+	/* high surrogate waiting for the low half of the pair */
+	uint32_t pj_surrogate;
+
+	/* literal being matched and how much of it was seen */
+	const char *pj_lit;
+	int pj_litlen;
+
+	/* parser options from #plist_json_setflags */
+	int pj_flags;
+
+	/* tree builder fed by #plist_json_parse */
+	plist_txt_t *pj_tree;
+
+	/* position just past the document in the last fragment */
+	const char *pj_tail;
+};
+
+
+__BEGIN_DECLS
+
+/**
+ * Create a JSON parsing context
+ *
+ * @param  jsonpp  result parse context
+ * @return zero on success or an error value
+ */
+int plist_json_new(plist_json_t **jsonpp);
+
+/**
+ * Free the JSON parsing context and any partial result
+ *
+ * @param  json  context that was allocated with #plist_json_new
+ */
+void plist_json_free(plist_json_t *json);
+
+/**
+ * Set the parser option flags, which are kept when #plist_json_result
+ * resets the context.
+ *
+ * PLIST_JSON_DATES reads a string that is exactly an ISO 8601 date in
+ * UTC, the form the writer uses, as a date.
+ *
+ * @param  json   context that was allocated with #plist_json_new
+ * @param  flags  bitwise or of the PLIST_JSON option flags
+ */
+void plist_json_setflags(plist_json_t *json, int flags);
+
+/**
+ * Parse a fragment of a JSON document into a plist object. Fragments
+ * can split the document anywhere, and input after the end of the
+ * document is ignored. A top level number is only complete once the
+ * character after it is seen, so it needs trailing whitespace.
+ *
+ * @param  json  context that was allocated with #plist_json_new
+ * @param  buf   fragment of the document
+ * @param  sz    size of the fragment
+ * @return zero on success or an error value
+ */
+int plist_json_parse(plist_json_t *json, const void *buf, size_t sz);
+
+/**
+ * Parse a fragment of a JSON document and deliver the values to an
+ * event sink instead of building a plist object. Strings and keys
+ * passed to the sink are only valid during the callback and are not
+ * null terminated.
+ *
+ * @param  json  context that was allocated with #plist_json_new
+ * @param  sax   event callbacks
+ * @param  arg   argument passed to every callback
+ * @param  buf   fragment of the document
+ * @param  sz    size of the fragment
+ * @return zero on success, the first non-zero callback return, or an
+ *         error value
+ */
+int plist_json_sax_parse(plist_json_t *json, const plist_txt_sax_t *sax,
+			 void *arg, const void *buf, size_t sz);
+
+/**
+ * Reset the context to start a new document, freeing any partial result
+ *
+ * @param  json  context that was allocated with #plist_json_new
+ */
+void plist_json_reset(plist_json_t *json);
+
+/**
+ * Retrieve the plist object for a completed document and reset the
+ * context for the next one
+ *
+ * @param  json     context that was allocated with #plist_json_new
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success, ENOENT if the document is not complete
+ */
+int plist_json_result(plist_json_t *json, plist_t **plistpp);
+
+/**
+ * Write a plist as a compact JSON document followed by a newline. The
+ * output is staged in a fixed buffer and written as it fills.
+ *
+ * @param  plist  element to write
+ * @param  fd     descriptor to write to
+ * @return zero on success, EINVAL for a key without a value, a real
+ *         that is not a finite number, or a year outside of four
+ *         digits, or an error value from write
+ */
+int plist_json_write(const plist_t *plist, int fd);
+
+/**
+ * Write a plist as a JSON document into an allocated buffer
+ *
+ * @param  plist  element to write
+ * @param  bufp   result document that the caller frees
+ * @param  szp    result size of the document
+ * @return zero on success or an error value as for #plist_json_write
+ */
+int plist_json_write_buf(const plist_t *plist, void **bufp, size_t *szp);
+
+__END_DECLS
+
+#endif /* !_PLIST_JSON_H_ */
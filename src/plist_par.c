@@ -0,0 +1,329 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_par.c
+ *
+ * Parallel parsing of a large text plist. A document that is one top
+ * level array is split at the commas between its elements, found with
+ * the block scanner so that strings and data are skipped, and the
+ * pieces are parsed as arrays of their own on a pool of threads. The
+ * elements of the pieces are then joined onto the result in order,
+ * which only relinks the list heads.
+ *
+ * @version $Id$
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "plist_txt.h"
+#include "plist_scan.h"
+
+#define PAR_MINPIECE  (256 * 1024) /* smallest piece worth handing off */
+#define PAR_PIECES    (4) /* pieces per thread to even out the load */
+
+/* forward declare */
+typedef struct plist_piece_s plist_piece_t;
+typedef struct plist_par_s plist_par_t;
+
+/* run of whole elements of the top level array */
+struct plist_piece_s {
+	const char *pp_buf;
+	size_t pp_sz;
+	plist_t *pp_array;
+	int pp_err;
+};
+
+/* work shared by the threads */
+struct plist_par_s {
+	pthread_mutex_t ppr_lock;
+	int ppr_next;
+	int ppr_npieces;
+	plist_piece_t *ppr_pieces;
+	plist_t *ppr_top;
+	int ppr_flags;
+	const plist_txt_paths_t *ppr_paths;
+};
+
+
+/**
+ * Find where to split a top level array. The split points are the first
+ * commas between elements at or past each of the evenly spaced targets.
+ *
+ * @return zero with the splits and the offsets of the array brackets,
+ *         or ENOENT when the document is not a complete top level array
+ */
+static int
+_plist_par_split(const char *buf, size_t sz, size_t *splits, int maxsplits,
+		 int *nsplitsp, size_t *startp, size_t *endp)
+{
+	char c;
+	char tail[SCAN_BLOCKSZ];
+	const char *cp;
+	size_t off;
+	size_t base;
+	size_t target;
+	long depth;
+	int nsplits;
+	unsigned int i;
+	uint64_t bits;
+	plist_scan_block_t blk;
+	plist_scan_carry_t carry;
+
+	for (off = 0; off < sz && isspace(buf[off]); off++)
+		;
+	if (off == sz || buf[off] != '(') {
+		return ENOENT;
+	}
+	*startp = off;
+
+	depth = 0;
+	nsplits = 0;
+	target = sz / (maxsplits + 1);
+	memset(&carry, 0, sizeof(carry));
+
+	for (base = 0; base < sz; base += SCAN_BLOCKSZ) {
+		cp = _plist_scan_block(buf, sz, base, tail, &carry, &blk);
+
+		bits = (blk.psb_brk | blk.psb_comma) & blk.psb_structs;
+		while (bits != 0) {
+			i = __builtin_ctzll(bits);
+			bits &= bits - 1;
+			c = cp[i];
+
+			if (c == '{' || c == '(') {
+				depth++;
+				continue;
+			}
+			if (c == '}' || c == ')') {
+				if (--depth == 0) {
+					/* the top level array is complete */
+					*nsplitsp = nsplits;
+					*endp = base + i;
+					return 0;
+				}
+				if (depth < 0) {
+					return ENOENT;
+				}
+				continue;
+			}
+
+			/* a comma */
+			off = base + i;
+			if (depth == 1 && off >= target &&
+			    nsplits < maxsplits) {
+				splits[nsplits++] = off;
+				target = (sz / (maxsplits + 1)) * (nsplits + 1);
+			}
+		}
+	}
+	return ENOENT;
+}
+
+
+static void *
+_plist_par_worker(void *arg)
+{
+	int i;
+	int err;
+	plist_t *ptmp;
+	plist_txt_t *txt;
+	plist_piece_t *piece;
+	plist_par_t *par = arg;
+
+	err = plist_txt_new(&txt);
+	if (err != 0) {
+		/* the other threads pick up the pieces */
+		return NULL;
+	}
+	plist_txt_setflags(txt, par->ppr_flags);
+	plist_txt_setpaths(txt, par->ppr_paths);
+
+	for (;;) {
+		pthread_mutex_lock(&par->ppr_lock);
+		i = par->ppr_next++;
+		pthread_mutex_unlock(&par->ppr_lock);
+		if (i >= par->ppr_npieces) {
+			break;
+		}
+		piece = &par->ppr_pieces[i];
+
+		/* the piece is parsed as an array of its elements */
+		err = plist_txt_parse(txt, "(", 1);
+		if (err == 0) {
+			err = plist_txt_parse(txt, piece->pp_buf,
+					      piece->pp_sz);
+		}
+		if (err == 0) {
+			err = plist_txt_parse(txt, ")", 1);
+		}
+		if (err != 0) {
+			plist_txt_reset(txt);
+			piece->pp_err = err;
+			continue;
+		}
+		err = plist_txt_result(txt, &piece->pp_array);
+		if (err != 0) {
+			piece->pp_err = err;
+			continue;
+		}
+
+		TAILQ_FOREACH(ptmp, &piece->pp_array->p_array.pa_elems,
+			      p_entry) {
+			ptmp->p_parent = par->ppr_top;
+		}
+		piece->pp_err = 0;
+	}
+
+	plist_txt_free(txt);
+	return NULL;
+}
+
+
+int
+plist_txt_parse_parallel(plist_txt_t *txt, const void *buf, size_t sz,
+			 int nthreads)
+{
+	int i;
+	int err;
+	int nsplits;
+	int maxpieces;
+	int nworkers;
+	size_t start;
+	size_t end;
+	size_t *splits;
+	pthread_t *workers;
+	plist_t *parray;
+	plist_piece_t *piece;
+	plist_par_t par;
+
+	if (!txt || !buf) {
+		return EINVAL;
+	}
+	if (txt->pt_state != PLIST_TXT_STATE_SCAN || txt->pt_depth != 0 ||
+	    txt->pt_top != NULL) {
+		/* already part way through a document */
+		return EBUSY;
+	}
+
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	maxpieces = nthreads * PAR_PIECES;
+	if (sz / PAR_MINPIECE < (size_t) maxpieces) {
+		maxpieces = sz / PAR_MINPIECE;
+	}
+	if (nthreads < 2 || maxpieces < 2) {
+		return plist_txt_parse(txt, buf, sz);
+	}
+
+	splits = malloc(maxpieces * sizeof(*splits));
+	if (splits == NULL) {
+		return ENOMEM;
+	}
+	err = _plist_par_split(buf, sz, splits, maxpieces - 1, &nsplits,
+			       &start, &end);
+	if (err != 0 || nsplits == 0) {
+		/* not an array that can be split */
+		free(splits);
+		return plist_txt_parse(txt, buf, sz);
+	}
+
+	memset(&par, 0, sizeof(par));
+	par.ppr_npieces = nsplits + 1;
+	par.ppr_flags = txt->pt_flags;
+	par.ppr_paths = txt->pt_paths;
+	par.ppr_pieces = calloc(par.ppr_npieces, sizeof(*par.ppr_pieces));
+	workers = calloc(nthreads, sizeof(*workers));
+	err = plist_array_new(&par.ppr_top);
+	if (par.ppr_pieces == NULL || workers == NULL || err != 0) {
+		free(splits);
+		free(par.ppr_pieces);
+		free(workers);
+		plist_free(par.ppr_top);
+		return ENOMEM;
+	}
+
+	for (i = 0; i < par.ppr_npieces; i++) {
+		piece = &par.ppr_pieces[i];
+		piece->pp_buf = (const char *) buf +
+		    ((i == 0) ? start : splits[i - 1]) + 1;
+		piece->pp_sz = ((i == nsplits) ? end : splits[i]) -
+		    (piece->pp_buf - (const char *) buf);
+		piece->pp_err = ENOMEM; /* until a thread gets to it */
+	}
+	free(splits);
+
+	/* this thread works on the pieces as well */
+	pthread_mutex_init(&par.ppr_lock, NULL);
+	for (nworkers = 0; nworkers < nthreads - 1; nworkers++) {
+		if (pthread_create(&workers[nworkers], NULL,
+				   _plist_par_worker, &par) != 0) {
+			break;
+		}
+	}
+	_plist_par_worker(&par);
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	pthread_mutex_destroy(&par.ppr_lock);
+	free(workers);
+
+	/* join the pieces in order */
+	err = 0;
+	for (i = 0; i < par.ppr_npieces; i++) {
+		piece = &par.ppr_pieces[i];
+		if (err == 0 && piece->pp_err != 0) {
+			err = piece->pp_err;
+		}
+		parray = piece->pp_array;
+		if (parray == NULL) {
+			continue;
+		}
+		if (err == 0) {
+			TAILQ_CONCAT(&par.ppr_top->p_array.pa_elems,
+				     &parray->p_array.pa_elems, p_entry);
+			par.ppr_top->p_array.pa_numelems +=
+			    parray->p_array.pa_numelems;
+			parray->p_array.pa_numelems = 0;
+		}
+		plist_free(parray);
+	}
+	free(par.ppr_pieces);
+
+	if (err != 0) {
+		plist_free(par.ppr_top);
+		txt->pt_state = PLIST_TXT_STATE_ERROR;
+		return err;
+	}
+	txt->pt_top = par.ppr_top;
+	txt->pt_state = PLIST_TXT_STATE_DONE;
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_scan.h
+ *
+ * Block scanner shared by the structural index and the parallel parser
+ * and not installed. A block of 64 bytes is classified into bit masks,
+ * a bit per byte (with SSE2 when the compiler targets it), and the
+ * string and data regions are derived from the masks with bit
+ * arithmetic so that no branch is taken per character.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_SCAN_H_
+#define _PLIST_SCAN_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SCAN_BLOCKSZ  (64) /* bytes classified per step */
+
+/* forward declare */
+typedef struct plist_scan_block_s plist_scan_block_t;
+typedef struct plist_scan_carry_s plist_scan_carry_t;
+
+/* character masks for one block */
+struct plist_scan_block_s {
+	uint64_t psb_op;	/* { } ( ) < > ; , : = */
+	uint64_t psb_brk;	/* { } ( ) */
+	uint64_t psb_comma;	/* , */
+	uint64_t psb_lt;	/* < */
+	uint64_t psb_gt;	/* > */
+	uint64_t psb_quote;	/* " */
+	uint64_t psb_bslash;	/* \ */
+
+	/* structurals outside of strings and data, with their bounds */
+	uint64_t psb_structs;
+};
+
+/* state carried from one block to the next */
+struct plist_scan_carry_s {
+	uint64_t psc_escaped;	/* first byte is escaped */
+	uint64_t psc_string;	/* all ones inside a string */
+	uint64_t psc_data;	/* all ones inside data */
+};
+
+
+#ifdef __SSE2__
+
+static inline void
+_plist_scan_classify(const char *cp, plist_scan_block_t *blk)
+{
+	__m128i v;
+	__m128i r;
+	__m128i op;
+	__m128i brk;
+	__m128i comma;
+	int i;
+
+#define movemask(_m)  ((uint64_t) (uint16_t) _mm_movemask_epi8(_m) << i)
+#define cmpeq(_c)     _mm_cmpeq_epi8(v, _mm_set1_epi8(_c))
+
+	memset(blk, 0, sizeof(*blk));
+	for (i = 0; i < SCAN_BLOCKSZ; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) &cp[i]);
+
+		brk = _mm_or_si128(_mm_or_si128(cmpeq('{'), cmpeq('}')),
+				   _mm_or_si128(cmpeq('('), cmpeq(')')));
+		comma = cmpeq(',');
+
+		/* ':' ';' '<' '=' '>' are one range starting at ':' */
+		r = _mm_sub_epi8(v, _mm_set1_epi8(':'));
+		op = _mm_cmpeq_epi8(_mm_min_epu8(r, _mm_set1_epi8(4)), r);
+		op = _mm_or_si128(op, _mm_or_si128(brk, comma));
+
+		blk->psb_op |= movemask(op);
+		blk->psb_brk |= movemask(brk);
+		blk->psb_comma |= movemask(comma);
+		blk->psb_lt |= movemask(cmpeq('<'));
+		blk->psb_gt |= movemask(cmpeq('>'));
+		blk->psb_quote |= movemask(cmpeq('"'));
+		blk->psb_bslash |= movemask(cmpeq('\\'));
+	}
+
+#undef cmpeq
+#undef movemask
+	return;
+}
+
+#else /* !__SSE2__ */
+
+/* character classes for the portable classifier */
+#define SCAN_OP      0x01
+#define SCAN_BRK     0x02
+#define SCAN_COMMA   0x04
+#define SCAN_LT      0x08
+#define SCAN_GT      0x10
+#define SCAN_QUOTE   0x20
+#define SCAN_BSLASH  0x40
+
+static const uint8_t plist_scan_class[256] = {
+	['{'] = SCAN_OP | SCAN_BRK, ['}'] = SCAN_OP | SCAN_BRK,
+	['('] = SCAN_OP | SCAN_BRK, [')'] = SCAN_OP | SCAN_BRK,
+	['<'] = SCAN_OP | SCAN_LT, ['>'] = SCAN_OP | SCAN_GT,
+	[','] = SCAN_OP | SCAN_COMMA, [';'] = SCAN_OP,
+	[':'] = SCAN_OP, ['='] = SCAN_OP,
+	['"'] = SCAN_QUOTE, ['\\'] = SCAN_BSLASH,
+};
+
+static inline void
+_plist_scan_classify(const char *cp, plist_scan_block_t *blk)
+{
+	uint8_t cls;
+	uint64_t bit;
+	int i;
+
+	memset(blk, 0, sizeof(*blk));
+	for (i = 0; i < SCAN_BLOCKSZ; i++) {
+		cls = plist_scan_class[(uint8_t) cp[i]];
+		if (cls == 0) {
+			continue;
+		}
+		bit = (uint64_t) 1 << i;
+		blk->psb_op |= (cls & SCAN_OP) ? bit : 0;
+		blk->psb_brk |= (cls & SCAN_BRK) ? bit : 0;
+		blk->psb_comma |= (cls & SCAN_COMMA) ? bit : 0;
+		blk->psb_lt |= (cls & SCAN_LT) ? bit : 0;
+		blk->psb_gt |= (cls & SCAN_GT) ? bit : 0;
+		blk->psb_quote |= (cls & SCAN_QUOTE) ? bit : 0;
+		blk->psb_bslash |= (cls & SCAN_BSLASH) ? bit : 0;
+	}
+	return;
+}
+
+#endif /* __SSE2__ */
+
+
+/**
+ * Each bit becomes the parity of itself and all the lower bits, which
+ * turns the bounds of a region into a mask of the region.
+ */
+static inline uint64_t
+_plist_scan_prefix_xor(uint64_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+/**
+ * Find the characters that follow an odd run of backslashes. The runs
+ * that start on odd bits are moved onto even bits by the addition so
+ * that alternate bits past each run mark the escaped characters.
+ */
+static inline uint64_t
+_plist_scan_escaped(uint64_t bslash, plist_scan_carry_t *carry)
+{
+	const uint64_t even = 0x5555555555555555ULL;
+	uint64_t follows;
+	uint64_t oddstarts;
+	uint64_t evenseqs;
+
+	if (bslash == 0 && carry->psc_escaped == 0) {
+		return 0;
+	}
+	bslash &= ~carry->psc_escaped;
+	follows = (bslash << 1) | carry->psc_escaped;
+	oddstarts = bslash & ~even & ~follows;
+	carry->psc_escaped =
+	    __builtin_add_overflow(oddstarts, bslash, &evenseqs);
+	return (even ^ (evenseqs << 1)) & follows;
+}
+
+/**
+ * Classify the block at offset base of a buffer, padding the last block
+ * with white space in tail, and find its structurals. Quotes that are
+ * not escaped bound the strings, and '<' and '>' outside of strings
+ * bound the data. The structurals are the characters outside of both
+ * plus the bounds themselves, so a string or data element always
+ * closes at the next structural.
+ *
+ * @return the block of characters the masks describe
+ */
+static inline const char *
+_plist_scan_block(const char *buf, size_t sz, size_t base, char *tail,
+		  plist_scan_carry_t *carry, plist_scan_block_t *blk)
+{
+	const char *cp;
+	uint64_t quote;
+	uint64_t bound;
+	uint64_t instr;
+	uint64_t indata;
+
+	cp = &buf[base];
+	if (sz - base < SCAN_BLOCKSZ) {
+		memset(tail, ' ', SCAN_BLOCKSZ);
+		memcpy(tail, cp, sz - base);
+		cp = tail;
+	}
+	_plist_scan_classify(cp, blk);
+
+	/* strings run from an opening quote up to the closing one */
+	quote = blk->psb_quote & ~_plist_scan_escaped(blk->psb_bslash, carry);
+	instr = _plist_scan_prefix_xor(quote) ^ carry->psc_string;
+	carry->psc_string = (uint64_t) ((int64_t) instr >> 63);
+
+	/* data runs from a '<' up to the '>' outside of strings */
+	bound = (blk->psb_lt | blk->psb_gt) & ~instr;
+	indata = _plist_scan_prefix_xor(bound) ^ carry->psc_data;
+	carry->psc_data = (uint64_t) ((int64_t) indata >> 63);
+
+	blk->psb_structs = (blk->psb_op & ~(instr | indata)) | quote |
+	    (blk->psb_lt & ~instr);
+	return cp;
+}
+
+#endif /* !_PLIST_SCAN_H_ */
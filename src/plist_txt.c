@@ -46,23 +46,229 @@
  * @version $Id: plist.h 11 2011-09-27 00:21:26Z ckhardin $
  */
 
+#define _XOPEN_SOURCE 700 /* for strptime */
+
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "plist_txt.h"
 
-#define CHUNK_EXTENDSZ  (32) /* grow a chunk by 32 bytes */
+#define CHUNK_EXTENDSZ  (32) /* grow a chunk by at least 32 bytes */
+#define CHUNK_INITSZ    (256) /* first allocation of the buffer */
+#define KEYSET_MINKEYS  (16)  /* index a dictionary past this many keys */
+
+/*
+ * Result of the pull reader's own callbacks that stops the state machine
+ * after an element. It is only honoured for the pull sink; the same
+ * value from a caller's callback is an error.
+ */
+#define PLIST_TXT_SUSPEND  (-1)
+
+/* character classes of the scanner in the low bits of the table */
+#define CC_INVALID  (0)
+#define CC_LBRACE   (1)
+#define CC_RBRACE   (2)
+#define CC_ASSIGN   (3)
+#define CC_SEMI     (4)
+#define CC_LPAREN   (5)
+#define CC_RPAREN   (6)
+#define CC_COMMA    (7)
+#define CC_LT       (8)
+#define CC_QUOTE    (9)
+#define CC_NUMBER   (10)
+#define CC_TRUE     (11)
+#define CC_FALSE    (12)
+#define CC_CLASSES  (13)
+#define CC_MASK     (0x0f)
+
+/* classes that the skipper of a value has to look at */
+#define CC_SKIPSET  ((1 << CC_LBRACE) | (1 << CC_RBRACE) | (1 << CC_SEMI) | \
+		     (1 << CC_LPAREN) | (1 << CC_RPAREN) | (1 << CC_QUOTE))
+
+/* properties of a character in the high bits of the table */
+#define CC_F_SPACE  (0x10) /* whitespace between elements */
+#define CC_F_DIGIT  (0x20) /* decimal digit */
+#define CC_F_REAL   (0x40) /* continues a real number */
+#define CC_F_STOP   (0x80) /* ends a plain run in a string */
+
+#define CCLASS(_c)  (_plist_txt_cc[(unsigned char) (_c)])
+#define HEXDIGIT    (0x10)
+#define ISHEX(_c)   (_plist_txt_hex[(unsigned char) (_c)] & HEXDIGIT)
+#define TOHEX(_c)   (_plist_txt_hex[(unsigned char) (_c)] & 0x0f)
+
+static const uint8_t _plist_txt_cc[256] = {
+	['\t'] = CC_F_SPACE,
+	['\n'] = CC_F_SPACE,
+	['\v'] = CC_F_SPACE,
+	['\f'] = CC_F_SPACE,
+	['\r'] = CC_F_SPACE,
+	[' '] = CC_F_SPACE,
+	['{'] = CC_LBRACE,
+	['}'] = CC_RBRACE,
+	[':'] = CC_ASSIGN,
+	['='] = CC_ASSIGN,
+	[';'] = CC_SEMI,
+	['('] = CC_LPAREN,
+	[')'] = CC_RPAREN,
+	[','] = CC_COMMA,
+	['<'] = CC_LT,
+	['"'] = CC_QUOTE | CC_F_STOP,
+	['\\'] = CC_F_STOP,
+	['-'] = CC_NUMBER | CC_F_REAL,
+	['0' ... '9'] = CC_NUMBER | CC_F_DIGIT | CC_F_REAL,
+	['.'] = CC_F_REAL,
+	['+'] = CC_F_REAL,
+	['e'] = CC_F_REAL,
+	['E'] = CC_F_REAL,
+	['t'] = CC_TRUE,
+	['T'] = CC_TRUE,
+	['f'] = CC_FALSE,
+	['F'] = CC_FALSE,
+};
+
+/* value of a hex digit along with HEXDIGIT, zero for anything else */
+static const uint8_t _plist_txt_hex[256] = {
+	['0'] = HEXDIGIT | 0, ['1'] = HEXDIGIT | 1, ['2'] = HEXDIGIT | 2,
+	['3'] = HEXDIGIT | 3, ['4'] = HEXDIGIT | 4, ['5'] = HEXDIGIT | 5,
+	['6'] = HEXDIGIT | 6, ['7'] = HEXDIGIT | 7, ['8'] = HEXDIGIT | 8,
+	['9'] = HEXDIGIT | 9,
+	['a'] = HEXDIGIT | 10, ['b'] = HEXDIGIT | 11, ['c'] = HEXDIGIT | 12,
+	['d'] = HEXDIGIT | 13, ['e'] = HEXDIGIT | 14, ['f'] = HEXDIGIT | 15,
+	['A'] = HEXDIGIT | 10, ['B'] = HEXDIGIT | 11, ['C'] = HEXDIGIT | 12,
+	['D'] = HEXDIGIT | 13, ['E'] = HEXDIGIT | 14, ['F'] = HEXDIGIT | 15,
+};
+
+/* path match of a level that keeps everything below it */
+#define PATH_ALL   (-1)
+#define PATH_NONE  (-2)
 
 /* forward declare */
 typedef struct plist_chunk_s plist_chunk_t;
+typedef struct plist_txt_pathnode_s plist_txt_pathnode_t;
 
 struct plist_chunk_s {
 	const char *pc_cp; /* current */
 	const char *pc_ep; /* end pointer */
 };
 
+/* scratch buffers shared by the contexts in compact mode */
+struct plist_txt_pool_s {
+	pthread_mutex_t ptp_lock;
+	size_t ptp_bufsz;
+	int ptp_nbufs;
+	int ptp_maxbufs;
+	void **ptp_bufs;
+};
+
+/* one key of the compiled paths, node zero is the top level */
+struct plist_txt_pathnode_s {
+	int ppn_parent;
+	bool ppn_leaf; /* the rest of the subtree is kept */
+	size_t ppn_len;
+	const char *ppn_name;
+};
+
+/* key paths shared by the contexts that project documents */
+struct plist_txt_paths_s {
+	int ppa_nnodes;
+	plist_txt_pathnode_t *ppa_nodes;
+	char *ppa_names;
+};
+
+/* open addressed hash of the keys in a dictionary being parsed */
+struct plist_keyset_s {
+	plist_t *pks_dict;
+	size_t pks_nslots; /* power of two or zero before indexing */
+	size_t pks_nkeys;
+	plist_t **pks_slots;
+};
+
+
+int
+plist_txt_pool_new(plist_txt_pool_t **poolpp, size_t bufsz, int maxbufs)
+{
+	plist_txt_pool_t *pool;
+
+	if (!poolpp || bufsz < CHUNK_EXTENDSZ || maxbufs < 0) {
+		return EINVAL;
+	}
+
+	pool = malloc(sizeof(*pool));
+	if (pool == NULL) {
+		return ENOMEM;
+	}
+	memset(pool, 0, sizeof(*pool));
+	pool->ptp_bufs = calloc(maxbufs + 1, sizeof(*pool->ptp_bufs));
+	if (pool->ptp_bufs == NULL) {
+		free(pool);
+		return ENOMEM;
+	}
+	pthread_mutex_init(&pool->ptp_lock, NULL);
+	pool->ptp_bufsz = bufsz;
+	pool->ptp_maxbufs = maxbufs;
+	*poolpp = pool;
+	return 0;
+}
+
+
+void
+plist_txt_pool_free(plist_txt_pool_t *pool)
+{
+	if (!pool) {
+		return;
+	}
+
+	while (pool->ptp_nbufs > 0) {
+		free(pool->ptp_bufs[--pool->ptp_nbufs]);
+	}
+	pthread_mutex_destroy(&pool->ptp_lock);
+	free(pool->ptp_bufs);
+	free(pool);
+	return;
+}
+
+/**
+ * Take an idle buffer from the pool or allocate a new one.
+ */
+static void *
+_plist_txt_pool_get(plist_txt_pool_t *pool)
+{
+	void *buf;
+
+	buf = NULL;
+	pthread_mutex_lock(&pool->ptp_lock);
+	if (pool->ptp_nbufs > 0) {
+		buf = pool->ptp_bufs[--pool->ptp_nbufs];
+	}
+	pthread_mutex_unlock(&pool->ptp_lock);
+	if (buf == NULL) {
+		buf = malloc(pool->ptp_bufsz);
+	}
+	return buf;
+}
+
+/**
+ * Give a buffer back to the pool. A buffer that grew past the pool
+ * size, or one more than the pool keeps, is freed.
+ */
+static void
+_plist_txt_pool_put(plist_txt_pool_t *pool, void *buf, size_t sz)
+{
+	if (sz == pool->ptp_bufsz) {
+		pthread_mutex_lock(&pool->ptp_lock);
+		if (pool->ptp_nbufs < pool->ptp_maxbufs) {
+			pool->ptp_bufs[pool->ptp_nbufs++] = buf;
+			buf = NULL;
+		}
+		pthread_mutex_unlock(&pool->ptp_lock);
+	}
+	free(buf);
+	return;
+}
 
 int
 plist_txt_new(plist_txt_t **txtpp)
@@ -80,6 +286,7 @@ plist_txt_new(plist_txt_t **txtpp)
 	memset(txt, 0, sizeof(*txt));
 
 	txt->pt_state = PLIST_TXT_STATE_SCAN;
+	txt->pt_bufmax = PLIST_TXT_BUFMAX;
 	*txtpp = txt;
 	return 0;
 }
@@ -96,326 +303,1510 @@ plist_txt_free(plist_txt_t *txt)
 		plist_free(txt->pt_top);
 	}
 	if (txt->pt_buf != NULL) {
-		free(txt->pt_buf);
+		if (txt->pt_pool != NULL) {
+			_plist_txt_pool_put(txt->pt_pool, txt->pt_buf,
+					    txt->pt_bufsz);
+		} else {
+			free(txt->pt_buf);
+		}
 	}
+	while (txt->pt_nkeysets > 0) {
+		txt->pt_nkeysets--;
+		free(txt->pt_keysets[txt->pt_nkeysets].pks_slots);
+	}
+	free(txt->pt_keysets);
+	free(txt->pt_stack);
+	free(txt->pt_pathstack);
 	free(txt);
 	return;
 }
 
 
+/**
+ * Let go of the scratch buffer when no value is being assembled in it,
+ * back to the pool or freed for a context without one.
+ */
 static void
-_plist_txt_push(plist_txt_t *txt, plist_t *value)
+_plist_txt_release(plist_txt_t *txt)
 {
-	if (txt->pt_depth == 0) {
-		txt->pt_top = value;
-		txt->pt_cur = value;
-		txt->pt_depth++;
-		txt->pt_state = PLIST_TXT_STATE_SCAN;
-		return;
-	}
-	if (txt->pt_cur == NULL) {
-		plist_free(value);
-		txt->pt_state = PLIST_TXT_STATE_ERROR;
-		return;
-	}
-
-	switch (txt->pt_cur->p_elem) {
-	case PLIST_KEY:
-		plist_dict_set(txt->pt_cur->p_parent,
-			       txt->pt_cur->p_key.pk_name, value);
-		break;
-	case PLIST_ARRAY:
-		plist_array_append(txt->pt_cur, value);
+	switch (txt->pt_state) {
+	case PLIST_TXT_STATE_ERROR:
+	case PLIST_TXT_STATE_DONE:
+	case PLIST_TXT_STATE_SCAN:
+	case PLIST_TXT_STATE_SKIP:
 		break;
 	default:
-		/* invalid parent */
-		plist_free(value);
-		txt->pt_state = PLIST_TXT_STATE_ERROR;
 		return;
 	}
-	txt->pt_cur = value;
-	txt->pt_depth++;
-	txt->pt_state = PLIST_TXT_STATE_SCAN;
+	if (txt->pt_pool != NULL) {
+		_plist_txt_pool_put(txt->pt_pool, txt->pt_buf, txt->pt_bufsz);
+	} else {
+		free(txt->pt_buf);
+	}
+	txt->pt_buf = NULL;
+	txt->pt_bufsz = 0;
+	txt->pt_bufoff = 0;
 	return;
 }
 
-static void
-_plist_txt_next(plist_txt_t *txt, plist_t *value)
+/**
+ * Compact mode gives up the scratch buffer at the end of every call.
+ */
+static inline void
+_plist_txt_idle(plist_txt_t *txt)
 {
-	char *str;
-
-	if (txt->pt_depth == 0) {
-		txt->pt_top = value;
-		txt->pt_cur = value;
-		txt->pt_state = PLIST_TXT_STATE_SCAN;
-		return;
-	}
-	if (txt->pt_cur == NULL) {
-		plist_free(value);
-		txt->pt_state = PLIST_TXT_STATE_ERROR;
-		return;
-	}
-
-	/* insert into the current container */
-	switch (txt->pt_cur->p_elem) {
-	case PLIST_DICT:
-		/* simple conversion of a string to a key */
-		if (value->p_elem != PLIST_STRING) {
-			plist_free(value);
-			txt->pt_state = PLIST_TXT_STATE_ERROR;
-			return;
-		}
-		str = value->p_string.ps_str;
-		if (plist_dict_haskey(txt->pt_cur, str) == true) {
-			plist_free(value);
-			txt->pt_state = PLIST_TXT_STATE_ERROR;
-			return;
-		}
-		value->p_elem = PLIST_KEY;
-		value->p_key.pk_name = str;
-		value->p_key.pk_value = NULL;
-
-		txt->pt_cur->p_dict.pd_numkeys++;
-		TAILQ_INSERT_TAIL(&txt->pt_cur->p_dict.pd_keys,
-				  value, p_entry);
-		value->p_parent = txt->pt_cur;
-		txt->pt_cur = value;
-		txt->pt_depth++;
-		break;
-	case PLIST_KEY:
-		plist_dict_set(txt->pt_cur->p_parent,
-			       txt->pt_cur->p_key.pk_name, value);
-		break;
-	case PLIST_ARRAY:
-		plist_array_append(txt->pt_cur, value);
-		break;
-	default:
-		/* invalid parent */
-		plist_free(value);
-		txt->pt_state = PLIST_TXT_STATE_ERROR;
-		return;
+	if (txt->pt_pool != NULL && txt->pt_buf != NULL) {
+		_plist_txt_release(txt);
 	}
-	txt->pt_state = PLIST_TXT_STATE_SCAN;
 	return;
 }
 
-static void
-_plist_txt_pop(plist_txt_t *txt)
+
+void
+plist_txt_setpool(plist_txt_t *txt, plist_txt_pool_t *pool)
 {
-	if (txt->pt_depth <= 0 || txt->pt_cur == NULL) {
-		txt->pt_state = PLIST_TXT_STATE_ERROR;
+	if (!txt) {
 		return;
 	}
-	txt->pt_depth--;
-	txt->pt_cur = txt->pt_cur->p_parent;
-	txt->pt_state = PLIST_TXT_STATE_SCAN;
+	if (txt->pt_buf != NULL) {
+		/* a buffer that is in use moves over with the context */
+		_plist_txt_release(txt);
+	}
+	txt->pt_pool = pool;
 	return;
 }
 
+
+/**
+ * Find the key under a node of the paths
+ */
 static int
-_plist_txt_buf(plist_txt_t *txt, size_t extend)
+_plist_txt_paths_child(const plist_txt_paths_t *paths, int parent,
+		       const char *name, size_t len)
 {
-	void *ptr;
-
-	if ((txt->pt_bufsz - txt->pt_bufoff) >= extend) {
-		return 0;
-	}
-
-	ptr = realloc(txt->pt_buf, txt->pt_bufsz + extend);
-	if (ptr == NULL) {
-		return ENOMEM;
+	int i;
+	const plist_txt_pathnode_t *ppn;
+
+	for (i = 1; i < paths->ppa_nnodes; i++) {
+		ppn = &paths->ppa_nodes[i];
+		if (ppn->ppn_parent == parent && ppn->ppn_len == len &&
+		    memcmp(ppn->ppn_name, name, len) == 0) {
+			return i;
+		}
 	}
-	txt->pt_buf = ptr;
-	txt->pt_bufsz += extend;
-	return 0;
+	return PATH_NONE;
 }
 
 
 int
-plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
+plist_txt_paths_new(plist_txt_paths_t **pathspp,
+		    const char *const *paths, int npaths)
 {
-	int err;
-	char *bp;
-	const char *cp;
-	plist_t *ptmp;
-	plist_chunk_t chunk;
-
-	if (!txt || !buf) {
+	int i;
+	int node;
+	int child;
+	int maxnodes;
+	char *cp;
+	char *ep;
+	size_t namesz;
+	plist_txt_paths_t *pp;
+	plist_txt_pathnode_t *ppn;
+
+	if (!pathspp || npaths < 0 || (npaths > 0 && !paths)) {
 		return EINVAL;
 	}
-	if (sz == 0) {
-		/* nothing to parse */
-		return 0;
-	}
 
-	chunk.pc_cp = buf; /* current */
-	chunk.pc_ep = &chunk.pc_cp[sz]; /* end */
- nextstate:
-	switch (txt->pt_state) {
-	case PLIST_TXT_STATE_DONE:
-		return 0;
-
-	case PLIST_TXT_STATE_SCAN:
-		/* eat whitespace */
-		while (chunk.pc_cp != chunk.pc_ep &&
-		       isspace(chunk.pc_cp[0]) && chunk.pc_cp[0] != '\0')
-			chunk.pc_cp++;
+	/* the top level and at most one node for each key */
+	maxnodes = 1;
+	namesz = 0;
+	for (i = 0; i < npaths; i++) {
+		if (!paths[i]) {
+			return EINVAL;
 		}
-		if (chunk.pc_cp == chunk.pc_ep) {
-			if (txt->pt_top != NULL && txt->pt_depth == 0) {
-				txt->pt_state = PLIST_TXT_STATE_DONE;
-			}
-			return 0;
+		namesz += strlen(paths[i]) + 1;
+		maxnodes++;
+		for (cp = strchr(paths[i], '/'); cp != NULL;
+		     cp = strchr(&cp[1], '/')) {
+			maxnodes++;
 		}
+	}
 
-		switch (chunk.pc_cp[0]) {
-		case '{':
-			err = plist_dict_new(&ptmp);
-			if (err != 0) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return err;
+	pp = malloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->ppa_nodes = malloc(maxnodes * sizeof(*pp->ppa_nodes));
+	pp->ppa_names = malloc(namesz + 1);
+	if (pp->ppa_nodes == NULL || pp->ppa_names == NULL) {
+		plist_txt_paths_free(pp);
+		return ENOMEM;
+	}
+	ppn = &pp->ppa_nodes[0];
+	ppn->ppn_parent = PATH_NONE;
+	ppn->ppn_leaf = false;
+	ppn->ppn_len = 0;
+	ppn->ppn_name = NULL;
+	pp->ppa_nnodes = 1;
+
+	cp = pp->ppa_names;
+	for (i = 0; i < npaths; i++) {
+		strcpy(cp, paths[i]);
+		node = 0;
+		for (;;) {
+			ep = strchr(cp, '/');
+			if (ep == NULL) {
+				ep = &cp[strlen(cp)];
 			}
-			_plist_txt_push(txt, ptmp);
-
-			chunk.pc_cp++;
-			goto nextstate;
-
-		case '}':
-			if (txt->pt_cur == NULL) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return EACCES;
+			if (ep == cp) {
+				/* empty key */
+				plist_txt_paths_free(pp);
+				return EINVAL;
 			}
-			if (txt->pt_cur->p_elem == PLIST_KEY) {
-				_plist_txt_pop(txt);
+			if (pp->ppa_nodes[node].ppn_leaf == false) {
+				child = _plist_txt_paths_child(pp, node,
+							       cp, ep - cp);
+				if (child == PATH_NONE) {
+					child = pp->ppa_nnodes++;
+					ppn = &pp->ppa_nodes[child];
+					ppn->ppn_parent = node;
+					ppn->ppn_leaf = false;
+					ppn->ppn_len = ep - cp;
+					ppn->ppn_name = cp;
+				}
+				node = child;
 			}
-			if (txt->pt_cur->p_elem != PLIST_DICT) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return EACCES;
+			cp = &ep[1];
+			if (ep[0] == '\0') {
+				break;
 			}
-			_plist_txt_pop(txt);
+		}
 
-			chunk.pc_cp++;
-			goto nextstate;
+		/* a shorter path takes everything under it */
+		pp->ppa_nodes[node].ppn_leaf = true;
+	}
 
-		case ':':
-			/* the value in a dictionary */
-			if (txt->pt_cur == NULL ||
-			    txt->pt_cur->p_elem != PLIST_KEY) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return EACCES;
-			}
+	*pathspp = pp;
+	return 0;
+}
 
-			chunk.pc_cp++;
-			goto nextstate;
 
-		case ';':
-			/* the next key in a dictionary */
-			if (txt->pt_cur == NULL ||
-			    txt->pt_cur->p_elem != PLIST_KEY) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return EACCES;
-			}
-			_plist_txt_pop(txt);
+void
+plist_txt_paths_free(plist_txt_paths_t *paths)
+{
+	if (!paths) {
+		return;
+	}
+	free(paths->ppa_nodes);
+	free(paths->ppa_names);
+	free(paths);
+	return;
+}
 
-			chunk.pc_cp++;
-			goto nextstate;
 
-		case '(':
-			err = plist_array_new(&ptmp);
-			if (err != 0) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return err;
-			}
-			_plist_txt_push(txt, ptmp);
+void
+plist_txt_setpaths(plist_txt_t *txt, const plist_txt_paths_t *paths)
+{
+	if (!txt) {
+		return;
+	}
+	txt->pt_paths = paths;
+	return;
+}
 
-			chunk.pc_cp++;
-			goto nextstate;
 
-		case ')':
-			if (txt->pt_cur == NULL ||
-			    txt->pt_cur->p_elem != PLIST_ARRAY) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return EACCES;
-			}
-			_plist_txt_pop(txt);
+void
+plist_txt_setflags(plist_txt_t *txt, int flags)
+{
+	if (!txt) {
+		return;
+	}
+	txt->pt_flags = flags;
+	return;
+}
 
-			chunk.pc_cp++;
-			goto nextstate;
 
-		case ',':
-			/* just the next element in an array */
-			if (txt->pt_cur == NULL ||
-			    txt->pt_cur->p_elem != PLIST_ARRAY) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return EACCES;
-			}
+static size_t
+_plist_keyset_hash(const char *name)
+{
+	size_t h;
 
-			chunk.pc_cp++;
-			goto nextstate;
+	/* FNV-1a */
+	h = 2166136261u;
+	while (*name != '\0') {
+		h ^= (unsigned char) *name++;
+		h *= 16777619u;
+	}
+	return h;
+}
 
-		case '<':
-			chunk.pc_cp++;
-			txt->pt_datacnt = 0;
-			txt->pt_bufoff = 0;
-			txt->pt_state = PLIST_TXT_STATE_DATA;
-			goto nextstate;
+/**
+ * Insert a key into the hash, returning EEXIST when the name is
+ * already present.
+ */
+static int
+_plist_keyset_add(plist_keyset_t *pks, plist_t *key)
+{
+	size_t i;
+	size_t mask;
+	plist_t *ptmp;
 
-		case '"':
-			cp = ++chunk.pc_cp;
-			/* eat until we get another '"' */
-			for (;;) {
-				if (cp == chunk.pc_ep) {
-					/* have a string fragment */
-					txt->pt_bufoff = 0;
-					err = _plist_txt_buf(
-						txt, cp - chunk.pc_cp);
-					if (err != 0) {
-						txt->pt_state =
-						    PLIST_TXT_STATE_ERROR;
-						return err;
-					}
-					txt->pt_state = PLIST_TXT_STATE_STRING;
-					goto nextstate;
-				}
+	mask = pks->pks_nslots - 1;
+	i = _plist_keyset_hash(key->p_key.pk_name) & mask;
+	while ((ptmp = pks->pks_slots[i]) != NULL) {
+		if (strcmp(ptmp->p_key.pk_name, key->p_key.pk_name) == 0) {
+			return EEXIST;
+		}
+		i = (i + 1) & mask;
+	}
+	pks->pks_slots[i] = key;
+	pks->pks_nkeys++;
+	return 0;
+}
+
+/**
+ * Size the hash to keep it at most half full and rehash the keys of
+ * the dictionary into it.
+ */
+static int
+_plist_keyset_grow(plist_keyset_t *pks)
+{
+	size_t nslots;
+	plist_t *ptmp;
+	plist_t **slots;
+
+	nslots = (pks->pks_nslots == 0) ? 4 * KEYSET_MINKEYS :
+	    2 * pks->pks_nslots;
+	slots = calloc(nslots, sizeof(*slots));
+	if (slots == NULL) {
+		return ENOMEM;
+	}
+	free(pks->pks_slots);
+	pks->pks_slots = slots;
+	pks->pks_nslots = nslots;
+	pks->pks_nkeys = 0;
+
+	TAILQ_FOREACH(ptmp, &pks->pks_dict->p_dict.pd_keys, p_entry) {
+		(void) _plist_keyset_add(pks, ptmp);
+	}
+	return 0;
+}
+
+/**
+ * Check a new name against the keys already in the current dictionary.
+ * Small dictionaries are scanned, larger ones are hashed.
+ */
+static int
+_plist_keyset_check(plist_txt_t *txt, plist_t *dict, const char *name)
+{
+	int err;
+	size_t i;
+	size_t mask;
+	plist_t *ptmp;
+	plist_keyset_t *pks;
+
+	if (txt->pt_nkeysets == 0) {
+		return EACCES;
+	}
+	pks = &txt->pt_keysets[txt->pt_nkeysets - 1];
+	assert(pks->pks_dict == dict);
+
+	if (pks->pks_nslots == 0) {
+		if (dict->p_dict.pd_numkeys < KEYSET_MINKEYS) {
+			return plist_dict_haskey(dict, name) ? EEXIST : 0;
+		}
+		err = _plist_keyset_grow(pks);
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	mask = pks->pks_nslots - 1;
+	i = _plist_keyset_hash(name) & mask;
+	while ((ptmp = pks->pks_slots[i]) != NULL) {
+		if (strcmp(ptmp->p_key.pk_name, name) == 0) {
+			return EEXIST;
+		}
+		i = (i + 1) & mask;
+	}
+	return 0;
+}
+
+/**
+ * Record a key that was added to the current dictionary.
+ */
+static int
+_plist_keyset_insert(plist_txt_t *txt, plist_t *key)
+{
+	plist_keyset_t *pks;
+
+	pks = &txt->pt_keysets[txt->pt_nkeysets - 1];
+	if (pks->pks_nslots == 0) {
+		return 0;
+	}
+	if (2 * (pks->pks_nkeys + 1) > pks->pks_nslots) {
+		/* rehash picks up the key from the dictionary */
+		return _plist_keyset_grow(pks);
+	}
+	return _plist_keyset_add(pks, key);
+}
+
+static int
+_plist_keyset_push(plist_txt_t *txt, plist_t *dict)
+{
+	plist_keyset_t *pks;
+
+	if (txt->pt_nkeysets == txt->pt_maxkeysets) {
+		int maxkeysets;
+
+		maxkeysets = (txt->pt_maxkeysets == 0) ? 8 :
+		    2 * txt->pt_maxkeysets;
+		pks = realloc(txt->pt_keysets, maxkeysets * sizeof(*pks));
+		if (pks == NULL) {
+			return ENOMEM;
+		}
+		txt->pt_keysets = pks;
+		txt->pt_maxkeysets = maxkeysets;
+	}
+
+	pks = &txt->pt_keysets[txt->pt_nkeysets++];
+	memset(pks, 0, sizeof(*pks));
+	pks->pks_dict = dict;
+	return 0;
+}
+
+static void
+_plist_keyset_pop(plist_txt_t *txt)
+{
+	plist_keyset_t *pks;
+
+	if (txt->pt_nkeysets == 0) {
+		return;
+	}
+	pks = &txt->pt_keysets[--txt->pt_nkeysets];
+	free(pks->pks_slots);
+	pks->pks_slots = NULL;
+	return;
+}
+
+
+/*
+ * Nesting of the containers being parsed. Each level is the element
+ * type of the container and a key is a level of its own so that the
+ * separators can be checked without a tree.
+ */
+#define STACK_VALUED  (0x80) /* key level that already has its value */
+
+static int
+_plist_txt_stack_push(plist_txt_t *txt, enum plist_elem_e elem)
+{
+	if (txt->pt_depth == txt->pt_stackmax) {
+		uint8_t *stack;
+		int stackmax;
+
+		stackmax = (txt->pt_stackmax == 0) ? 16 : 2 * txt->pt_stackmax;
+		stack = realloc(txt->pt_stack, stackmax);
+		if (stack == NULL) {
+			return ENOMEM;
+		}
+		txt->pt_stack = stack;
+		txt->pt_stackmax = stackmax;
+	}
+	txt->pt_stack[txt->pt_depth++] = elem;
+	return 0;
+}
+
+static int
+_plist_txt_stack_top(const plist_txt_t *txt)
+{
+	if (txt->pt_depth == 0) {
+		return PLIST_UNKNOWN;
+	}
+	return txt->pt_stack[txt->pt_depth - 1];
+}
+
+
+/**
+ * Path match of the innermost level, the top level starts at the root
+ * of the paths
+ */
+static int
+_plist_txt_path_top(const plist_txt_t *txt)
+{
+	if (txt->pt_depth == 0) {
+		return 0;
+	}
+	return txt->pt_pathstack[txt->pt_depth - 1];
+}
+
+/**
+ * Record the path match of the level that was just pushed
+ */
+static int
+_plist_txt_path_set(plist_txt_t *txt, int node)
+{
+	if (txt->pt_pathmax < txt->pt_stackmax) {
+		int *stack;
+
+		stack = realloc(txt->pt_pathstack,
+				txt->pt_stackmax * sizeof(*stack));
+		if (stack == NULL) {
+			return ENOMEM;
+		}
+		txt->pt_pathstack = stack;
+		txt->pt_pathmax = txt->pt_stackmax;
+	}
+	txt->pt_pathstack[txt->pt_depth - 1] = node;
+	return 0;
+}
+
+/**
+ * Match a dictionary key against the paths. Returns PATH_NONE when the
+ * value of the key is not wanted.
+ */
+static int
+_plist_txt_path_key(const plist_txt_t *txt, const char *s, size_t len)
+{
+	int node;
+	const plist_txt_paths_t *paths = txt->pt_paths;
+
+	node = _plist_txt_path_top(txt);
+	if (node == PATH_ALL) {
+		return PATH_ALL;
+	}
+	node = _plist_txt_paths_child(paths, node, s, len);
+	if (node == PATH_NONE) {
+		return PATH_NONE;
+	}
+	return paths->ppa_nodes[node].ppn_leaf ? PATH_ALL : node;
+}
+
+
+/*
+ * Tree building sink for the parse events. This is what the plain
+ * #plist_txt_parse uses, the argument is the parse context itself.
+ */
+
+/**
+ * Attach a value to the key that was just parsed. The key node is the
+ * current element so there is no need to search the dictionary for it.
+ */
+static int
+_plist_txt_setkey(plist_t *key, plist_t *value)
+{
+	if (key->p_key.pk_value != NULL) {
+		/* a second value for the same key */
+		return EINVAL;
+	}
+	key->p_key.pk_value = value;
+	value->p_parent = key;
+	return 0;
+}
+
+static int
+_plist_tree_attach(plist_txt_t *txt, plist_t *value)
+{
+	int err;
+	plist_t *cur;
+
+	cur = txt->pt_cur;
+	if (cur == NULL) {
+		if (txt->pt_top != NULL) {
+			plist_free(value);
+			return EACCES;
+		}
+		/* options hold for the whole document */
+		txt->pt_dupcheck =
+		    ((txt->pt_flags & PLIST_TXT_NODUPCHECK) == 0);
+		txt->pt_top = value;
+		return 0;
+	}
+
+	switch (cur->p_elem) {
+	case PLIST_KEY:
+		err = _plist_txt_setkey(cur, value);
+		break;
+	case PLIST_ARRAY:
+		err = plist_array_append(cur, value);
+		break;
+	default:
+		/* invalid parent */
+		err = EACCES;
+		break;
+	}
+	if (err != 0) {
+		plist_free(value);
+	}
+	return err;
+}
+
+static int
+_plist_tree_begin_dict(void *arg)
+{
+	int err;
+	plist_t *dict;
+	plist_txt_t *txt = arg;
+
+	err = plist_dict_new(&dict);
+	if (err != 0) {
+		return err;
+	}
+	err = _plist_tree_attach(txt, dict);
+	if (err != 0) {
+		return err;
+	}
+	txt->pt_cur = dict;
+
+	if (txt->pt_dupcheck) {
+		return _plist_keyset_push(txt, dict);
+	}
+	return 0;
+}
+
+static int
+_plist_tree_end_dict(void *arg)
+{
+	plist_txt_t *txt = arg;
+
+	if (txt->pt_cur != NULL && txt->pt_cur->p_elem == PLIST_KEY) {
+		txt->pt_cur = txt->pt_cur->p_parent;
+	}
+	if (txt->pt_cur == NULL || txt->pt_cur->p_elem != PLIST_DICT) {
+		return EACCES;
+	}
+	if (txt->pt_nkeysets > 0 &&
+	    txt->pt_keysets[txt->pt_nkeysets - 1].pks_dict == txt->pt_cur) {
+		/* the dictionary is closed so drop its index */
+		_plist_keyset_pop(txt);
+	}
+	txt->pt_cur = txt->pt_cur->p_parent;
+	return 0;
+}
+
+/**
+ * Values that were not assembled in the scratch buffer are still in the
+ * caller's fragment, which can be borrowed when the caller allows it.
+ */
+static bool
+_plist_tree_borrow(const plist_txt_t *txt, const void *ptr)
+{
+	const char *bp = txt->pt_buf;
+
+	if (!txt->pt_borrow) {
+		return false;
+	}
+	return (bp == NULL || (const char *) ptr < bp ||
+		(const char *) ptr >= &bp[txt->pt_bufsz]);
+}
+
+/**
+ * Create a string node for a string or a key, terminating a borrowed
+ * one in place over its closing quote.
+ */
+static int
+_plist_tree_nstring(plist_txt_t *txt, plist_t **stringpp,
+		    const char *s, size_t len)
+{
+	if (_plist_tree_borrow(txt, s)) {
+		((char *) s)[len] = '\0';
+		return plist_string_ref_new(stringpp, s);
+	}
+	return plist_nstring_new(stringpp, s, len);
+}
+
+static int
+_plist_tree_key(void *arg, const char *name, size_t len)
+{
+	int err;
+	char *str;
+	plist_t *key;
+	plist_t *dict;
+	plist_txt_t *txt = arg;
+
+	if (txt->pt_cur != NULL && txt->pt_cur->p_elem == PLIST_KEY) {
+		/* done with the previous key */
+		txt->pt_cur = txt->pt_cur->p_parent;
+	}
+	dict = txt->pt_cur;
+	if (dict == NULL || dict->p_elem != PLIST_DICT) {
+		return EACCES;
+	}
+
+	/* simple conversion of a string to a key */
+	err = _plist_tree_nstring(txt, &key, name, len);
+	if (err != 0) {
+		return err;
+	}
+	str = key->p_string.ps_str;
+	if (txt->pt_dupcheck) {
+		err = _plist_keyset_check(txt, dict, str);
+		if (err != 0) {
+			plist_free(key);
+			return err;
+		}
+	}
+	key->p_elem = PLIST_KEY;
+	key->p_key.pk_name = str;
+	key->p_key.pk_value = NULL;
+
+	dict->p_dict.pd_numkeys++;
+	TAILQ_INSERT_TAIL(&dict->p_dict.pd_keys, key, p_entry);
+	key->p_parent = dict;
+	txt->pt_cur = key;
+
+	if (txt->pt_dupcheck) {
+		return _plist_keyset_insert(txt, key);
+	}
+	return 0;
+}
+
+static int
+_plist_tree_begin_array(void *arg)
+{
+	int err;
+	plist_t *array;
+	plist_txt_t *txt = arg;
+
+	err = plist_array_new(&array);
+	if (err != 0) {
+		return err;
+	}
+	err = _plist_tree_attach(txt, array);
+	if (err != 0) {
+		return err;
+	}
+	txt->pt_cur = array;
+	return 0;
+}
+
+static int
+_plist_tree_end_array(void *arg)
+{
+	plist_txt_t *txt = arg;
+
+	if (txt->pt_cur == NULL || txt->pt_cur->p_elem != PLIST_ARRAY) {
+		return EACCES;
+	}
+	txt->pt_cur = txt->pt_cur->p_parent;
+	return 0;
+}
+
+static int
+_plist_tree_string(void *arg, const char *s, size_t len)
+{
+	int err;
+	plist_t *ptmp;
+
+	err = _plist_tree_nstring(arg, &ptmp, s, len);
+	if (err != 0) {
+		return err;
+	}
+	return _plist_tree_attach(arg, ptmp);
+}
+
+static int
+_plist_tree_integer(void *arg, long long num)
+{
+	int err;
+	plist_t *ptmp;
+
+	err = plist_integer_new(&ptmp, num);
+	if (err != 0) {
+		return err;
+	}
+	return _plist_tree_attach(arg, ptmp);
+}
+
+static int
+_plist_tree_real(void *arg, double num)
+{
+	int err;
+	plist_t *ptmp;
+
+	err = plist_real_new(&ptmp, num);
+	if (err != 0) {
+		return err;
+	}
+	return _plist_tree_attach(arg, ptmp);
+}
+
+static int
+_plist_tree_boolean(void *arg, bool flag)
+{
+	int err;
+	plist_t *ptmp;
+
+	err = plist_boolean_new(&ptmp, flag);
+	if (err != 0) {
+		return err;
+	}
+	return _plist_tree_attach(arg, ptmp);
+}
+
+static int
+_plist_tree_data(void *arg, const void *buf, size_t sz)
+{
+	int err;
+	plist_t *ptmp;
+
+	if (_plist_tree_borrow(arg, buf)) {
+		err = plist_data_ref_new(&ptmp, buf, sz);
+	} else {
+		err = plist_data_new(&ptmp, buf, sz);
+	}
+	if (err != 0) {
+		return err;
+	}
+	return _plist_tree_attach(arg, ptmp);
+}
+
+static int
+_plist_tree_date(void *arg, const struct tm *tm)
+{
+	int err;
+	plist_t *ptmp;
+
+	err = plist_date_new(&ptmp, tm);
+	if (err != 0) {
+		return err;
+	}
+	return _plist_tree_attach(arg, ptmp);
+}
+
+const plist_txt_sax_t plist_txt_tree_sax = {
+	.psx_begin_dict = _plist_tree_begin_dict,
+	.psx_end_dict = _plist_tree_end_dict,
+	.psx_key = _plist_tree_key,
+	.psx_begin_array = _plist_tree_begin_array,
+	.psx_end_array = _plist_tree_end_array,
+	.psx_string = _plist_tree_string,
+	.psx_integer = _plist_tree_integer,
+	.psx_real = _plist_tree_real,
+	.psx_boolean = _plist_tree_boolean,
+	.psx_data = _plist_tree_data,
+	.psx_date = _plist_tree_date,
+};
+
+
+/*
+ * Token sink for the pull reader (arg is the plist_txt_token_t). Every
+ * element fills in the token and suspends the state machine so that
+ * the caller gets one token per call.
+ */
+
+static int
+_plist_pull_mark(void *arg, enum plist_txt_tok_e type)
+{
+	plist_txt_token_t *tok = arg;
+
+	tok->ptk_type = type;
+	return PLIST_TXT_SUSPEND;
+}
+
+static int
+_plist_pull_view(void *arg, enum plist_txt_tok_e type,
+		 const void *ptr, size_t len)
+{
+	plist_txt_token_t *tok = arg;
+
+	tok->ptk_ptr = ptr;
+	tok->ptk_len = len;
+	return _plist_pull_mark(arg, type);
+}
+
+static int
+_plist_pull_begin_dict(void *arg)
+{
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_BEGIN_DICT);
+}
+
+static int
+_plist_pull_end_dict(void *arg)
+{
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_END_DICT);
+}
+
+static int
+_plist_pull_key(void *arg, const char *name, size_t len)
+{
+	return _plist_pull_view(arg, PLIST_TXT_TOK_KEY, name, len);
+}
+
+static int
+_plist_pull_begin_array(void *arg)
+{
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_BEGIN_ARRAY);
+}
+
+static int
+_plist_pull_end_array(void *arg)
+{
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_END_ARRAY);
+}
+
+static int
+_plist_pull_string(void *arg, const char *s, size_t len)
+{
+	return _plist_pull_view(arg, PLIST_TXT_TOK_STRING, s, len);
+}
+
+static int
+_plist_pull_integer(void *arg, long long num)
+{
+	plist_txt_token_t *tok = arg;
+
+	tok->ptk_integer = num;
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_INTEGER);
+}
+
+static int
+_plist_pull_real(void *arg, double num)
+{
+	plist_txt_token_t *tok = arg;
+
+	tok->ptk_real = num;
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_REAL);
+}
+
+static int
+_plist_pull_boolean(void *arg, bool flag)
+{
+	plist_txt_token_t *tok = arg;
+
+	tok->ptk_boolean = flag;
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_BOOLEAN);
+}
+
+static int
+_plist_pull_data(void *arg, const void *buf, size_t sz)
+{
+	return _plist_pull_view(arg, PLIST_TXT_TOK_DATA, buf, sz);
+}
+
+static int
+_plist_pull_date(void *arg, const struct tm *tm)
+{
+	plist_txt_token_t *tok = arg;
+
+	tok->ptk_date = *tm;
+	return _plist_pull_mark(arg, PLIST_TXT_TOK_DATE);
+}
+
+static const plist_txt_sax_t plist_txt_pull = {
+	.psx_begin_dict = _plist_pull_begin_dict,
+	.psx_end_dict = _plist_pull_end_dict,
+	.psx_key = _plist_pull_key,
+	.psx_begin_array = _plist_pull_begin_array,
+	.psx_end_array = _plist_pull_end_array,
+	.psx_string = _plist_pull_string,
+	.psx_integer = _plist_pull_integer,
+	.psx_real = _plist_pull_real,
+	.psx_boolean = _plist_pull_boolean,
+	.psx_data = _plist_pull_data,
+	.psx_date = _plist_pull_date,
+};
+
+
+/*
+ * Event helpers for the state machine. These check that the element is
+ * allowed at the current nesting, hand it to the callback, and pick the
+ * next state. A value that completes at the top level ends the parse.
+ */
+
+static int
+_plist_txt_value(plist_txt_t *txt)
+{
+	uint8_t *top;
+
+	if (txt->pt_depth == 0) {
+		return 0;
+	}
+	top = &txt->pt_stack[txt->pt_depth - 1];
+	switch (*top) {
+	case PLIST_ARRAY:
+		return 0;
+	case PLIST_KEY:
+		*top |= STACK_VALUED;
+		return 0;
+	default:
+		/* a dictionary expects a key or a key has a value */
+		return EACCES;
+	}
+}
+
+static void
+_plist_txt_emitted(plist_txt_t *txt)
+{
+	txt->pt_state = (txt->pt_depth == 0) ?
+	    PLIST_TXT_STATE_DONE : PLIST_TXT_STATE_SCAN;
+	return;
+}
+
+static int
+_plist_txt_open(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		enum plist_elem_e elem)
+{
+	int err;
+	int node;
+
+	err = _plist_txt_value(txt);
+	if (err != 0) {
+		return err;
+	}
+	node = (txt->pt_paths != NULL) ? _plist_txt_path_top(txt) : PATH_ALL;
+	err = _plist_txt_stack_push(txt, elem);
+	if (err == 0 && txt->pt_paths != NULL) {
+		/* a container is on the path of its key */
+		err = _plist_txt_path_set(txt, node);
+	}
+	if (err != 0) {
+		return err;
+	}
+	if (elem == PLIST_DICT && sax->psx_begin_dict != NULL) {
+		err = sax->psx_begin_dict(arg);
+	}
+	if (elem == PLIST_ARRAY && sax->psx_begin_array != NULL) {
+		err = sax->psx_begin_array(arg);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	txt->pt_state = PLIST_TXT_STATE_SCAN;
+	return err;
+}
+
+static int
+_plist_txt_close(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		 enum plist_elem_e elem)
+{
+	int err;
+
+	if (elem == PLIST_DICT &&
+	    (_plist_txt_stack_top(txt) & ~STACK_VALUED) == PLIST_KEY) {
+		/* last entry of the dictionary without a ';' */
+		txt->pt_depth--;
+	}
+	if (_plist_txt_stack_top(txt) != (int) elem) {
+		return EACCES;
+	}
+	txt->pt_depth--;
+
+	err = 0;
+	if (elem == PLIST_DICT && sax->psx_end_dict != NULL) {
+		err = sax->psx_end_dict(arg);
+	}
+	if (elem == PLIST_ARRAY && sax->psx_end_array != NULL) {
+		err = sax->psx_end_array(arg);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	_plist_txt_emitted(txt);
+	return err;
+}
+
+/**
+ * A complete string is a key when it is directly inside a dictionary
+ * and a value everywhere else.
+ */
+static int
+_plist_txt_string(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		  const char *s, size_t len)
+{
+	int err;
+	int node;
+
+	if (_plist_txt_stack_top(txt) == PLIST_DICT) {
+		node = PATH_ALL;
+		if (txt->pt_paths != NULL) {
+			node = _plist_txt_path_key(txt, s, len);
+			if (node == PATH_NONE) {
+				/* pass over the value without parsing it */
+				txt->pt_skipdepth = 0;
+				txt->pt_skipstr = false;
+				txt->pt_escape = false;
+				txt->pt_state = PLIST_TXT_STATE_SKIP;
+				return 0;
+			}
+		}
+		err = _plist_txt_stack_push(txt, PLIST_KEY);
+		if (err == 0 && txt->pt_paths != NULL) {
+			err = _plist_txt_path_set(txt, node);
+		}
+		if (err != 0) {
+			return err;
+		}
+		if (sax->psx_key != NULL) {
+			err = sax->psx_key(arg, s, len);
+			if (err != 0 && err != PLIST_TXT_SUSPEND) {
+				return err;
+			}
+		}
+		txt->pt_state = PLIST_TXT_STATE_SCAN;
+		return err;
+	}
+
+	err = _plist_txt_value(txt);
+	if (err == 0 && sax->psx_string != NULL) {
+		err = sax->psx_string(arg, s, len);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	_plist_txt_emitted(txt);
+	return err;
+}
+
+static int
+_plist_txt_integer(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		   long long num)
+{
+	int err;
+
+	err = _plist_txt_value(txt);
+	if (err == 0 && sax->psx_integer != NULL) {
+		err = sax->psx_integer(arg, num);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	_plist_txt_emitted(txt);
+	return err;
+}
+
+static int
+_plist_txt_real(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		double num)
+{
+	int err;
+
+	err = _plist_txt_value(txt);
+	if (err == 0 && sax->psx_real != NULL) {
+		err = sax->psx_real(arg, num);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	_plist_txt_emitted(txt);
+	return err;
+}
+
+static int
+_plist_txt_boolean(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		   bool flag)
+{
+	int err;
+
+	err = _plist_txt_value(txt);
+	if (err == 0 && sax->psx_boolean != NULL) {
+		err = sax->psx_boolean(arg, flag);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	_plist_txt_emitted(txt);
+	return err;
+}
+
+static int
+_plist_txt_data(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		const void *buf, size_t sz)
+{
+	int err;
+
+	err = _plist_txt_value(txt);
+	if (err == 0 && sax->psx_data != NULL) {
+		err = sax->psx_data(arg, buf, sz);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	_plist_txt_emitted(txt);
+	return err;
+}
+
+static int
+_plist_txt_date(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		const struct tm *tm)
+{
+	int err;
+
+	err = _plist_txt_value(txt);
+	if (err == 0 && sax->psx_date != NULL) {
+		err = sax->psx_date(arg, tm);
+	}
+	if (err != 0 && err != PLIST_TXT_SUSPEND) {
+		return err;
+	}
+	_plist_txt_emitted(txt);
+	return err;
+}
+
+
+/**
+ * Make room for at least extend more bytes past the buffer offset. The
+ * buffer doubles so a large value costs a logarithmic number of
+ * reallocations rather than one per CHUNK_EXTENDSZ bytes.
+ */
+static int
+_plist_txt_buf(plist_txt_t *txt, size_t extend)
+{
+	void *ptr;
+	size_t need;
+	size_t newsz;
+
+	if ((txt->pt_bufsz - txt->pt_bufoff) >= extend) {
+		return 0;
+	}
+	if (txt->pt_buf == NULL && txt->pt_pool != NULL) {
+		txt->pt_buf = _plist_txt_pool_get(txt->pt_pool);
+		if (txt->pt_buf == NULL) {
+			return ENOMEM;
+		}
+		txt->pt_bufsz = txt->pt_pool->ptp_bufsz;
+		if ((txt->pt_bufsz - txt->pt_bufoff) >= extend) {
+			return 0;
+		}
+	}
+
+	need = txt->pt_bufoff + extend;
+	if (need < extend) {
+		return ENOMEM;
+	}
+	newsz = (txt->pt_bufsz < CHUNK_INITSZ) ? CHUNK_INITSZ : txt->pt_bufsz;
+	while (newsz < need) {
+		if (newsz > SIZE_MAX / 2) {
+			newsz = need;
+			break;
+		}
+		newsz *= 2;
+	}
+	if (newsz < txt->pt_bufhint) {
+		newsz = txt->pt_bufhint;
+	}
+
+	ptr = realloc(txt->pt_buf, newsz);
+	if (ptr == NULL) {
+		return ENOMEM;
+	}
+	txt->pt_buf = ptr;
+	txt->pt_bufsz = newsz;
+	return 0;
+}
+
+
+int
+plist_txt_reserve(plist_txt_t *txt, size_t sz)
+{
+	void *ptr;
+
+	if (!txt) {
+		return EINVAL;
+	}
+
+	txt->pt_bufhint = sz;
+	if (txt->pt_bufsz >= sz) {
+		return 0;
+	}
+
+	ptr = realloc(txt->pt_buf, sz);
+	if (ptr == NULL) {
+		return ENOMEM;
+	}
+	txt->pt_buf = ptr;
+	txt->pt_bufsz = sz;
+	return 0;
+}
+
+
+void
+plist_txt_set_highwater(plist_txt_t *txt, size_t sz)
+{
+	if (!txt) {
+		return;
+	}
+	txt->pt_bufmax = sz;
+	return;
+}
+
+
+/**
+ * Decode hex data over its own digits when the closing bracket is in
+ * the fragment. Two digits make each byte so the output never passes
+ * the input. The digits are all checked before any of them are
+ * written. Returns ENOENT when the data has to go through the scratch
+ * buffer instead, or EACCES for something other than a hex digit.
+ */
+static int
+_plist_txt_hexinsitu(char *buf, const char *ep, const char **endp,
+		     size_t *szp)
+{
+	char *dp;
+	const char *cp;
+	const char *close;
+	size_t cnt;
+
+	if (buf == ep || buf[0] == '*') {
+		/* a date, or nothing to decide with */
+		return ENOENT;
+	}
+	close = memchr(buf, '>', ep - buf);
+	if (close == NULL) {
+		return ENOENT;
+	}
+	for (cp = buf; cp != close; cp++) {
+		if ((CCLASS(cp[0]) & CC_F_SPACE) == 0 && !ISHEX(cp[0])) {
+			return EACCES;
+		}
+	}
+
+	cnt = 0;
+	dp = buf;
+	for (cp = buf; cp != close; cp++) {
+		if (CCLASS(cp[0]) & CC_F_SPACE) {
+			continue;
+		}
+		if ((cnt % 2) == 0) {
+			dp[0] = TOHEX(cp[0]) << 4;
+		} else {
+			dp[0] |= TOHEX(cp[0]);
+			dp++;
+		}
+		cnt++;
+	}
+
+	*endp = &close[1];
+	*szp = cnt/2 + cnt%2;
+	return 0;
+}
+
+/*
+ * With GCC and clang the states and the character classes jump to
+ * their code through tables of label addresses, so each transition is
+ * an indirect branch of its own instead of all of them going through
+ * the one jump of the switch. Other compilers use the switch.
+ */
+#if defined(__GNUC__) && !defined(PLIST_TXT_NO_THREADED)
+#define PLIST_TXT_THREADED
+#define NEXTSTATE()     goto *states[txt->pt_state]
+#define DISPATCH(_l)    _l:
+#else
+#define NEXTSTATE()     goto nextstate
+#define DISPATCH(_l)
+#endif
+
+/**
+ * Run the state machine over one fragment of input and hand each
+ * element that is found to the event callbacks.
+ */
+static int
+_plist_txt_run(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+	       const void *buf, size_t sz)
+{
+	int err;
+	uint8_t cc;
+	char *bp;
+	const char *cp;
+	const char *sp;
+	plist_chunk_t chunk;
+#ifdef PLIST_TXT_THREADED
+	static const void *const states[] = {
+		[PLIST_TXT_STATE_ERROR] = &&st_error,
+		[PLIST_TXT_STATE_DONE] = &&st_done,
+		[PLIST_TXT_STATE_SCAN] = &&st_scan,
+		[PLIST_TXT_STATE_DATA] = &&st_data,
+		[PLIST_TXT_STATE_DATE] = &&st_date,
+		[PLIST_TXT_STATE_STRING] = &&st_string,
+		[PLIST_TXT_STATE_NUMBER] = &&st_number,
+		[PLIST_TXT_STATE_DOUBLE] = &&st_double,
+		[PLIST_TXT_STATE_TRUE] = &&st_true,
+		[PLIST_TXT_STATE_FALSE] = &&st_false,
+		[PLIST_TXT_STATE_SKIP] = &&st_skip,
+	};
+	static const void *const scans[CC_CLASSES] = {
+		[CC_INVALID] = &&sc_invalid,
+		[CC_LBRACE] = &&sc_lbrace,
+		[CC_RBRACE] = &&sc_rbrace,
+		[CC_ASSIGN] = &&sc_assign,
+		[CC_SEMI] = &&sc_semi,
+		[CC_LPAREN] = &&sc_lparen,
+		[CC_RPAREN] = &&sc_rparen,
+		[CC_COMMA] = &&sc_comma,
+		[CC_LT] = &&sc_lt,
+		[CC_QUOTE] = &&sc_quote,
+		[CC_NUMBER] = &&sc_number,
+		[CC_TRUE] = &&sc_true,
+		[CC_FALSE] = &&sc_false,
+	};
+#endif
+
+	if (sz == 0) {
+		/* nothing to parse */
+		return 0;
+	}
+
+	chunk.pc_cp = buf; /* current */
+	chunk.pc_ep = &chunk.pc_cp[sz]; /* end */
+#ifdef PLIST_TXT_THREADED
+	if ((unsigned) txt->pt_state >=
+	    sizeof(states) / sizeof(states[0])) {
+		return EACCES;
+	}
+#else
+ nextstate:
+#endif
+	switch (txt->pt_state) {
+	case PLIST_TXT_STATE_DONE:
+	DISPATCH(st_done)
+		txt->pt_tail = chunk.pc_cp;
+		return 0;
+
+	case PLIST_TXT_STATE_SCAN:
+	DISPATCH(st_scan)
+		/* eat whitespace */
+		while (chunk.pc_cp != chunk.pc_ep &&
+		       (CCLASS(chunk.pc_cp[0]) & CC_F_SPACE)) {
+			chunk.pc_cp++;
+		}
+		if (chunk.pc_cp == chunk.pc_ep) {
+			return 0;
+		}
+
+		cc = CCLASS(chunk.pc_cp[0]) & CC_MASK;
+#ifdef PLIST_TXT_THREADED
+		goto *scans[cc];
+#endif
+		switch (cc) {
+		case CC_LBRACE:
+		DISPATCH(sc_lbrace)
+			chunk.pc_cp++;
+			err = _plist_txt_open(txt, sax, arg, PLIST_DICT);
+			if (err != 0) {
+				goto stop;
+			}
+			NEXTSTATE();
+
+		case CC_RBRACE:
+		DISPATCH(sc_rbrace)
+			chunk.pc_cp++;
+			err = _plist_txt_close(txt, sax, arg, PLIST_DICT);
+			if (err != 0) {
+				goto stop;
+			}
+			NEXTSTATE();
+
+		case CC_ASSIGN:
+		DISPATCH(sc_assign)
+			/* the value in a dictionary */
+			if (_plist_txt_stack_top(txt) != PLIST_KEY) {
+				txt->pt_state = PLIST_TXT_STATE_ERROR;
+				return EACCES;
+			}
+
+			chunk.pc_cp++;
+			NEXTSTATE();
+
+		case CC_SEMI:
+		DISPATCH(sc_semi)
+			/* the next key in a dictionary */
+			if ((_plist_txt_stack_top(txt) & ~STACK_VALUED) !=
+			    PLIST_KEY) {
+				txt->pt_state = PLIST_TXT_STATE_ERROR;
+				return EACCES;
+			}
+			txt->pt_depth--;
+
+			chunk.pc_cp++;
+			NEXTSTATE();
+
+		case CC_LPAREN:
+		DISPATCH(sc_lparen)
+			chunk.pc_cp++;
+			err = _plist_txt_open(txt, sax, arg, PLIST_ARRAY);
+			if (err != 0) {
+				goto stop;
+			}
+			NEXTSTATE();
+
+		case CC_RPAREN:
+		DISPATCH(sc_rparen)
+			chunk.pc_cp++;
+			err = _plist_txt_close(txt, sax, arg, PLIST_ARRAY);
+			if (err != 0) {
+				goto stop;
+			}
+			NEXTSTATE();
 
-				if (cp[0] == '\\') {
-					/* escape */
-					txt->pt_bufoff = 0;
-					err = _plist_txt_buf(
-						txt, cp - chunk.pc_cp);
-					if (err != 0) {
-						txt->pt_state =
-						    PLIST_TXT_STATE_ERROR;
-						return err;
-					}
-					txt->pt_state = PLIST_TXT_STATE_STRING;
-					goto nextstate;
+		case CC_COMMA:
+		DISPATCH(sc_comma)
+			/* just the next element in an array */
+			if (_plist_txt_stack_top(txt) != PLIST_ARRAY) {
+				txt->pt_state = PLIST_TXT_STATE_ERROR;
+				return EACCES;
+			}
+
+			chunk.pc_cp++;
+			NEXTSTATE();
+
+		case CC_LT:
+		DISPATCH(sc_lt)
+			chunk.pc_cp++;
+			if (txt->pt_borrow) {
+				size_t sz;
+
+				/* decode in place when the data is complete */
+				err = _plist_txt_hexinsitu((char *) chunk.pc_cp,
+							   chunk.pc_ep, &cp, &sz);
+				if (err == EACCES) {
+					txt->pt_state = PLIST_TXT_STATE_ERROR;
+					return err;
 				}
-				if (cp[0] == '"') {
-					int cplen;
-
-					/* have a string */
-					cplen = cp - chunk.pc_cp;
-					err = plist_format_new(
-						&ptmp, "%.*s",
-						cplen, chunk.pc_cp);
+				if (err == 0) {
+					sp = chunk.pc_cp;
+					chunk.pc_cp = cp;
+					err = _plist_txt_data(txt, sax, arg, sp, sz);
 					if (err != 0) {
-						txt->pt_state =
-						    PLIST_TXT_STATE_ERROR;
-						return err;
+						goto stop;
 					}
-					_plist_txt_next(txt, ptmp);
-					chunk.pc_cp = &cp[1];
-					goto nextstate;
+					NEXTSTATE();
 				}
+				err = 0;
+			}
+			txt->pt_datacnt = 0;
+			txt->pt_bufoff = 0;
+			txt->pt_state = PLIST_TXT_STATE_DATA;
+			NEXTSTATE();
+
+		case CC_QUOTE:
+		DISPATCH(sc_quote)
+			cp = ++chunk.pc_cp;
+			/* eat until another '"' or an escape */
+			while (cp != chunk.pc_ep &&
+			       (CCLASS(cp[0]) & CC_F_STOP) == 0) {
 				cp++;
 			}
+			if (cp == chunk.pc_ep || cp[0] == '\\') {
+				/* have a string fragment or an escape */
+				txt->pt_bufoff = 0;
+				err = _plist_txt_buf(txt, cp - chunk.pc_cp);
+				if (err != 0) {
+					txt->pt_state = PLIST_TXT_STATE_ERROR;
+					return err;
+				}
+				txt->pt_state = PLIST_TXT_STATE_STRING;
+				NEXTSTATE();
+			}
 
-			/* not reached */
-			break;
+			/* have a string or a dictionary key */
+			sp = chunk.pc_cp;
+			chunk.pc_cp = &cp[1];
+			err = _plist_txt_string(txt, sax, arg, sp, cp - sp);
+			if (err != 0) {
+				goto stop;
+			}
+			NEXTSTATE();
 
-		case '-':
-		case '0' ... '9':
+		case CC_NUMBER:
+		DISPATCH(sc_number)
 			cp = chunk.pc_cp;
 			if (cp[0] == '-') {
 				cp++;
@@ -437,9 +1828,9 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 						return err;
 					}
 					txt->pt_state = PLIST_TXT_STATE_NUMBER;
-					goto nextstate;
+					NEXTSTATE();
 				}
-				if (isdigit(cp[0])) {
+				if (CCLASS(cp[0]) & CC_F_DIGIT) {
 					cp++;
 					continue;
 				}
@@ -455,7 +1846,7 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 						return err;
 					}
 					txt->pt_state = PLIST_TXT_STATE_DOUBLE;
-					goto nextstate;
+					NEXTSTATE();
 				}
 
 				/* try to parse this number */
@@ -465,22 +1856,20 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 					return EINVAL;
 				}
 
-				err = plist_integer_new(&ptmp, ll);
+				chunk.pc_cp = cp;
+				err = _plist_txt_integer(txt, sax, arg, ll);
 				if (err != 0) {
-					txt->pt_state = PLIST_TXT_STATE_ERROR;
-					return err;
+					goto stop;
 				}
-				_plist_txt_next(txt, ptmp);
-				chunk.pc_cp = cp;
-				goto nextstate;
+				NEXTSTATE();
 			}
 
 			/* not reached */
 			break;
 
-		case 'T':
-		case 't':
-			if (chunk.pc_ep - chunk.pc_cp < strlen("rue")) {
+		case CC_TRUE:
+		DISPATCH(sc_true)
+			if ((size_t) (chunk.pc_ep - chunk.pc_cp) < strlen("true")) {
 				/* don't have enough chars */
 				txt->pt_bufoff = 0;
 				err = _plist_txt_buf(txt, sizeof("true"));
@@ -489,7 +1878,7 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 					return err;
 				}
 				txt->pt_state = PLIST_TXT_STATE_TRUE;
-				goto nextstate;
+				NEXTSTATE();
 			}
 			/* check the next sequence */
 			if ((tolower(chunk.pc_cp[1]) != 'r') ||
@@ -500,18 +1889,17 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				return EINVAL;
 			}
 
-			err = plist_boolean_new(&ptmp, true);
+			chunk.pc_cp += 4;
+			err = _plist_txt_boolean(txt, sax, arg, true);
 			if (err != 0) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return err;
+				goto stop;
 			}
-			_plist_txt_next(txt, ptmp);
-			chunk.pc_cp += 4;
-			goto nextstate;
+			NEXTSTATE();
 
-		case 'F':
-		case 'f':
-			if (chunk.pc_ep - chunk.pc_cp < strlen("alse")) {
+		case CC_FALSE:
+		DISPATCH(sc_false)
+			if ((size_t) (chunk.pc_ep - chunk.pc_cp) <
+			    strlen("false")) {
 				/* don't have enough chars */
 				txt->pt_bufoff = 0;
 				err = _plist_txt_buf(txt, sizeof("false"));
@@ -520,7 +1908,7 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 					return err;
 				}
 				txt->pt_state = PLIST_TXT_STATE_FALSE;
-				goto nextstate;
+				NEXTSTATE();
 			}
 			/* check the next sequence */
 			if ((tolower(chunk.pc_cp[1]) != 'a') ||
@@ -532,23 +1920,16 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				return EINVAL;
 			}
 
-			err = plist_boolean_new(&ptmp, false);
-			if (err != 0) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return err;
-			}
-			_plist_txt_next(txt, ptmp);
 			chunk.pc_cp += 5;
-			goto nextstate;
-
-		case '\0':
-			if (txt->pt_top != NULL && txt->pt_depth == 0) {
-				txt->pt_state = PLIST_TXT_STATE_DONE;
-				return 0;
+			err = _plist_txt_boolean(txt, sax, arg, false);
+			if (err != 0) {
+				goto stop;
 			}
-			break;
+			NEXTSTATE();
 
+		case CC_INVALID:
 		default:
+		DISPATCH(sc_invalid)
 			break;
 		}
 
@@ -557,6 +1938,7 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 		return EINVAL;
 
 	case PLIST_TXT_STATE_DATA:
+	DISPATCH(st_data)
 		bp = txt->pt_buf;
 		for (;;) {
 			if (chunk.pc_cp == chunk.pc_ep) {
@@ -566,7 +1948,7 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				/* switch to date parse */
 				chunk.pc_cp++;
 				txt->pt_state = PLIST_TXT_STATE_DATE;
-				goto nextstate;
+				NEXTSTATE();
 			}
 			if (txt->pt_bufoff == txt->pt_bufsz) {
 				err = _plist_txt_buf(txt, CHUNK_EXTENDSZ);
@@ -576,7 +1958,7 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				}
 				bp = txt->pt_buf;
 			}
-			if (isblank(chunk.pc_cp[0]) == true) {
+			if (CCLASS(chunk.pc_cp[0]) & CC_F_SPACE) {
 				chunk.pc_cp++;
 				continue;
 			}
@@ -585,35 +1967,34 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				chunk.pc_cp++;
 				break;
 			}
-
-#define tohex(_c)  (isdigit(_c) ? (_c) - '0' : tolower(_c)  - 'a' + 10)
+			if (!ISHEX(chunk.pc_cp[0])) {
+				txt->pt_state = PLIST_TXT_STATE_ERROR;
+				return EACCES;
+			}
 
 			if ((txt->pt_datacnt % 2) == 0) {
 				bp[txt->pt_bufoff] =
-				    tohex(chunk.pc_cp[0]) << 4;
+				    TOHEX(chunk.pc_cp[0]) << 4;
 				txt->pt_datacnt++;
 				chunk.pc_cp++;
 				continue;
 			}
-			bp[txt->pt_bufoff] |= tohex(chunk.pc_cp[0]);
+			bp[txt->pt_bufoff] |= TOHEX(chunk.pc_cp[0]);
 			txt->pt_datacnt++;
 			txt->pt_bufoff++;
 			chunk.pc_cp++;
-
-#undef tohex
 		}
 
 		/* insert a data buffer */
-		err = plist_data_new(&ptmp, bp,
-				     txt->pt_datacnt/2 + txt->pt_datacnt%2);
+		err = _plist_txt_data(txt, sax, arg, bp,
+				      txt->pt_datacnt/2 + txt->pt_datacnt%2);
 		if (err != 0) {
-			txt->pt_state = PLIST_TXT_STATE_ERROR;
-			return err;
+			goto stop;
 		}
-		_plist_txt_next(txt, ptmp);
-		goto nextstate;
+		NEXTSTATE();
 
 	case PLIST_TXT_STATE_DATE:
+	DISPATCH(st_date)
 		/* pull the date string in the buffer */
 		bp = txt->pt_buf;
 		for (;;) {
@@ -641,43 +2022,35 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 
 		/* insert a date string */
 		struct tm tm;
+		memset(&tm, 0, sizeof(tm));
 		cp = strptime(bp, "%Y-%m-%d %H:%M:%S %z", &tm);
 		if (cp == NULL) {
 			/* conversion failed */
 			txt->pt_state = PLIST_TXT_STATE_ERROR;
 			return EINVAL;
 		}
-		err = plist_date_new(&ptmp, &tm);
+		err = _plist_txt_date(txt, sax, arg, &tm);
 		if (err != 0) {
-			txt->pt_state = PLIST_TXT_STATE_ERROR;
-			return err;
+			goto stop;
 		}
-		_plist_txt_next(txt, ptmp);
-		goto nextstate;
+		NEXTSTATE();
 
 		
 	case PLIST_TXT_STATE_STRING:
+	DISPATCH(st_string)
 		/* escape the string into the buffer */
-		bp = txt->pt_buf;
 		for (;;) {
 			if (chunk.pc_cp == chunk.pc_ep) {
 				return 0;
 			}
-			if (txt->pt_bufoff == txt->pt_bufsz) {
-				err = _plist_txt_buf(txt, CHUNK_EXTENDSZ);
+			if (txt->pt_escape) {
+				err = _plist_txt_buf(txt, 1);
 				if (err != 0) {
 					txt->pt_state = PLIST_TXT_STATE_ERROR;
 					return err;
 				}
 				bp = txt->pt_buf;
-			}
-			if (txt->pt_escape) {
 				switch (chunk.pc_cp[0]) {
-				case '\\':
-				case '/':
-				case '"':
-					bp[txt->pt_bufoff] = chunk.pc_cp[0];
-					break;
 				case 'b':
 					bp[txt->pt_bufoff] = '\b';
 					break;
@@ -693,38 +2066,59 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				case 'r':
 					bp[txt->pt_bufoff] = '\r';
 					break;
+				case '\\':
+				case '/':
+				case '"':
+				default:
+					bp[txt->pt_bufoff] = chunk.pc_cp[0];
+					break;
 				}
 				txt->pt_bufoff++;
 				chunk.pc_cp++;
 				txt->pt_escape = false;
 				continue;
 			}
+
+			/* copy the run of plain characters in one go */
+			for (cp = chunk.pc_cp; cp != chunk.pc_ep; cp++) {
+				if (CCLASS(cp[0]) & CC_F_STOP) {
+					break;
+				}
+			}
+			err = _plist_txt_buf(txt, (cp - chunk.pc_cp) + 1);
+			if (err != 0) {
+				txt->pt_state = PLIST_TXT_STATE_ERROR;
+				return err;
+			}
+			bp = txt->pt_buf;
+			memcpy(&bp[txt->pt_bufoff], chunk.pc_cp, cp - chunk.pc_cp);
+			txt->pt_bufoff += cp - chunk.pc_cp;
+			chunk.pc_cp = cp;
+
+			if (chunk.pc_cp == chunk.pc_ep) {
+				return 0;
+			}
 			if (chunk.pc_cp[0] == '\\') {
 				txt->pt_escape = true;
 				chunk.pc_cp++;
 				continue;
 			}
-			if (chunk.pc_cp[0] == '"') {
-				bp[txt->pt_bufoff] = '\0';
-				chunk.pc_cp++;
-				break;
-			}
 
-			bp[txt->pt_bufoff] = chunk.pc_cp[0];
-			txt->pt_bufoff++;
+			/* closing quote */
+			bp[txt->pt_bufoff] = '\0';
 			chunk.pc_cp++;
+			break;
 		}
 
 		/* insert an escaped string */
-		err = plist_string_new(&ptmp, bp);
+		err = _plist_txt_string(txt, sax, arg, bp, txt->pt_bufoff);
 		if (err != 0) {
-			txt->pt_state = PLIST_TXT_STATE_ERROR;
-			return err;
+			goto stop;
 		}
-		_plist_txt_next(txt, ptmp);
-		goto nextstate;
+		NEXTSTATE();
 
 	case PLIST_TXT_STATE_NUMBER:
+	DISPATCH(st_number)
 		bp = txt->pt_buf;
 		for (;;) {
 			char *ep;
@@ -746,10 +2140,10 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 			    chunk.pc_cp[0] == 'e' || chunk.pc_cp[0] == 'E') {
 				/* switch to a real number */
 				txt->pt_state = PLIST_TXT_STATE_DOUBLE;
-				goto nextstate;
+				NEXTSTATE();
 			}
 
-			if (isdigit(chunk.pc_cp[0])) {
+			if (CCLASS(chunk.pc_cp[0]) & CC_F_DIGIT) {
 				bp[txt->pt_bufoff] = chunk.pc_cp[0];
 				txt->pt_bufoff++;
 				chunk.pc_cp++;
@@ -770,19 +2164,18 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				return EINVAL;
 			}
 
-			err = plist_integer_new(&ptmp, ll);
+			err = _plist_txt_integer(txt, sax, arg, ll);
 			if (err != 0) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return err;
+				goto stop;
 			}
-			_plist_txt_next(txt, ptmp);
-			goto nextstate;
+			NEXTSTATE();
 		}
 
 		/* notreached */
 		break;
 
 	case PLIST_TXT_STATE_DOUBLE:
+	DISPATCH(st_double)
 		bp = txt->pt_buf;
 		for (;;) {
 			char *ep;
@@ -800,10 +2193,7 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				bp = txt->pt_buf;
 			}
 
-			if (chunk.pc_cp[0] == '.' ||
-			    chunk.pc_cp[0] == 'e' || chunk.pc_cp[0] == 'E' ||
-			    chunk.pc_cp[0] == '+' || chunk.pc_cp[0] == '-' ||
-			    isdigit(chunk.pc_cp[0])) {
+			if (CCLASS(chunk.pc_cp[0]) & CC_F_REAL) {
 				bp[txt->pt_bufoff] = chunk.pc_cp[0];
 				txt->pt_bufoff++;
 				chunk.pc_cp++;
@@ -818,19 +2208,18 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 				return EINVAL;
 			}
 
-			err = plist_real_new(&ptmp, d);
+			err = _plist_txt_real(txt, sax, arg, d);
 			if (err != 0) {
-				txt->pt_state = PLIST_TXT_STATE_ERROR;
-				return err;
+				goto stop;
 			}
-			_plist_txt_next(txt, ptmp);
-			goto nextstate;
+			NEXTSTATE();
 		}
 
 		/* notreached */
 		break;
 
 	case PLIST_TXT_STATE_TRUE:
+	DISPATCH(st_true)
 		assert(strlen("true") < txt->pt_bufsz);
 		assert(txt->pt_bufoff < txt->pt_bufsz);
 
@@ -853,15 +2242,14 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 			return EINVAL;
 		}
 
-		err = plist_boolean_new(&ptmp, true);
+		err = _plist_txt_boolean(txt, sax, arg, true);
 		if (err != 0) {
-			txt->pt_state = PLIST_TXT_STATE_ERROR;
-			return err;
+			goto stop;
 		}
-		_plist_txt_next(txt, ptmp);
-		goto nextstate;
+		NEXTSTATE();
 
 	case PLIST_TXT_STATE_FALSE:
+	DISPATCH(st_false)
 		assert(strlen("false") < txt->pt_bufsz);
 		assert(txt->pt_bufoff < txt->pt_bufsz);
 
@@ -885,20 +2273,302 @@ plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
 			return EINVAL;
 		}
 
-		err = plist_boolean_new(&ptmp, false);
+		err = _plist_txt_boolean(txt, sax, arg, false);
 		if (err != 0) {
-			txt->pt_state = PLIST_TXT_STATE_ERROR;
-			return err;
+			goto stop;
+		}
+		NEXTSTATE();
+
+	case PLIST_TXT_STATE_SKIP:
+	DISPATCH(st_skip)
+		/* the end of the entry at the same level as the key */
+		cp = chunk.pc_cp;
+		for (;;) {
+			if (cp == chunk.pc_ep) {
+				return 0;
+			}
+			if (txt->pt_escape) {
+				txt->pt_escape = false;
+				cp++;
+				continue;
+			}
+			if (txt->pt_skipstr) {
+				while (cp != chunk.pc_ep &&
+				       (CCLASS(cp[0]) & CC_F_STOP) == 0) {
+					cp++;
+				}
+				if (cp == chunk.pc_ep) {
+					return 0;
+				}
+				if (cp[0] == '\\') {
+					txt->pt_escape = true;
+				} else {
+					txt->pt_skipstr = false;
+				}
+				cp++;
+				continue;
+			}
+
+			while (cp != chunk.pc_ep &&
+			       ((CC_SKIPSET >> (CCLASS(cp[0]) & CC_MASK)) & 1) ==
+			       0) {
+				cp++;
+			}
+			if (cp == chunk.pc_ep) {
+				return 0;
+			}
+			cc = CCLASS(cp[0]) & CC_MASK;
+			if (cc == CC_QUOTE) {
+				txt->pt_skipstr = true;
+				cp++;
+				continue;
+			}
+			if (cc == CC_LBRACE || cc == CC_LPAREN) {
+				txt->pt_skipdepth++;
+				cp++;
+				continue;
+			}
+			if (txt->pt_skipdepth > 0) {
+				if (cc != CC_SEMI) {
+					txt->pt_skipdepth--;
+				}
+				cp++;
+				continue;
+			}
+
+			/* the close of the dictionary is left for the scan */
+			if (cc == CC_SEMI) {
+				cp++;
+			}
+			break;
 		}
-		_plist_txt_next(txt, ptmp);
-		goto nextstate;
+		chunk.pc_cp = cp;
+		txt->pt_state = PLIST_TXT_STATE_SCAN;
+		NEXTSTATE();
 
 	default:
 	case PLIST_TXT_STATE_ERROR:
+	DISPATCH(st_error)
 		return EACCES;
 	}
 
 	return EAGAIN;
+
+ stop:
+	if (err == PLIST_TXT_SUSPEND && sax == &plist_txt_pull) {
+		/* the element was taken, remember where to pick up */
+		txt->pt_cp = chunk.pc_cp;
+		return err;
+	}
+	if (err < 0) {
+		/* not an error number the caller can report */
+		err = EINVAL;
+	}
+	txt->pt_state = PLIST_TXT_STATE_ERROR;
+	return err;
+}
+
+#undef DISPATCH
+#undef NEXTSTATE
+
+
+int
+plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz)
+{
+	int err;
+
+	if (!txt || !buf) {
+		return EINVAL;
+	}
+	err = _plist_txt_run(txt, &plist_txt_tree_sax, txt, buf, sz);
+	_plist_txt_idle(txt);
+	return err;
+}
+
+
+int
+plist_txt_parse_borrowed(plist_txt_t *txt, void *buf, size_t sz)
+{
+	int err;
+
+	if (!txt || !buf) {
+		return EINVAL;
+	}
+	txt->pt_borrow = true;
+	err = _plist_txt_run(txt, &plist_txt_tree_sax, txt, buf, sz);
+	txt->pt_borrow = false;
+	_plist_txt_idle(txt);
+	return err;
+}
+
+
+int
+plist_txt_parse_next(plist_txt_t *txt, const void *buf, size_t sz,
+		     size_t *usedp)
+{
+	int err;
+
+	if (!txt || (!buf && sz != 0) || !usedp) {
+		return EINVAL;
+	}
+	*usedp = 0;
+	if (txt->pt_state == PLIST_TXT_STATE_DONE) {
+		/* the last document has not been collected */
+		return 0;
+	}
+
+	txt->pt_tail = NULL;
+	err = _plist_txt_run(txt, &plist_txt_tree_sax, txt, buf, sz);
+	_plist_txt_idle(txt);
+	if (err != 0) {
+		return err;
+	}
+	if (txt->pt_state != PLIST_TXT_STATE_DONE) {
+		*usedp = sz;
+		return EAGAIN;
+	}
+
+	/* every completed document passes through the done state */
+	assert(txt->pt_tail != NULL);
+	*usedp = txt->pt_tail - (const char *) buf;
+	return 0;
+}
+
+
+int
+plist_txt_sax_parse(plist_txt_t *txt, const plist_txt_sax_t *sax, void *arg,
+		    const void *buf, size_t sz)
+{
+	int err;
+
+	if (!txt || !sax || !buf) {
+		return EINVAL;
+	}
+	err = _plist_txt_run(txt, sax, arg, buf, sz);
+	_plist_txt_idle(txt);
+	return err;
+}
+
+
+int
+plist_txt_feed(plist_txt_t *txt, const void *buf, size_t sz)
+{
+	if (!txt || (!buf && sz != 0)) {
+		return EINVAL;
+	}
+	if (txt->pt_cp != txt->pt_ep) {
+		return EBUSY;
+	}
+	txt->pt_cp = buf;
+	txt->pt_ep = &txt->pt_cp[sz];
+	return 0;
+}
+
+
+int
+plist_txt_next_token(plist_txt_t *txt, plist_txt_token_t *tok)
+{
+	int err;
+	const char *bp;
+
+	if (!txt || !tok) {
+		return EINVAL;
+	}
+	tok->ptk_type = PLIST_TXT_TOK_NONE;
+	tok->ptk_ptr = NULL;
+	tok->ptk_len = 0;
+	tok->ptk_copied = false;
+	if (txt->pt_state == PLIST_TXT_STATE_DONE) {
+		return ENOENT;
+	}
+	/* the previous token was the last use of the buffer */
+	_plist_txt_idle(txt);
+
+	err = _plist_txt_run(txt, &plist_txt_pull, tok,
+			     txt->pt_cp, txt->pt_ep - txt->pt_cp);
+	if (err == PLIST_TXT_SUSPEND) {
+		bp = txt->pt_buf;
+		tok->ptk_copied = (tok->ptk_ptr != NULL &&
+				   (const char *) tok->ptk_ptr >= bp &&
+				   (const char *) tok->ptk_ptr <
+				   &bp[txt->pt_bufsz]);
+		return 0;
+	}
+	if (err != 0) {
+		return err;
+	}
+
+	/* the whole fragment went into the context */
+	txt->pt_cp = txt->pt_ep;
+	return EAGAIN;
+}
+
+
+/**
+ * Reset the parse state while holding on to the intermediate buffer,
+ * trimmed back to the high-water mark, the buffer sizing policy, the
+ * nesting stack, and the parser options.
+ */
+static void
+_plist_txt_reset(plist_txt_t *txt)
+{
+	while (txt->pt_nkeysets > 0) {
+		_plist_keyset_pop(txt);
+	}
+
+	if (txt->pt_pool != NULL) {
+		/* compact mode holds nothing between documents */
+		txt->pt_state = PLIST_TXT_STATE_SCAN;
+		_plist_txt_idle(txt);
+		free(txt->pt_keysets);
+		txt->pt_keysets = NULL;
+		txt->pt_maxkeysets = 0;
+		free(txt->pt_stack);
+		txt->pt_stack = NULL;
+		txt->pt_stackmax = 0;
+		free(txt->pt_pathstack);
+		txt->pt_pathstack = NULL;
+		txt->pt_pathmax = 0;
+	} else if (txt->pt_bufsz > txt->pt_bufmax) {
+		void *ptr;
+
+		if (txt->pt_bufmax == 0) {
+			free(txt->pt_buf);
+			txt->pt_buf = NULL;
+			txt->pt_bufsz = 0;
+		} else if ((ptr = realloc(txt->pt_buf,
+					  txt->pt_bufmax)) != NULL) {
+			/* a failed shrink just keeps the larger buffer */
+			txt->pt_buf = ptr;
+			txt->pt_bufsz = txt->pt_bufmax;
+		}
+	}
+
+	txt->pt_state = PLIST_TXT_STATE_SCAN;
+	txt->pt_depth = 0;
+	txt->pt_top = NULL;
+	txt->pt_cur = NULL;
+	txt->pt_escape = false;
+	txt->pt_datacnt = 0;
+	txt->pt_bufoff = 0;
+	txt->pt_cp = NULL;
+	txt->pt_ep = NULL;
+	txt->pt_tail = NULL;
+	txt->pt_skipdepth = 0;
+	txt->pt_skipstr = false;
+	return;
+}
+
+
+void
+plist_txt_reset(plist_txt_t *txt)
+{
+	if (!txt) {
+		return;
+	}
+	plist_free(txt->pt_top);
+	_plist_txt_reset(txt);
+	return;
 }
 
 
@@ -913,12 +2583,7 @@ plist_txt_result(plist_txt_t *txt, plist_t **plistpp)
 	}
 	pstate = txt->pt_state;
 	ptmp = txt->pt_top;
-	if (txt->pt_buf != NULL) {
-		free(txt->pt_buf);
-	}
-
-	memset(txt, 0, sizeof(*txt));
-	txt->pt_state = PLIST_TXT_STATE_SCAN;
+	_plist_txt_reset(txt);
 
 	/* return a result if the parser completed */
 	if (pstate == PLIST_TXT_STATE_DONE) {
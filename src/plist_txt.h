@@ -53,6 +53,11 @@
 
 /* forward declare */
 typedef struct plist_txt_s plist_txt_t;
+typedef struct plist_keyset_s plist_keyset_t;
+typedef struct plist_txt_sax_s plist_txt_sax_t;
+typedef struct plist_txt_token_s plist_txt_token_t;
+typedef struct plist_txt_pool_s plist_txt_pool_t;
+typedef struct plist_txt_paths_s plist_txt_paths_t;
 
 enum plist_txt_state_e {
 	PLIST_TXT_STATE_ERROR = 0,
@@ -66,6 +71,7 @@ enum plist_txt_state_e {
 	PLIST_TXT_STATE_DOUBLE,
 	PLIST_TXT_STATE_TRUE,
 	PLIST_TXT_STATE_FALSE,
+	PLIST_TXT_STATE_SKIP,
 };
 
 /**
@@ -74,7 +80,11 @@ enum plist_txt_state_e {
  */
 struct plist_txt_s {
 	enum plist_txt_state_e pt_state;
+
+	/* container nesting of the input */
 	int pt_depth;
+	int pt_stackmax;
+	uint8_t *pt_stack;
 
 	/* plist storage objects */
 	plist_t *pt_top;
@@ -84,17 +94,128 @@ struct plist_txt_s {
 	bool pt_escape;
 
 	/* offset for data conversion */
-	off_t pt_datacnt;
+	size_t pt_datacnt;
 
 	/* buffer used for intermediate data */
-	off_t pt_bufoff;
+	size_t pt_bufoff;
 	size_t pt_bufsz;
 	void *pt_buf;
+
+	/* scratch buffer sizing policy kept across results */
+	size_t pt_bufhint;
+	size_t pt_bufmax;
+
+	/* duplicate key detection for each open dictionary */
+	int pt_nkeysets;
+	int pt_maxkeysets;
+	plist_keyset_t *pt_keysets;
+
+	/* parser options from #plist_txt_setflags */
+	int pt_flags;
+
+	/* duplicate key check latched when a document starts */
+	bool pt_dupcheck;
+
+	/* input fragment that is pulled by #plist_txt_next_token */
+	const char *pt_cp;
+	const char *pt_ep;
+
+	/* values may refer to the input from #plist_txt_parse_borrowed */
+	bool pt_borrow;
+
+	/* first input character after the completed document */
+	const char *pt_tail;
+
+	/* shared scratch buffers from #plist_txt_setpool */
+	plist_txt_pool_t *pt_pool;
+
+	/* key paths from #plist_txt_setpaths and the match at each level */
+	const plist_txt_paths_t *pt_paths;
+	int pt_pathmax;
+	int *pt_pathstack;
+
+	/* nesting and string state of a value that is being skipped */
+	int pt_skipdepth;
+	bool pt_skipstr;
 };
 
+/* parser option flags */
+#define PLIST_TXT_NODUPCHECK  0x0001 /* trust input to have unique keys */
+
+/**
+ * Event callbacks for parsing without building a plist object. Each
+ * callback returns zero to continue or an error number that stops the
+ * parse and is returned to the caller; a negative return is reported as
+ * EINVAL. Any callback may be left null to
+ * ignore that element.
+ *
+ * Strings, keys, and data point either into the input fragment or into
+ * the context buffer and are only valid for the duration of the call.
+ * Strings and keys are not null terminated.
+ */
+struct plist_txt_sax_s {
+	int (*psx_begin_dict)(void *arg);
+	int (*psx_end_dict)(void *arg);
+	int (*psx_key)(void *arg, const char *name, size_t len);
+	int (*psx_begin_array)(void *arg);
+	int (*psx_end_array)(void *arg);
+	int (*psx_string)(void *arg, const char *s, size_t len);
+	int (*psx_integer)(void *arg, long long num);
+	int (*psx_real)(void *arg, double num);
+	int (*psx_boolean)(void *arg, bool flag);
+	int (*psx_data)(void *arg, const void *buf, size_t sz);
+	int (*psx_date)(void *arg, const struct tm *tm);
+};
+
+enum plist_txt_tok_e {
+	PLIST_TXT_TOK_NONE = 0,
+	PLIST_TXT_TOK_BEGIN_DICT,
+	PLIST_TXT_TOK_END_DICT,
+	PLIST_TXT_TOK_KEY,
+	PLIST_TXT_TOK_BEGIN_ARRAY,
+	PLIST_TXT_TOK_END_ARRAY,
+	PLIST_TXT_TOK_STRING,
+	PLIST_TXT_TOK_INTEGER,
+	PLIST_TXT_TOK_REAL,
+	PLIST_TXT_TOK_BOOLEAN,
+	PLIST_TXT_TOK_DATA,
+	PLIST_TXT_TOK_DATE,
+};
+
+/**
+ * Token returned by #plist_txt_next_token. Keys, strings, and data are
+ * a view of ptk_len bytes at ptk_ptr rather than a copy. The view points
+ * into the fed fragment unless ptk_copied is set, in which case the
+ * value spanned fragments, had escapes, or was decoded and it points
+ * into the context buffer. Either way it is only valid until the next
+ * call on the context. Only the field matching ptk_type is set.
+ */
+struct plist_txt_token_s {
+	enum plist_txt_tok_e ptk_type;
+
+	const void *ptk_ptr;
+	size_t ptk_len;
+	bool ptk_copied;
+
+	long long ptk_integer;
+	double ptk_real;
+	bool ptk_boolean;
+	struct tm ptk_date;
+};
+
+/* default high-water mark for the scratch buffer between results */
+#define PLIST_TXT_BUFMAX  (64 * 1024)
+
 
 __BEGIN_DECLS
 
+/**
+ * Event sink that builds the plist object of a text context, for other
+ * readers to feed. The argument is the context and the object is left
+ * in pt_top when the top level element is closed.
+ */
+extern const plist_txt_sax_t plist_txt_tree_sax;
+
 /**
  * Create a text parsing context that can be used for incremental
  * string parsing of the character objects
@@ -111,10 +232,127 @@ int plist_txt_new(plist_txt_t **txtpp);
  */
 void plist_txt_free(plist_txt_t *txt);
 
+/**
+ * Provide a size hint for the intermediate buffer used to assemble
+ * strings, data, and numbers that span input fragments. The buffer is
+ * grown to the hint immediately and any later growth jumps straight
+ * to at least the hint.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ * @param  sz   expected size of the largest value in the input
+ * @return zero on success or an error value
+ */
+int plist_txt_reserve(plist_txt_t *txt, size_t sz);
+
+/**
+ * Set the high-water mark for the intermediate buffer. The buffer is
+ * kept when #plist_txt_result resets the context, but one that grew
+ * beyond this size is shrunk back to it. A zero size releases the
+ * buffer on every reset.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ * @param  sz   largest buffer size to keep between results
+ */
+void plist_txt_set_highwater(plist_txt_t *txt, size_t sz);
+
+/**
+ * Create a pool of scratch buffers to share between many parsing
+ * contexts, see #plist_txt_setpool. The pool can be used by contexts
+ * in different threads at the same time.
+ *
+ * @param  poolpp   result pool
+ * @param  bufsz    size of each pooled buffer
+ * @param  maxbufs  most idle buffers to keep for reuse
+ * @return zero on success or an error value
+ */
+int plist_txt_pool_new(plist_txt_pool_t **poolpp, size_t bufsz, int maxbufs);
+
+/**
+ * Free a pool of scratch buffers. Every context using the pool has to
+ * be freed or detached from it first.
+ *
+ * @param  pool  pool that was allocated with #plist_txt_pool_new
+ */
+void plist_txt_pool_free(plist_txt_pool_t *pool);
+
+/**
+ * Switch a context to compact mode with scratch buffers from a shared
+ * pool. The context only holds a buffer while a value spans input
+ * fragments and gives it back at the end of each parse call, and the
+ * nesting arrays are released between documents, so an idle context
+ * costs little more than the context itself. A token from
+ * #plist_txt_next_token that was copied keeps the buffer until the
+ * next parse call. A NULL pool goes back to a private buffer.
+ *
+ * Everything else that a context only needs for an option, the key
+ * sets, the path matches and the nesting stack, is allocated when it
+ * is first used, so the fixed part is the structure alone. A context
+ * that is in the middle of a document adds at most one pool buffer and
+ * one nesting entry per open container, and also holds the part of the
+ * tree built so far. That is not kept in a shared arena: the nodes are
+ * separate heap allocations, so a result can be freed with #plist_free
+ * without reference to the pool, and that partial tree is most of what
+ * a busy context costs.
+ *
+ * @param  txt   context that was allocated with #plist_txt_new
+ * @param  pool  pool that was allocated with #plist_txt_pool_new
+ */
+void plist_txt_setpool(plist_txt_t *txt, plist_txt_pool_t *pool);
+
+/**
+ * Compile a set of key paths for #plist_txt_setpaths. A path is the
+ * dictionary keys from the top level down separated by '/', such as
+ * "header/version", so a key with a '/' in it cannot be selected. The
+ * paths are copied and the set can be shared by any number of contexts.
+ *
+ * @param  pathspp  result set of paths
+ * @param  paths    array of null terminated key paths
+ * @param  npaths   number of paths in the array
+ * @return zero on success, EINVAL for an empty key in a path, or an error
+ */
+int plist_txt_paths_new(plist_txt_paths_t **pathspp,
+			const char *const *paths, int npaths);
+
+/**
+ * Free a set of key paths that is no longer used by any context
+ * @param  paths  set that was allocated with #plist_txt_paths_new
+ */
+void plist_txt_paths_free(plist_txt_paths_t *paths);
+
+/**
+ * Only build the parts of a document that are on a set of key paths.
+ * A dictionary entry is kept when its key path leads to one of the
+ * paths or is inside one, and the elements of a kept array share the
+ * path of the array. The value of any other entry is passed over by
+ * matching quotes and brackets without being parsed, so neither the
+ * syntax inside it nor the key for a duplicate is checked, and the
+ * event callbacks never see it. Set the paths between documents. The
+ * paths are kept when #plist_txt_result resets the context and a NULL
+ * set parses whole documents again.
+ *
+ * @param  txt    context that was allocated with #plist_txt_new
+ * @param  paths  set that was allocated with #plist_txt_paths_new
+ */
+void plist_txt_setpaths(plist_txt_t *txt, const plist_txt_paths_t *paths);
+
+/**
+ * Set the parser option flags. The flags are kept when #plist_txt_result
+ * resets the context and take effect at the start of the next document,
+ * so changing them in the middle of a document has no effect on it.
+ *
+ * PLIST_TXT_NODUPCHECK skips the check for a key that is repeated in a
+ * dictionary, which is only safe for input that is known to be valid.
+ *
+ * @param  txt    context that was allocated with #plist_txt_new
+ * @param  flags  bitwise or of the PLIST_TXT option flags
+ */
+void plist_txt_setflags(plist_txt_t *txt, int flags);
+
 /**
  * Variant of the parse string fragment using the allocated context.
  * This is similar to #plist_txt_parse but does not require a
- * null terminated string.
+ * null terminated string. Any input after a completed document is
+ * ignored, see #plist_txt_parse_next for a stream of documents.
  *
  * @param  txt  context that was allocated with #plist_txt_new
  * @param  buf  pointer to a character array
@@ -123,6 +361,142 @@ void plist_txt_free(plist_txt_t *txt);
  */
 int plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz);
 
+/**
+ * Parse a fragment without copying the strings, keys and data that are
+ * complete in it. The elements refer to the fragment instead, which is
+ * why the fragment is not const: it is modified in place. The closing
+ * quote of each of those strings is replaced with a null and data is
+ * decoded over its own hex digits, so afterwards the fragment no longer
+ * holds the original text, even when the parse fails. Values with
+ * escapes or that span fragments are still copied. The fragment has to
+ * outlive the tree, or the tree has to be given its own copies with
+ * #plist_detach_storage.
+ *
+ * The caller passes a buffer it is willing to give up, such as its own
+ * copy of the text. A read only file mapping can not be used, but a
+ * private writable one can, at the price of a copy of every page that
+ * is written. #plist_txt_parse_file never borrows and so never writes
+ * to its mapping.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ * @param  buf  pointer to a writable character array
+ * @param  sz   size of the character array
+ * @return zero on success or an error value
+ */
+int plist_txt_parse_borrowed(plist_txt_t *txt, void *buf, size_t sz);
+
+/**
+ * Parse a fragment of a stream of documents that follow each other
+ * without any framing. Parsing stops as soon as a document completes
+ * and the rest of the fragment is left for the next call, after the
+ * document is collected with #plist_txt_result. The context keeps its
+ * buffers from one document to the next. A top level number is only
+ * complete once the character after it is seen, so the end of the
+ * stream may need a trailing space.
+ *
+ * @param  txt    context that was allocated with #plist_txt_new
+ * @param  buf    pointer to a character array
+ * @param  sz     size of the character array
+ * @param  usedp  result number of characters that were consumed
+ * @return zero when a document is complete, EAGAIN when the whole
+ *         fragment was consumed without completing one, or an error
+ */
+int plist_txt_parse_next(plist_txt_t *txt, const void *buf, size_t sz,
+			 size_t *usedp);
+
+/**
+ * Parse a whole document using several threads. A document that is a
+ * top level array is split between its elements by a quick scan that
+ * skips strings and data, and the pieces are parsed at the same time and
+ * joined in order. Any other document, or one too small to be worth
+ * splitting, is parsed the same way as #plist_txt_parse. The result is
+ * collected with #plist_txt_result.
+ *
+ * @param  txt       context that was allocated with #plist_txt_new and
+ *                   has not been given any input yet
+ * @param  buf       pointer to the whole document
+ * @param  sz        size of the document
+ * @param  nthreads  number of threads, or zero for one per processor
+ * @return zero on success or an error value
+ */
+int plist_txt_parse_parallel(plist_txt_t *txt, const void *buf, size_t sz,
+			     int nthreads);
+
+/**
+ * Parse a document from a file. See #plist_txt_parse_fd.
+ *
+ * @param  txt   context that was allocated with #plist_txt_new
+ * @param  path  name of the file
+ * @return zero on success or an error value
+ */
+int plist_txt_parse_file(plist_txt_t *txt, const char *path);
+
+/**
+ * Parse a document from the current offset of a file descriptor to the
+ * end of the file. A regular file is memory mapped and parsed in large
+ * windows, and the pages behind the parser are released, so the input
+ * never has to fit in memory. Pipes and other descriptors that cannot be
+ * mapped are read in large blocks. The result is collected with
+ * #plist_txt_result, which fails if the input ended before the document
+ * was complete.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ * @param  fd   open file descriptor, which is left open
+ * @return zero on success or an error value
+ */
+int plist_txt_parse_fd(plist_txt_t *txt, int fd);
+
+/**
+ * Parse a string fragment and report the elements to the event
+ * callbacks instead of building a plist object. The fragments are fed
+ * the same way as #plist_txt_parse and the context state reaches
+ * PLIST_TXT_STATE_DONE when the top level element is complete.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ * @param  sax  event callbacks
+ * @param  arg  argument passed to each callback
+ * @param  buf  pointer to a character array
+ * @param  sz   size of the character array
+ * @return zero on success or an error value
+ */
+int plist_txt_sax_parse(plist_txt_t *txt, const plist_txt_sax_t *sax,
+			void *arg, const void *buf, size_t sz);
+
+/**
+ * Hand the next fragment of input to the context for reading with
+ * #plist_txt_next_token. The fragment is not copied and must stay valid
+ * until it has been read through, which is when #plist_txt_next_token
+ * returns EAGAIN.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ * @param  buf  pointer to a character array
+ * @param  sz   size of the character array
+ * @return zero on success, EBUSY if the previous fragment has not been
+ *         read through, or an error value
+ */
+int plist_txt_feed(plist_txt_t *txt, const void *buf, size_t sz);
+
+/**
+ * Pull the next token from the fed input without building a plist
+ * object or allocating per element. Each element is checked against the
+ * nesting the same way as #plist_txt_parse.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ * @param  tok  result token
+ * @return zero with a token, EAGAIN when the fragment is used up and
+ *         more input has to be fed, ENOENT once the top level element
+ *         is complete, or an error value
+ */
+int plist_txt_next_token(plist_txt_t *txt, plist_txt_token_t *tok);
+
+/**
+ * Reset the parse context so that it can be used for another document,
+ * discarding any partial result.
+ *
+ * @param  txt  context that was allocated with #plist_txt_new
+ */
+void plist_txt_reset(plist_txt_t *txt);
+
 /**
  * Retrieve the result object from the parse context. This will also
  * reset the state of the parser so that it can be used to parse
@@ -134,6 +508,29 @@ int plist_txt_parse(plist_txt_t *txt, const void *buf, size_t sz);
  */
 int plist_txt_result(plist_txt_t *txt, plist_t **plistpp);
 
+/**
+ * Write a plist in the text format with one key or array element per
+ * line, in a form that #plist_txt_parse reads back to the same elements.
+ * Dates are written with the <*...> extension and a zero offset.
+ *
+ * @param  plist  element to write
+ * @param  fd     descriptor to write to
+ * @return zero on success, EINVAL for a key without a value, a real
+ *         that is not finite, or a year outside of four digits, or an
+ *         error value from write
+ */
+int plist_txt_write(const plist_t *plist, int fd);
+
+/**
+ * Write a plist in the text format to an allocated buffer
+ *
+ * @param  plist  element to write
+ * @param  bufp   result buffer that the caller frees
+ * @param  szp    result size of the buffer
+ * @return zero on success or an error value as for #plist_txt_write
+ */
+int plist_txt_write_buf(const plist_t *plist, void **bufp, size_t *szp);
+
 __END_DECLS
 
 #endif /* !_PLIST_TXT_H_ */
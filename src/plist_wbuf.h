@@ -0,0 +1,275 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_wbuf.h
+ *
+ * Output buffer shared by the XML, JSON and text writers and not
+ * installed. The writers format straight into a staging buffer that is
+ * flushed to a descriptor when it fills, or into a buffer that grows
+ * and is handed to the caller. The number, date and base64 formatting
+ * that more than one writer needs is kept here as well, so a file that
+ * includes this defines _DEFAULT_SOURCE for timegm and gmtime_r.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_WBUF_H_
+#define _PLIST_WBUF_H_
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+
+#define WBUF_OUTSZ     (64 * 1024)	/* staging buffer for a descriptor */
+#define WBUF_REALSZ    (40)		/* room for a formatted real */
+#define WBUF_INTSZ     (24)		/* room for a formatted integer */
+
+/* forward declare */
+typedef struct plist_wbuf_s plist_wbuf_t;
+
+/**
+ * Output of a writer, either a staging buffer in front of a descriptor
+ * when pw_fd is set or a growing buffer when it is -1
+ */
+struct plist_wbuf_s {
+	int pw_fd;
+	char *pw_out;
+	size_t pw_outsz;
+	size_t pw_fill;
+};
+
+static const char plist_wbuf_b64enc[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+static inline int
+_plist_wbuf_flush(plist_wbuf_t *pw)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < pw->pw_fill; off += n) {
+		n = write(pw->pw_fd, &pw->pw_out[off], pw->pw_fill - off);
+		if (n < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			return errno;
+		}
+	}
+	pw->pw_fill = 0;
+	return 0;
+}
+
+/**
+ * Make room for n bytes of output, which is never more than the
+ * staging buffer when writing to a descriptor
+ */
+static inline int
+_plist_wbuf_room(plist_wbuf_t *pw, size_t n)
+{
+	char *ptr;
+	size_t newsz;
+
+	if (pw->pw_outsz - pw->pw_fill >= n) {
+		return 0;
+	}
+	if (pw->pw_fd >= 0) {
+		return _plist_wbuf_flush(pw);
+	}
+	newsz = (pw->pw_outsz == 0) ? WBUF_OUTSZ : pw->pw_outsz;
+	while (newsz - pw->pw_fill < n) {
+		if (newsz > SIZE_MAX / 2) {
+			return ENOMEM;
+		}
+		newsz *= 2;
+	}
+	ptr = realloc(pw->pw_out, newsz);
+	if (ptr == NULL) {
+		return ENOMEM;
+	}
+	pw->pw_out = ptr;
+	pw->pw_outsz = newsz;
+	return 0;
+}
+
+static inline int
+_plist_wbuf_bytes(plist_wbuf_t *pw, const void *buf, size_t len)
+{
+	int err;
+	size_t n;
+	const char *cp = buf;
+
+	if (pw->pw_fd < 0) {
+		err = _plist_wbuf_room(pw, len);
+		if (err != 0) {
+			return err;
+		}
+	}
+	while (len > 0) {
+		err = _plist_wbuf_room(pw, 1);
+		if (err != 0) {
+			return err;
+		}
+		n = pw->pw_outsz - pw->pw_fill;
+		n = (len < n) ? len : n;
+		memcpy(&pw->pw_out[pw->pw_fill], cp, n);
+		pw->pw_fill += n;
+		cp += n;
+		len -= n;
+	}
+	return 0;
+}
+
+#define WSTR(_pw, _s)  _plist_wbuf_bytes((_pw), (_s), sizeof(_s) - 1)
+
+/**
+ * Set up the staging buffer in front of a descriptor
+ */
+static inline int
+_plist_wbuf_open(plist_wbuf_t *pw, int fd)
+{
+	memset(pw, 0, sizeof(*pw));
+	pw->pw_fd = fd;
+	if (fd < 0) {
+		return 0;
+	}
+	pw->pw_out = malloc(WBUF_OUTSZ);
+	if (pw->pw_out == NULL) {
+		return ENOMEM;
+	}
+	pw->pw_outsz = WBUF_OUTSZ;
+	return 0;
+}
+
+/**
+ * Encode up to three bytes per group of four base64 characters with the
+ * padding for a short last group, returning the end of the output
+ */
+static inline char *
+_plist_wbuf_b64(char *out, const uint8_t *buf, size_t n)
+{
+	size_t i;
+	uint32_t v;
+
+	for (i = 0; i + 3 <= n; i += 3) {
+		v = (buf[i] << 16) | (buf[i + 1] << 8) | buf[i + 2];
+		out[0] = plist_wbuf_b64enc[v >> 18];
+		out[1] = plist_wbuf_b64enc[(v >> 12) & 0x3f];
+		out[2] = plist_wbuf_b64enc[(v >> 6) & 0x3f];
+		out[3] = plist_wbuf_b64enc[v & 0x3f];
+		out += 4;
+	}
+	if (i < n) {
+		v = buf[i] << 16;
+		if (i + 1 < n) {
+			v |= buf[i + 1] << 8;
+		}
+		out[0] = plist_wbuf_b64enc[v >> 18];
+		out[1] = plist_wbuf_b64enc[(v >> 12) & 0x3f];
+		out[2] = (i + 1 < n) ? plist_wbuf_b64enc[(v >> 6) & 0x3f] : '=';
+		out[3] = '=';
+		out += 4;
+	}
+	return out;
+}
+
+/**
+ * Move the fields of a date to UTC. A date parsed from text keeps its
+ * fields local to the offset, which is held in tm_gmtoff.
+ */
+static inline int
+_plist_wbuf_utc(const struct tm *tm, struct tm *utc)
+{
+	time_t t;
+	struct tm tmp = *tm;
+
+	t = timegm(&tmp) - tm->tm_gmtoff;
+	if (gmtime_r(&t, utc) == NULL) {
+		return ERANGE;
+	}
+	return 0;
+}
+
+static inline char *
+_plist_wbuf_2digits(char *cp, int v)
+{
+	*cp++ = '0' + (v / 10) % 10;
+	*cp++ = '0' + v % 10;
+	return cp;
+}
+
+/**
+ * Format an integer backwards from the end of a buffer of WBUF_INTSZ
+ * bytes, returning the first digit
+ */
+static inline char *
+_plist_wbuf_int(char *ep, long long num)
+{
+	unsigned long long u;
+
+	u = (num < 0) ? 0 - (unsigned long long) num : (unsigned long long) num;
+	do {
+		*--ep = '0' + u % 10;
+		u /= 10;
+	} while (u != 0);
+	if (num < 0) {
+		*--ep = '-';
+	}
+	return ep;
+}
+
+/**
+ * Format a finite real into a buffer of WBUF_REALSZ bytes with the
+ * shortest of 15 or 17 digits that reads back to the same value. A
+ * fraction is added when asked for and printf leaves it out, so that a
+ * reader takes the number as a real rather than an integer.
+ */
+static inline int
+_plist_wbuf_real(char *buf, double num, bool point)
+{
+	int n;
+
+	n = snprintf(buf, WBUF_REALSZ, "%.15g", num);
+	if (strtod(buf, NULL) != num) {
+		n = snprintf(buf, WBUF_REALSZ, "%.17g", num);
+	}
+	if (point && strpbrk(buf, ".e") == NULL) {
+		buf[n++] = '.';
+		buf[n++] = '0';
+	}
+	return n;
+}
+
+#endif /* !_PLIST_WBUF_H_ */
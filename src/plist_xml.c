@@ -0,0 +1,1604 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_xml.c
+ *
+ * Reader and writer for XML property lists. The tokenizer is a state
+ * machine over the fed fragments that only knows the markup a property
+ * list uses.
+ * Text and tags are located with memchr and handed on in place when
+ * they are whole inside a fragment, so the scratch buffer is only
+ * touched for values that span fragments or have to be decoded.
+ *
+ * @version $Id$
+ */
+
+#define _DEFAULT_SOURCE /* for gmtime_r and timegm */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "plist_xml.h"
+#include "plist_wbuf.h"
+
+#define XML_STACKSZ    (16)	/* initial nesting stack */
+#define XML_BUFSZ      (256)	/* initial scratch buffer */
+
+#define ISSPACE(_c)  ((_c) == ' ' || (_c) == '\n' || \
+		      (_c) == '\t' || (_c) == '\r')
+
+/* elements of the plist DTD */
+enum plist_xml_elem_e {
+	XML_NONE = 0,
+	XML_PLIST,
+	XML_DICT,
+	XML_ARRAY,
+	XML_KEY,
+	XML_STRING,
+	XML_INTEGER,
+	XML_REAL,
+	XML_TRUE,
+	XML_FALSE,
+	XML_DATE,
+	XML_DATA,
+};
+
+/* base64 alphabet, with zero for characters outside of it */
+#define B64(_c)  (_plist_xml_b64[(unsigned char) (_c)])
+
+static const uint8_t _plist_xml_b64[256] = {
+	['A'] = 1, ['B'] = 2, ['C'] = 3, ['D'] = 4, ['E'] = 5, ['F'] = 6,
+	['G'] = 7, ['H'] = 8, ['I'] = 9, ['J'] = 10, ['K'] = 11, ['L'] = 12,
+	['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16, ['Q'] = 17,
+	['R'] = 18, ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22,
+	['W'] = 23, ['X'] = 24, ['Y'] = 25, ['Z'] = 26,
+	['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30, ['e'] = 31,
+	['f'] = 32, ['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36,
+	['k'] = 37, ['l'] = 38, ['m'] = 39, ['n'] = 40, ['o'] = 41,
+	['p'] = 42, ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46,
+	['u'] = 47, ['v'] = 48, ['w'] = 49, ['x'] = 50, ['y'] = 51,
+	['z'] = 52, ['0'] = 53, ['1'] = 54, ['2'] = 55, ['3'] = 56,
+	['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60, ['8'] = 61,
+	['9'] = 62, ['+'] = 63, ['/'] = 64,
+};
+
+
+static enum plist_xml_elem_e
+_plist_xml_elem(const char *name, size_t len)
+{
+	switch (len) {
+	case 3:
+		if (memcmp(name, "key", 3) == 0) {
+			return XML_KEY;
+		}
+		break;
+	case 4:
+		if (memcmp(name, "dict", 4) == 0) {
+			return XML_DICT;
+		} else if (memcmp(name, "real", 4) == 0) {
+			return XML_REAL;
+		} else if (memcmp(name, "true", 4) == 0) {
+			return XML_TRUE;
+		} else if (memcmp(name, "date", 4) == 0) {
+			return XML_DATE;
+		} else if (memcmp(name, "data", 4) == 0) {
+			return XML_DATA;
+		}
+		break;
+	case 5:
+		if (memcmp(name, "array", 5) == 0) {
+			return XML_ARRAY;
+		} else if (memcmp(name, "false", 5) == 0) {
+			return XML_FALSE;
+		} else if (memcmp(name, "plist", 5) == 0) {
+			return XML_PLIST;
+		}
+		break;
+	case 6:
+		if (memcmp(name, "string", 6) == 0) {
+			return XML_STRING;
+		}
+		break;
+	case 7:
+		if (memcmp(name, "integer", 7) == 0) {
+			return XML_INTEGER;
+		}
+		break;
+	}
+	return XML_NONE;
+}
+
+/**
+ * Append to the text of the current element, always leaving room for
+ * a terminating null.
+ */
+static int
+_plist_xml_append(plist_xml_t *xml, const char *s, size_t len)
+{
+	char *ptr;
+	size_t newsz;
+
+	if (xml->px_textlen + len >= xml->px_bufsz) {
+		newsz = (xml->px_bufsz == 0) ? XML_BUFSZ : xml->px_bufsz;
+		while (xml->px_textlen + len >= newsz) {
+			if (newsz > SIZE_MAX / 2) {
+				return ENOMEM;
+			}
+			newsz *= 2;
+		}
+		ptr = realloc(xml->px_buf, newsz);
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		xml->px_buf = ptr;
+		xml->px_bufsz = newsz;
+	}
+	memcpy(&xml->px_buf[xml->px_textlen], s, len);
+	xml->px_textlen += len;
+	return 0;
+}
+
+/**
+ * Move text that is still in the fragment into the scratch buffer,
+ * before more text is added or the fragment goes away.
+ */
+static int
+_plist_xml_unview(plist_xml_t *xml)
+{
+	const char *view = xml->px_view;
+
+	if (view == NULL) {
+		return 0;
+	}
+	xml->px_view = NULL;
+	return _plist_xml_append(xml, view, xml->px_viewlen);
+}
+
+/**
+ * Decode an entity reference, without the '&' and ';', as UTF-8
+ */
+static int
+_plist_xml_entity(plist_xml_t *xml, const char *ent, size_t len)
+{
+	int base;
+	size_t i;
+	unsigned long cp;
+	char utf[4];
+	size_t n;
+
+	if (len == 2 && memcmp(ent, "lt", 2) == 0) {
+		return _plist_xml_append(xml, "<", 1);
+	} else if (len == 2 && memcmp(ent, "gt", 2) == 0) {
+		return _plist_xml_append(xml, ">", 1);
+	} else if (len == 3 && memcmp(ent, "amp", 3) == 0) {
+		return _plist_xml_append(xml, "&", 1);
+	} else if (len == 4 && memcmp(ent, "quot", 4) == 0) {
+		return _plist_xml_append(xml, "\"", 1);
+	} else if (len == 4 && memcmp(ent, "apos", 4) == 0) {
+		return _plist_xml_append(xml, "'", 1);
+	} else if (len < 2 || ent[0] != '#') {
+		return EINVAL;
+	}
+
+	/* character reference */
+	i = 1;
+	base = 10;
+	if (ent[1] == 'x') {
+		i = 2;
+		base = 16;
+	}
+	if (i == len) {
+		return EINVAL;
+	}
+	for (cp = 0; i < len; i++) {
+		int c = (unsigned char) ent[i];
+
+		if (c >= '0' && c <= '9') {
+			c -= '0';
+		} else if (base == 16 && c >= 'a' && c <= 'f') {
+			c -= 'a' - 10;
+		} else if (base == 16 && c >= 'A' && c <= 'F') {
+			c -= 'A' - 10;
+		} else {
+			return EINVAL;
+		}
+		cp = cp * base + c;
+		if (cp > 0x10ffff) {
+			return EINVAL;
+		}
+	}
+	if (cp == 0 || (cp >= 0xd800 && cp <= 0xdfff)) {
+		return EINVAL;
+	}
+
+	if (cp < 0x80) {
+		utf[0] = cp;
+		n = 1;
+	} else if (cp < 0x800) {
+		utf[0] = 0xc0 | (cp >> 6);
+		utf[1] = 0x80 | (cp & 0x3f);
+		n = 2;
+	} else if (cp < 0x10000) {
+		utf[0] = 0xe0 | (cp >> 12);
+		utf[1] = 0x80 | ((cp >> 6) & 0x3f);
+		utf[2] = 0x80 | (cp & 0x3f);
+		n = 3;
+	} else {
+		utf[0] = 0xf0 | (cp >> 18);
+		utf[1] = 0x80 | ((cp >> 12) & 0x3f);
+		utf[2] = 0x80 | ((cp >> 6) & 0x3f);
+		utf[3] = 0x80 | (cp & 0x3f);
+		n = 4;
+	}
+	return _plist_xml_append(xml, utf, n);
+}
+
+/**
+ * Decode base64 skipping whitespace. The output never passes the input
+ * so the text can be decoded in place.
+ */
+static int
+_plist_xml_base64(const char *in, size_t len, uint8_t *out, size_t *outszp)
+{
+	size_t i;
+	size_t n;
+	int bits;
+	int npad;
+	uint32_t acc;
+	uint8_t val;
+
+	n = 0;
+	acc = 0;
+	bits = 0;
+	npad = 0;
+	for (i = 0; i < len; i++) {
+		val = B64(in[i]);
+		if (val != 0 && npad == 0) {
+			acc = (acc << 6) | (val - 1);
+			bits += 6;
+			if (bits >= 8) {
+				bits -= 8;
+				out[n++] = acc >> bits;
+			}
+		} else if (in[i] == '=') {
+			npad++;
+		} else if (!ISSPACE(in[i])) {
+			return EINVAL;
+		}
+	}
+
+	/* a single character of a quantum is not a whole byte */
+	if (bits >= 6 || npad > 2) {
+		return EINVAL;
+	}
+	*outszp = n;
+	return 0;
+}
+
+static int
+_plist_xml_digits(const char *s, int n, int *valp)
+{
+	int v;
+
+	for (v = 0; n > 0; n--, s++) {
+		if (*s < '0' || *s > '9') {
+			return EINVAL;
+		}
+		v = v * 10 + (*s - '0');
+	}
+	*valp = v;
+	return 0;
+}
+
+/**
+ * Parse the ISO 8601 date of the plist DTD, YYYY-MM-DDTHH:MM:SSZ
+ */
+static int
+_plist_xml_date(const char *s, size_t len, struct tm *tm)
+{
+	int err;
+
+	if (len != 20 || s[4] != '-' || s[7] != '-' || s[10] != 'T' ||
+	    s[13] != ':' || s[16] != ':' || s[19] != 'Z') {
+		return EINVAL;
+	}
+	memset(tm, 0, sizeof(*tm));
+	err = _plist_xml_digits(&s[0], 4, &tm->tm_year);
+	if (err == 0) {
+		err = _plist_xml_digits(&s[5], 2, &tm->tm_mon);
+	}
+	if (err == 0) {
+		err = _plist_xml_digits(&s[8], 2, &tm->tm_mday);
+	}
+	if (err == 0) {
+		err = _plist_xml_digits(&s[11], 2, &tm->tm_hour);
+	}
+	if (err == 0) {
+		err = _plist_xml_digits(&s[14], 2, &tm->tm_min);
+	}
+	if (err == 0) {
+		err = _plist_xml_digits(&s[17], 2, &tm->tm_sec);
+	}
+	if (err != 0) {
+		return err;
+	}
+	if (tm->tm_mon < 1 || tm->tm_mon > 12 ||
+	    tm->tm_mday < 1 || tm->tm_mday > 31 ||
+	    tm->tm_hour > 23 || tm->tm_min > 59 || tm->tm_sec > 60) {
+		return EINVAL;
+	}
+	tm->tm_year -= 1900;
+	tm->tm_mon -= 1;
+	return 0;
+}
+
+/**
+ * Convert the text of an integer, which is decimal or hex with a 0x
+ * prefix and an optional sign
+ */
+static int
+_plist_xml_integer(const char *s, long long *nump)
+{
+	int c;
+	int base;
+	bool neg;
+	unsigned long long num;
+	unsigned long long limit;
+
+	neg = false;
+	if (*s == '-' || *s == '+') {
+		neg = (*s == '-');
+		s++;
+	}
+	base = 10;
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		base = 16;
+		s += 2;
+	}
+	if (*s == '\0') {
+		return EINVAL;
+	}
+	limit = neg ? (unsigned long long) LLONG_MAX + 1 : LLONG_MAX;
+	for (num = 0; *s != '\0'; s++) {
+		c = (unsigned char) *s;
+		if (c >= '0' && c <= '9') {
+			c -= '0';
+		} else if (base == 16 && c >= 'a' && c <= 'f') {
+			c -= 'a' - 10;
+		} else if (base == 16 && c >= 'A' && c <= 'F') {
+			c -= 'A' - 10;
+		} else {
+			return EINVAL;
+		}
+		if (num > (limit - c) / base) {
+			return ERANGE;
+		}
+		num = num * base + c;
+	}
+	*nump = neg ? (long long) (0 - num) : (long long) num;
+	return 0;
+}
+
+/**
+ * Take the text of a scalar element as a null terminated string without
+ * the surrounding whitespace
+ */
+static int
+_plist_xml_trimmed(plist_xml_t *xml, char **sp, size_t *lenp)
+{
+	int err;
+	char *s;
+	size_t len;
+
+	err = _plist_xml_unview(xml);
+	if (err == 0 && xml->px_buf == NULL) {
+		err = _plist_xml_append(xml, "", 0);
+	}
+	if (err != 0) {
+		return err;
+	}
+	s = xml->px_buf;
+	len = xml->px_textlen;
+	while (len > 0 && ISSPACE(s[len - 1])) {
+		len--;
+	}
+	while (len > 0 && ISSPACE(*s)) {
+		s++;
+		len--;
+	}
+	s[len] = '\0';
+	*sp = s;
+	*lenp = len;
+	return 0;
+}
+
+/**
+ * Deliver the text of the element that was just closed
+ */
+static int
+_plist_xml_text(plist_xml_t *xml, const plist_txt_sax_t *sax, void *arg)
+{
+	int err;
+	char *s;
+	char *ep;
+	size_t len;
+	long long num;
+	double real;
+	struct tm tm;
+	const char *text;
+
+	if (xml->px_view != NULL) {
+		text = xml->px_view;
+		len = xml->px_viewlen;
+	} else {
+		text = (xml->px_buf != NULL) ? xml->px_buf : "";
+		len = xml->px_textlen;
+	}
+
+	switch (xml->px_value) {
+	case XML_KEY:
+		if (sax->psx_key == NULL) {
+			return 0;
+		}
+		return sax->psx_key(arg, text, len);
+
+	case XML_STRING:
+		if (sax->psx_string == NULL) {
+			return 0;
+		}
+		return sax->psx_string(arg, text, len);
+
+	case XML_DATA:
+		err = _plist_xml_unview(xml);
+		if (err == 0 && xml->px_buf == NULL) {
+			err = _plist_xml_append(xml, "", 0);
+		}
+		if (err == 0) {
+			err = _plist_xml_base64(xml->px_buf, xml->px_textlen,
+						(uint8_t *) xml->px_buf, &len);
+		}
+		if (err != 0 || sax->psx_data == NULL) {
+			return err;
+		}
+		return sax->psx_data(arg, xml->px_buf, len);
+
+	default:
+		break;
+	}
+
+	err = _plist_xml_trimmed(xml, &s, &len);
+	if (err != 0) {
+		return err;
+	}
+	switch (xml->px_value) {
+	case XML_INTEGER:
+		err = _plist_xml_integer(s, &num);
+		if (err == 0 && sax->psx_integer != NULL) {
+			err = sax->psx_integer(arg, num);
+		}
+		break;
+
+	case XML_REAL:
+		real = strtod(s, &ep);
+		if (len == 0 || ep != &s[len]) {
+			err = EINVAL;
+		} else if (sax->psx_real != NULL) {
+			err = sax->psx_real(arg, real);
+		}
+		break;
+
+	case XML_TRUE:
+	case XML_FALSE:
+		if (len != 0) {
+			err = EINVAL;
+		} else if (sax->psx_boolean != NULL) {
+			err = sax->psx_boolean(arg,
+					       xml->px_value == XML_TRUE);
+		}
+		break;
+
+	case XML_DATE:
+		err = _plist_xml_date(s, len, &tm);
+		if (err == 0 && sax->psx_date != NULL) {
+			err = sax->psx_date(arg, &tm);
+		}
+		break;
+
+	default:
+		err = EINVAL;
+		break;
+	}
+	return err;
+}
+
+/**
+ * Account for a value starting at the current level, which has to be
+ * the only top level value, an array element, or the value of a key
+ */
+static int
+_plist_xml_slot(plist_xml_t *xml)
+{
+	if (xml->px_depth == 0) {
+		if (xml->px_topseen) {
+			return EINVAL;
+		}
+		xml->px_topseen = true;
+		return 0;
+	}
+	if (xml->px_stack[xml->px_depth - 1] == XML_DICT) {
+		if (!xml->px_keyed) {
+			return EINVAL;
+		}
+		xml->px_keyed = false;
+	}
+	return 0;
+}
+
+/**
+ * A value is complete, which finishes a document without the plist
+ * element when it is the top level value
+ */
+static void
+_plist_xml_complete(plist_xml_t *xml)
+{
+	if (xml->px_depth == 0 && !xml->px_plist) {
+		xml->px_state = PLIST_XML_STATE_DONE;
+	} else {
+		xml->px_state = PLIST_XML_STATE_CONTENT;
+	}
+}
+
+static int
+_plist_xml_push(plist_xml_t *xml, enum plist_xml_elem_e elem)
+{
+	int newmax;
+	uint8_t *ptr;
+
+	if (xml->px_depth == xml->px_stackmax) {
+		newmax = (xml->px_stackmax == 0) ?
+		    XML_STACKSZ : xml->px_stackmax * 2;
+		ptr = realloc(xml->px_stack, newmax);
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+		xml->px_stack = ptr;
+		xml->px_stackmax = newmax;
+	}
+	xml->px_stack[xml->px_depth++] = elem;
+	return 0;
+}
+
+static int
+_plist_xml_end(plist_xml_t *xml, const plist_txt_sax_t *sax, void *arg,
+	       enum plist_xml_elem_e elem)
+{
+	int err;
+
+	if (xml->px_value != XML_NONE) {
+		/* the closing tag of a text element */
+		if ((int) elem != xml->px_value) {
+			return EINVAL;
+		}
+		err = _plist_xml_text(xml, sax, arg);
+		xml->px_view = NULL;
+		xml->px_textlen = 0;
+		if (err != 0) {
+			return err;
+		}
+		if (elem == XML_KEY) {
+			xml->px_state = PLIST_XML_STATE_CONTENT;
+		} else {
+			_plist_xml_complete(xml);
+		}
+		xml->px_value = XML_NONE;
+		return 0;
+	}
+
+	switch (elem) {
+	case XML_DICT:
+	case XML_ARRAY:
+		if (xml->px_depth == 0 ||
+		    xml->px_stack[xml->px_depth - 1] != elem ||
+		    xml->px_keyed) {
+			return EINVAL;
+		}
+		if (elem == XML_DICT && sax->psx_end_dict != NULL) {
+			err = sax->psx_end_dict(arg);
+		} else if (elem == XML_ARRAY && sax->psx_end_array != NULL) {
+			err = sax->psx_end_array(arg);
+		} else {
+			err = 0;
+		}
+		if (err != 0) {
+			return err;
+		}
+		xml->px_depth--;
+		_plist_xml_complete(xml);
+		return 0;
+
+	case XML_PLIST:
+		if (!xml->px_plist || !xml->px_topseen ||
+		    xml->px_depth != 0) {
+			return EINVAL;
+		}
+		xml->px_plist = false;
+		xml->px_state = PLIST_XML_STATE_DONE;
+		return 0;
+
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_xml_start(plist_xml_t *xml, const plist_txt_sax_t *sax, void *arg,
+		 enum plist_xml_elem_e elem, bool empty)
+{
+	int err;
+
+	if (xml->px_value != XML_NONE) {
+		/* text elements have no children */
+		return EINVAL;
+	}
+
+	switch (elem) {
+	case XML_PLIST:
+		if (xml->px_plist || xml->px_topseen || empty) {
+			return EINVAL;
+		}
+		xml->px_plist = true;
+		return 0;
+
+	case XML_KEY:
+		if (xml->px_depth == 0 ||
+		    xml->px_stack[xml->px_depth - 1] != XML_DICT ||
+		    xml->px_keyed) {
+			return EINVAL;
+		}
+		xml->px_keyed = true;
+		break;
+
+	case XML_NONE:
+		return EINVAL;
+
+	default:
+		err = _plist_xml_slot(xml);
+		if (err != 0) {
+			return err;
+		}
+		break;
+	}
+
+	switch (elem) {
+	case XML_DICT:
+	case XML_ARRAY:
+		if (elem == XML_DICT && sax->psx_begin_dict != NULL) {
+			err = sax->psx_begin_dict(arg);
+		} else if (elem == XML_ARRAY && sax->psx_begin_array != NULL) {
+			err = sax->psx_begin_array(arg);
+		} else {
+			err = 0;
+		}
+		if (err == 0) {
+			err = _plist_xml_push(xml, elem);
+		}
+		if (err == 0 && empty) {
+			err = _plist_xml_end(xml, sax, arg, elem);
+		}
+		return err;
+
+	case XML_INTEGER:
+	case XML_REAL:
+	case XML_DATE:
+		if (empty) {
+			return EINVAL;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	xml->px_value = elem;
+	xml->px_view = NULL;
+	xml->px_textlen = 0;
+	if (empty) {
+		return _plist_xml_end(xml, sax, arg, elem);
+	}
+	xml->px_state = PLIST_XML_STATE_TEXT;
+	return 0;
+}
+
+/**
+ * Handle a tag, given as the characters between the '<' and the '>'
+ */
+static int
+_plist_xml_tag(plist_xml_t *xml, const plist_txt_sax_t *sax, void *arg,
+	       const char *tag, size_t len)
+{
+	bool empty;
+	size_t n;
+
+	if (len == 0) {
+		return EINVAL;
+	}
+
+	/* the handlers move on to text or the end of the document */
+	xml->px_state = PLIST_XML_STATE_CONTENT;
+	if (tag[0] == '/') {
+		tag++;
+		len--;
+		while (len > 0 && ISSPACE(tag[len - 1])) {
+			len--;
+		}
+		return _plist_xml_end(xml, sax, arg,
+				      _plist_xml_elem(tag, len));
+	}
+
+	empty = (tag[len - 1] == '/');
+	for (n = 0; n < len && !ISSPACE(tag[n]) && tag[n] != '/'; n++) {
+		continue;
+	}
+	return _plist_xml_start(xml, sax, arg, _plist_xml_elem(tag, n),
+				empty);
+}
+
+/**
+ * Return from skipped markup to the text or the content around it
+ */
+static void
+_plist_xml_skipped(plist_xml_t *xml)
+{
+	xml->px_state = (xml->px_value != XML_NONE) ?
+	    PLIST_XML_STATE_TEXT : PLIST_XML_STATE_CONTENT;
+}
+
+/**
+ * Classify markup that starts with '!' once enough of it is known,
+ * setting morep while it is still undecided
+ */
+static int
+_plist_xml_bang(plist_xml_t *xml, bool *morep)
+{
+	int err;
+	size_t len = xml->px_taglen;
+	const char *tag = xml->px_tag;
+
+	*morep = false;
+	if (len <= 3 && memcmp(tag, "!--", len) == 0) {
+		if (len == 3) {
+			xml->px_match = 0;
+			xml->px_state = PLIST_XML_STATE_COMMENT;
+			return _plist_xml_unview(xml);
+		}
+		*morep = true;
+		return 0;
+	}
+	if (len <= 8 && memcmp(tag, "![CDATA[", len) == 0) {
+		if (len == 8) {
+			if (xml->px_value == XML_NONE) {
+				return EINVAL;
+			}
+			err = _plist_xml_unview(xml);
+			xml->px_match = 0;
+			xml->px_state = PLIST_XML_STATE_CDATA;
+			return err;
+		}
+		*morep = true;
+		return 0;
+	}
+
+	/* the document type, which is only allowed in the prolog */
+	if (xml->px_value != XML_NONE || xml->px_plist || xml->px_topseen) {
+		return EINVAL;
+	}
+	xml->px_match = 0;
+	xml->px_state = PLIST_XML_STATE_DOCTYPE;
+	return 0;
+}
+
+static int
+_plist_xml_run(plist_xml_t *xml, const plist_txt_sax_t *sax, void *arg,
+	       const void *buf, size_t sz)
+{
+	int err;
+	char c;
+	const char *p;
+	const char *q;
+	const char *cp = buf;
+	const char *ep = cp + sz;
+	bool more;
+
+	if (xml->px_state == PLIST_XML_STATE_ERROR) {
+		return EINVAL;
+	}
+
+	err = 0;
+	while (err == 0) {
+		if (cp == ep && xml->px_state != PLIST_XML_STATE_DONE) {
+			/* text in front of an unfinished tag has to be
+			 * kept past the fragment */
+			err = _plist_xml_unview(xml);
+			if (err != 0) {
+				break;
+			}
+			return 0;
+		}
+
+		switch (xml->px_state) {
+		case PLIST_XML_STATE_DONE:
+			xml->px_tail = cp;
+			return 0;
+
+		case PLIST_XML_STATE_ERROR:
+			return EINVAL;
+
+		case PLIST_XML_STATE_CONTENT:
+			while (cp != ep && ISSPACE(*cp)) {
+				cp++;
+			}
+			if (cp == ep) {
+				break;
+			}
+			if (*cp != '<') {
+				err = EINVAL;
+				break;
+			}
+			cp++;
+			xml->px_taglen = 0;
+			xml->px_quote = '\0';
+			xml->px_state = PLIST_XML_STATE_MARKUP;
+			break;
+
+		case PLIST_XML_STATE_TEXT:
+			p = memchr(cp, '<', ep - cp);
+			q = memchr(cp, '&', ((p != NULL) ? p : ep) - cp);
+			if (q != NULL) {
+				err = _plist_xml_unview(xml);
+				if (err == 0) {
+					err = _plist_xml_append(xml, cp, q - cp);
+				}
+				cp = q + 1;
+				xml->px_entlen = 0;
+				xml->px_state = PLIST_XML_STATE_ENTITY;
+			} else if (p == NULL) {
+				err = _plist_xml_unview(xml);
+				if (err == 0) {
+					err = _plist_xml_append(xml, cp, ep - cp);
+				}
+				cp = ep;
+			} else {
+				if (xml->px_textlen == 0 && xml->px_view == NULL) {
+					/* the usual case of text in one piece */
+					xml->px_view = cp;
+					xml->px_viewlen = p - cp;
+				} else {
+					err = _plist_xml_unview(xml);
+					if (err == 0) {
+						err = _plist_xml_append(xml, cp,
+									p - cp);
+					}
+				}
+				cp = p + 1;
+				xml->px_taglen = 0;
+				xml->px_quote = '\0';
+				xml->px_state = PLIST_XML_STATE_MARKUP;
+			}
+			break;
+
+		case PLIST_XML_STATE_ENTITY:
+			while (cp != ep && *cp != ';') {
+				if (xml->px_entlen == PLIST_XML_ENTMAX) {
+					err = EINVAL;
+					break;
+				}
+				xml->px_ent[xml->px_entlen++] = *cp++;
+			}
+			if (err != 0 || cp == ep) {
+				break;
+			}
+			cp++;
+			err = _plist_xml_entity(xml, xml->px_ent,
+						xml->px_entlen);
+			xml->px_state = PLIST_XML_STATE_TEXT;
+			break;
+
+		case PLIST_XML_STATE_MARKUP:
+			if (xml->px_taglen == 0 && *cp == '?') {
+				cp++;
+				xml->px_match = 0;
+				xml->px_state = PLIST_XML_STATE_PI;
+				break;
+			}
+			if (xml->px_taglen == 0 && *cp != '!' &&
+			    (p = memchr(cp, '>', ep - cp)) != NULL &&
+			    memchr(cp, '"', p - cp) == NULL &&
+			    memchr(cp, '\'', p - cp) == NULL) {
+				/* the whole tag is in the fragment */
+				q = cp;
+				cp = p + 1;
+				err = _plist_xml_tag(xml, sax, arg, q, p - q);
+				break;
+			}
+			while (cp != ep) {
+				c = *cp++;
+				if (xml->px_quote != '\0') {
+					if (c == xml->px_quote) {
+						xml->px_quote = '\0';
+					}
+				} else if (c == '"' || c == '\'') {
+					xml->px_quote = c;
+				} else if (c == '>' && (xml->px_taglen == 0 ||
+						       xml->px_tag[0] != '!')) {
+					err = _plist_xml_tag(xml, sax, arg,
+							     xml->px_tag,
+							     xml->px_taglen);
+					break;
+				}
+
+				/* keep the name and the last character */
+				if (xml->px_taglen == PLIST_XML_TAGMAX) {
+					xml->px_taglen--;
+				}
+				xml->px_tag[xml->px_taglen++] = c;
+				if (xml->px_tag[0] == '!') {
+					err = _plist_xml_bang(xml, &more);
+					if (err != 0 || !more) {
+						break;
+					}
+				}
+			}
+			break;
+
+		case PLIST_XML_STATE_COMMENT:
+			while (cp != ep) {
+				c = *cp++;
+				if (c == '-') {
+					if (xml->px_match < 2) {
+						xml->px_match++;
+					}
+				} else if (c == '>' && xml->px_match == 2) {
+					_plist_xml_skipped(xml);
+					break;
+				} else {
+					xml->px_match = 0;
+				}
+			}
+			break;
+
+		case PLIST_XML_STATE_PI:
+			while (cp != ep) {
+				c = *cp++;
+				if (c == '>' && xml->px_match == 1) {
+					_plist_xml_skipped(xml);
+					break;
+				}
+				xml->px_match = (c == '?');
+			}
+			break;
+
+		case PLIST_XML_STATE_DOCTYPE:
+			/* px_match is the depth of the internal subset */
+			while (cp != ep) {
+				c = *cp++;
+				if (c == '[') {
+					xml->px_match++;
+				} else if (c == ']' && xml->px_match > 0) {
+					xml->px_match--;
+				} else if (c == '>' && xml->px_match == 0) {
+					xml->px_state = PLIST_XML_STATE_CONTENT;
+					break;
+				}
+			}
+			break;
+
+		case PLIST_XML_STATE_CDATA:
+			/* px_match is the number of pending ']' */
+			while (err == 0 && cp != ep) {
+				if (xml->px_match == 0) {
+					p = memchr(cp, ']', ep - cp);
+					q = (p != NULL) ? p : ep;
+					err = _plist_xml_append(xml, cp, q - cp);
+					cp = q;
+					if (p != NULL) {
+						cp++;
+						xml->px_match = 1;
+					}
+					continue;
+				}
+				c = *cp++;
+				if (c == ']') {
+					if (xml->px_match == 2) {
+						err = _plist_xml_append(xml,
+									"]", 1);
+					} else {
+						xml->px_match++;
+					}
+				} else if (c == '>' && xml->px_match == 2) {
+					xml->px_state = PLIST_XML_STATE_TEXT;
+					break;
+				} else {
+					err = _plist_xml_append(xml, "]]",
+								xml->px_match);
+					xml->px_match = 0;
+					cp--;
+				}
+			}
+			break;
+		}
+	}
+
+	xml->px_state = PLIST_XML_STATE_ERROR;
+	return err;
+}
+
+
+int
+plist_xml_new(plist_xml_t **xmlpp)
+{
+	int err;
+	plist_xml_t *xml;
+
+	if (!xmlpp) {
+		return EINVAL;
+	}
+	xml = malloc(sizeof(*xml));
+	if (xml == NULL) {
+		return ENOMEM;
+	}
+	memset(xml, 0, sizeof(*xml));
+	err = plist_txt_new(&xml->px_tree);
+	if (err != 0) {
+		free(xml);
+		return err;
+	}
+	xml->px_state = PLIST_XML_STATE_CONTENT;
+	*xmlpp = xml;
+	return 0;
+}
+
+
+void
+plist_xml_free(plist_xml_t *xml)
+{
+	if (xml == NULL) {
+		return;
+	}
+	plist_txt_free(xml->px_tree);
+	free(xml->px_stack);
+	free(xml->px_buf);
+	free(xml);
+}
+
+
+int
+plist_xml_parse(plist_xml_t *xml, const void *buf, size_t sz)
+{
+	if (!xml || (!buf && sz != 0)) {
+		return EINVAL;
+	}
+	return _plist_xml_run(xml, &plist_txt_tree_sax, xml->px_tree,
+			      buf, sz);
+}
+
+
+int
+plist_xml_sax_parse(plist_xml_t *xml, const plist_txt_sax_t *sax, void *arg,
+		    const void *buf, size_t sz)
+{
+	if (!xml || !sax || (!buf && sz != 0)) {
+		return EINVAL;
+	}
+	return _plist_xml_run(xml, sax, arg, buf, sz);
+}
+
+
+void
+plist_xml_reset(plist_xml_t *xml)
+{
+	if (!xml) {
+		return;
+	}
+	plist_txt_reset(xml->px_tree);
+	xml->px_state = PLIST_XML_STATE_CONTENT;
+	xml->px_depth = 0;
+	xml->px_keyed = false;
+	xml->px_plist = false;
+	xml->px_topseen = false;
+	xml->px_value = XML_NONE;
+	xml->px_textlen = 0;
+	xml->px_view = NULL;
+	xml->px_taglen = 0;
+	xml->px_tail = NULL;
+}
+
+
+int
+plist_xml_result(plist_xml_t *xml, plist_t **plistpp)
+{
+	plist_t *ptmp;
+
+	if (!xml || !plistpp) {
+		return EINVAL;
+	}
+	if (xml->px_state != PLIST_XML_STATE_DONE) {
+		plist_xml_reset(xml);
+		return ENOENT;
+	}
+
+	/* detach the tree before the builder is reset */
+	ptmp = xml->px_tree->pt_top;
+	xml->px_tree->pt_top = NULL;
+	plist_xml_reset(xml);
+	*plistpp = ptmp;
+	return 0;
+}
+
+
+/*
+ * Writer
+ *
+ * The tree is walked through the parent links the same way as
+ * plist_dump, so no stack is kept and an array of any length is
+ * written element by element into the output buffer of plist_wbuf.h.
+ * Text is copied in runs between the characters that need a
+ * reference, which are found 16 bytes at a time with SSE2.
+ */
+
+#define XML_B64LINE    (57)		/* data bytes per line of base64 */
+
+#define XML_HEADER \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+	"<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" " \
+	"\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n" \
+	"<plist version=\"1.0\">\n"
+#define XML_TRAILER    "</plist>\n"
+
+static const char _plist_xml_tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+static int
+_plist_xml_windent(plist_wbuf_t *pw, int indent)
+{
+	int err;
+	int n;
+
+	for (err = 0; err == 0 && indent > 0; indent -= n) {
+		n = (indent < (int) sizeof(_plist_xml_tabs) - 1) ?
+		    indent : (int) sizeof(_plist_xml_tabs) - 1;
+		err = _plist_wbuf_bytes(pw, _plist_xml_tabs, n);
+	}
+	return err;
+}
+
+/**
+ * Length of the leading run of text that can be copied as it is, up
+ * to a character that has to be written as a reference
+ */
+static inline size_t
+_plist_xml_plain(const char *s, size_t len)
+{
+	size_t i = 0;
+	char c;
+#ifdef __SSE2__
+	__m128i v;
+	__m128i m;
+	unsigned bits;
+	const __m128i amp = _mm_set1_epi8('&');
+	const __m128i lt = _mm_set1_epi8('<');
+	const __m128i gt = _mm_set1_epi8('>');
+	const __m128i cr = _mm_set1_epi8('\r');
+
+	for (; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) &s[i]);
+		m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, amp),
+					      _mm_cmpeq_epi8(v, lt)),
+				 _mm_or_si128(_mm_cmpeq_epi8(v, gt),
+					      _mm_cmpeq_epi8(v, cr)));
+		bits = _mm_movemask_epi8(m);
+		if (bits != 0) {
+			return i + __builtin_ctz(bits);
+		}
+	}
+#endif
+	for (; i < len; i++) {
+		c = s[i];
+		if (c == '&' || c == '<' || c == '>' || c == '\r') {
+			return i;
+		}
+	}
+	return len;
+}
+
+/**
+ * Write text with the markup characters as references. A carriage
+ * return is a reference too since a reader turns a raw one into a
+ * line feed.
+ */
+static int
+_plist_xml_wtext(plist_wbuf_t *pw, const char *s, size_t len)
+{
+	int err;
+	size_t n;
+
+	for (;;) {
+		n = _plist_xml_plain(s, len);
+		err = _plist_wbuf_bytes(pw, s, n);
+		if (err != 0 || n == len) {
+			return err;
+		}
+		switch (s[n]) {
+		case '&':
+			err = WSTR(pw, "&amp;");
+			break;
+		case '<':
+			err = WSTR(pw, "&lt;");
+			break;
+		case '>':
+			err = WSTR(pw, "&gt;");
+			break;
+		default:
+			err = WSTR(pw, "&#13;");
+			break;
+		}
+		if (err != 0) {
+			return err;
+		}
+		s += n + 1;
+		len -= n + 1;
+	}
+}
+
+/**
+ * Write an element with text on one line
+ */
+static int
+_plist_xml_welem(plist_wbuf_t *pw, int indent, const char *name,
+		 const char *text, size_t len, bool escape)
+{
+	int err;
+	size_t namelen = strlen(name);
+
+	err = _plist_xml_windent(pw, indent);
+	if (err == 0) {
+		err = _plist_wbuf_room(pw, namelen + 2);
+	}
+	if (err != 0) {
+		return err;
+	}
+	pw->pw_out[pw->pw_fill++] = '<';
+	memcpy(&pw->pw_out[pw->pw_fill], name, namelen);
+	pw->pw_fill += namelen;
+	pw->pw_out[pw->pw_fill++] = '>';
+
+	err = escape ? _plist_xml_wtext(pw, text, len) :
+	    _plist_wbuf_bytes(pw, text, len);
+	if (err == 0) {
+		err = _plist_wbuf_room(pw, namelen + 4);
+	}
+	if (err != 0) {
+		return err;
+	}
+	pw->pw_out[pw->pw_fill++] = '<';
+	pw->pw_out[pw->pw_fill++] = '/';
+	memcpy(&pw->pw_out[pw->pw_fill], name, namelen);
+	pw->pw_fill += namelen;
+	pw->pw_out[pw->pw_fill++] = '>';
+	pw->pw_out[pw->pw_fill++] = '\n';
+	return 0;
+}
+
+/**
+ * Write data as base64 lines at the indent of the element, encoding
+ * straight into the staging buffer
+ */
+static int
+_plist_xml_wdata(plist_wbuf_t *pw, int indent, const uint8_t *buf, size_t sz)
+{
+	int err;
+	size_t n;
+	char *out;
+
+	if (sz == 0) {
+		err = _plist_xml_windent(pw, indent);
+		return (err != 0) ? err : WSTR(pw, "<data></data>\n");
+	}
+	err = _plist_xml_windent(pw, indent);
+	if (err == 0) {
+		err = WSTR(pw, "<data>\n");
+	}
+	while (err == 0 && sz > 0) {
+		n = (sz < XML_B64LINE) ? sz : XML_B64LINE;
+		err = _plist_xml_windent(pw, indent);
+		if (err == 0) {
+			err = _plist_wbuf_room(pw, XML_B64LINE / 3 * 4 + 1);
+		}
+		if (err != 0) {
+			break;
+		}
+		out = _plist_wbuf_b64(&pw->pw_out[pw->pw_fill], buf, n);
+		*out++ = '\n';
+		pw->pw_fill = out - pw->pw_out;
+		buf += n;
+		sz -= n;
+	}
+	if (err == 0) {
+		err = _plist_xml_windent(pw, indent);
+	}
+	return (err != 0) ? err : WSTR(pw, "</data>\n");
+}
+
+/**
+ * Format the date in UTC with the offset it was read with taken off,
+ * the same instant as the binary writer
+ */
+static int
+_plist_xml_wdate(plist_wbuf_t *pw, int indent, const struct tm *date)
+{
+	int err;
+	int year;
+	struct tm utc;
+	const struct tm *tm = &utc;
+	char buf[sizeof("YYYY-MM-DDTHH:MM:SSZ")];
+	char *cp = buf;
+
+	err = _plist_wbuf_utc(date, &utc);
+	if (err != 0) {
+		return err;
+	}
+	year = tm->tm_year + 1900;
+	if (year < 0 || year > 9999) {
+		return EINVAL;
+	}
+	cp = _plist_wbuf_2digits(cp, year / 100);
+	cp = _plist_wbuf_2digits(cp, year % 100);
+	*cp++ = '-';
+	cp = _plist_wbuf_2digits(cp, tm->tm_mon + 1);
+	*cp++ = '-';
+	cp = _plist_wbuf_2digits(cp, tm->tm_mday);
+	*cp++ = 'T';
+	cp = _plist_wbuf_2digits(cp, tm->tm_hour);
+	*cp++ = ':';
+	cp = _plist_wbuf_2digits(cp, tm->tm_min);
+	*cp++ = ':';
+	cp = _plist_wbuf_2digits(cp, tm->tm_sec);
+	*cp++ = 'Z';
+	return _plist_xml_welem(pw, indent, "date", buf, cp - buf, false);
+}
+
+static int
+_plist_xml_wint(plist_wbuf_t *pw, int indent, long long num)
+{
+	char buf[WBUF_INTSZ];
+	char *cp;
+
+	cp = _plist_wbuf_int(&buf[sizeof(buf)], num);
+	return _plist_xml_welem(pw, indent, "integer", cp,
+				&buf[sizeof(buf)] - cp, false);
+}
+
+/**
+ * Write a real element, with the spellings of the property list format
+ * for the values that are not numbers
+ */
+static int
+_plist_xml_wreal(plist_wbuf_t *pw, int indent, double num)
+{
+	int n;
+	char buf[WBUF_REALSZ];
+
+	if (isnan(num)) {
+		return _plist_xml_welem(pw, indent, "real", "nan", 3, false);
+	} else if (isinf(num)) {
+		return (num > 0) ?
+		    _plist_xml_welem(pw, indent, "real", "+infinity", 9, false) :
+		    _plist_xml_welem(pw, indent, "real", "-infinity", 9, false);
+	}
+	n = _plist_wbuf_real(buf, num, false);
+	return _plist_xml_welem(pw, indent, "real", buf, n, false);
+}
+
+/**
+ * Write one element at its indent, or only the opening tag of a
+ * container that has children
+ */
+static int
+_plist_xml_wvalue(plist_wbuf_t *pw, const plist_t *pcur, int indent)
+{
+	int err;
+
+	switch (pcur->p_elem) {
+	case PLIST_DICT:
+	case PLIST_ARRAY:
+		err = _plist_xml_windent(pw, indent);
+		if (err != 0) {
+			return err;
+		}
+		if (pcur->p_elem == PLIST_DICT) {
+			return TAILQ_EMPTY(&pcur->p_dict.pd_keys) ?
+			    WSTR(pw, "<dict/>\n") : WSTR(pw, "<dict>\n");
+		}
+		return TAILQ_EMPTY(&pcur->p_array.pa_elems) ?
+		    WSTR(pw, "<array/>\n") : WSTR(pw, "<array>\n");
+	case PLIST_KEY:
+		return _plist_xml_welem(pw, indent, "key",
+					pcur->p_key.pk_name,
+					strlen(pcur->p_key.pk_name), true);
+	case PLIST_STRING:
+		return _plist_xml_welem(pw, indent, "string",
+					pcur->p_string.ps_str,
+					strlen(pcur->p_string.ps_str), true);
+	case PLIST_INTEGER:
+		return _plist_xml_wint(pw, indent, pcur->p_integer.pi_int);
+	case PLIST_REAL:
+		return _plist_xml_wreal(pw, indent, pcur->p_real.pr_double);
+	case PLIST_BOOLEAN:
+		err = _plist_xml_windent(pw, indent);
+		if (err != 0) {
+			return err;
+		}
+		return pcur->p_boolean.pb_bool ?
+		    WSTR(pw, "<true/>\n") : WSTR(pw, "<false/>\n");
+	case PLIST_DATE:
+		return _plist_xml_wdate(pw, indent, &pcur->p_date.pd_tm);
+	case PLIST_DATA:
+		return _plist_xml_wdata(pw, indent, pcur->p_data.pd_data,
+					pcur->p_data.pd_datasz);
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+_plist_xml_emit(plist_wbuf_t *pw, const plist_t *plist)
+{
+	int err;
+	int indent;
+	const plist_t *pcur;
+	const plist_t *pnext;
+
+	if (plist->p_elem == PLIST_KEY) {
+		return EINVAL;
+	}
+	err = WSTR(pw, XML_HEADER);
+	indent = 0;
+	for (pcur = plist; err == 0 && pcur != NULL; pcur = pnext) {
+		err = _plist_xml_wvalue(pw, pcur, indent);
+		if (err != 0) {
+			break;
+		}
+
+		/* descend into a container, or from a key to its value */
+		pnext = NULL;
+		if (pcur->p_elem == PLIST_DICT) {
+			pnext = TAILQ_FIRST(&pcur->p_dict.pd_keys);
+		} else if (pcur->p_elem == PLIST_ARRAY) {
+			pnext = TAILQ_FIRST(&pcur->p_array.pa_elems);
+		} else if (pcur->p_elem == PLIST_KEY) {
+			pnext = pcur->p_key.pk_value;
+			if (pnext == NULL) {
+				err = EINVAL;
+			}
+			continue;
+		}
+		if (pnext != NULL) {
+			indent++;
+			continue;
+		}
+
+		/* ascend, closing every container that is finished */
+		while (err == 0 && pcur != plist) {
+			pnext = pcur->p_parent;
+			if (pnext == NULL) {
+				err = EINVAL;
+				break;
+			}
+			if (pnext->p_elem == PLIST_KEY) {
+				pcur = pnext;
+				pnext = TAILQ_NEXT(pcur, p_entry);
+				if (pnext != NULL) {
+					break;
+				}
+				pcur = pcur->p_parent;
+				indent--;
+				err = _plist_xml_windent(pw, indent);
+				if (err == 0) {
+					err = WSTR(pw, "</dict>\n");
+				}
+				continue;
+			}
+			pnext = TAILQ_NEXT(pcur, p_entry);
+			if (pnext != NULL) {
+				break;
+			}
+			pcur = pcur->p_parent;
+			indent--;
+			err = _plist_xml_windent(pw, indent);
+			if (err == 0) {
+				err = WSTR(pw, "</array>\n");
+			}
+		}
+		if (pcur == plist) {
+			pnext = NULL;
+		}
+	}
+	if (err == 0) {
+		err = WSTR(pw, XML_TRAILER);
+	}
+	return err;
+}
+
+
+int
+plist_xml_write(const plist_t *plist, int fd)
+{
+	int err;
+	plist_wbuf_t pw;
+
+	if (!plist || fd < 0) {
+		return EINVAL;
+	}
+	err = _plist_wbuf_open(&pw, fd);
+	if (err != 0) {
+		return err;
+	}
+	err = _plist_xml_emit(&pw, plist);
+	if (err == 0) {
+		err = _plist_wbuf_flush(&pw);
+	}
+	free(pw.pw_out);
+	return err;
+}
+
+
+int
+plist_xml_write_buf(const plist_t *plist, void **bufp, size_t *szp)
+{
+	int err;
+	plist_wbuf_t pw;
+
+	if (!plist || !bufp || !szp) {
+		return EINVAL;
+	}
+	(void) _plist_wbuf_open(&pw, -1);
+	err = _plist_xml_emit(&pw, plist);
+	if (err != 0) {
+		free(pw.pw_out);
+		return err;
+	}
+	*bufp = pw.pw_out;
+	*szp = pw.pw_fill;
+	return 0;
+}
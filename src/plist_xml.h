@@ -0,0 +1,216 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_xml.h
+ *
+ * Incremental reader and streaming writer for the XML property list
+ * format. Only the plist
+ * DTD is understood (plist, dict, key, array, string, integer, real,
+ * true, false, date, and data) so there is no general XML parser
+ * underneath, and the document can be fed in fragments of any size the
+ * same way as #plist_txt_parse.
+ *
+ * The XML declaration, the document type, comments, and processing
+ * instructions are skipped. Text is decoded for the five predefined
+ * entities, character references, and CDATA sections, data is base64,
+ * and dates are ISO 8601 in UTC (YYYY-MM-DDTHH:MM:SSZ).
+ *
+ * Events go through the same #plist_txt_sax_t sink as the text parser
+ * so a sink like #plist_bind_sax reads either format.
+ *
+ * The writer produces the layout of Apple's tools, one element per line
+ * indented with tabs, and streams it out without an intermediate copy
+ * of the document.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_XML_H_
+#define _PLIST_XML_H_
+
+#include <plist.h>
+#include <plist_txt.h>
+
+/* forward declare */
+typedef struct plist_xml_s plist_xml_t;
+
+enum plist_xml_state_e {
+	PLIST_XML_STATE_ERROR = 0,
+	PLIST_XML_STATE_DONE,
+
+	PLIST_XML_STATE_CONTENT,
+	PLIST_XML_STATE_TEXT,
+	PLIST_XML_STATE_ENTITY,
+	PLIST_XML_STATE_MARKUP,
+	PLIST_XML_STATE_COMMENT,
+	PLIST_XML_STATE_PI,
+	PLIST_XML_STATE_DOCTYPE,
+	PLIST_XML_STATE_CDATA,
+};
+
+/* longest tag that is kept, anything past it is attributes */
+#define PLIST_XML_TAGMAX  (32)
+
+/* longest entity reference between the '&' and the ';' */
+#define PLIST_XML_ENTMAX  (12)
+
+/**
+ * XML parser context
+ */
+struct plist_xml_s {
+	enum plist_xml_state_e px_state;
+
+	/* open containers, one element per level */
+	int px_depth;
+	int px_stackmax;
+	uint8_t *px_stack;
+
+	/* a key was read and its value is pending at the current level */
+	bool px_keyed;
+
+	/* inside the plist element and whether the top value was read */
+	bool px_plist;
+	bool px_topseen;
+
+	/* element whose text is being collected */
+	int px_value;
+
+	/* text of the element that spanned fragments or was decoded */
+	size_t px_textlen;
+	size_t px_bufsz;
+	char *px_buf;
+
+	/* text of the element still in the fed fragment */
+	const char *px_view;
+	size_t px_viewlen;
+
+	/* tag after the '<' and the attribute quote it is in */
+	size_t px_taglen;
+	char px_tag[PLIST_XML_TAGMAX];
+	char px_quote;
+
+	/* terminator characters matched so far in skipped markup */
+	int px_match;
+
+	/* entity reference after the '&' */
+	int px_entlen;
+	char px_ent[PLIST_XML_ENTMAX];
+
+	/* tree builder fed by #plist_xml_parse */
+	plist_txt_t *px_tree;
+
+	/* position just past the document in the last fragment */
+	const char *px_tail;
+};
+
+
+__BEGIN_DECLS
+
+/**
+ * Create an XML parsing context
+ *
+ * @param  xmlpp  result parse context
+ * @return zero on success or an error value
+ */
+int plist_xml_new(plist_xml_t **xmlpp);
+
+/**
+ * Free the XML parsing context and any partial result
+ *
+ * @param  xml  context that was allocated with #plist_xml_new
+ */
+void plist_xml_free(plist_xml_t *xml);
+
+/**
+ * Parse a fragment of an XML document into a plist object. Fragments
+ * can split the document anywhere, and input after the end of the
+ * document is ignored.
+ *
+ * @param  xml  context that was allocated with #plist_xml_new
+ * @param  buf  fragment of the document
+ * @param  sz   size of the fragment
+ * @return zero on success or an error value
+ */
+int plist_xml_parse(plist_xml_t *xml, const void *buf, size_t sz);
+
+/**
+ * Parse a fragment of an XML document and deliver the elements to an
+ * event sink instead of building a plist object. Strings, keys, and
+ * data passed to the sink are only valid during the callback.
+ *
+ * @param  xml  context that was allocated with #plist_xml_new
+ * @param  sax  event callbacks
+ * @param  arg  argument passed to every callback
+ * @param  buf  fragment of the document
+ * @param  sz   size of the fragment
+ * @return zero on success, the first non-zero callback return, or an
+ *         error value
+ */
+int plist_xml_sax_parse(plist_xml_t *xml, const plist_txt_sax_t *sax,
+			void *arg, const void *buf, size_t sz);
+
+/**
+ * Reset the context to start a new document, freeing any partial result
+ *
+ * @param  xml  context that was allocated with #plist_xml_new
+ */
+void plist_xml_reset(plist_xml_t *xml);
+
+/**
+ * Retrieve the plist object for a completed document and reset the
+ * context for the next one
+ *
+ * @param  xml      context that was allocated with #plist_xml_new
+ * @param  plistpp  result object that the caller frees
+ * @return zero on success, ENOENT if the document is not complete
+ */
+int plist_xml_result(plist_xml_t *xml, plist_t **plistpp);
+
+/**
+ * Write a plist as an XML document. The output is staged in a fixed
+ * buffer and written as it fills, so the size of the document does not
+ * matter. Dates are written from the fields of the element as UTC.
+ *
+ * @param  plist  element to write
+ * @param  fd     descriptor to write to
+ * @return zero on success, EINVAL for a key without a value or a year
+ *         outside of four digits, or an error value from write
+ */
+int plist_xml_write(const plist_t *plist, int fd);
+
+/**
+ * Write a plist as an XML document into an allocated buffer
+ *
+ * @param  plist  element to write
+ * @param  bufp   result document that the caller frees
+ * @param  szp    result size of the document
+ * @return zero on success or an error value as for #plist_xml_write
+ */
+int plist_xml_write_buf(const plist_t *plist, void **bufp, size_t *szp);
+
+__END_DECLS
+
+#endif /* !_PLIST_XML_H_ */
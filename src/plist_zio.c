@@ -0,0 +1,595 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_zio.c
+ *
+ * Compressed input and output with zlib (gzip) and libzstd, each built
+ * in when configure finds the library. Decoding and encoding run on a
+ * thread of their own that is joined to the reader or writer by a pipe,
+ * so a block is decoded while the one before it is parsed, and the
+ * readers and writers work the same as for a plain descriptor.
+ *
+ * @version $Id$
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for F_SETPIPE_SZ */
+#endif
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#ifdef PLIST_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PLIST_ZSTD
+#include <zstd.h>
+#endif
+
+#include "plist_io.h"
+#include "plist_zio.h"
+
+#define ZIO_BUFSZ   (256 * 1024)	/* block read or coded per step */
+#define ZIO_PIPESZ  (1024 * 1024)	/* pipe buffer between the threads */
+
+/**
+ * Codec thread and the pipe that joins it to the caller
+ */
+struct plist_zio_s {
+	pthread_t pz_thread;
+	enum plist_compress_e pz_comp;
+	bool pz_encode;
+	int pz_level;
+
+	/* input of the thread, a prefix and then a descriptor */
+	const uint8_t *pz_pre;
+	size_t pz_presz;
+	int pz_infd;
+
+	/* output of the thread and the end of the pipe for the caller */
+	int pz_outfd;
+	int pz_userfd;
+
+	int pz_stop;
+	int pz_err;
+	bool pz_end;		/* between streams, or all flushed */
+
+#ifdef PLIST_ZLIB
+	z_stream pz_zs;
+#endif
+#ifdef PLIST_ZSTD
+	ZSTD_DStream *pz_zd;
+	ZSTD_CCtx *pz_zc;
+#endif
+	uint8_t *pz_in;
+	uint8_t *pz_out;
+};
+
+
+enum plist_compress_e
+plist_compress_detect(const void *buf, size_t sz)
+{
+	const uint8_t *cp = buf;
+
+	if (!buf) {
+		return PLIST_COMPRESS_NONE;
+	}
+	if (sz >= 2 && cp[0] == 0x1f && cp[1] == 0x8b) {
+		return PLIST_COMPRESS_GZIP;
+	}
+	if (sz >= 4 && cp[0] == 0x28 && cp[1] == 0xb5 &&
+	    cp[2] == 0x2f && cp[3] == 0xfd) {
+		return PLIST_COMPRESS_ZSTD;
+	}
+	return PLIST_COMPRESS_NONE;
+}
+
+
+bool
+plist_compress_available(enum plist_compress_e comp)
+{
+	switch (comp) {
+	case PLIST_COMPRESS_NONE:
+		return true;
+#ifdef PLIST_ZLIB
+	case PLIST_COMPRESS_GZIP:
+		return true;
+#endif
+#ifdef PLIST_ZSTD
+	case PLIST_COMPRESS_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+
+static int
+_plist_zio_write(int fd, const void *buf, size_t sz)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < sz; off += n) {
+		n = write(fd, (const char *) buf + off, sz - off);
+		if (n < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			return errno;
+		}
+	}
+	return 0;
+}
+
+static ssize_t
+_plist_zio_read(int fd, void *buf, size_t sz)
+{
+	ssize_t n;
+
+	do {
+		n = read(fd, buf, sz);
+	} while (n < 0 && errno == EINTR);
+	return n;
+}
+
+
+/*
+ * Codecs
+ */
+
+static int
+_plist_zio_init(plist_zio_t *z)
+{
+	switch (z->pz_comp) {
+#ifdef PLIST_ZLIB
+	case PLIST_COMPRESS_GZIP:
+		if (z->pz_encode) {
+			/* 16 over the window bits asks for a gzip wrapper */
+			return (deflateInit2(&z->pz_zs, (z->pz_level == 0) ?
+					     Z_DEFAULT_COMPRESSION : z->pz_level,
+					     Z_DEFLATED, 15 + 16, 8,
+					     Z_DEFAULT_STRATEGY) == Z_OK) ?
+			    0 : EINVAL;
+		}
+		/* 32 over the window bits takes either wrapper */
+		return (inflateInit2(&z->pz_zs, 15 + 32) == Z_OK) ? 0 : ENOMEM;
+#endif
+#ifdef PLIST_ZSTD
+	case PLIST_COMPRESS_ZSTD:
+		if (z->pz_encode) {
+			z->pz_zc = ZSTD_createCCtx();
+			if (z->pz_zc == NULL) {
+				return ENOMEM;
+			}
+			if (z->pz_level != 0 &&
+			    ZSTD_isError(ZSTD_CCtx_setParameter(z->pz_zc,
+					ZSTD_c_compressionLevel, z->pz_level))) {
+				return EINVAL;
+			}
+			/* a damaged frame is caught like with the gzip crc */
+			(void) ZSTD_CCtx_setParameter(z->pz_zc,
+						      ZSTD_c_checksumFlag, 1);
+			return 0;
+		}
+		z->pz_zd = ZSTD_createDStream();
+		if (z->pz_zd == NULL) {
+			return ENOMEM;
+		}
+		return ZSTD_isError(ZSTD_initDStream(z->pz_zd)) ? ENOMEM : 0;
+#endif
+	default:
+		return ENOTSUP;
+	}
+}
+
+static void
+_plist_zio_fini(plist_zio_t *z)
+{
+	switch (z->pz_comp) {
+#ifdef PLIST_ZLIB
+	case PLIST_COMPRESS_GZIP:
+		if (z->pz_encode) {
+			deflateEnd(&z->pz_zs);
+		} else {
+			inflateEnd(&z->pz_zs);
+		}
+		break;
+#endif
+#ifdef PLIST_ZSTD
+	case PLIST_COMPRESS_ZSTD:
+		if (z->pz_zc != NULL) {
+			ZSTD_freeCCtx(z->pz_zc);
+		}
+		if (z->pz_zd != NULL) {
+			ZSTD_freeDStream(z->pz_zd);
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+/**
+ * Run the codec over as much of the input as fits in one output block.
+ * A decoder sets pz_end when a stream is complete, and an encoder that
+ * is finishing sets it once everything is flushed.
+ *
+ * @return zero with the input advanced and the output length set, or
+ *         EINVAL for damaged input
+ */
+static int
+_plist_zio_step(plist_zio_t *z, const uint8_t **inp, size_t *inszp,
+		bool finish, size_t *outlenp)
+{
+#ifdef PLIST_ZLIB
+	int ret;
+	size_t n;
+#endif
+#ifdef PLIST_ZSTD
+	size_t r;
+	ZSTD_inBuffer ib;
+	ZSTD_outBuffer ob;
+#endif
+
+	switch (z->pz_comp) {
+#ifdef PLIST_ZLIB
+	case PLIST_COMPRESS_GZIP:
+		if (!z->pz_encode && z->pz_end && *inszp > 0) {
+			/* the start, or another member after the last */
+			if (inflateReset(&z->pz_zs) != Z_OK) {
+				return EINVAL;
+			}
+		}
+		n = (*inszp < UINT_MAX) ? *inszp : UINT_MAX;
+		z->pz_zs.next_in = (Bytef *) *inp;
+		z->pz_zs.avail_in = n;
+		z->pz_zs.next_out = z->pz_out;
+		z->pz_zs.avail_out = ZIO_BUFSZ;
+		if (z->pz_encode) {
+			ret = deflate(&z->pz_zs, finish ? Z_FINISH : Z_NO_FLUSH);
+		} else {
+			ret = inflate(&z->pz_zs, Z_NO_FLUSH);
+		}
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+			return EINVAL;
+		}
+		z->pz_end = (ret == Z_STREAM_END);
+		*inp += n - z->pz_zs.avail_in;
+		*inszp -= n - z->pz_zs.avail_in;
+		*outlenp = ZIO_BUFSZ - z->pz_zs.avail_out;
+		return 0;
+#endif
+#ifdef PLIST_ZSTD
+	case PLIST_COMPRESS_ZSTD:
+		ib.src = *inp;
+		ib.size = *inszp;
+		ib.pos = 0;
+		ob.dst = z->pz_out;
+		ob.size = ZIO_BUFSZ;
+		ob.pos = 0;
+		if (z->pz_encode) {
+			r = ZSTD_compressStream2(z->pz_zc, &ob, &ib, finish ?
+						 ZSTD_e_end : ZSTD_e_continue);
+		} else {
+			r = ZSTD_decompressStream(z->pz_zd, &ob, &ib);
+		}
+		if (ZSTD_isError(r)) {
+			return EINVAL;
+		}
+		/* zero is a whole frame, or for an encoder all flushed */
+		z->pz_end = (r == 0);
+		*inp += ib.pos;
+		*inszp -= ib.pos;
+		*outlenp = ob.pos;
+		return 0;
+#endif
+	default:
+		return ENOTSUP;
+	}
+}
+
+
+/*
+ * Threads
+ */
+
+/**
+ * Decode the prefix and then the descriptor into the pipe until the
+ * input ends or the caller asks to stop
+ */
+static void *
+_plist_zio_decode(void *arg)
+{
+	int err;
+	ssize_t n;
+	size_t insz;
+	size_t outlen;
+	const uint8_t *in;
+	plist_zio_t *z = arg;
+
+	err = 0;
+	for (;;) {
+		if (z->pz_pre != NULL) {
+			in = z->pz_pre;
+			insz = z->pz_presz;
+			z->pz_pre = NULL;
+		} else if (z->pz_infd >= 0) {
+			n = _plist_zio_read(z->pz_infd, z->pz_in, ZIO_BUFSZ);
+			if (n < 0) {
+				err = errno;
+				break;
+			}
+			in = z->pz_in;
+			insz = n;
+		} else {
+			insz = 0;
+		}
+		if (insz == 0) {
+			/* the input has to end between streams */
+			if (!z->pz_end) {
+				err = EINVAL;
+			}
+			break;
+		}
+
+		/* a full output block may leave more to flush */
+		do {
+			err = _plist_zio_step(z, &in, &insz, false, &outlen);
+			if (err == 0 && outlen > 0) {
+				err = _plist_zio_write(z->pz_outfd, z->pz_out,
+						       outlen);
+			}
+			if (__atomic_load_n(&z->pz_stop, __ATOMIC_ACQUIRE)) {
+				goto out;
+			}
+		} while (err == 0 && (insz > 0 || outlen == ZIO_BUFSZ));
+		if (err != 0) {
+			break;
+		}
+	}
+
+out:
+	z->pz_err = err;
+	close(z->pz_outfd);
+	return NULL;
+}
+
+/**
+ * Encode everything read from the pipe to the descriptor. After an
+ * error the pipe is still drained so that the writer never blocks.
+ */
+static void *
+_plist_zio_encode(void *arg)
+{
+	int err;
+	ssize_t n;
+	size_t insz;
+	size_t outlen;
+	const uint8_t *in;
+	bool finish;
+	plist_zio_t *z = arg;
+
+	err = 0;
+	do {
+		n = _plist_zio_read(z->pz_infd, z->pz_in, ZIO_BUFSZ);
+		if (n < 0) {
+			err = (err != 0) ? err : errno;
+			break;
+		}
+		if (err != 0) {
+			continue;
+		}
+		in = z->pz_in;
+		insz = n;
+		finish = (n == 0);
+		do {
+			err = _plist_zio_step(z, &in, &insz, finish, &outlen);
+			if (err == 0 && outlen > 0) {
+				err = _plist_zio_write(z->pz_outfd, z->pz_out,
+						       outlen);
+			}
+		} while (err == 0 && (insz > 0 || outlen == ZIO_BUFSZ ||
+				      (finish && !z->pz_end)));
+	} while (n > 0);
+
+	z->pz_err = err;
+	return NULL;
+}
+
+static void
+_plist_zio_free(plist_zio_t *z)
+{
+	_plist_zio_fini(z);
+	free(z->pz_in);
+	free(z->pz_out);
+	free(z);
+}
+
+/**
+ * Set up the codec and the pipe and start the thread, which reads the
+ * pipe when encoding and writes it when decoding
+ */
+static int
+_plist_zio_start(plist_zio_t **zp, enum plist_compress_e comp,
+		 bool encode, int level, const void *pre, size_t presz, int fd)
+{
+	int err;
+	int pfd[2];
+	plist_zio_t *z;
+
+	if (comp == PLIST_COMPRESS_NONE || !plist_compress_available(comp)) {
+		return ENOTSUP;
+	}
+	z = calloc(1, sizeof(*z));
+	if (z == NULL) {
+		return ENOMEM;
+	}
+	z->pz_comp = comp;
+	z->pz_encode = encode;
+	z->pz_level = level;
+	z->pz_pre = pre;
+	z->pz_presz = presz;
+	z->pz_end = true;
+	z->pz_in = malloc(ZIO_BUFSZ);
+	z->pz_out = malloc(ZIO_BUFSZ);
+	err = (z->pz_in == NULL || z->pz_out == NULL) ?
+	    ENOMEM : _plist_zio_init(z);
+	if (err != 0) {
+		_plist_zio_free(z);
+		return err;
+	}
+
+	if (pipe(pfd) != 0) {
+		err = errno;
+		_plist_zio_free(z);
+		return err;
+	}
+#ifdef F_SETPIPE_SZ
+	/* fewer and larger hand offs than the default 64 KB */
+	(void) fcntl(pfd[1], F_SETPIPE_SZ, ZIO_PIPESZ);
+#endif
+	if (encode) {
+		z->pz_infd = pfd[0];
+		z->pz_outfd = fd;
+		z->pz_userfd = pfd[1];
+	} else {
+		z->pz_infd = fd;
+		z->pz_outfd = pfd[1];
+		z->pz_userfd = pfd[0];
+	}
+
+	err = pthread_create(&z->pz_thread, NULL, encode ?
+			     _plist_zio_encode : _plist_zio_decode, z);
+	if (err != 0) {
+		close(pfd[0]);
+		close(pfd[1]);
+		_plist_zio_free(z);
+		return err;
+	}
+	*zp = z;
+	return 0;
+}
+
+
+int
+plist_zio_reader(plist_zio_t **zp, enum plist_compress_e comp,
+		 const void *pre, size_t presz, int fd, int *rfdp)
+{
+	int err;
+
+	if (!zp || !rfdp) {
+		return EINVAL;
+	}
+	err = _plist_zio_start(zp, comp, false, 0, pre, presz, fd);
+	if (err == 0) {
+		*rfdp = (*zp)->pz_userfd;
+	}
+	return err;
+}
+
+
+int
+plist_zio_finish(plist_zio_t *z, int err)
+{
+	char buf[4096];
+
+	/* a decoder that is still going stops at its next block */
+	__atomic_store_n(&z->pz_stop, 1, __ATOMIC_RELEASE);
+	while (_plist_zio_read(z->pz_userfd, buf, sizeof(buf)) > 0) {
+		continue;
+	}
+	close(z->pz_userfd);
+	pthread_join(z->pz_thread, NULL);
+	if (z->pz_err != 0) {
+		err = z->pz_err;
+	}
+	_plist_zio_free(z);
+	return err;
+}
+
+
+int
+plist_write_compressed(const plist_t *plist, enum plist_format_e format,
+		       enum plist_compress_e comp, int level, int fd)
+{
+	int err;
+	plist_zio_t *z;
+
+	if (!plist || fd < 0) {
+		return EINVAL;
+	}
+	if (comp == PLIST_COMPRESS_NONE) {
+		return plist_write_fd(plist, format, fd);
+	}
+	err = _plist_zio_start(&z, comp, true, level, NULL, 0, fd);
+	if (err != 0) {
+		return err;
+	}
+
+	/* the end of the pipe finishes the stream */
+	err = plist_write_fd(plist, format, z->pz_userfd);
+	close(z->pz_userfd);
+	pthread_join(z->pz_thread, NULL);
+	close(z->pz_infd);
+	if (err == 0) {
+		err = z->pz_err;
+	}
+	_plist_zio_free(z);
+	return err;
+}
+
+
+int
+plist_write_compressed_file(const plist_t *plist, enum plist_format_e format,
+			    enum plist_compress_e comp, int level,
+			    const char *path)
+{
+	int fd;
+	int err;
+
+	if (!plist || !path) {
+		return EINVAL;
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		return errno;
+	}
+	err = plist_write_compressed(plist, format, comp, level, fd);
+	if (close(fd) != 0 && err == 0) {
+		err = errno;
+	}
+	return err;
+}
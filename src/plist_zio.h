@@ -0,0 +1,75 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_zio.h
+ *
+ * Decompressor thread behind the readers in plist_io.c and not
+ * installed. The thread decodes the input into a pipe that the caller
+ * reads like any other descriptor, so the readers are fed the same way
+ * as from an uncompressed pipe while the next blocks are decoded.
+ *
+ * @version $Id$
+ */
+
+#ifndef _PLIST_ZIO_H_
+#define _PLIST_ZIO_H_
+
+#include "plist_io.h"
+
+/* forward declare */
+typedef struct plist_zio_s plist_zio_t;
+
+__BEGIN_DECLS
+
+/**
+ * Start decoding a compressed stream on a thread. The input is the
+ * prefix, which has to stay valid until #plist_zio_finish, followed by
+ * everything that can be read from fd.
+ *
+ * @param  zp    result decoder
+ * @param  comp  compression of the input
+ * @param  pre   first bytes of the input
+ * @param  presz number of bytes in the prefix
+ * @param  fd    descriptor with the rest of the input, or -1
+ * @param  rfdp  result descriptor to read the decoded bytes from
+ * @return zero on success, ENOTSUP for a compression that was not
+ *         built in, or an error value
+ */
+int plist_zio_reader(plist_zio_t **zp, enum plist_compress_e comp,
+		     const void *pre, size_t presz, int fd, int *rfdp);
+
+/**
+ * Stop the decoder, close the read descriptor, and free the decoder.
+ *
+ * @param  z    decoder from #plist_zio_reader
+ * @param  err  result of reading the decoded bytes
+ * @return the decoder error if there was one, otherwise err
+ */
+int plist_zio_finish(plist_zio_t *z, int err);
+
+__END_DECLS
+
+#endif /* !_PLIST_ZIO_H_ */
@@ -33,15 +33,30 @@
 
 #include <sys/types.h>
 #include <sys/syslog.h>
+#include <sys/wait.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
 #include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <atf-c.h>
 
 #include "plist.h"
 #include "plist_txt.h"
+#include "plist_idx.h"
+#include "plist_bind.h"
+#include "plist_gen.h"
+#include "plist_genrt.h"
+#include "plist_bpl.h"
+#include "plist_xml.h"
+#include "plist_flat.h"
+#include "plist_json.h"
+#include "plist_io.h"
+#include "plist_cbor.h"
 
 
 ATF_TC(t_plist_new);
@@ -87,6 +102,10 @@ ATF_TC_BODY(t_plist_new, tc)
 	ATF_REQUIRE(plist_iselem(ptmp, plist_stoe("string")) == true);
 	ATF_REQUIRE(plist_iselem(ptmp, PLIST_UNKNOWN) == false);
 	plist_free(ptmp);
+	ATF_REQUIRE(plist_nstring_new(&ptmp, "string-tail", 6) == 0);
+	ATF_REQUIRE(plist_iselem(ptmp, PLIST_STRING) == true);
+	ATF_REQUIRE(strcmp(ptmp->p_string.ps_str, "string") == 0);
+	plist_free(ptmp);
 	ATF_REQUIRE(plist_format_new(&ptmp, "%s%c%s",
 				     "format", '-', "string") == 0);
 	ATF_REQUIRE(plist_iselem(ptmp, PLIST_STRING) == true);
@@ -319,7 +338,7 @@ const char *txtgood[] = {
 
 ATF_TC_BODY(t_plist_txt, tc)
 {
-	int i, j;
+	size_t i, j;
 	plist_t *ptmp1, *ptmp2;
 	plist_txt_t *parse;
 
@@ -350,11 +369,3092 @@ ATF_TC_BODY(t_plist_txt, tc)
 }
 
 
+ATF_TC(t_plist_txt_buf);
+ATF_TC_HEAD(t_plist_txt_buf, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt parser scratch buffer");
+}
+ATF_TC_BODY(t_plist_txt_buf, tc)
+{
+#define _STRLEN  (100 * 1000)
+#define _FRAGSZ  (1000)
+
+	size_t i, j;
+	char *doc;
+	size_t docsz;
+	plist_t *ptmp;
+	plist_txt_t *parse;
+
+	/* a quoted string that spans many input fragments */
+	docsz = _STRLEN + sizeof("\"\"");
+	doc = malloc(docsz);
+	ATF_REQUIRE(doc != NULL);
+	doc[0] = '"';
+	for (i = 1; i <= _STRLEN; i++) {
+		doc[i] = 'a' + (i % 26);
+	}
+	doc[_STRLEN + 1] = '"';
+	doc[_STRLEN + 2] = '\0';
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	for (j = 0; j < 2; j++) {
+		for (i = 0; i < docsz; i += _FRAGSZ) {
+			ATF_REQUIRE(plist_txt_parse(parse, &doc[i],
+			    (docsz - i < _FRAGSZ) ? docsz - i : _FRAGSZ) == 0);
+		}
+		ATF_REQUIRE(parse->pt_bufsz >= _STRLEN);
+		ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+		ATF_REQUIRE(plist_iselem(ptmp, PLIST_STRING) == true);
+		ATF_REQUIRE(strlen(ptmp->p_string.ps_str) == _STRLEN);
+		ATF_REQUIRE(memcmp(ptmp->p_string.ps_str, &doc[1],
+				   _STRLEN) == 0);
+		plist_free(ptmp);
+
+		/* the buffer is trimmed back to the high-water mark */
+		ATF_REQUIRE(parse->pt_bufsz <= PLIST_TXT_BUFMAX);
+	}
+
+	/* a reservation survives the reset and a zero mark releases */
+	ATF_REQUIRE(plist_txt_reserve(parse, 4096) == 0);
+	ATF_REQUIRE(parse->pt_bufsz >= 4096);
+	plist_txt_set_highwater(parse, 0);
+	ATF_REQUIRE(plist_txt_parse(parse, "\"x\"", 3) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	ATF_REQUIRE(parse->pt_buf == NULL && parse->pt_bufsz == 0);
+	ATF_REQUIRE(parse->pt_bufhint == 4096);
+	plist_free(ptmp);
+
+	/* booleans cut at the end of a fragment */
+	ATF_REQUIRE(plist_txt_parse(parse, "( tru", 5) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, "e, fals", 7) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, "e )", 3) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	ATF_REQUIRE(ptmp->p_array.pa_numelems == 2);
+	plist_free(ptmp);
+
+	plist_txt_free(parse);
+	free(doc);
+
+#undef _FRAGSZ
+#undef _STRLEN
+}
+
+
+ATF_TC(t_plist_txt_dupkey);
+ATF_TC_HEAD(t_plist_txt_dupkey, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt duplicate keys");
+}
+ATF_TC_BODY(t_plist_txt_dupkey, tc)
+{
+#define _NKEYS  (1000)
+
+	int i;
+	char *doc;
+	size_t docsz;
+	size_t off;
+	plist_t *ptmp;
+	plist_txt_t *parse;
+	char name[32];
+
+	docsz = _NKEYS * sizeof("\"key0000\" : 0000; ") + 32;
+	doc = malloc(docsz);
+	ATF_REQUIRE(doc != NULL);
+	off = snprintf(doc, docsz, "{ ");
+	for (i = 0; i < _NKEYS; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"\"key%d\" : %d; ", i, i);
+	}
+
+	/* every key is unique */
+	snprintf(&doc[off], docsz - off, "}");
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc) + 1) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	ATF_REQUIRE(ptmp->p_dict.pd_numkeys == _NKEYS);
+	for (i = 0; i < _NKEYS; i += 37) {
+		snprintf(name, sizeof(name), "key%d", i);
+		ATF_REQUIRE(plist_dict_haskey(ptmp, name) == true);
+	}
+	plist_free(ptmp);
+
+	/* repeat a key well past the point where the dict is hashed */
+	snprintf(&doc[off], docsz - off, "\"key%d\" : 0; }", _NKEYS / 2);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc) + 1) != 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == ENOENT);
+
+	/* and in a nested dictionary after a large one is closed */
+	ATF_REQUIRE(plist_txt_parse(parse, "( { \"a\" : 1; \"b\" : 2 }, "
+		    "{ \"a\" : 1; \"a\" : 2 } )", 46) != 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == ENOENT);
+
+	/* trusted input skips the check */
+	plist_txt_setflags(parse, PLIST_TXT_NODUPCHECK);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc) + 1) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	ATF_REQUIRE(ptmp->p_dict.pd_numkeys == _NKEYS + 1);
+	plist_free(ptmp);
+
+	/* flags changed inside a document wait for the next one */
+	ATF_REQUIRE(plist_txt_parse(parse, "{ \"a\" : { ", 10) == 0);
+	plist_txt_setflags(parse, 0);
+	ATF_REQUIRE(plist_txt_parse(parse, "}; \"a\" : 2 }", 12) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	ATF_REQUIRE(ptmp->p_dict.pd_numkeys == 2);
+	plist_free(ptmp);
+	ATF_REQUIRE(plist_txt_parse(parse, "{ \"a\" : { ", 10) == 0);
+	plist_txt_setflags(parse, PLIST_TXT_NODUPCHECK);
+	ATF_REQUIRE(plist_txt_parse(parse, "}; \"a\" : 2 }", 12) != 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == ENOENT);
+
+	plist_txt_free(parse);
+	free(doc);
+
+#undef _NKEYS
+}
+
+
+/* record the parse events as a string */
+struct saxlog_s {
+	char sl_buf[512];
+	size_t sl_off;
+	int sl_stop;
+	int sl_err;
+};
+
+static int
+_saxlog(void *arg, const char *fmt, ...)
+{
+	va_list ap;
+	struct saxlog_s *sl = arg;
+
+	va_start(ap, fmt);
+	sl->sl_off += vsnprintf(&sl->sl_buf[sl->sl_off],
+				sizeof(sl->sl_buf) - sl->sl_off, fmt, ap);
+	va_end(ap);
+	if (sl->sl_stop > 0 && --sl->sl_stop == 0) {
+		return (sl->sl_err != 0) ? sl->sl_err : ECANCELED;
+	}
+	return 0;
+}
+
+static int
+_sax_begin_dict(void *arg)
+{
+	return _saxlog(arg, "{");
+}
+
+static int
+_sax_end_dict(void *arg)
+{
+	return _saxlog(arg, "}");
+}
+
+static int
+_sax_key(void *arg, const char *name, size_t len)
+{
+	return _saxlog(arg, "k%.*s=", (int) len, name);
+}
+
+static int
+_sax_begin_array(void *arg)
+{
+	return _saxlog(arg, "(");
+}
+
+static int
+_sax_end_array(void *arg)
+{
+	return _saxlog(arg, ")");
+}
+
+static int
+_sax_string(void *arg, const char *s, size_t len)
+{
+	return _saxlog(arg, "s%.*s,", (int) len, s);
+}
+
+static int
+_sax_integer(void *arg, long long num)
+{
+	return _saxlog(arg, "i%lld,", num);
+}
+
+static int
+_sax_real(void *arg, double num)
+{
+	return _saxlog(arg, "r%g,", num);
+}
+
+static int
+_sax_boolean(void *arg, bool flag)
+{
+	return _saxlog(arg, "b%d,", flag);
+}
+
+static int
+_sax_data(void *arg, const void *buf, size_t sz)
+{
+	(void) buf;
+
+	return _saxlog(arg, "d%zu,", sz);
+}
+
+static int
+_sax_date(void *arg, const struct tm *tm)
+{
+	return _saxlog(arg, "t%d,", tm->tm_year + 1900);
+}
+
+static const plist_txt_sax_t saxlog = {
+	.psx_begin_dict = _sax_begin_dict,
+	.psx_end_dict = _sax_end_dict,
+	.psx_key = _sax_key,
+	.psx_begin_array = _sax_begin_array,
+	.psx_end_array = _sax_end_array,
+	.psx_string = _sax_string,
+	.psx_integer = _sax_integer,
+	.psx_real = _sax_real,
+	.psx_boolean = _sax_boolean,
+	.psx_data = _sax_data,
+	.psx_date = _sax_date,
+};
+
+ATF_TC(t_plist_txt_sax);
+ATF_TC_HEAD(t_plist_txt_sax, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt event parser");
+}
+ATF_TC_BODY(t_plist_txt_sax, tc)
+{
+	size_t j;
+	const char *doc;
+	const char *events;
+	struct saxlog_s sl;
+	plist_txt_t *parse;
+
+	doc = "{ \"a\" : ( 1, -2.5, \"s\\\"q\", true ); "
+	    "\"b\" : { \"c\" : <dead beef>; \"d\" : false }; "
+	    "\"e\" : <*1999-01-02 03:04:05 +0000> }";
+	events = "{ka=(i1,r-2.5,ss\"q,b1,)kb={kc=d4,kd=b0,}"
+	    "ke=t1999,}";
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+
+	memset(&sl, 0, sizeof(sl));
+	ATF_REQUIRE(plist_txt_sax_parse(parse, &saxlog, &sl,
+					doc, strlen(doc)) == 0);
+	ATF_REQUIRE(parse->pt_state == PLIST_TXT_STATE_DONE);
+	ATF_REQUIRE_STREQ(sl.sl_buf, events);
+	plist_txt_reset(parse);
+
+	/* a byte at a time */
+	memset(&sl, 0, sizeof(sl));
+	for (j = 0; j < strlen(doc); j++) {
+		ATF_REQUIRE(plist_txt_sax_parse(parse, &saxlog, &sl,
+						&doc[j], 1) == 0);
+	}
+	ATF_REQUIRE(parse->pt_state == PLIST_TXT_STATE_DONE);
+	ATF_REQUIRE_STREQ(sl.sl_buf, events);
+	plist_txt_reset(parse);
+
+	/* a callback error stops the parse */
+	memset(&sl, 0, sizeof(sl));
+	sl.sl_stop = 3;
+	ATF_REQUIRE(plist_txt_sax_parse(parse, &saxlog, &sl,
+					doc, strlen(doc)) == ECANCELED);
+	ATF_REQUIRE_STREQ(sl.sl_buf, "{ka=(");
+	ATF_REQUIRE(parse->pt_state == PLIST_TXT_STATE_ERROR);
+	plist_txt_reset(parse);
+
+	/* a negative callback result is an error, not a suspend */
+	memset(&sl, 0, sizeof(sl));
+	sl.sl_stop = 3;
+	sl.sl_err = -1;
+	ATF_REQUIRE(plist_txt_sax_parse(parse, &saxlog, &sl,
+					doc, strlen(doc)) == EINVAL);
+	ATF_REQUIRE_STREQ(sl.sl_buf, "{ka=(");
+	ATF_REQUIRE(parse->pt_state == PLIST_TXT_STATE_ERROR);
+	ATF_REQUIRE(plist_txt_sax_parse(parse, &saxlog, &sl,
+					doc, strlen(doc)) == EACCES);
+	plist_txt_reset(parse);
+
+	/* structure is still checked without a tree */
+	memset(&sl, 0, sizeof(sl));
+	ATF_REQUIRE(plist_txt_sax_parse(parse, &saxlog, &sl,
+					"{ 1 }", 5) != 0);
+	plist_txt_reset(parse);
+	ATF_REQUIRE(plist_txt_sax_parse(parse, &saxlog, &sl,
+					"( 1 }", 5) != 0);
+
+	plist_txt_free(parse);
+}
+
+
+/* log a pulled token the same way as the event callbacks */
+static void
+_toklog(struct saxlog_s *sl, const plist_txt_token_t *tok)
+{
+	switch (tok->ptk_type) {
+	case PLIST_TXT_TOK_BEGIN_DICT:
+		_sax_begin_dict(sl);
+		break;
+	case PLIST_TXT_TOK_END_DICT:
+		_sax_end_dict(sl);
+		break;
+	case PLIST_TXT_TOK_KEY:
+		_sax_key(sl, tok->ptk_ptr, tok->ptk_len);
+		break;
+	case PLIST_TXT_TOK_BEGIN_ARRAY:
+		_sax_begin_array(sl);
+		break;
+	case PLIST_TXT_TOK_END_ARRAY:
+		_sax_end_array(sl);
+		break;
+	case PLIST_TXT_TOK_STRING:
+		_sax_string(sl, tok->ptk_ptr, tok->ptk_len);
+		break;
+	case PLIST_TXT_TOK_INTEGER:
+		_sax_integer(sl, tok->ptk_integer);
+		break;
+	case PLIST_TXT_TOK_REAL:
+		_sax_real(sl, tok->ptk_real);
+		break;
+	case PLIST_TXT_TOK_BOOLEAN:
+		_sax_boolean(sl, tok->ptk_boolean);
+		break;
+	case PLIST_TXT_TOK_DATA:
+		_sax_data(sl, tok->ptk_ptr, tok->ptk_len);
+		break;
+	case PLIST_TXT_TOK_DATE:
+		_sax_date(sl, &tok->ptk_date);
+		break;
+	default:
+		_saxlog(sl, "?");
+		break;
+	}
+	return;
+}
+
+ATF_TC(t_plist_txt_token);
+ATF_TC_HEAD(t_plist_txt_token, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt pull tokenizer");
+}
+ATF_TC_BODY(t_plist_txt_token, tc)
+{
+	size_t j;
+	int err;
+	const char *doc;
+	const char *events;
+	struct saxlog_s sl;
+	plist_txt_t *parse;
+	plist_txt_token_t tok;
+
+	doc = "{ \"a\" : ( 1, -2.5, \"s\\\"q\", true ); "
+	    "\"b\" : { \"c\" : <dead beef>; \"d\" : false }; "
+	    "\"e\" : <*1999-01-02 03:04:05 +0000> }";
+	events = "{ka=(i1,r-2.5,ss\"q,b1,)kb={kc=d4,kd=b0,}"
+	    "ke=t1999,}";
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+
+	/* nothing fed yet */
+	ATF_REQUIRE(plist_txt_next_token(parse, &tok) == EAGAIN);
+
+	/* the whole document in one fragment */
+	memset(&sl, 0, sizeof(sl));
+	ATF_REQUIRE(plist_txt_feed(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_feed(parse, doc, strlen(doc)) == EBUSY);
+	ATF_REQUIRE(plist_txt_next_token(parse, &tok) == 0);
+	ATF_REQUIRE(tok.ptk_type == PLIST_TXT_TOK_BEGIN_DICT);
+	_toklog(&sl, &tok);
+	ATF_REQUIRE(plist_txt_next_token(parse, &tok) == 0);
+	ATF_REQUIRE(tok.ptk_type == PLIST_TXT_TOK_KEY);
+	ATF_REQUIRE(tok.ptk_ptr == &doc[3] && tok.ptk_len == 1);
+	ATF_REQUIRE(tok.ptk_copied == false);
+	_toklog(&sl, &tok);
+	while ((err = plist_txt_next_token(parse, &tok)) == 0) {
+		if (tok.ptk_type == PLIST_TXT_TOK_STRING) {
+			/* escaped so it was assembled in the buffer */
+			ATF_REQUIRE(tok.ptk_copied == true);
+		}
+		_toklog(&sl, &tok);
+	}
+	ATF_REQUIRE(err == ENOENT);
+	ATF_REQUIRE(parse->pt_state == PLIST_TXT_STATE_DONE);
+	ATF_REQUIRE_STREQ(sl.sl_buf, events);
+	plist_txt_reset(parse);
+
+	/* a byte at a time */
+	memset(&sl, 0, sizeof(sl));
+	for (j = 0; j < strlen(doc); j++) {
+		ATF_REQUIRE(plist_txt_feed(parse, &doc[j], 1) == 0);
+		while ((err = plist_txt_next_token(parse, &tok)) == 0) {
+			_toklog(&sl, &tok);
+		}
+		ATF_REQUIRE(err == EAGAIN || err == ENOENT);
+	}
+	ATF_REQUIRE(err == ENOENT);
+	ATF_REQUIRE_STREQ(sl.sl_buf, events);
+	plist_txt_reset(parse);
+
+	/* structure is still checked */
+	ATF_REQUIRE(plist_txt_feed(parse, "( 1 }", 5) == 0);
+	ATF_REQUIRE(plist_txt_next_token(parse, &tok) == 0);
+	ATF_REQUIRE(plist_txt_next_token(parse, &tok) == 0);
+	ATF_REQUIRE(tok.ptk_type == PLIST_TXT_TOK_INTEGER);
+	ATF_REQUIRE(plist_txt_next_token(parse, &tok) == EACCES);
+
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_idx);
+ATF_TC_HEAD(t_plist_idx, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist structural index");
+}
+ATF_TC_BODY(t_plist_idx, tc)
+{
+	char buf[67];
+	const char *doc;
+	size_t count;
+	plist_t *ptmp;
+	plist_idx_t *idx;
+	plist_idx_node_t root;
+	plist_idx_node_t node;
+	plist_idx_node_t elem;
+
+	/* structural characters inside strings and data are skipped */
+	doc = " { \"s\" = \"a;b{(\\\"=\"; "
+	    "\"t\\\"k\" : <*1999-01-02 03:04:05 +0000>; "
+	    "\"list\" = ( 1, { \"x\" = -2.5 }, ( ), \"q\", true, ); "
+	    "\"n\" = 42 } ";
+
+	ATF_REQUIRE(plist_idx_new(&idx, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_idx_root(idx, &root) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &root) == PLIST_DICT);
+	ATF_REQUIRE(plist_idx_count(idx, &root, &count) == 0);
+	ATF_REQUIRE_EQ(count, 4);
+
+	ATF_REQUIRE(plist_idx_lookup(idx, &root, "s", &node) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &node) == PLIST_STRING);
+	ATF_REQUIRE(plist_idx_plist(idx, &node, &ptmp) == 0);
+	ATF_REQUIRE_STREQ(ptmp->p_string.ps_str, "a;b{(\"=");
+	plist_free(ptmp);
+
+	/* escaped key */
+	ATF_REQUIRE(plist_idx_lookup(idx, &root, "t\"k", &node) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &node) == PLIST_DATE);
+
+	ATF_REQUIRE(plist_idx_lookup(idx, &root, "n", &node) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &node) == PLIST_INTEGER);
+	ATF_REQUIRE(plist_idx_plist(idx, &node, &ptmp) == 0);
+	ATF_REQUIRE_EQ(ptmp->p_integer.pi_int, 42);
+	plist_free(ptmp);
+	ATF_REQUIRE(plist_idx_lookup(idx, &root, "nope", &node) == ENOENT);
+
+	ATF_REQUIRE(plist_idx_lookup(idx, &root, "list", &node) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &node) == PLIST_ARRAY);
+	ATF_REQUIRE(plist_idx_count(idx, &node, &count) == 0);
+	ATF_REQUIRE_EQ(count, 5);
+	ATF_REQUIRE(plist_idx_at(idx, &node, 0, &elem) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &elem) == PLIST_INTEGER);
+	ATF_REQUIRE(plist_idx_at(idx, &node, 2, &elem) == 0);
+	ATF_REQUIRE(plist_idx_count(idx, &elem, &count) == 0);
+	ATF_REQUIRE_EQ(count, 0);
+	ATF_REQUIRE(plist_idx_at(idx, &node, 4, &elem) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &elem) == PLIST_BOOLEAN);
+	ATF_REQUIRE(plist_idx_at(idx, &node, 5, &elem) == ENOENT);
+
+	ATF_REQUIRE(plist_idx_at(idx, &node, 1, &elem) == 0);
+	ATF_REQUIRE(plist_idx_lookup(idx, &elem, "x", &elem) == 0);
+	ATF_REQUIRE(plist_idx_type(idx, &elem) == PLIST_REAL);
+
+	/* a subtree is parsed on its own */
+	ATF_REQUIRE(plist_idx_plist(idx, &node, &ptmp) == 0);
+	ATF_REQUIRE(ptmp->p_elem == PLIST_ARRAY);
+	plist_free(ptmp);
+
+	/* wrong container type */
+	ATF_REQUIRE(plist_idx_at(idx, &root, 0, &elem) == EINVAL);
+	plist_idx_free(idx);
+
+	/* an escape at the end of a block escapes the next block */
+	memset(buf, 'a', sizeof(buf));
+	buf[0] = '"';
+	buf[63] = '\\';
+	buf[64] = '"';
+	buf[66] = '"';
+	ATF_REQUIRE(plist_idx_new(&idx, buf, 67) == 0);
+	ATF_REQUIRE(plist_idx_root(idx, &root) == 0);
+	ATF_REQUIRE(plist_idx_plist(idx, &root, &ptmp) == 0);
+	ATF_REQUIRE_EQ(strlen(ptmp->p_string.ps_str), 64);
+	plist_free(ptmp);
+	plist_idx_free(idx);
+
+	/* an escaped backslash does not escape the closing quote */
+	doc = "( \"a\\\\\", \"b\" )";
+	ATF_REQUIRE(plist_idx_new(&idx, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_idx_root(idx, &root) == 0);
+	ATF_REQUIRE(plist_idx_count(idx, &root, &count) == 0);
+	ATF_REQUIRE_EQ(count, 2);
+	plist_idx_free(idx);
+
+	/* nesting is checked when the index is built */
+	doc = "{ \"a\" = ( 1, 2 }";
+	ATF_REQUIRE(plist_idx_new(&idx, doc, strlen(doc)) == EINVAL);
+	doc = "( \"a )";
+	ATF_REQUIRE(plist_idx_new(&idx, doc, strlen(doc)) == EINVAL);
+}
+
+
+ATF_TC(t_plist_txt_parallel);
+ATF_TC_HEAD(t_plist_txt_parallel, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt parallel parse");
+}
+ATF_TC_BODY(t_plist_txt_parallel, tc)
+{
+#define _NRECS  40000
+
+	int i;
+	char *doc;
+	size_t docsz;
+	size_t off;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_t *pelem;
+	plist_txt_t *parse;
+
+	/* separators inside strings and data must not split the array */
+	docsz = _NRECS * 128 + 16;
+	doc = malloc(docsz);
+	ATF_REQUIRE(doc != NULL);
+	off = snprintf(doc, docsz, " ( ");
+	for (i = 0; i < _NRECS; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"n\" = %d; \"s\" = \"a, (b) \\\"}, \"; "
+				"\"d\" = <*1999-01-02 03:04:05 +0000>; "
+				"\"l\" = ( %d, \"x,y\" ) }, ", i, i);
+	}
+	off += snprintf(&doc[off], docsz - off, ")");
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, off) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE_EQ(ptmp1->p_array.pa_numelems, _NRECS);
+
+	ATF_REQUIRE(plist_txt_parse_parallel(parse, doc, off, 4) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE_EQ(ptmp2->p_array.pa_numelems, _NRECS);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	TAILQ_FOREACH(pelem, &ptmp2->p_array.pa_elems, p_entry) {
+		ATF_REQUIRE(pelem->p_parent == ptmp2);
+	}
+	plist_free(ptmp1);
+	plist_free(ptmp2);
+
+	/* an error in any piece fails the parse */
+	strstr(&doc[off / 2], "{ \"n\"")[0] = '(';
+	ATF_REQUIRE(plist_txt_parse_parallel(parse, doc, off, 4) != 0);
+	plist_txt_reset(parse);
+
+	/* other documents are parsed serially */
+	ATF_REQUIRE(plist_txt_parse_parallel(parse, "{ \"a\" = 1 }", 11,
+					     4) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(ptmp1->p_elem == PLIST_DICT);
+	plist_free(ptmp1);
+
+	/* only a fresh context */
+	ATF_REQUIRE(plist_txt_parse(parse, "( 1,", 4) == 0);
+	ATF_REQUIRE(plist_txt_parse_parallel(parse, doc, off, 4) == EBUSY);
+
+	plist_txt_free(parse);
+	free(doc);
+
+#undef _NRECS
+}
+
+
+ATF_TC(t_plist_txt_file);
+ATF_TC_HEAD(t_plist_txt_file, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt file parsing");
+}
+ATF_TC_BODY(t_plist_txt_file, tc)
+{
+	int fd;
+	int pfd[2];
+	char path[] = "t_plist.XXXXXX";
+	const char *doc;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse;
+
+	doc = "{ \"a\" = ( 1, 2.5, \"s\" ); \"b\" = <0102> }";
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+
+	/* a mapped file */
+	fd = mkstemp(path);
+	ATF_REQUIRE(fd >= 0);
+	ATF_REQUIRE(write(fd, doc, strlen(doc)) == (ssize_t) strlen(doc));
+	ATF_REQUIRE(plist_txt_parse_file(parse, path) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+
+	/* from the current offset */
+	ATF_REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+	ATF_REQUIRE(write(fd, "xxxx", 4) == 4);
+	ATF_REQUIRE(write(fd, doc, strlen(doc)) == (ssize_t) strlen(doc));
+	ATF_REQUIRE(lseek(fd, 4, SEEK_SET) == 4);
+	ATF_REQUIRE(plist_txt_parse_fd(parse, fd) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+
+	/* a top level number ends with the file */
+	ATF_REQUIRE(ftruncate(fd, 0) == 0);
+	ATF_REQUIRE(pwrite(fd, "42", 2, 0) == 2);
+	ATF_REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+	ATF_REQUIRE(plist_txt_parse_fd(parse, fd) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE_EQ(ptmp2->p_integer.pi_int, 42);
+	plist_free(ptmp2);
+
+	/* a truncated document has no result */
+	ATF_REQUIRE(ftruncate(fd, 0) == 0);
+	ATF_REQUIRE(pwrite(fd, doc, 10, 0) == 10);
+	ATF_REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+	ATF_REQUIRE(plist_txt_parse_fd(parse, fd) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == ENOENT);
+	close(fd);
+	unlink(path);
+
+	/* a pipe is read */
+	ATF_REQUIRE(pipe(pfd) == 0);
+	ATF_REQUIRE(write(pfd[1], doc, strlen(doc)) == (ssize_t) strlen(doc));
+	close(pfd[1]);
+	ATF_REQUIRE(plist_txt_parse_fd(parse, pfd[0]) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	close(pfd[0]);
+
+	ATF_REQUIRE(plist_txt_parse_file(parse, path) == ENOENT);
+
+	plist_free(ptmp1);
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_txt_borrow);
+ATF_TC_HEAD(t_plist_txt_borrow, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt borrowed storage");
+}
+ATF_TC_BODY(t_plist_txt_borrow, tc)
+{
+#define _INBUF(_p)  ((const char *) (_p) >= buf && \
+		     (const char *) (_p) < &buf[strlen(doc)])
+
+	char *buf;
+	const char *doc;
+	const char *lit;
+	plist_t *pkey;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_t *pval;
+	plist_txt_t *parse;
+
+	doc = "{ \"name\" = \"value\"; \"esc\" = \"a\\\"b\"; "
+	      "\"blob\" = <0102 03>; \"list\" = ( \"x\", 1 ) }";
+	buf = strdup(doc);
+	ATF_REQUIRE(buf != NULL);
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(plist_txt_parse_borrowed(parse, buf, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+
+	/* keys, plain strings and data refer to the input */
+	pkey = TAILQ_FIRST(&ptmp2->p_dict.pd_keys);
+	ATF_REQUIRE(_INBUF(pkey->p_key.pk_name));
+	ATF_REQUIRE(_INBUF(pkey->p_key.pk_value->p_string.ps_str));
+	pkey = TAILQ_NEXT(pkey, p_entry);
+	ATF_REQUIRE(_INBUF(pkey->p_key.pk_name));
+	ATF_REQUIRE(!_INBUF(pkey->p_key.pk_value->p_string.ps_str));
+	pkey = TAILQ_NEXT(pkey, p_entry);
+	pval = pkey->p_key.pk_value;
+	ATF_REQUIRE(_INBUF(pval->p_data.pd_data));
+	ATF_REQUIRE(pval->p_data.pd_datasz == 3);
+	ATF_REQUIRE(memcmp(pval->p_data.pd_data, "\1\2\3", 3) == 0);
+
+	/* detached copies survive the input */
+	ATF_REQUIRE(plist_detach_storage(&ptmp2) == 0);
+	pkey = TAILQ_FIRST(&ptmp2->p_dict.pd_keys);
+	ATF_REQUIRE(!_INBUF(pkey->p_key.pk_name));
+	ATF_REQUIRE(pkey->p_key.pk_value->p_parent == pkey);
+	pkey = TAILQ_NEXT(TAILQ_NEXT(TAILQ_NEXT(pkey, p_entry), p_entry),
+			  p_entry);
+	pval = TAILQ_FIRST(&pkey->p_key.pk_value->p_array.pa_elems);
+	ATF_REQUIRE(!_INBUF(pval->p_string.ps_str));
+	memset(buf, 0, strlen(doc));
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_free(ptmp1);
+
+	/* a top level string moves when it is detached */
+	strcpy(buf, "\"top\"");
+	ATF_REQUIRE(plist_txt_parse_borrowed(parse, buf, strlen(buf)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(ptmp1->p_string.ps_str == &buf[1]);
+	ATF_REQUIRE(plist_detach_storage(&ptmp1) == 0);
+	ATF_REQUIRE(ptmp1->p_string.ps_str == (char *) &ptmp1[1]);
+	ATF_REQUIRE(strcmp(ptmp1->p_string.ps_str, "top") == 0);
+	plist_free(ptmp1);
+
+	/* bad hex is refused before the data is decoded over the input */
+	strcpy(buf, "( \"s\", <01zz> )");
+	ATF_REQUIRE(plist_txt_parse_borrowed(parse, buf, strlen(buf)) ==
+		    EACCES);
+	ATF_REQUIRE(strcmp(&buf[8], "01zz> )") == 0);
+	plist_txt_reset(parse);
+	ATF_REQUIRE(plist_txt_parse(parse, "<01zz>", 6) == EACCES);
+	plist_txt_reset(parse);
+
+	/* the reference constructors */
+	lit = "literal";
+	ATF_REQUIRE(plist_string_ref_new(&ptmp1, lit) == 0);
+	ATF_REQUIRE(ptmp1->p_string.ps_str == lit);
+	ATF_REQUIRE(plist_data_ref_new(&ptmp2, lit, 3) == 0);
+	ATF_REQUIRE(ptmp2->p_data.pd_data == lit);
+	plist_free(ptmp2);
+	ATF_REQUIRE(plist_array_new(&ptmp2) == 0);
+	ATF_REQUIRE(plist_array_append(ptmp2, ptmp1) == 0);
+	ATF_REQUIRE(plist_detach_storage(&ptmp2) == 0);
+	ptmp1 = TAILQ_FIRST(&ptmp2->p_array.pa_elems);
+	ATF_REQUIRE(ptmp1->p_string.ps_str != lit);
+	ATF_REQUIRE(ptmp1->p_parent == ptmp2);
+	ATF_REQUIRE(strcmp(ptmp1->p_string.ps_str, lit) == 0);
+	plist_free(ptmp2);
+
+	plist_txt_free(parse);
+	free(buf);
+
+#undef _INBUF
+}
+
+
+ATF_TC(t_plist_txt_stream);
+ATF_TC_HEAD(t_plist_txt_stream, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt stream of documents");
+}
+ATF_TC_BODY(t_plist_txt_stream, tc)
+{
+	int n;
+	size_t off;
+	size_t len;
+	size_t used;
+	size_t fragsz;
+	size_t docsz;
+	const char *cp;
+	const char *doc;
+	plist_t *ptmp;
+	plist_txt_t *parse;
+	static const enum plist_elem_e elems[] = {
+		PLIST_DICT, PLIST_ARRAY, PLIST_STRING, PLIST_INTEGER,
+		PLIST_DATA
+	};
+
+	doc = "{ \"a\" = 1; }( 1, 2 )\"s\"\n42 <00ff>";
+	docsz = strlen(doc);
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	for (fragsz = 1; fragsz <= docsz; fragsz++) {
+		n = 0;
+		for (off = 0; off < docsz; off += fragsz) {
+			cp = &doc[off];
+			len = (docsz - off < fragsz) ? docsz - off : fragsz;
+			while (len > 0) {
+				if (plist_txt_parse_next(parse, cp, len,
+							 &used) != 0) {
+					ATF_REQUIRE(used == len);
+					break;
+				}
+				ATF_REQUIRE(used <= len);
+				ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+				ATF_REQUIRE(n < 5);
+				ATF_REQUIRE(plist_iselem(ptmp, elems[n]) == true);
+				plist_free(ptmp);
+				cp += used;
+				len -= used;
+				n++;
+			}
+		}
+		ATF_REQUIRE_EQ(n, 5);
+	}
+
+	/* an uncollected document holds up the stream */
+	ATF_REQUIRE(plist_txt_parse_next(parse, "()()", 4, &used) == 0);
+	ATF_REQUIRE_EQ(used, 2);
+	ATF_REQUIRE(plist_txt_parse_next(parse, "()", 2, &used) == 0);
+	ATF_REQUIRE_EQ(used, 0);
+	plist_txt_reset(parse);
+
+	/* errors stop the stream */
+	ATF_REQUIRE(plist_txt_parse_next(parse, "( } )", 5, &used) != 0);
+	plist_txt_reset(parse);
+	ATF_REQUIRE(plist_txt_parse_next(parse, "( 7 )", 5, &used) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	plist_free(ptmp);
+
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_txt_pool);
+ATF_TC_HEAD(t_plist_txt_pool, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt compact contexts");
+}
+ATF_TC_BODY(t_plist_txt_pool, tc)
+{
+	int i;
+	void *buf;
+	const char *doc;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse1;
+	plist_txt_t *parse2;
+	plist_txt_pool_t *pool;
+	plist_txt_token_t tok;
+
+	ATF_REQUIRE(plist_txt_pool_new(&pool, 8, 2) == EINVAL);
+	ATF_REQUIRE(plist_txt_pool_new(&pool, 64, 2) == 0);
+	ATF_REQUIRE(plist_txt_new(&parse1) == 0);
+	ATF_REQUIRE(plist_txt_new(&parse2) == 0);
+	plist_txt_setpool(parse1, pool);
+	plist_txt_setpool(parse2, pool);
+
+	/* the buffer is only held while a value spans fragments */
+	ATF_REQUIRE(plist_txt_parse(parse1, "( \"abc", 7) == 0);
+	ATF_REQUIRE(parse1->pt_buf != NULL);
+	buf = parse1->pt_buf;
+	ATF_REQUIRE(plist_txt_parse(parse1, "def\", 1 ", 8) == 0);
+	ATF_REQUIRE(parse1->pt_buf == NULL);
+	ATF_REQUIRE(plist_txt_parse(parse2, "\"x", 2) == 0);
+	ATF_REQUIRE(parse2->pt_buf == buf);
+	ATF_REQUIRE(plist_txt_parse(parse2, "\"", 1) == 0);
+	ATF_REQUIRE(parse2->pt_buf == NULL);
+	ATF_REQUIRE(plist_txt_result(parse2, &ptmp1) == 0);
+	ATF_REQUIRE(strcmp(ptmp1->p_string.ps_str, "x") == 0);
+	plist_free(ptmp1);
+
+	/* and nothing is held between documents */
+	ATF_REQUIRE(plist_txt_parse(parse1, " )", 2) == 0);
+	ATF_REQUIRE(plist_txt_result(parse1, &ptmp1) == 0);
+	ATF_REQUIRE(ptmp1->p_array.pa_numelems == 2);
+	plist_free(ptmp1);
+	ATF_REQUIRE(parse1->pt_stack == NULL && parse1->pt_keysets == NULL);
+
+	/* compact contexts parse the same as any other */
+	doc = "{ \"k\\\"ey\" = ( \"a b c\", 12345, -1.5e3, <0a0b0c>, "
+	      "true, false, <*2011-11-12 18:31:01 +0000> ); "
+	      "\"long string value past the pooled buffer size ....\" = "
+	      "{ } }";
+	ATF_REQUIRE(plist_txt_parse(parse2, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse2, &ptmp2) == 0);
+	for (i = 0; doc[i] != '\0'; i++) {
+		ATF_REQUIRE(plist_txt_parse(parse1, &doc[i], 1) == 0);
+	}
+	ATF_REQUIRE(plist_txt_result(parse1, &ptmp1) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp1);
+	plist_free(ptmp2);
+
+	/* a copied token stays valid until the next call */
+	ATF_REQUIRE(plist_txt_feed(parse1, "\"a\\tb\" ", 8) == 0);
+	ATF_REQUIRE(plist_txt_next_token(parse1, &tok) == 0);
+	ATF_REQUIRE(tok.ptk_copied == true);
+	ATF_REQUIRE(memcmp(tok.ptk_ptr, "a\tb", 3) == 0);
+	ATF_REQUIRE(plist_txt_next_token(parse1, &tok) == ENOENT);
+	plist_txt_reset(parse1);
+
+	/* back to a private buffer */
+	plist_txt_setpool(parse1, NULL);
+	ATF_REQUIRE(plist_txt_parse(parse1, "\"abc", 4) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse1, "\"", 1) == 0);
+	ATF_REQUIRE(parse1->pt_buf != NULL);
+	ATF_REQUIRE(plist_txt_result(parse1, &ptmp1) == 0);
+	plist_free(ptmp1);
+
+	plist_txt_free(parse1);
+	plist_txt_free(parse2);
+	plist_txt_pool_free(pool);
+}
+
+
+ATF_TC(t_plist_txt_dispatch);
+ATF_TC_HEAD(t_plist_txt_dispatch, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt character classes");
+}
+ATF_TC_BODY(t_plist_txt_dispatch, tc)
+{
+	size_t i;
+	const char *doc;
+	const char *bad[] = { "@", "\0", "\xff", "( 1 ]", "{ \"a\" # 1 }" };
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse;
+
+	/* every class and every kind of whitespace, whole and by bytes */
+	doc = "{\t\"a\":TRUE;\r\n\"b\" = (False,\v-12, 3.25E+2,\f"
+	      "<0A 0b\n0c>, \"e\\\"s\", {}, ()); \"c\"=t\x72ue }";
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(ptmp1->p_dict.pd_numkeys == 3);
+	for (i = 0; doc[i] != '\0'; i++) {
+		ATF_REQUIRE(plist_txt_parse(parse, &doc[i], 1) == 0);
+	}
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp1);
+	plist_free(ptmp2);
+
+	/* anything outside the classes stops the parse for good */
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		ATF_REQUIRE(plist_txt_parse(parse, bad[i],
+					    strlen(bad[i]) + 1) == EINVAL);
+		ATF_REQUIRE(plist_txt_parse(parse, " 1 ", 3) == EACCES);
+		plist_txt_reset(parse);
+	}
+
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_txt_paths);
+ATF_TC_HEAD(t_plist_txt_paths, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist txt key path projection");
+}
+ATF_TC_BODY(t_plist_txt_paths, tc)
+{
+	int i;
+	const char *doc;
+	const char *want;
+	const char *bad1[] = { "" };
+	const char *bad2[] = { "a//b" };
+	const char *paths[] = {
+		"header/version", "header/name", "list/id",
+		"keep", "keep/a/b", "missing/x"
+	};
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse;
+	plist_txt_paths_t *pp;
+
+	ATF_REQUIRE(plist_txt_paths_new(&pp, bad1, 1) == EINVAL);
+	ATF_REQUIRE(plist_txt_paths_new(&pp, bad2, 1) == EINVAL);
+	ATF_REQUIRE(plist_txt_paths_new(&pp, paths, 6) == 0);
+
+	doc = "{ \"header\" = { \"version\" = 3; \"name\" = \"x\"; "
+	      "\"junk\" = ( \"a\\\"})\", { \"q\" = 1; } ) }; "
+	      "\"big\" = ( { \"x\" = \"y;\" }, <00ff>, \"s\" ); "
+	      "\"bad\" = ( @@ 1 2 ); "
+	      "\"list\" = ( { \"id\" = 1; \"skip\" = { } }, { \"id\" = 2 }, 7 ); "
+	      "\"keep\" = { \"a\" = { \"b\" = 1 }; \"c\" = true }; "
+	      "\"tail\" = \"z\" }";
+	want = "{ \"header\" = { \"version\" = 3; \"name\" = \"x\" }; "
+	       "\"list\" = ( { \"id\" = 1 }, { \"id\" = 2 }, 7 ); "
+	       "\"keep\" = { \"a\" = { \"b\" = 1 }; \"c\" = true } }";
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, want, strlen(want)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+
+	/* only the branches on the paths, whole and by bytes */
+	plist_txt_setpaths(parse, pp);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	for (i = 0; doc[i] != '\0'; i++) {
+		ATF_REQUIRE(plist_txt_parse(parse, &doc[i], 1) == 0);
+	}
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_free(ptmp1);
+
+	/* the structure outside of a skipped value is still checked */
+	ATF_REQUIRE(plist_txt_parse(parse, "{ \"big\" = 1 ) ", 14) == EACCES);
+	plist_txt_reset(parse);
+
+	/* and the whole document without the paths */
+	plist_txt_setpaths(parse, NULL);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == EINVAL);
+	plist_txt_reset(parse);
+
+	plist_txt_free(parse);
+	plist_txt_paths_free(pp);
+}
+
+
+struct t_bind_log {
+	int8_t level;
+	char *path;
+};
+
+struct t_bind_host {
+	char name[8];
+	int16_t port;
+	bool up;
+};
+
+struct t_bind_conf {
+	int32_t version;
+	double ratio;
+	float small;
+	char *owner;
+	plist_bind_vector_t mac;
+	struct tm when;
+	struct t_bind_log log;
+	plist_bind_vector_t hosts;
+	plist_bind_vector_t ports;
+	int untouched;
+};
+
+static const plist_bind_desc_t t_bind_short_fields[] = {
+	{ "r", PLIST_BIND_REAL, 0, sizeof(short), NULL, NULL, NULL },
+	{ "b", PLIST_BIND_BOOLEAN, 0, sizeof(short), NULL, NULL, NULL },
+	{ "t", PLIST_BIND_DATE, 0, sizeof(short), NULL, NULL, NULL },
+	{ "s", PLIST_BIND_STRING, 0, sizeof(short), NULL, NULL, NULL },
+	{ "d", PLIST_BIND_DATA, 0, sizeof(short), NULL, NULL, NULL },
+	PLIST_BIND_END
+};
+
+static const plist_bind_desc_t t_bind_log_fields[] = {
+	PLIST_BIND_FIELD("level", PLIST_BIND_INTEGER, struct t_bind_log, level),
+	PLIST_BIND_FIELD("path", PLIST_BIND_STRING, struct t_bind_log, path),
+	PLIST_BIND_END
+};
+
+static const plist_bind_desc_t t_bind_host_fields[] = {
+	PLIST_BIND_FIELD("name", PLIST_BIND_STRBUF, struct t_bind_host, name),
+	PLIST_BIND_FIELD("port", PLIST_BIND_INTEGER, struct t_bind_host, port),
+	PLIST_BIND_FIELD("up", PLIST_BIND_BOOLEAN, struct t_bind_host, up),
+	PLIST_BIND_END
+};
+
+static const plist_bind_desc_t t_bind_host = {
+	NULL, PLIST_BIND_STRUCT, 0, sizeof(struct t_bind_host),
+	t_bind_host_fields, NULL, NULL
+};
+
+static const plist_bind_desc_t t_bind_port = {
+	NULL, PLIST_BIND_INTEGER, 0, sizeof(int), NULL, NULL, NULL
+};
+
+static const plist_bind_desc_t t_bind_conf_fields[] = {
+	PLIST_BIND_FIELD("version", PLIST_BIND_INTEGER,
+			 struct t_bind_conf, version),
+	PLIST_BIND_FIELD("ratio", PLIST_BIND_REAL, struct t_bind_conf, ratio),
+	PLIST_BIND_FIELD("small", PLIST_BIND_REAL, struct t_bind_conf, small),
+	PLIST_BIND_FIELD("owner", PLIST_BIND_STRING,
+			 struct t_bind_conf, owner),
+	PLIST_BIND_FIELD("mac", PLIST_BIND_DATA, struct t_bind_conf, mac),
+	PLIST_BIND_FIELD("when", PLIST_BIND_DATE, struct t_bind_conf, when),
+	PLIST_BIND_NESTED("log", struct t_bind_conf, log, t_bind_log_fields),
+	PLIST_BIND_VECTOR("hosts", struct t_bind_conf, hosts, &t_bind_host),
+	PLIST_BIND_VECTOR("ports", struct t_bind_conf, ports, &t_bind_port),
+	PLIST_BIND_END
+};
+
+/**
+ * Check everything that the bind test document sets
+ */
+static void
+t_bind_check(const struct t_bind_conf *conf)
+{
+	const struct t_bind_host *host;
+	const int *port;
+
+	ATF_REQUIRE(conf->version == 3);
+	ATF_REQUIRE(conf->ratio == 2.0);
+	ATF_REQUIRE(conf->small == 0.25);
+	ATF_REQUIRE(strcmp(conf->owner, "o\"ps") == 0);
+	ATF_REQUIRE(conf->mac.pbv_nelems == 3);
+	ATF_REQUIRE(memcmp(conf->mac.pbv_elems, "\x00\x11\x22", 3) == 0);
+	ATF_REQUIRE(conf->when.tm_year == 111 && conf->when.tm_min == 31);
+	ATF_REQUIRE(conf->log.level == -2);
+	ATF_REQUIRE(strcmp(conf->log.path, "/var/log") == 0);
+	ATF_REQUIRE(conf->hosts.pbv_nelems == 2);
+	host = conf->hosts.pbv_elems;
+	ATF_REQUIRE(strcmp(host[0].name, "a") == 0 && host[0].port == 80);
+	ATF_REQUIRE(host[0].up == true);
+	ATF_REQUIRE(strcmp(host[1].name, "bb") == 0 && host[1].port == 0);
+	ATF_REQUIRE(host[1].up == false);
+	ATF_REQUIRE(conf->ports.pbv_nelems == 3);
+	port = conf->ports.pbv_elems;
+	ATF_REQUIRE(port[0] == 1 && port[1] == 2 && port[2] == 3);
+	ATF_REQUIRE(conf->untouched == 42);
+}
+
+ATF_TC(t_plist_bind);
+ATF_TC_HEAD(t_plist_bind, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist bind into structures");
+}
+ATF_TC_BODY(t_plist_bind, tc)
+{
+	int i;
+	const char *doc;
+	struct t_bind_conf conf;
+	plist_t *ptmp;
+	plist_txt_t *parse;
+	plist_bind_t *bind;
+
+	doc = "{ \"version\" = 3; \"ratio\" = 2; \"small\" = 0.25; "
+	      "\"owner\" = \"o\\\"ps\"; \"mac\" = <001122>; "
+	      "\"when\" = <*2011-11-12 18:31:01 +0000>; "
+	      "\"extra\" = { \"x\" = ( 1, { \"y\" = 2 } ) }; "
+	      "\"log\" = { \"level\" = -2; \"path\" = \"/var/log\"; "
+	      "\"other\" = true }; "
+	      "\"hosts\" = ( { \"name\" = \"a\"; \"port\" = 80; \"up\" = true }, "
+	      "{ \"name\" = \"bb\" } ); \"ports\" = ( 1, 2, 3 ) }";
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+
+	/* straight from the text */
+	memset(&conf, 0, sizeof(conf));
+	conf.untouched = 42;
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == 0);
+	t_bind_check(&conf);
+	plist_bind_release(t_bind_conf_fields, &conf);
+	ATF_REQUIRE(conf.owner == NULL && conf.hosts.pbv_elems == NULL);
+
+	/* the event sink across fragments */
+	memset(&conf, 0, sizeof(conf));
+	conf.untouched = 42;
+	ATF_REQUIRE(plist_bind_new(&bind, t_bind_conf_fields, &conf) == 0);
+	for (i = 0; doc[i] != '\0'; i++) {
+		ATF_REQUIRE(plist_txt_sax_parse(parse, &plist_bind_sax, bind,
+						&doc[i], 1) == 0);
+	}
+	ATF_REQUIRE(bind->pb_done == true);
+	plist_bind_free(bind);
+	plist_txt_reset(parse);
+	t_bind_check(&conf);
+	plist_bind_release(t_bind_conf_fields, &conf);
+
+	/* and from a tree */
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	memset(&conf, 0, sizeof(conf));
+	conf.untouched = 42;
+	ATF_REQUIRE(plist_bind(ptmp, t_bind_conf_fields, &conf) == 0);
+	t_bind_check(&conf);
+
+	/* binding again and repeated keys replace what was there */
+	ATF_REQUIRE(plist_bind(ptmp, t_bind_conf_fields, &conf) == 0);
+	t_bind_check(&conf);
+	doc = "{ \"owner\" = \"a\"; \"owner\" = \"b\"; "
+	      "\"mac\" = <01>; \"mac\" = <0203> }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == 0);
+	ATF_REQUIRE_STREQ(conf.owner, "b");
+	ATF_REQUIRE(conf.mac.pbv_nelems == 2);
+
+	/* an empty array replaces the elements from before */
+	ATF_REQUIRE(plist_bind(ptmp, t_bind_conf_fields, &conf) == 0);
+	ATF_REQUIRE(conf.ports.pbv_nelems == 3);
+	doc = "{ \"ports\" = ( ) }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == 0);
+	ATF_REQUIRE(conf.ports.pbv_nelems == 0);
+	ATF_REQUIRE(conf.ports.pbv_elems == NULL);
+	ATF_REQUIRE(conf.hosts.pbv_nelems == 2);
+	plist_free(ptmp);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	conf.ports.pbv_elems = malloc(sizeof(int));
+	conf.ports.pbv_nelems = 1;
+	conf.ports.pbv_maxelems = 1;
+	ATF_REQUIRE(plist_bind(ptmp, t_bind_conf_fields, &conf) == 0);
+	ATF_REQUIRE(conf.ports.pbv_nelems == 0);
+	ATF_REQUIRE(conf.ports.pbv_elems == NULL);
+	plist_bind_release(t_bind_conf_fields, &conf);
+	plist_free(ptmp);
+
+	/* a real member that is neither a float nor a double */
+	doc = "{ \"r\" = 1.5 }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_short_fields, &i,
+				     doc, strlen(doc)) == EINVAL);
+	doc = "{ \"r\" = 1 }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_short_fields, &i,
+				     doc, strlen(doc)) == EINVAL);
+
+	/* nor do scalars bind into members of the wrong size */
+	doc = "{ \"b\" = true }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_short_fields, &i,
+				     doc, strlen(doc)) == EINVAL);
+	doc = "{ \"t\" = <*2011-11-12 18:31:01 +0000> }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_short_fields, &i,
+				     doc, strlen(doc)) == EINVAL);
+	doc = "{ \"s\" = \"x\" }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_short_fields, &i,
+				     doc, strlen(doc)) == EINVAL);
+	doc = "{ \"d\" = <01> }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_short_fields, &i,
+				     doc, strlen(doc)) == EINVAL);
+
+	/* values that do not fit their members */
+	memset(&conf, 0, sizeof(conf));
+	doc = "{ \"version\" = \"3\" }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == EINVAL);
+	doc = "{ \"log\" = { \"level\" = 300 } }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == ERANGE);
+	doc = "{ \"hosts\" = ( { \"name\" = \"toolongname\" } ) }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == ERANGE);
+	doc = "{ \"log\" = ( ) }";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == EINVAL);
+	doc = "( 1 )";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == EINVAL);
+	doc = "{ \"version\" = 1; ";
+	ATF_REQUIRE(plist_bind_parse(parse, t_bind_conf_fields, &conf,
+				     doc, strlen(doc)) == ENOENT);
+	plist_bind_release(t_bind_conf_fields, &conf);
+
+	plist_txt_free(parse);
+}
+
+ATF_TC(t_plist_gen);
+ATF_TC_HEAD(t_plist_gen, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist generated decoders");
+}
+ATF_TC_BODY(t_plist_gen, tc)
+{
+	int i;
+	int8_t i8;
+	int32_t i32;
+	long long ll;
+	bool b;
+	double d;
+	char buf[8];
+	char *str;
+	const char *key;
+	const char *doc;
+	size_t len;
+	size_t hsz, csz;
+	char *hbuf, *cbuf;
+	FILE *hfp, *cfp;
+	struct tm tm;
+	plist_t *ptmp;
+	plist_txt_t *parse;
+	plist_gen_t pg;
+	plist_bind_vector_t pbv;
+	static const char *bad[] = {
+		"( 1 )",
+		"{ \"fields\" = { \"a\" = \"int32\" } }",
+		"{ \"name\" = \"1x\"; \"fields\" = { \"a\" = \"int32\" } }",
+		"{ \"name\" = \"x\"; \"fields\" = { } }",
+		"{ \"name\" = \"x\"; \"fields\" = { \"a\" = \"int7\" } }",
+		"{ \"name\" = \"x\"; \"fields\" = { \"a\" = \"char[0]\" } }",
+		"{ \"name\" = \"x\"; \"fields\" = { \"a\" = ( ) } }",
+		"{ \"name\" = \"x\"; \"fields\" = "
+		    "{ \"a-b\" = \"bool\"; \"a_b\" = \"bool\" } }",
+	};
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+
+	/* compile a schema with every type */
+	doc = "{ \"name\" = \"t_rec\"; \"fields\" = { "
+	      "\"id\" = \"int64\"; \"small\" = \"int8\"; "
+	      "\"on\" = \"bool\"; \"ratio\" = \"float\"; "
+	      "\"avg\" = \"double\"; \"owner\" = \"string\"; "
+	      "\"host-name\" = \"char[16]\"; \"mac\" = \"data\"; "
+	      "\"when\" = \"date\"; "
+	      "\"log\" = { \"level\" = \"int16\" } } }";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+	hfp = open_memstream(&hbuf, &hsz);
+	cfp = open_memstream(&cbuf, &csz);
+	ATF_REQUIRE(hfp != NULL && cfp != NULL);
+	ATF_REQUIRE(plist_gen_compile(ptmp, "t_rec.h", hfp, cfp) == 0);
+	fclose(hfp);
+	fclose(cfp);
+	ATF_REQUIRE(strstr(hbuf, "typedef struct t_rec_s t_rec_t;") != NULL);
+	ATF_REQUIRE(strstr(hbuf, "char host_name[16];") != NULL);
+	ATF_REQUIRE(strstr(hbuf, "struct t_rec_log_s log;") != NULL);
+	ATF_REQUIRE(strstr(hbuf, "void t_rec_release(") != NULL);
+	ATF_REQUIRE(strstr(cbuf, "#include \"t_rec.h\"") != NULL);
+	ATF_REQUIRE(strstr(cbuf, "t_rec_decode(") != NULL);
+	free(hbuf);
+	free(cbuf);
+	plist_free(ptmp);
+
+	/* schemas that cannot be compiled */
+	for (i = 0; i < (int) (sizeof(bad) / sizeof(bad[0])); i++) {
+		ATF_REQUIRE(plist_txt_parse(parse, bad[i],
+					    strlen(bad[i])) == 0);
+		ATF_REQUIRE(plist_txt_result(parse, &ptmp) == 0);
+		hfp = open_memstream(&hbuf, &hsz);
+		cfp = open_memstream(&cbuf, &csz);
+		ATF_REQUIRE(plist_gen_compile(ptmp, "x.h", hfp,
+					      cfp) == EINVAL);
+		fclose(hfp);
+		fclose(cfp);
+		free(hbuf);
+		free(cbuf);
+		plist_free(ptmp);
+	}
+
+	/* the runtime the decoders are built from */
+	doc = "{ \"a\" = 12; \"b\\\"c\" = -010; \"c\" = 300; "
+	      "\"d\" = \"str\\n\"; \"e\" = true; \"f\" = 1.5e1; "
+	      "\"g\" = ( 1, { \"x\" = \")\" } ); \"h\" = <0011 22>; "
+	      "\"i\" = <*2011-11-12 18:31:01 +0000>; \"j\" = \"toolong!\" }";
+	plist_gen_init(&pg, doc, strlen(doc));
+	ATF_REQUIRE(plist_gen_open(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(len == 1 && key[0] == 'a');
+	ATF_REQUIRE(plist_gen_integer(&pg, &ll) == 0 && ll == 12);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(len == 3 && memcmp(key, "b\"c", 3) == 0);
+	ATF_REQUIRE(plist_gen_int32(&pg, &i32) == 0 && i32 == -8);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(plist_gen_int8(&pg, &i8) == ERANGE);
+	pg.pg_cp = strstr(doc, "\"d\"");
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(plist_gen_boolean(&pg, &b) == EINVAL);
+	ATF_REQUIRE(plist_gen_string(&pg, &str) == 0);
+	ATF_REQUIRE(strcmp(str, "str\n") == 0);
+	free(str);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(plist_gen_boolean(&pg, &b) == 0 && b == true);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(plist_gen_real(&pg, &d) == 0 && d == 15.0);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(plist_gen_skip(&pg) == 0);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	memset(&pbv, 0, sizeof(pbv));
+	ATF_REQUIRE(plist_gen_data(&pg, &pbv) == 0);
+	ATF_REQUIRE(pbv.pbv_nelems == 3);
+	ATF_REQUIRE(memcmp(pbv.pbv_elems, "\x00\x11\x22", 3) == 0);
+	free(pbv.pbv_elems);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(plist_gen_date(&pg, &tm) == 0);
+	ATF_REQUIRE(tm.tm_year == 111 && tm.tm_min == 31);
+	ATF_REQUIRE(plist_gen_next(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == 0);
+	ATF_REQUIRE(plist_gen_strbuf(&pg, buf, sizeof(buf)) == ERANGE);
+	pg.pg_cp = strrchr(doc, '}');
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == PLIST_GEN_END);
+
+	/* truncated documents */
+	plist_gen_init(&pg, doc, 8);
+	ATF_REQUIRE(plist_gen_open(&pg) == 0);
+	ATF_REQUIRE(plist_gen_key(&pg, &key, &len) == ENOENT);
+
+	plist_txt_free(parse);
+}
+
+/* 149 bytes from another writer */
+static const char t_bpl_doc[] =
+	"\x62\x70\x6c\x69\x73\x74\x30\x30\xd7\x01\x02\x03"
+	"\x04\x05\x06\x07\x08\x09\x0a\x0b\x0f\x10\x11\x54"
+	"\x6e\x61\x6d\x65\x51\x6e\x53\x6e\x65\x67\x54\x6c"
+	"\x69\x73\x74\x51\x75\x51\x64\x54\x77\x68\x65\x6e"
+	"\x53\x64\x65\x76\x10\x05\x13\xff\xff\xff\xff\xff"
+	"\xff\xff\xfd\xa3\x0c\x0d\x0e\x09\x23\x3f\xf8\x00"
+	"\x00\x00\x00\x00\x00\x08\x64\x00\x68\x00\xe9\xd8"
+	"\x3d\xde\x00\x42\x01\x02\x33\x41\xb4\x6e\xf2\xe5"
+	"\x00\x00\x00\x08\x17\x1c\x1e\x22\x27\x29\x2b\x30"
+	"\x34\x36\x3f\x43\x44\x4d\x4e\x57\x5a\x00\x00\x00"
+	"\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00\x00\x00"
+	"\x12\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	"\x00\x00\x00\x00\x63";
+
+static const struct t_bpl_case {
+	const char *tb_name;
+	size_t tb_sz;
+	int tb_newerr;
+	int tb_plisterr;
+	const char *tb_doc;
+} t_bpl_corpus[] = {
+	{ "short", 8, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30" },
+	{ "magic", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x31\x10\x05\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "offset size", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x10\x05\x08\x00"
+	  "\x00\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "reference size", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x10\x05\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x09\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "top object", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x10\x05\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x01\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "object count", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x10\x05\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x03\xe8\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "offset table", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x10\x05\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\xc8" },
+	{ "object offset", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x10\x05\x0a\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "header offset", 43, EINVAL, 0,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x10\x05\x02\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "cycle", 43, 0, E2BIG,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\xa1\x00\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "count", 51, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\xaf\x13\xff\xff"
+	  "\xff\xff\xff\xff\xff\xff\x08\x00\x00\x00\x00\x00"
+	  "\x00\x01\x01\x00\x00\x00\x00\x00\x00\x00\x01\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x12" },
+	{ "count marker", 45, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x5f\x20\x61\x62"
+	  "\x08\x00\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00"
+	  "\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x0c" },
+	{ "reference", 43, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\xa1\x05\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "surrogate", 44, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x61\xd8\x00\x08"
+	  "\x00\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00"
+	  "\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x0b" },
+	{ "int64", 50, 0, ERANGE,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x13\x00\x00\x01"
+	  "\x00\x00\x00\x00\x00\x08\x00\x00\x00\x00\x00\x00"
+	  "\x01\x01\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x11" },
+	{ "int128", 58, 0, ERANGE,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x14\x00\x00\x00"
+	  "\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x08\x00\x00\x00\x00\x00\x00\x01\x01\x00\x00"
+	  "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x19" },
+	{ "int size", 74, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x15\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x08\x00\x00\x00\x00\x00\x00"
+	  "\x01\x01\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x29" },
+	{ "real size", 44, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x21\x00\x00\x08"
+	  "\x00\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00"
+	  "\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x0b" },
+	{ "date size", 46, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x32\x00\x00\x00"
+	  "\x00\x08\x00\x00\x00\x00\x00\x00\x01\x01\x00\x00"
+	  "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x0d" },
+	{ "truncated", 43, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x53\x61\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "uid", 43, 0, ENOTSUP,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x80\x01\x08\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x0a" },
+	{ "null", 42, 0, ENOTSUP,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x00\x08\x00\x00"
+	  "\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00\x00"
+	  "\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x09" },
+	{ "key", 47, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\xd1\x01\x01\x10"
+	  "\x05\x08\x0b\x00\x00\x00\x00\x00\x00\x01\x01\x00"
+	  "\x00\x00\x00\x00\x00\x00\x02\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x0d" },
+	{ "marker", 42, 0, EINVAL,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\x70\x08\x00\x00"
+	  "\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00\x00"
+	  "\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x09" },
+	{ "expansion", 115, 0, E2BIG,
+	  "\x62\x70\x6c\x69\x73\x74\x30\x30\xa4\x01\x01\x01"
+	  "\x01\xa4\x02\x02\x02\x02\xa4\x03\x03\x03\x03\xa4"
+	  "\x04\x04\x04\x04\xa4\x05\x05\x05\x05\xa4\x06\x06"
+	  "\x06\x06\xa4\x07\x07\x07\x07\xa4\x08\x08\x08\x08"
+	  "\xa4\x09\x09\x09\x09\xa4\x0a\x0a\x0a\x0a\xa4\x0b"
+	  "\x0b\x0b\x0b\xa4\x0c\x0c\x0c\x0c\x10\x05\x08\x0d"
+	  "\x12\x17\x1c\x21\x26\x2b\x30\x35\x3a\x3f\x44\x00"
+	  "\x00\x00\x00\x00\x00\x01\x01\x00\x00\x00\x00\x00"
+	  "\x00\x00\x0d\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	  "\x00\x00\x00\x00\x00\x00\x46" },
+};
+
+/**
+ * Chain of arrays that each hold the next one
+ */
+static size_t
+t_bpl_chain(char *buf, int n)
+{
+	int i;
+	size_t off;
+	size_t offtab;
+
+	memcpy(buf, "bplist00", 8);
+	off = 8;
+	for (i = 0; i < n; i++) {
+		buf[off++] = 0xa1;
+		buf[off++] = (i + 1) >> 8;
+		buf[off++] = (i + 1) & 0xff;
+	}
+	buf[off++] = 0x10;
+	buf[off++] = 0x05;
+	offtab = off;
+	for (i = 0; i <= n; i++) {
+		buf[off++] = (8 + i * 3) >> 8;
+		buf[off++] = (8 + i * 3) & 0xff;
+	}
+	memset(&buf[off], 0, 32);
+	buf[off + 6] = 2;
+	buf[off + 7] = 2;
+	buf[off + 14] = (n + 1) >> 8;
+	buf[off + 15] = (n + 1) & 0xff;
+	buf[off + 30] = offtab >> 8;
+	buf[off + 31] = offtab & 0xff;
+	return off + 32;
+}
+
+ATF_TC(t_plist_bpl);
+ATF_TC_HEAD(t_plist_bpl, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist binary reader");
+}
+ATF_TC_BODY(t_plist_bpl, tc)
+{
+	int fd;
+	size_t i, j;
+	int err;
+	bool b;
+	double d;
+	int64_t ll;
+	char *str;
+	char *buf;
+	size_t sz;
+	size_t count;
+	const void *data;
+	struct tm tm;
+	char path[] = "t_plist.XXXXXX";
+	const char *doc;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse;
+	plist_bpl_t *bpl;
+	plist_bpl_node_t root, node, key;
+	static const uint8_t mutations[] = { 0x00, 0x01, 0x0f, 0x7f, 0x80, 0xff };
+
+	doc = "{ \"name\" = \"dev\"; \"n\" = 5; \"neg\" = -3; "
+	      "\"list\" = ( true, 1.5, false ); "
+	      "\"u\" = \"h\xc3\xa9\xf0\x9f\x98\x80\"; \"d\" = <0102>; "
+	      "\"when\" = <*2011-11-12 18:31:01 +0000> }";
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	plist_txt_free(parse);
+
+	/* lazy access */
+	ATF_REQUIRE(plist_bpl_new(&bpl, t_bpl_doc,
+				  sizeof(t_bpl_doc) - 1) == 0);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_type(bpl, &root) == PLIST_DICT);
+	ATF_REQUIRE(plist_bpl_count(bpl, &root, &count) == 0 && count == 7);
+	ATF_REQUIRE(plist_bpl_entry(bpl, &root, 0, &key, &node) == 0);
+	ATF_REQUIRE(plist_bpl_string(bpl, &key, &str) == 0);
+	ATF_REQUIRE_STREQ(str, "name");
+	free(str);
+	ATF_REQUIRE(plist_bpl_string(bpl, &node, &str) == 0);
+	ATF_REQUIRE_STREQ(str, "dev");
+	free(str);
+	ATF_REQUIRE(plist_bpl_entry(bpl, &root, 7, &key, &node) == ENOENT);
+
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &root, "n", &node) == 0);
+	ATF_REQUIRE(plist_bpl_integer(bpl, &node, &ll) == 0 && ll == 5);
+	ATF_REQUIRE(plist_bpl_real(bpl, &node, &d) == EINVAL);
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &root, "neg", &node) == 0);
+	ATF_REQUIRE(plist_bpl_integer(bpl, &node, &ll) == 0 && ll == -3);
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &root, "list", &node) == 0);
+	ATF_REQUIRE(plist_bpl_type(bpl, &node) == PLIST_ARRAY);
+	ATF_REQUIRE(plist_bpl_at(bpl, &node, 3, &key) == ENOENT);
+	ATF_REQUIRE(plist_bpl_at(bpl, &node, 2, &key) == 0);
+	ATF_REQUIRE(plist_bpl_boolean(bpl, &key, &b) == 0 && b == false);
+	ATF_REQUIRE(plist_bpl_at(bpl, &node, 1, &key) == 0);
+	ATF_REQUIRE(plist_bpl_real(bpl, &key, &d) == 0 && d == 1.5);
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &node, "n", &key) == EINVAL);
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &root, "u", &node) == 0);
+	ATF_REQUIRE(plist_bpl_string(bpl, &node, &str) == 0);
+	ATF_REQUIRE_STREQ(str, "h\xc3\xa9\xf0\x9f\x98\x80");
+	free(str);
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &root, "d", &node) == 0);
+	ATF_REQUIRE(plist_bpl_data(bpl, &node, &data, &sz) == 0);
+	ATF_REQUIRE(sz == 2 && memcmp(data, "\x01\x02", 2) == 0);
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &root, "when", &node) == 0);
+	ATF_REQUIRE(plist_bpl_date(bpl, &node, &tm) == 0);
+	ATF_REQUIRE(tm.tm_year == 111 && tm.tm_mon == 10 &&
+		    tm.tm_mday == 12 && tm.tm_hour == 18 &&
+		    tm.tm_min == 31 && tm.tm_sec == 1);
+	ATF_REQUIRE(plist_bpl_lookup(bpl, &root, "none", &node) == ENOENT);
+
+	/* and all at once */
+	ATF_REQUIRE(plist_bpl_plist(bpl, &root, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_bpl_free(bpl);
+
+	/* a mapped file */
+	fd = mkstemp(path);
+	ATF_REQUIRE(fd >= 0);
+	ATF_REQUIRE(write(fd, t_bpl_doc, sizeof(t_bpl_doc) - 1) ==
+		    sizeof(t_bpl_doc) - 1);
+	close(fd);
+	ATF_REQUIRE(plist_bpl_open(&bpl, path) == 0);
+	ATF_REQUIRE(bpl->bp_mapsz == sizeof(t_bpl_doc) - 1);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_plist(bpl, &root, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_bpl_free(bpl);
+	unlink(path);
+	ATF_REQUIRE(plist_bpl_open(&bpl, path) == ENOENT);
+
+	/* damaged documents */
+	for (i = 0; i < sizeof(t_bpl_corpus) / sizeof(t_bpl_corpus[0]); i++) {
+		const struct t_bpl_case *tb = &t_bpl_corpus[i];
+
+		err = plist_bpl_new(&bpl, tb->tb_doc, tb->tb_sz);
+		if (err != tb->tb_newerr) {
+			atf_tc_fail("%s: open %d", tb->tb_name, err);
+		}
+		if (err != 0) {
+			continue;
+		}
+		ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+		err = plist_bpl_plist(bpl, &root, &ptmp2);
+		if (err != tb->tb_plisterr) {
+			atf_tc_fail("%s: plist %d", tb->tb_name, err);
+		}
+		plist_bpl_free(bpl);
+	}
+	ATF_REQUIRE(plist_bpl_new(&bpl, t_bpl_corpus[14].tb_doc,
+				  t_bpl_corpus[14].tb_sz) == 0);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_integer(bpl, &root, &ll) == 0);
+	ATF_REQUIRE(ll == 1LL << 40);
+	plist_bpl_free(bpl);
+
+	/* nesting that is too deep */
+	buf = malloc(4096);
+	ATF_REQUIRE(buf != NULL);
+	sz = t_bpl_chain(buf, PLIST_BPL_MAXDEPTH);
+	ATF_REQUIRE(plist_bpl_new(&bpl, buf, sz) == 0);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_plist(bpl, &root, &ptmp2) == 0);
+	plist_free(ptmp2);
+	plist_bpl_free(bpl);
+	sz = t_bpl_chain(buf, PLIST_BPL_MAXDEPTH + 1);
+	ATF_REQUIRE(plist_bpl_new(&bpl, buf, sz) == 0);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_plist(bpl, &root, &ptmp2) == E2BIG);
+	plist_bpl_free(bpl);
+
+	/* every byte of a good document changed, only has to not crash */
+	for (i = 0; i < sizeof(t_bpl_doc) - 1; i++) {
+		for (j = 0; j < sizeof(mutations); j++) {
+			memcpy(buf, t_bpl_doc, sizeof(t_bpl_doc) - 1);
+			buf[i] = mutations[j];
+			if (plist_bpl_new(&bpl, buf,
+					  sizeof(t_bpl_doc) - 1) != 0) {
+				continue;
+			}
+			ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+			if (plist_bpl_plist(bpl, &root, &ptmp2) == 0) {
+				plist_free(ptmp2);
+			}
+			if (plist_bpl_lookup(bpl, &root, "u", &node) == 0 &&
+			    plist_bpl_string(bpl, &node, &str) == 0) {
+				free(str);
+			}
+			plist_bpl_free(bpl);
+		}
+	}
+	free(buf);
+
+	plist_free(ptmp1);
+}
+
+ATF_TC(t_plist_bpl_write);
+ATF_TC_HEAD(t_plist_bpl_write, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist binary writer");
+}
+ATF_TC_BODY(t_plist_bpl_write, tc)
+{
+	int i;
+	int fd;
+	void *buf;
+	void *buf2;
+	size_t sz;
+	size_t sz2;
+	size_t count;
+	char name[32];
+	char path[] = "t_plist.XXXXXX";
+	const char *doc;
+	struct tm tm;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_t *ptmp3;
+	plist_txt_t *parse;
+	plist_bpl_t *bpl;
+	plist_bpl_node_t root;
+
+	doc = "{ \"name\" = \"dev\"; \"n\" = 5; \"neg\" = -3; "
+	      "\"big\" = 70000; \"list\" = ( true, 1.5, false, \"dev\", 5 ); "
+	      "\"u\" = \"h\xc3\xa9\xf0\x9f\x98\x80\"; \"d\" = <0102>; "
+	      "\"e\" = <>; \"when\" = <*2011-11-12 18:31:01 +0000>; "
+	      "\"more\" = { \"name\" = \"dev\"; \"d\" = <0102> } }";
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+
+	/* round trip with the shared values written once */
+	ATF_REQUIRE(plist_bpl_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(plist_bpl_new(&bpl, buf, sz) == 0);
+	ATF_REQUIRE(bpl->bp_refsz == 1 && bpl->bp_offsz == 1);
+	ATF_REQUIRE(bpl->bp_nobjs == 24);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_plist(bpl, &root, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_bpl_free(bpl);
+
+	/* the same bytes through a descriptor */
+	fd = mkstemp(path);
+	ATF_REQUIRE(fd >= 0);
+	ATF_REQUIRE(plist_bpl_write(ptmp1, fd) == 0);
+	close(fd);
+	ATF_REQUIRE(plist_bpl_open(&bpl, path) == 0);
+	ATF_REQUIRE(bpl->bp_sz == sz && memcmp(bpl->bp_buf, buf, sz) == 0);
+	plist_bpl_free(bpl);
+	unlink(path);
+	free(buf);
+	plist_free(ptmp1);
+
+	/* a date read with an offset is written as the same instant */
+	doc = "<*2011-01-01 12:00:00 +0200>";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(plist_bpl_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(plist_bpl_new(&bpl, buf, sz) == 0);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_date(bpl, &root, &tm) == 0);
+	ATF_REQUIRE(tm.tm_year == 111 && tm.tm_mday == 1 &&
+		    tm.tm_hour == 10 && tm.tm_min == 0);
+	plist_bpl_free(bpl);
+	free(buf);
+	plist_free(ptmp1);
+
+	/* wider references, long strings, and counts past the marker */
+	ATF_REQUIRE(plist_array_new(&ptmp1) == 0);
+	for (i = 0; i < 300; i++) {
+		ATF_REQUIRE(plist_integer_new(&ptmp2, i * 1000) == 0);
+		ATF_REQUIRE(plist_array_append(ptmp1, ptmp2) == 0);
+	}
+	ATF_REQUIRE(plist_dict_new(&ptmp2) == 0);
+	for (i = 0; i < 20; i++) {
+		snprintf(name, sizeof(name), "key\xc3\xa9%02d", i);
+		ATF_REQUIRE(plist_format_new(&ptmp3, "%s with a long "
+					     "value \xe2\x82\xac %0100d",
+					     name, i) == 0);
+		ATF_REQUIRE(plist_dict_set(ptmp2, name, ptmp3) == 0);
+	}
+	ATF_REQUIRE(plist_array_append(ptmp1, ptmp2) == 0);
+	ATF_REQUIRE(plist_bpl_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(plist_bpl_new(&bpl, buf, sz) == 0);
+	ATF_REQUIRE(bpl->bp_refsz == 2 && bpl->bp_offsz == 2);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	ATF_REQUIRE(plist_bpl_plist(bpl, &root, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_bpl_free(bpl);
+	free(buf);
+
+	/* strings have to be UTF-8 */
+	ATF_REQUIRE(plist_string_new(&ptmp2, "bad \xc3") == 0);
+	ATF_REQUIRE(plist_array_append(ptmp1, ptmp2) == 0);
+	ATF_REQUIRE(plist_bpl_write_buf(ptmp1, &buf, &sz) == EINVAL);
+	plist_free(ptmp1);
+
+	/* nesting deeper than the reader builds is still written */
+	ATF_REQUIRE(plist_array_new(&ptmp1) == 0);
+	ptmp3 = ptmp1;
+	for (i = 0; i < 2 * PLIST_BPL_MAXDEPTH; i++) {
+		ATF_REQUIRE(plist_array_new(&ptmp2) == 0);
+		ATF_REQUIRE(plist_array_append(ptmp3, ptmp2) == 0);
+		ptmp3 = ptmp2;
+	}
+	ATF_REQUIRE(plist_bpl_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(plist_bpl_write_buf(ptmp1, &buf2, &sz2) == 0);
+	ATF_REQUIRE(sz == sz2 && memcmp(buf, buf2, sz) == 0);
+	free(buf2);
+	ATF_REQUIRE(plist_bpl_new(&bpl, buf, sz) == 0);
+	ATF_REQUIRE(plist_bpl_root(bpl, &root) == 0);
+	for (i = 0; i < 2 * PLIST_BPL_MAXDEPTH; i++) {
+		ATF_REQUIRE(plist_bpl_at(bpl, &root, 0, &root) == 0);
+	}
+	ATF_REQUIRE(plist_bpl_count(bpl, &root, &count) == 0 && count == 0);
+	plist_bpl_free(bpl);
+	free(buf);
+	plist_free(ptmp1);
+
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_xml);
+ATF_TC_HEAD(t_plist_xml, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "XML plist reader");
+}
+ATF_TC_BODY(t_plist_xml, tc)
+{
+	int i;
+	size_t k;
+	size_t len;
+	const char *doc;
+	const char *xmldoc;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse;
+	plist_xml_t *xml;
+	static const char *bad[] = {
+		"<plist><dict><key>a</key></dict></plist>",
+		"<plist><dict><string>a</string></dict></plist>",
+		"<plist><array><key>a</key></array></plist>",
+		"<plist><array></dict></plist>",
+		"<plist><true/><false/></plist>",
+		"<plist><dict>text</dict></plist>",
+		"<plist><string>a<true/></string></plist>",
+		"<plist><data>AB=C</data></plist>",
+		"<plist><data>A</data></plist>",
+		"<plist><string>&bogus;</string></plist>",
+		"<plist><string>&#xd800;</string></plist>",
+		"<plist><integer>9223372036854775808</integer></plist>",
+		"<plist><integer>12a</integer></plist>",
+		"<plist><integer/></plist>",
+		"<plist><real>1.5.1</real></plist>",
+		"<plist><date>2011-13-01T00:00:00Z</date></plist>",
+		"<plist><true>x</true></plist>",
+		"<plist><dict><key>a</key><key>b</key></dict></plist>",
+		"<plist><array><![CDATA[x]]></array></plist>",
+		"<plist><bogus/></plist>",
+	};
+
+	doc = "{ \"name\" = \"a<b & \\\"c\\\" \xc3\xa9\xf0\x9f\x98\x80\"; "
+	      "\"n\" = 42; \"neg\" = -12; \"hex\" = 255; "
+	      "\"pi\" = 3.25; \"yes\" = true; \"no\" = false; "
+	      "\"blob\" = <00010203fffe>; \"empty\" = <>; \"e\" = \"\"; "
+	      "\"when\" = <*2011-11-12 18:31:01 +0000>; "
+	      "\"raw\" = \"x<y>]]z\"; \"\" = ( ); "
+	      "\"list\" = ( { }, ( 1, 2 ), \"in\" ) }";
+	xmldoc = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		 "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+		 "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+		 "<!-- a comment -- with dashes > and brackets -->\n"
+		 "<plist version=\"1.0\">\n<dict>\n"
+		 "\t<key>name</key>\n"
+		 "\t<string>a&lt;b &amp; &quot;c&quot; &#233;&#x1F600;</string>\n"
+		 "\t<key>n</key> <integer> 42 </integer>\n"
+		 "\t<key>neg</key><integer>-12</integer>\n"
+		 "\t<key>hex</key><integer>0xff</integer>\n"
+		 "\t<key>pi</key><real>3.25</real>\n"
+		 "\t<key>yes</key><true/>\n"
+		 "\t<key>no</key><false />\n"
+		 "\t<key>blob</key><data>\n\tAAEC\n\tA//+\n\t</data>\n"
+		 "\t<key>empty</key><data/>\n"
+		 "\t<key>e</key><string></string>\n"
+		 "\t<key>when</key><date>2011-11-12T18:31:01Z</date>\n"
+		 "\t<key>raw</key><string>x<![CDATA[<y>]]]]><!-- -->"
+		 "<![CDATA[z]]></string>\n"
+		 "\t<key/><array/>\n"
+		 "\t<key>list</key><array><dict></dict>"
+		 "<array><integer>1</integer><integer>2</integer></array>"
+		 "<string>in</string></array>\n"
+		 "</dict>\n</plist>\n";
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+
+	/* whole, then split at every position, then a byte at a time */
+	len = strlen(xmldoc);
+	ATF_REQUIRE(plist_xml_new(&xml) == 0);
+	ATF_REQUIRE(plist_xml_parse(xml, xmldoc, len) == 0);
+	ATF_REQUIRE(plist_xml_result(xml, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	for (k = 1; k < len; k++) {
+		ATF_REQUIRE(plist_xml_parse(xml, xmldoc, k) == 0);
+		ATF_REQUIRE(plist_xml_parse(xml, &xmldoc[k], len - k) == 0);
+		ATF_REQUIRE(plist_xml_result(xml, &ptmp2) == 0);
+		ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+		plist_free(ptmp2);
+	}
+	for (k = 0; k < len; k++) {
+		ATF_REQUIRE(plist_xml_parse(xml, &xmldoc[k], 1) == 0);
+	}
+	ATF_REQUIRE(plist_xml_result(xml, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_free(ptmp1);
+
+	/* a bare value is a document and what follows it is left alone */
+	doc = "<integer>7</integer> trailing";
+	ATF_REQUIRE(plist_xml_parse(xml, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(xml->px_tail == &doc[20]);
+	ATF_REQUIRE(plist_xml_result(xml, &ptmp1) == 0);
+	ATF_REQUIRE(ptmp1->p_elem == PLIST_INTEGER &&
+		    ptmp1->p_integer.pi_int == 7);
+	plist_free(ptmp1);
+
+	/* an unfinished document has no result */
+	doc = "<plist><array><true/>";
+	ATF_REQUIRE(plist_xml_parse(xml, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_xml_result(xml, &ptmp1) == ENOENT);
+
+	for (i = 0; i < (int) (sizeof(bad) / sizeof(bad[0])); i++) {
+		ATF_REQUIRE(plist_xml_parse(xml, bad[i], strlen(bad[i])) != 0);
+		ATF_REQUIRE(plist_xml_result(xml, &ptmp1) == ENOENT);
+	}
+
+	plist_xml_free(xml);
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_xml_write);
+ATF_TC_HEAD(t_plist_xml_write, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "XML plist writer");
+}
+ATF_TC_BODY(t_plist_xml_write, tc)
+{
+	int i;
+	int fd;
+	void *buf;
+	char *buf2;
+	size_t sz;
+	uint8_t bytes[200];
+	char path[] = "t_plist.XXXXXX";
+	const char *doc;
+	const char *expect;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_t *ptmp3;
+	plist_t *ptmp4;
+	plist_txt_t *parse;
+	plist_xml_t *xml;
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_xml_new(&xml) == 0);
+
+	/* the layout of a small document */
+	doc = "{ \"a&b\" = ( 1, -2.5, true ); \"d\" = <0001fe>; "
+	      "\"e\" = { }; \"w\" = <*2011-11-12 18:31:01 +0000> }";
+	expect = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		 "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+		 "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+		 "<plist version=\"1.0\">\n"
+		 "<dict>\n"
+		 "\t<key>a&amp;b</key>\n"
+		 "\t<array>\n"
+		 "\t\t<integer>1</integer>\n"
+		 "\t\t<real>-2.5</real>\n"
+		 "\t\t<true/>\n"
+		 "\t</array>\n"
+		 "\t<key>d</key>\n"
+		 "\t<data>\n"
+		 "\tAAH+\n"
+		 "\t</data>\n"
+		 "\t<key>e</key>\n"
+		 "\t<dict/>\n"
+		 "\t<key>w</key>\n"
+		 "\t<date>2011-11-12T18:31:01Z</date>\n"
+		 "</dict>\n"
+		 "</plist>\n";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(plist_xml_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == strlen(expect) && memcmp(buf, expect, sz) == 0);
+	free(buf);
+	plist_free(ptmp1);
+
+	/* a date read with an offset is written in UTC */
+	doc = "<*2011-11-12 20:31:01 +0200>";
+	expect = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		 "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+		 "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+		 "<plist version=\"1.0\">\n"
+		 "<date>2011-11-12T18:31:01Z</date>\n"
+		 "</plist>\n";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(plist_xml_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == strlen(expect) && memcmp(buf, expect, sz) == 0);
+	free(buf);
+	plist_free(ptmp1);
+
+	/* text that needs references on both sides of a 16 byte block,
+	 * data of every padding and across lines, and awkward reals */
+	ATF_REQUIRE(plist_dict_new(&ptmp1) == 0);
+	ATF_REQUIRE(plist_string_new(&ptmp2, "0123456789abcde<fghij>"
+				     "klmnopqrstuvw&xyz\r\n\xc3\xa9]]>") == 0);
+	ATF_REQUIRE(plist_dict_set(ptmp1, "<text>", ptmp2) == 0);
+	ATF_REQUIRE(plist_string_new(&ptmp2, "") == 0);
+	ATF_REQUIRE(plist_dict_set(ptmp1, "", ptmp2) == 0);
+	ATF_REQUIRE(plist_array_new(&ptmp2) == 0);
+	for (i = 0; i < (int) sizeof(bytes); i++) {
+		bytes[i] = i * 7;
+	}
+	for (i = 0; i < (int) sizeof(bytes); i += 13) {
+		ATF_REQUIRE(plist_data_new(&ptmp3, bytes, i) == 0);
+		ATF_REQUIRE(plist_array_append(ptmp2, ptmp3) == 0);
+	}
+	ATF_REQUIRE(plist_real_new(&ptmp3, 0.1) == 0);
+	ATF_REQUIRE(plist_array_append(ptmp2, ptmp3) == 0);
+	ATF_REQUIRE(plist_real_new(&ptmp3, 1e300) == 0);
+	ATF_REQUIRE(plist_array_append(ptmp2, ptmp3) == 0);
+	ATF_REQUIRE(plist_real_new(&ptmp3, -1.0 / 3) == 0);
+	ATF_REQUIRE(plist_array_append(ptmp2, ptmp3) == 0);
+	ATF_REQUIRE(plist_integer_new(&ptmp3, INT_MIN) == 0);
+	ATF_REQUIRE(plist_array_append(ptmp2, ptmp3) == 0);
+	ATF_REQUIRE(plist_array_new(&ptmp3) == 0);
+	ATF_REQUIRE(plist_array_append(ptmp2, ptmp3) == 0);
+	ATF_REQUIRE(plist_dict_set(ptmp1, "list", ptmp2) == 0);
+
+	ATF_REQUIRE(plist_xml_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(plist_xml_parse(xml, buf, sz) == 0);
+	ATF_REQUIRE(plist_xml_result(xml, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+
+	/* the same bytes through a descriptor */
+	fd = mkstemp(path);
+	ATF_REQUIRE(fd >= 0);
+	ATF_REQUIRE(plist_xml_write(ptmp1, fd) == 0);
+	buf2 = malloc(sz + 1);
+	ATF_REQUIRE(buf2 != NULL);
+	ATF_REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+	ATF_REQUIRE(read(fd, buf2, sz + 1) == (ssize_t) sz);
+	ATF_REQUIRE(memcmp(buf, buf2, sz) == 0);
+	close(fd);
+	unlink(path);
+	free(buf2);
+	free(buf);
+
+	/* an element inside a tree is written on its own */
+	TAILQ_FOREACH(ptmp2, &ptmp1->p_dict.pd_keys, p_entry) {
+		if (strcmp(ptmp2->p_key.pk_name, "list") == 0) {
+			break;
+		}
+	}
+	ATF_REQUIRE(ptmp2 != NULL);
+	ptmp2 = ptmp2->p_key.pk_value;
+	ATF_REQUIRE(plist_xml_write_buf(ptmp2, &buf, &sz) == 0);
+	ATF_REQUIRE(plist_xml_parse(xml, buf, sz) == 0);
+	ATF_REQUIRE(plist_xml_result(xml, &ptmp3) == 0);
+	ATF_REQUIRE(plist_copy(ptmp2, &ptmp4) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp4, ptmp3) == true);
+	plist_free(ptmp4);
+	plist_free(ptmp3);
+	free(buf);
+	plist_free(ptmp1);
+
+	plist_xml_free(xml);
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_flat);
+ATF_TC_HEAD(t_plist_flat, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "plist flat writer and reader");
+}
+ATF_TC_BODY(t_plist_flat, tc)
+{
+	int fd;
+	int err;
+	bool b;
+	double d;
+	int64_t ll;
+	void *buf;
+	void *buf2;
+	uint8_t *copy;
+	size_t i;
+	size_t sz;
+	size_t len;
+	size_t count;
+	const char *str;
+	const void *data;
+	struct tm tm;
+	char path[] = "t_plist.XXXXXX";
+	const char *doc;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse;
+	plist_flat_t *flat;
+	plist_flat_node_t root, node, elem;
+
+	doc = "{ \"name\" = \"dev\"; \"n\" = 5; \"neg\" = -3; "
+	      "\"list\" = ( true, 1.5, false ); \"a\" = { }; "
+	      "\"d\" = <0102>; \"\" = \"\"; "
+	      "\"when\" = <*2011-11-12 18:31:01 +0000> }";
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	plist_txt_free(parse);
+
+	ATF_REQUIRE(plist_flat_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(sz % 8 == 0 && memcmp(buf, "plflat00", 8) == 0);
+	ATF_REQUIRE(plist_flat_verify(buf, sz) == 0);
+	ATF_REQUIRE(plist_flat_new(&flat, buf, sz, 0) == 0);
+	ATF_REQUIRE(plist_flat_root(flat, &root) == 0);
+	ATF_REQUIRE(plist_flat_type(flat, &root) == PLIST_DICT);
+	ATF_REQUIRE(plist_flat_count(flat, &root, &count) == 0 && count == 8);
+
+	/* entries come back in the order of the key bytes */
+	ATF_REQUIRE(plist_flat_entry(flat, &root, 0, &str, &node) == 0);
+	ATF_REQUIRE(strcmp(str, "") == 0);
+	ATF_REQUIRE(plist_flat_entry(flat, &root, 1, &str, &node) == 0);
+	ATF_REQUIRE(strcmp(str, "a") == 0);
+	ATF_REQUIRE(plist_flat_count(flat, &node, &count) == 0 && count == 0);
+	ATF_REQUIRE(plist_flat_lookup(flat, &node, "a", &elem) == ENOENT);
+	ATF_REQUIRE(plist_flat_entry(flat, &root, 7, &str, &node) == 0);
+	ATF_REQUIRE(strcmp(str, "when") == 0);
+	ATF_REQUIRE(plist_flat_entry(flat, &root, 8, &str, &node) == ENOENT);
+
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "name", &node) == 0);
+	ATF_REQUIRE(plist_flat_string(flat, &node, &str, &len) == 0);
+	ATF_REQUIRE(len == 3 && strcmp(str, "dev") == 0);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "nam", &node) == ENOENT);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "names", &node) == ENOENT);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "n", &node) == 0);
+	ATF_REQUIRE(plist_flat_integer(flat, &node, &ll) == 0 && ll == 5);
+	ATF_REQUIRE(plist_flat_real(flat, &node, &d) == EINVAL);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "neg", &node) == 0);
+	ATF_REQUIRE(plist_flat_integer(flat, &node, &ll) == 0 && ll == -3);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "list", &node) == 0);
+	ATF_REQUIRE(plist_flat_type(flat, &node) == PLIST_ARRAY);
+	ATF_REQUIRE(plist_flat_lookup(flat, &node, "n", &elem) == EINVAL);
+	ATF_REQUIRE(plist_flat_at(flat, &node, 3, &elem) == ENOENT);
+	ATF_REQUIRE(plist_flat_at(flat, &node, 1, &elem) == 0);
+	ATF_REQUIRE(plist_flat_real(flat, &elem, &d) == 0 && d == 1.5);
+	ATF_REQUIRE(plist_flat_at(flat, &node, 2, &elem) == 0);
+	ATF_REQUIRE(plist_flat_boolean(flat, &elem, &b) == 0 && b == false);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "d", &node) == 0);
+	ATF_REQUIRE(plist_flat_data(flat, &node, &data, &len) == 0);
+	ATF_REQUIRE(len == 2 && memcmp(data, "\x01\x02", 2) == 0);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "when", &node) == 0);
+	ATF_REQUIRE(plist_flat_date(flat, &node, &tm) == 0);
+	ATF_REQUIRE(tm.tm_year == 111 && tm.tm_mon == 10 && tm.tm_mday == 12);
+	ATF_REQUIRE(tm.tm_hour == 18 && tm.tm_min == 31 && tm.tm_sec == 1);
+
+	ATF_REQUIRE(plist_flat_plist(flat, &root, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+	plist_flat_free(flat);
+
+	/* a date read with an offset is written as the same instant */
+	doc = "<*2011-11-12 20:31:01 +0200>";
+	ATF_REQUIRE(plist_read_buf(doc, strlen(doc), 0, &ptmp2) == 0);
+	ATF_REQUIRE(plist_flat_write_buf(ptmp2, &buf2, &len) == 0);
+	plist_free(ptmp2);
+	ATF_REQUIRE(plist_flat_new(&flat, buf2, len, 0) == 0);
+	ATF_REQUIRE(plist_flat_root(flat, &node) == 0);
+	ATF_REQUIRE(plist_flat_date(flat, &node, &tm) == 0);
+	ATF_REQUIRE(tm.tm_hour == 18 && tm.tm_min == 31 && tm.tm_sec == 1);
+	plist_flat_free(flat);
+	free(buf2);
+
+	/* the trusted path only checks the header */
+	ATF_REQUIRE(plist_flat_new(&flat, buf, sz, PLIST_FLAT_TRUSTED) == 0);
+	plist_flat_free(flat);
+	ATF_REQUIRE(plist_flat_new(&flat, buf, sz - 8,
+				   PLIST_FLAT_TRUSTED) == EINVAL);
+
+	/* damage anywhere is either caught or leaves a readable document */
+	copy = malloc(sz);
+	ATF_REQUIRE(copy != NULL);
+	for (i = 0; i < sz * 8; i++) {
+		memcpy(copy, buf, sz);
+		copy[i / 8] ^= 1 << (i % 8);
+		if (plist_flat_new(&flat, copy, sz, 0) != 0) {
+			continue;
+		}
+		ATF_REQUIRE(plist_flat_root(flat, &node) == 0);
+		err = plist_flat_plist(flat, &node, &ptmp2);
+		if (err == 0) {
+			plist_free(ptmp2);
+		}
+		plist_flat_free(flat);
+	}
+	for (i = 0; i < sz; i++) {
+		ATF_REQUIRE(plist_flat_verify(buf, i) == EINVAL);
+	}
+	free(copy);
+
+	/* the same document through a file */
+	fd = mkstemp(path);
+	ATF_REQUIRE(fd >= 0);
+	ATF_REQUIRE(plist_flat_write(ptmp1, fd) == 0);
+	close(fd);
+	ATF_REQUIRE(plist_flat_open(&flat, path, 0) == 0);
+	unlink(path);
+	ATF_REQUIRE(flat->pf_sz == sz && memcmp(flat->pf_buf, buf, sz) == 0);
+	ATF_REQUIRE(plist_flat_root(flat, &root) == 0);
+	ATF_REQUIRE(plist_flat_lookup(flat, &root, "name", &node) == 0);
+	ATF_REQUIRE(plist_flat_string(flat, &node, &str, NULL) == 0);
+	ATF_REQUIRE(strcmp(str, "dev") == 0);
+	plist_flat_free(flat);
+	free(buf);
+	plist_free(ptmp1);
+
+	/* a scalar document */
+	ATF_REQUIRE(plist_integer_new(&ptmp1, -7) == 0);
+	ATF_REQUIRE(plist_flat_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == 32);
+	ATF_REQUIRE(plist_flat_new(&flat, buf, sz, 0) == 0);
+	ATF_REQUIRE(plist_flat_root(flat, &root) == 0);
+	ATF_REQUIRE(plist_flat_integer(flat, &root, &ll) == 0 && ll == -7);
+	ATF_REQUIRE(plist_flat_count(flat, &root, &count) == EINVAL);
+	plist_flat_free(flat);
+	free(buf);
+	plist_free(ptmp1);
+}
+
+
+ATF_TC(t_plist_json);
+ATF_TC_HEAD(t_plist_json, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "JSON reader and writer");
+}
+ATF_TC_BODY(t_plist_json, tc)
+{
+	int fd;
+	size_t i;
+	size_t off;
+	size_t frag;
+	void *buf;
+	char *buf2;
+	size_t sz;
+	char path[] = "t_plist.XXXXXX";
+	const char *doc;
+	const char *expect;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_t *ptmp3;
+	plist_txt_t *parse;
+	plist_json_t *json;
+	static const char *bad[] = {
+		"[null]", "{\"a\":1,\"a\":2}", "[1,]", "[01]", "[1.]", "[-]",
+		"[1e+]", "[tru]", "{\"a\" 1}", "{,}", "[1 2]", "{\"a\":}",
+		"[\"\t\"]", "[\"\\x\"]", "[\"\\ud800x\"]", "[\"\\udc00\"]",
+		"[\"\\u12g4\"]", "]", "{]", NULL
+	};
+
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	ATF_REQUIRE(plist_json_new(&json) == 0);
+
+	/* the same tree for every way of splitting the document */
+	doc = "{ \"name\" : \"dev\\t\\\"q\\\"\", \"n\": -5, \"big\": 1e2,\n"
+	      "  \"list\": [true, false, 0.25, [], {}],\n"
+	      "  \"u\": \"h\\u00e9\\ud83d\\ude00\", \"raw\": \"h\xc3\xa9\" } ";
+	expect = "{ \"name\" = \"dev\\t\\\"q\\\"\"; \"n\" = -5; "
+		 "\"big\" = 100.0; \"list\" = ( true, false, 0.25, ( ), { } ); "
+		 "\"u\" = \"h\xc3\xa9\xf0\x9f\x98\x80\"; \"raw\" = \"h\xc3\xa9\" }";
+	ATF_REQUIRE(plist_txt_parse(parse, expect, strlen(expect)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	for (frag = 1; frag <= strlen(doc); frag++) {
+		for (off = 0; off < strlen(doc); off += frag) {
+			sz = strlen(doc) - off;
+			ATF_REQUIRE(plist_json_parse(json, &doc[off],
+						     (sz < frag) ? sz : frag) == 0);
+		}
+		ATF_REQUIRE(plist_json_result(json, &ptmp2) == 0);
+		ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+		plist_free(ptmp2);
+	}
+	plist_free(ptmp1);
+
+	/* the document ends at the close and the rest is not read */
+	ATF_REQUIRE(plist_json_parse(json, "[1] [2]", 7) == 0);
+	ATF_REQUIRE(json->pj_state == PLIST_JSON_STATE_DONE);
+	ATF_REQUIRE(plist_json_result(json, &ptmp1) == 0);
+	plist_free(ptmp1);
+	ATF_REQUIRE(plist_json_parse(json, "[1", 2) == 0);
+	ATF_REQUIRE(plist_json_result(json, &ptmp1) == ENOENT);
+
+	for (i = 0; bad[i] != NULL; i++) {
+		ATF_REQUIRE(plist_json_parse(json, bad[i],
+					     strlen(bad[i])) != 0);
+		ATF_REQUIRE(plist_json_result(json, &ptmp1) == ENOENT);
+	}
+
+	/* the layout of the writer and the mapping of data and dates */
+	doc = "{ \"a\\\"b\" = ( 1, -2.5, 3.0, true ); \"d\" = <0001fe>; "
+	      "\"e\" = { }; \"f\" = ( ); \"s\" = \"x\\n\x01/\"; "
+	      "\"w\" = <*2011-11-12 18:31:01 +0000> }";
+	expect = "{\"a\\\"b\":[1,-2.5,3.0,true],\"d\":\"AAH+\",\"e\":{},"
+		 "\"f\":[],\"s\":\"x\\n\\u0001/\","
+		 "\"w\":\"2011-11-12T18:31:01Z\"}\n";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(plist_json_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == strlen(expect) && memcmp(buf, expect, sz) == 0);
+
+	/* a descriptor gets the same bytes */
+	fd = mkstemp(path);
+	ATF_REQUIRE(fd >= 0);
+	ATF_REQUIRE(plist_json_write(ptmp1, fd) == 0);
+	ATF_REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+	buf2 = malloc(sz + 1);
+	ATF_REQUIRE(buf2 != NULL);
+	ATF_REQUIRE(read(fd, buf2, sz + 1) == (ssize_t) sz);
+	ATF_REQUIRE(memcmp(buf, buf2, sz) == 0);
+	free(buf2);
+	close(fd);
+	unlink(path);
+
+	/* dates read back with the option, data stays a string */
+	plist_json_setflags(json, PLIST_JSON_DATES);
+	ATF_REQUIRE(plist_json_parse(json, buf, sz) == 0);
+	ATF_REQUIRE(plist_json_result(json, &ptmp2) == 0);
+	TAILQ_FOREACH(ptmp3, &ptmp2->p_dict.pd_keys, p_entry) {
+		if (strcmp(ptmp3->p_key.pk_name, "d") == 0) {
+			ATF_REQUIRE(ptmp3->p_key.pk_value->p_elem ==
+				    PLIST_STRING);
+		} else if (strcmp(ptmp3->p_key.pk_name, "w") == 0) {
+			ATF_REQUIRE(ptmp3->p_key.pk_value->p_elem ==
+				    PLIST_DATE);
+		}
+	}
+	free(buf);
+	doc = "{ \"a\\\"b\" = ( 1, -2.5, 3.0, true ); \"d\" = \"AAH+\"; "
+	      "\"e\" = { }; \"f\" = ( ); \"s\" = \"x\\n\x01/\"; "
+	      "\"w\" = <*2011-11-12 18:31:01 +0000> }";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp3) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp3, ptmp2) == true);
+	plist_free(ptmp3);
+	plist_free(ptmp2);
+	plist_free(ptmp1);
+
+	/* a date read with an offset is written in UTC */
+	doc = "<*2011-11-12 20:31:01 +0200>";
+	expect = "\"2011-11-12T18:31:01Z\"\n";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(plist_json_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == strlen(expect) && memcmp(buf, expect, sz) == 0);
+	free(buf);
+	plist_free(ptmp1);
+
+	/* values JSON has no spelling for */
+	ATF_REQUIRE(plist_real_new(&ptmp1, INFINITY) == 0);
+	ATF_REQUIRE(plist_json_write_buf(ptmp1, &buf, &sz) == EINVAL);
+	plist_free(ptmp1);
+
+	plist_json_free(json);
+	plist_txt_free(parse);
+}
+
+ATF_TC(t_plist_io);
+ATF_TC_HEAD(t_plist_io, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "format detection and dispatch");
+}
+ATF_TC_BODY(t_plist_io, tc)
+{
+	int fd;
+	int pfd[2];
+	int flags;
+	size_t i;
+	void *buf;
+	size_t sz;
+	char path[] = "t_plist.XXXXXX";
+	const char *doc;
+	const char *expect;
+	struct tm tm;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_txt_t *parse;
+	enum plist_format_e fmt;
+	static const struct {
+		const char *td_doc;
+		enum plist_format_e td_fmt;
+	} detect[] = {
+		{ "bplist00", PLIST_FORMAT_BINARY },
+		{ "plflat00", PLIST_FORMAT_FLAT },
+		{ "bplis", PLIST_FORMAT_UNKNOWN },
+		{ "\xef\xbb\xbf <?xml version=\"1.0\"?>", PLIST_FORMAT_XML },
+		{ "<!DOCTYPE plist>", PLIST_FORMAT_XML },
+		{ "<plist>", PLIST_FORMAT_XML },
+		{ "<?x", PLIST_FORMAT_UNKNOWN },
+		{ "<dead beef>", PLIST_FORMAT_TEXT },
+		{ "<*2011-11-12 18:31:01 +0000>", PLIST_FORMAT_TEXT },
+		{ "( 1, 2 )", PLIST_FORMAT_TEXT },
+		{ "[1, 2]", PLIST_FORMAT_JSON },
+		{ "{ \"a\" = 1; }", PLIST_FORMAT_TEXT },
+		{ "{ \"a\" : 1; }", PLIST_FORMAT_TEXT },
+		{ "{ \"a:=\" : { \"b\" : 1 }, \"c\" : 2 }", PLIST_FORMAT_JSON },
+		{ "{ \"\\u00e9\" : 1 }", PLIST_FORMAT_JSON },
+		{ "{ \"a\" : 1 }", PLIST_FORMAT_UNKNOWN },
+		{ "\"s\"", PLIST_FORMAT_UNKNOWN },
+		{ "-12 ", PLIST_FORMAT_TEXT },
+		{ "null", PLIST_FORMAT_JSON },
+		{ "", PLIST_FORMAT_UNKNOWN },
+		{ "xyz", PLIST_FORMAT_UNKNOWN },
+	};
+
+	for (i = 0; i < sizeof(detect) / sizeof(detect[0]); i++) {
+		fmt = plist_format_detect(detect[i].td_doc,
+					  strlen(detect[i].td_doc));
+		if (fmt != detect[i].td_fmt) {
+			atf_tc_fail("%s: format %d", detect[i].td_doc, fmt);
+		}
+	}
+
+	/* the layout of the text writer */
+	ATF_REQUIRE(plist_txt_new(&parse) == 0);
+	doc = "{ \"a\\\"b\" = ( 1, -2.5, 3.0, true ); \"d\" = <0001fe0203>; "
+	      "\"e\" = { }; \"f\" = ( ); \"s\" = \"x\\n\x01/\"; "
+	      "\"w\" = <*2011-11-12 18:31:01 +0000> }";
+	expect = "{\n"
+		 "\t\"a\\\"b\" = (\n\t\t1,\n\t\t-2.5,\n\t\t3.0,\n\t\ttrue\n\t);\n"
+		 "\t\"d\" = <0001fe02 03>;\n"
+		 "\t\"e\" = {};\n"
+		 "\t\"f\" = ();\n"
+		 "\t\"s\" = \"x\\n\x01/\";\n"
+		 "\t\"w\" = <*2011-11-12 18:31:01 +0000>;\n"
+		 "}\n";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+	ATF_REQUIRE(plist_write_buf(ptmp1, PLIST_FORMAT_TEXT, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == strlen(expect) && memcmp(buf, expect, sz) == 0);
+	free(buf);
+
+	/* a date keeps the offset it was read with */
+	doc = "( <*2011-11-12 20:31:01 +0200>, <*2011-11-12 18:01:01 -0030> )";
+	expect = "(\n\t<*2011-11-12 20:31:01 +0200>,\n"
+		 "\t<*2011-11-12 18:01:01 -0030>\n)\n";
+	ATF_REQUIRE(plist_txt_parse(parse, doc, strlen(doc)) == 0);
+	ATF_REQUIRE(plist_txt_result(parse, &ptmp2) == 0);
+	ATF_REQUIRE(plist_write_buf(ptmp2, PLIST_FORMAT_TEXT, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == strlen(expect) && memcmp(buf, expect, sz) == 0);
+	free(buf);
+	plist_free(ptmp2);
+
+	/* and one that +HHMM cannot spell is moved to UTC */
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = 111;
+	tm.tm_mon = 10;
+	tm.tm_mday = 12;
+	tm.tm_hour = 18;
+	tm.tm_min = 31;
+	tm.tm_sec = 1;
+	tm.tm_gmtoff = 5;
+	expect = "<*2011-11-12 18:30:56 +0000>\n";
+	ATF_REQUIRE(plist_date_new(&ptmp2, &tm) == 0);
+	ATF_REQUIRE(plist_write_buf(ptmp2, PLIST_FORMAT_TEXT, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == strlen(expect) && memcmp(buf, expect, sz) == 0);
+	free(buf);
+	plist_free(ptmp2);
+
+	/* every format through a buffer, a file, a descriptor, and a pipe */
+	for (fmt = PLIST_FORMAT_TEXT; fmt <= PLIST_FORMAT_JSON; fmt++) {
+		flags = (fmt == PLIST_FORMAT_JSON) ? PLIST_READ_DATES : 0;
+		if (fmt == PLIST_FORMAT_JSON) {
+			/* data has no JSON spelling and reads back as base64 */
+			plist_free(ptmp1);
+			doc = "{ \"a\\\"b\" = ( 1, -2.5, 3.0, true ); "
+			      "\"d\" = \"AAH+AgM=\"; \"e\" = { }; \"f\" = ( ); "
+			      "\"s\" = \"x\\n\x01/\"; "
+			      "\"w\" = <*2011-11-12 18:31:01 +0000> }";
+			ATF_REQUIRE(plist_txt_parse(parse, doc,
+						    strlen(doc)) == 0);
+			ATF_REQUIRE(plist_txt_result(parse, &ptmp1) == 0);
+		}
+
+		ATF_REQUIRE(plist_write_buf(ptmp1, fmt, &buf, &sz) == 0);
+		ATF_REQUIRE(plist_format_detect(buf, sz) == fmt);
+		ATF_REQUIRE(plist_read_buf(buf, sz, flags, &ptmp2) == 0);
+		ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+		plist_free(ptmp2);
+
+		strcpy(path, "t_plist.XXXXXX");
+		fd = mkstemp(path);
+		ATF_REQUIRE(fd >= 0);
+		close(fd);
+		ATF_REQUIRE(plist_write_file(ptmp1, fmt, path) == 0);
+		ATF_REQUIRE(plist_read_file(path, flags, &ptmp2) == 0);
+		ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+		plist_free(ptmp2);
+		ATF_REQUIRE(plist_read_file(path, flags | PLIST_READ_PARALLEL,
+					    &ptmp2) == 0);
+		ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+		plist_free(ptmp2);
+
+		/* from the current offset of a descriptor */
+		fd = open(path, O_RDWR | O_TRUNC);
+		ATF_REQUIRE(fd >= 0);
+		ATF_REQUIRE(write(fd, "xxxx", 4) == 4);
+		ATF_REQUIRE(plist_write_fd(ptmp1, fmt, fd) == 0);
+		ATF_REQUIRE(lseek(fd, 4, SEEK_SET) == 4);
+		ATF_REQUIRE(plist_read_fd(fd, flags, &ptmp2) == 0);
+		ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+		plist_free(ptmp2);
+		close(fd);
+		unlink(path);
+
+		ATF_REQUIRE(pipe(pfd) == 0);
+		ATF_REQUIRE(write(pfd[1], buf, sz) == (ssize_t) sz);
+		close(pfd[1]);
+		ATF_REQUIRE(plist_read_fd(pfd[0], flags, &ptmp2) == 0);
+		ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+		plist_free(ptmp2);
+		close(pfd[0]);
+		free(buf);
+	}
+	plist_free(ptmp1);
+
+	/* a top level number ends with the input */
+	ATF_REQUIRE(plist_read_buf("42", 2, 0, &ptmp1) == 0);
+	ATF_REQUIRE_EQ(ptmp1->p_integer.pi_int, 42);
+	ATF_REQUIRE(plist_write_buf(ptmp1, PLIST_FORMAT_UNKNOWN,
+				    &buf, &sz) == EINVAL);
+	plist_free(ptmp1);
+
+	ATF_REQUIRE(plist_read_buf("xyz", 3, 0, &ptmp1) == EINVAL);
+	ATF_REQUIRE(plist_read_buf("bplist00", 8, 0, &ptmp1) == EINVAL);
+	plist_txt_free(parse);
+}
+
+
+ATF_TC(t_plist_zio);
+ATF_TC_HEAD(t_plist_zio, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "compressed input and output");
+}
+ATF_TC_BODY(t_plist_zio, tc)
+{
+	int fd;
+	int pfd[2];
+	int i;
+	int status;
+	pid_t pid;
+	char *doc;
+	size_t off;
+	size_t docsz;
+	char *buf;
+	ssize_t sz;
+	char path[] = "t_plist.XXXXXX";
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	enum plist_compress_e comp;
+	enum plist_format_e fmt;
+	static const uint8_t gz[] = { 0x1f, 0x8b, 0x08 };
+	static const uint8_t zst[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+	ATF_REQUIRE(plist_compress_detect(gz, sizeof(gz)) ==
+		    PLIST_COMPRESS_GZIP);
+	ATF_REQUIRE(plist_compress_detect(zst, sizeof(zst)) ==
+		    PLIST_COMPRESS_ZSTD);
+	ATF_REQUIRE(plist_compress_detect(zst, 3) == PLIST_COMPRESS_NONE);
+	ATF_REQUIRE(plist_compress_detect("( 1 )", 5) == PLIST_COMPRESS_NONE);
+	ATF_REQUIRE(plist_format_detect(zst, sizeof(zst)) ==
+		    PLIST_FORMAT_UNKNOWN);
+
+	/* large enough to take several blocks through the pipe */
+	docsz = 3 * 1024 * 1024;
+	doc = malloc(docsz);
+	ATF_REQUIRE(doc != NULL);
+	off = snprintf(doc, docsz, "( ");
+	for (i = 0; off < docsz - 1024 * 1024; i++) {
+		off += snprintf(&doc[off], docsz - off,
+				"{ \"id\" = %d; \"name\" = \"host%d\"; "
+				"\"mac\" = <0011 2233 %04x> }, ", i, i, i);
+	}
+	off += snprintf(&doc[off], docsz - off, "\"end\" )");
+	ATF_REQUIRE(plist_read_buf(doc, off, 0, &ptmp1) == 0);
+	free(doc);
+
+	for (comp = PLIST_COMPRESS_GZIP; comp <= PLIST_COMPRESS_ZSTD; comp++) {
+		if (!plist_compress_available(comp)) {
+			ATF_REQUIRE(plist_write_compressed(ptmp1,
+				    PLIST_FORMAT_TEXT, comp, 0, 1) == ENOTSUP);
+			continue;
+		}
+		for (fmt = PLIST_FORMAT_TEXT; fmt <= PLIST_FORMAT_JSON; fmt++) {
+			strcpy(path, "t_plist.XXXXXX");
+			fd = mkstemp(path);
+			ATF_REQUIRE(fd >= 0);
+			close(fd);
+			ATF_REQUIRE(plist_write_compressed_file(ptmp1, fmt,
+				    comp, 1, path) == 0);
+			ATF_REQUIRE(plist_read_file(path, 0, &ptmp2) == 0);
+			ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+			plist_free(ptmp2);
+
+			/* the same stream from memory and from a pipe */
+			fd = open(path, O_RDONLY);
+			ATF_REQUIRE(fd >= 0);
+			sz = lseek(fd, 0, SEEK_END);
+			ATF_REQUIRE(sz > 0);
+			buf = malloc(sz);
+			ATF_REQUIRE(buf != NULL);
+			ATF_REQUIRE(pread(fd, buf, sz, 0) == sz);
+			close(fd);
+			unlink(path);
+			ATF_REQUIRE(plist_compress_detect(buf, sz) == comp);
+			ATF_REQUIRE(plist_read_buf(buf, sz, 0, &ptmp2) == 0);
+			ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+			plist_free(ptmp2);
+
+			ATF_REQUIRE(pipe(pfd) == 0);
+			pid = fork();
+			ATF_REQUIRE(pid >= 0);
+			if (pid == 0) {
+				close(pfd[0]);
+				_exit(write(pfd[1], buf, sz) != sz);
+			}
+			close(pfd[1]);
+			ATF_REQUIRE(plist_read_fd(pfd[0], 0, &ptmp2) == 0);
+			ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+			plist_free(ptmp2);
+			close(pfd[0]);
+			ATF_REQUIRE(waitpid(pid, &status, 0) == pid);
+			ATF_REQUIRE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+			/* a stream that stops early or is damaged */
+			ATF_REQUIRE(plist_read_buf(buf, sz / 2, 0,
+						   &ptmp2) != 0);
+			buf[sz / 2] ^= 0x55;
+			buf[sz / 2 + 1] ^= 0x55;
+			if (plist_read_buf(buf, sz, 0, &ptmp2) == 0) {
+				plist_free(ptmp2);
+				atf_tc_fail("damaged stream %d/%d", comp, fmt);
+			}
+			free(buf);
+		}
+	}
+	plist_free(ptmp1);
+}
+
+
+ATF_TC(t_plist_cbor);
+ATF_TC_HEAD(t_plist_cbor, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "CBOR encode and decode");
+}
+ATF_TC_BODY(t_plist_cbor, tc)
+{
+	int err;
+	size_t i;
+	size_t len;
+	size_t sz;
+	void *buf;
+	uint8_t *copy;
+	uint8_t out[64];
+	uint8_t deep[600];
+	const char *doc;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	plist_t *pval;
+	static const uint8_t small[] = {
+		0xa1, 0x61, 'a', 0x83, 0x0a, 0x39, 0x01, 0xf3, 0xf5
+	};
+	static const struct {
+		const char *in;
+		size_t insz;
+		enum plist_elem_e elem;
+	} vec[] = {
+		{ "\xf9\x3c\x00", 3, PLIST_REAL },
+		{ "\xc0\x74" "2013-03-21T20:04:00Z", 22, PLIST_DATE },
+		{ "\xc0\x78\x1b" "2013-03-21T22:34:00.5+02:30", 30,
+		  PLIST_DATE },
+		{ "\xc1\x1a\x51\x4b\x67\xb0", 6, PLIST_DATE },
+		{ "\xc1\xfb\x41\xd4\x52\xd9\xec\x20\x00\x00", 10, PLIST_DATE },
+		{ "\x9f\x01\x82\x02\x03\xff", 6, PLIST_ARRAY },
+		{ "\xbf\x61\x61\x01\xff", 5, PLIST_DICT },
+		{ "\xd9\xd9\xf7\x43\x01\x02\x03", 7, PLIST_DATA },
+		{ "\xd8\x20\x60", 3, PLIST_STRING },
+	};
+	static const struct {
+		const char *in;
+		size_t insz;
+		int err;
+	} bad[] = {
+		{ "\xf6", 1, EINVAL },
+		{ "\xf7", 1, EINVAL },
+		{ "\xff", 1, EINVAL },
+		{ "\x1c", 1, EINVAL },
+		{ "\x01\x01", 2, EINVAL },
+		{ "\x1a\x80\x00\x00\x00", 5, ERANGE },
+		{ "\x3a\x80\x00\x00\x00", 5, ERANGE },
+		{ "\x5f\x41\x01\xff", 4, ENOTSUP },
+		{ "\xa1\x01\x02", 3, EINVAL },
+		{ "\xc0\x64" "2013", 6, EINVAL },
+		{ "\x9b\xff\xff\xff\xff\xff\xff\xff\xff", 9, EINVAL },
+	};
+
+	/* the shortest heads and a single precision real when it is exact */
+	ATF_REQUIRE(plist_read_buf("{ \"a\" = ( 10, -500, true ); }", 29, 0,
+				   &ptmp1) == 0);
+	ATF_REQUIRE(plist_cbor_encode(ptmp1, out, sizeof(out), &len) == 0);
+	ATF_REQUIRE(len == sizeof(small) && memcmp(out, small, len) == 0);
+	plist_free(ptmp1);
+	ATF_REQUIRE(plist_real_new(&ptmp1, 1.5) == 0);
+	ATF_REQUIRE(plist_cbor_encode(ptmp1, out, sizeof(out), &len) == 0);
+	ATF_REQUIRE(len == 5 && memcmp(out, "\xfa\x3f\xc0\x00\x00", 5) == 0);
+	plist_free(ptmp1);
+	ATF_REQUIRE(plist_real_new(&ptmp1, 0.1) == 0);
+	ATF_REQUIRE(plist_cbor_encode(ptmp1, out, sizeof(out), &len) == 0);
+	ATF_REQUIRE(len == 9 && out[0] == 0xfb);
+	ATF_REQUIRE(plist_cbor_decode(out, len, &ptmp2) == 0);
+	ATF_REQUIRE(ptmp2->p_real.pr_double == 0.1);
+	plist_free(ptmp2);
+	plist_free(ptmp1);
+
+	doc = "{ \"name\" = \"dev\"; \"n\" = 5; \"neg\" = -3; "
+	      "\"max\" = 2147483647; \"min\" = -2147483648; "
+	      "\"list\" = ( true, 1.5, false, \"\", ( ) ); \"a\" = { }; "
+	      "\"d\" = <0102>; \"\" = \"\"; \"tail\" = \"last\"; "
+	      "\"when\" = <*2011-11-12 18:31:01 +0000>; \"end\" = \"x\" }";
+	ATF_REQUIRE(plist_read_buf(doc, strlen(doc), 0, &ptmp1) == 0);
+
+	/* measure, come up short, then fit exactly */
+	ATF_REQUIRE(plist_cbor_encode(ptmp1, NULL, 0, &len) == 0);
+	ATF_REQUIRE(len > 0);
+	copy = malloc(len);
+	ATF_REQUIRE(copy != NULL);
+	ATF_REQUIRE(plist_cbor_encode(ptmp1, copy, len - 1, &sz) == ENOSPC);
+	ATF_REQUIRE(sz == len);
+	ATF_REQUIRE(plist_cbor_write_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE(sz == len);
+	ATF_REQUIRE(plist_cbor_encode(ptmp1, copy, len, &sz) == 0);
+	ATF_REQUIRE(sz == len && memcmp(buf, copy, len) == 0);
+
+	/* copied, then borrowed which rewrites the buffer */
+	ATF_REQUIRE(plist_cbor_decode(buf, len, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	ATF_REQUIRE(plist_cbor_encode(ptmp2, out, 0, &sz) == ENOSPC);
+	plist_free(ptmp2);
+	ATF_REQUIRE(plist_cbor_decode_borrowed(copy, len, &ptmp2) == 0);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	pval = TAILQ_FIRST(&ptmp2->p_dict.pd_keys);
+	ATF_REQUIRE(strcmp(pval->p_key.pk_name, "name") == 0);
+	ATF_REQUIRE((uint8_t *) pval->p_key.pk_name > copy &&
+		    (uint8_t *) pval->p_key.pk_name < copy + len);
+	pval = pval->p_key.pk_value;
+	ATF_REQUIRE(strcmp(pval->p_string.ps_str, "dev") == 0);
+	ATF_REQUIRE((uint8_t *) pval->p_string.ps_str > copy &&
+		    (uint8_t *) pval->p_string.ps_str < copy + len);
+	ATF_REQUIRE(plist_detach_storage(&ptmp2) == 0);
+	memset(copy, 0xee, len);
+	free(copy);
+	ATF_REQUIRE(plist_isequal(ptmp1, ptmp2) == true);
+	plist_free(ptmp2);
+
+	/* every truncation fails cleanly */
+	for (i = 0; i < len; i++) {
+		copy = malloc(i + 1);
+		ATF_REQUIRE(copy != NULL);
+		memcpy(copy, buf, i);
+		if (plist_cbor_decode(copy, i, &ptmp2) == 0 ||
+		    plist_cbor_decode_borrowed(copy, i, &ptmp2) == 0) {
+			atf_tc_fail("truncated at %zu", i);
+		}
+		free(copy);
+	}
+	free(buf);
+	plist_free(ptmp1);
+
+	/* a date read with an offset is written as the same instant */
+	doc = "<*2013-03-21 22:34:00 +0230>";
+	ATF_REQUIRE(plist_read_buf(doc, strlen(doc), 0, &ptmp1) == 0);
+	ATF_REQUIRE(plist_cbor_encode(ptmp1, out, sizeof(out), &len) == 0);
+	ATF_REQUIRE(plist_cbor_decode(out, len, &ptmp2) == 0);
+	ATF_REQUIRE(ptmp2->p_date.pd_tm.tm_hour == 20 &&
+		    ptmp2->p_date.pd_tm.tm_min == 4);
+	plist_free(ptmp2);
+	plist_free(ptmp1);
+
+	for (i = 0; i < sizeof(vec) / sizeof(vec[0]); i++) {
+		err = plist_cbor_decode(vec[i].in, vec[i].insz, &ptmp1);
+		if (err != 0 || ptmp1->p_elem != vec[i].elem) {
+			atf_tc_fail("vector %zu: %d", i, err);
+		}
+		if (ptmp1->p_elem == PLIST_DATE) {
+			ATF_REQUIRE(ptmp1->p_date.pd_tm.tm_year == 113 &&
+				    ptmp1->p_date.pd_tm.tm_hour == 20 &&
+				    ptmp1->p_date.pd_tm.tm_min == 4 &&
+				    ptmp1->p_date.pd_tm.tm_sec == 0);
+		}
+		plist_free(ptmp1);
+	}
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		err = plist_cbor_decode(bad[i].in, bad[i].insz, &ptmp1);
+		if (err != bad[i].err) {
+			atf_tc_fail("bad vector %zu: %d", i, err);
+		}
+	}
+
+	/* arrays nested past the limit */
+	memset(deep, 0x81, sizeof(deep));
+	deep[sizeof(deep) - 1] = 0x01;
+	ATF_REQUIRE(plist_cbor_decode(deep, sizeof(deep), &ptmp1) == E2BIG);
+	ATF_REQUIRE(plist_cbor_decode(&deep[sizeof(deep) - 100], 100,
+				      &ptmp1) == 0);
+	plist_free(ptmp1);
+}
+
+
+/* collects a dump through the callback, failing once it has a limit */
+struct t_dump_s {
+	char *td_buf;
+	size_t td_len;
+	size_t td_max;
+	int td_calls;
+};
+
+static int
+t_dump_collect(void *arg, const void *buf, size_t len)
+{
+	struct t_dump_s *td = arg;
+
+	td->td_calls++;
+	if (td->td_len + len > td->td_max) {
+		return ENOSPC;
+	}
+	memcpy(&td->td_buf[td->td_len], buf, len);
+	td->td_len += len;
+	return 0;
+}
+
+ATF_TC(t_plist_dump);
+ATF_TC_HEAD(t_plist_dump, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "dump to a stream, memory and callback");
+}
+ATF_TC_BODY(t_plist_dump, tc)
+{
+	size_t i;
+	size_t j;
+	size_t n;
+	size_t cnt;
+	size_t sz;
+	size_t fsz;
+	void *buf;
+	char *fbuf;
+	char *line;
+	FILE *fp;
+	uint8_t *data;
+	plist_t *ptmp1;
+	plist_t *ptmp2;
+	struct t_dump_s td;
+	const char *doc = "{ \"a\" = ( 1, \"s\", true, ( ) ); "
+	    "\"d\" = <41420aff 43444546 4748494a 4b4c4d4e 4f505152>; "
+	    "\"r\" = 1.5; }";
+	const char *expect =
+	    "dict\n"
+	    "        key=a\n"
+	    "        array\n"
+	    "                integer=1\n"
+	    "                string=s\n"
+	    "                boolean=true\n"
+	    "                array\n"
+	    "        key=d\n"
+	    "        data\n"
+	    "0:\t41 42 0a ff 43 44 45 46 47 48 49 4a 4b 4c 4d 4e    "
+	    "AB..CDEFGHIJKLMN\n"
+	    "16:\t4f 50 51 52                                "
+	    "        OPQR\n"
+	    "        key=r\n"
+	    "        real=1.500000\n";
+
+	ATF_REQUIRE(plist_read_buf(doc, strlen(doc), 0, &ptmp1) == 0);
+	ATF_REQUIRE(plist_dump_buf(ptmp1, &buf, &sz) == 0);
+	ATF_REQUIRE_STREQ((char *) buf, expect);
+	ATF_REQUIRE(sz == strlen(expect));
+	free(buf);
+
+	fp = open_memstream(&fbuf, &fsz);
+	ATF_REQUIRE(fp != NULL);
+	plist_dump(ptmp1, fp);
+	ATF_REQUIRE(fclose(fp) == 0);
+	ATF_REQUIRE_STREQ(fbuf, expect);
+	free(fbuf);
+
+	/* a failure from the function stops the dump */
+	memset(&td, 0, sizeof(td));
+	ATF_REQUIRE(plist_dump_cb(ptmp1, t_dump_collect, &td) == ENOSPC);
+	ATF_REQUIRE(td.td_calls == 1);
+	ATF_REQUIRE(plist_dump_cb(NULL, t_dump_collect, &td) == EINVAL);
+	ATF_REQUIRE(plist_dump_cb(ptmp1, NULL, &td) == EINVAL);
+
+	/* data over many flushes of the buffer */
+	sz = 1024 * 1024 + 7;
+	data = malloc(sz);
+	ATF_REQUIRE(data != NULL);
+	for (i = 0; i < sz; i++) {
+		data[i] = i * 131 + (i >> 8);
+	}
+	ATF_REQUIRE(plist_data_new(&ptmp2, data, sz) == 0);
+	ATF_REQUIRE(plist_dict_set(ptmp1, "z", ptmp2) == 0);
+	ATF_REQUIRE(plist_dump_buf(ptmp1, &buf, &fsz) == 0);
+	ATF_REQUIRE(strncmp(buf, expect, strlen(expect)) == 0);
+
+	memset(&td, 0, sizeof(td));
+	td.td_max = fsz;
+	td.td_buf = malloc(fsz);
+	ATF_REQUIRE(td.td_buf != NULL);
+	ATF_REQUIRE(plist_dump_cb(ptmp1, t_dump_collect, &td) == 0);
+	ATF_REQUIRE(td.td_calls > 1);
+	ATF_REQUIRE(td.td_len == fsz && memcmp(td.td_buf, buf, fsz) == 0);
+	free(td.td_buf);
+
+	/* every line of the data against the same line from printf */
+	line = strstr((char *) buf + strlen(expect), "data\n");
+	ATF_REQUIRE(line != NULL);
+	line += strlen("data\n");
+	fbuf = malloc(128);
+	ATF_REQUIRE(fbuf != NULL);
+	for (i = 0; i < sz; i += 16) {
+		cnt = (sz - i < 16) ? sz - i : 16;
+		n = snprintf(fbuf, 128, "%zu:\t", i);
+		for (j = 0; j < cnt; j++) {
+			n += snprintf(&fbuf[n], 128 - n, "%02x ", data[i + j]);
+		}
+		n += snprintf(&fbuf[n], 128 - n, "%*s",
+			      (int) (1 + 16 - cnt) * 3, "");
+		for (j = 0; j < cnt; j++) {
+			fbuf[n++] = isprint(data[i + j]) ? data[i + j] : '.';
+		}
+		fbuf[n++] = '\n';
+		if (memcmp(line, fbuf, n) != 0) {
+			atf_tc_fail("data line at %zu", i);
+		}
+		line += n;
+	}
+	ATF_REQUIRE(line == (char *) buf + fsz);
+	free(fbuf);
+	free(buf);
+	free(data);
+	plist_free(ptmp1);
+
+	/* a real longer than a line is written whole */
+	ATF_REQUIRE(plist_real_new(&ptmp1, 1.0e300) == 0);
+	ATF_REQUIRE(plist_dump_buf(ptmp1, &buf, &sz) == 0);
+	fbuf = malloc(sz + 1);
+	ATF_REQUIRE(fbuf != NULL);
+	ATF_REQUIRE(sz > 300 &&
+		    (size_t) snprintf(fbuf, sz + 1, "real=%f\n", 1.0e300) == sz);
+	ATF_REQUIRE_STREQ((char *) buf, fbuf);
+	free(fbuf);
+	free(buf);
+	plist_free(ptmp1);
+}
+
+
 ATF_TP_ADD_TCS(tp)
 {
 	ATF_TP_ADD_TC(tp, t_plist_new);
 	ATF_TP_ADD_TC(tp, t_plist_dict);
 	ATF_TP_ADD_TC(tp, t_plist_array);
 	ATF_TP_ADD_TC(tp, t_plist_txt);
+	ATF_TP_ADD_TC(tp, t_plist_txt_buf);
+	ATF_TP_ADD_TC(tp, t_plist_txt_dupkey);
+	ATF_TP_ADD_TC(tp, t_plist_txt_sax);
+	ATF_TP_ADD_TC(tp, t_plist_txt_token);
+	ATF_TP_ADD_TC(tp, t_plist_idx);
+	ATF_TP_ADD_TC(tp, t_plist_txt_parallel);
+	ATF_TP_ADD_TC(tp, t_plist_txt_file);
+	ATF_TP_ADD_TC(tp, t_plist_txt_borrow);
+	ATF_TP_ADD_TC(tp, t_plist_txt_stream);
+	ATF_TP_ADD_TC(tp, t_plist_txt_pool);
+	ATF_TP_ADD_TC(tp, t_plist_txt_dispatch);
+	ATF_TP_ADD_TC(tp, t_plist_txt_paths);
+	ATF_TP_ADD_TC(tp, t_plist_bind);
+	ATF_TP_ADD_TC(tp, t_plist_gen);
+	ATF_TP_ADD_TC(tp, t_plist_bpl);
+	ATF_TP_ADD_TC(tp, t_plist_bpl_write);
+	ATF_TP_ADD_TC(tp, t_plist_xml);
+	ATF_TP_ADD_TC(tp, t_plist_xml_write);
+	ATF_TP_ADD_TC(tp, t_plist_flat);
+	ATF_TP_ADD_TC(tp, t_plist_json);
+	ATF_TP_ADD_TC(tp, t_plist_io);
+	ATF_TP_ADD_TC(tp, t_plist_zio);
+	ATF_TP_ADD_TC(tp, t_plist_cbor);
+	ATF_TP_ADD_TC(tp, t_plist_dump);
 	return atf_no_error();
 }
@@ -0,0 +1,116 @@
+/*
+ *
+ * Copyright (c) 2011  Charles Hardin <ckhardin@gmail.com>
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file plist_codegen.c
+ *
+ * Build time tool that compiles a decoder schema into C. It reads the
+ * schema document and writes the output name with .h and .c appended,
+ * see plist_gen.h for the schema.
+ *
+ *   plist-codegen schema.plist tlm
+ *
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "plist.h"
+#include "plist_txt.h"
+#include "plist_gen.h"
+
+
+int
+main(int argc, char **argv)
+{
+	int err;
+	char *hpath;
+	char *cpath;
+	const char *header;
+	FILE *hfp;
+	FILE *cfp;
+	plist_t *schema;
+	plist_txt_t *txt;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s schema output\n", argv[0]);
+		return 1;
+	}
+
+	err = plist_txt_new(&txt);
+	if (err == 0) {
+		err = plist_txt_parse_file(txt, argv[1]);
+		if (err == 0) {
+			err = plist_txt_result(txt, &schema);
+		}
+		plist_txt_free(txt);
+	}
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(err));
+		return 1;
+	}
+
+	hpath = malloc(strlen(argv[2]) + sizeof(".h"));
+	cpath = malloc(strlen(argv[2]) + sizeof(".c"));
+	if (hpath == NULL || cpath == NULL) {
+		fprintf(stderr, "%s\n", strerror(ENOMEM));
+		return 1;
+	}
+	sprintf(hpath, "%s.h", argv[2]);
+	sprintf(cpath, "%s.c", argv[2]);
+
+	/* the source includes the header from its own directory */
+	header = strrchr(hpath, '/');
+	header = (header != NULL) ? &header[1] : hpath;
+
+	hfp = fopen(hpath, "w");
+	cfp = fopen(cpath, "w");
+	if (hfp == NULL || cfp == NULL) {
+		err = errno;
+	} else {
+		err = plist_gen_compile(schema, header, hfp, cfp);
+	}
+	if (hfp != NULL && fclose(hfp) != 0 && err == 0) {
+		err = errno;
+	}
+	if (cfp != NULL && fclose(cfp) != 0 && err == 0) {
+		err = errno;
+	}
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(err));
+		unlink(hpath);
+		unlink(cpath);
+	}
+
+	plist_free(schema);
+	free(hpath);
+	free(cpath);
+	return (err == 0) ? 0 : 1;
+}